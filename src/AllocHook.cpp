@@ -0,0 +1,30 @@
+//
+// Created by Alex on 2022/6/5.
+//
+
+#include <new>
+#include <cstdlib>
+#include "PassTimer.h"
+
+// The global operator new counting the allocations for the PassTimer while AllocStats::enabled is set.
+// It replaces the one of the program, so it is linked into the driver and the tests, never the library.
+// The frees are not tracked.
+void *operator new(size_t size) {
+    if (AllocStats::enabled) {
+        auto &Stats = getThreadAllocStats();
+        Stats.count++;
+        Stats.bytes += size;
+    }
+    if (void *Ptr = std::malloc(size ? size : 1)) {
+        return Ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
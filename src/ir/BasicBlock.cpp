@@ -4,6 +4,7 @@
 
 #include "BasicBlock.h"
 #include "Function.h"
+#include "DomTreeUpdater.h"
 
 BasicBlock *BasicBlock::Create(Function *parent, StrView name) {
     ASSERT(parent);
@@ -30,10 +31,14 @@ BasicBlock::BasicBlock(Function *parent, StrView name)
     }
 }
 
-BasicBlock *BasicBlock::split(Instruction *i, std::string newName) {
+BasicBlock *BasicBlock::split(Instruction *i, std::string newName, DomTreeUpdater *updater) {
     if (newName.empty()) {
         newName = getName() + ".split";
     }
+    std::vector<BasicBlock *> Preds;
+    if (updater) {
+        Preds.assign(preds_begin(), preds_end());
+    }
     BasicBlock *NewBB = new BasicBlock(newName);
     insertBeforeThis(NewBB);
     iterator First = begin();
@@ -43,7 +48,24 @@ BasicBlock *BasicBlock::split(Instruction *i, std::string newName) {
         NewBB->append(Inst);
     }
     replaceAllUsesWith(NewBB);
+    // the edges out of the block still leave from the lower half
+    for (auto *Succ: succs()) {
+        for (auto &Phi: Succ->phis()) {
+            for (unsigned I = 0; I < Phi.getOperandNum(); ++I) {
+                if (Phi.getIncomingBlock(I) == NewBB) {
+                    Phi.setIncomingBlock(I, this);
+                }
+            }
+        }
+    }
     NewBB->append(new BranchInst(this));
+    if (updater) {
+        for (auto *Pred: Preds) {
+            updater->deleteEdge(Pred, this);
+            updater->insertEdge(Pred, NewBB);
+        }
+        updater->insertEdge(NewBB, this);
+    }
     return NewBB;
 
     /*if (newName.empty()) {
@@ -6,12 +6,15 @@
 #define DRAGONIR_BASICBLOCK_H
 
 #include <set>
+#include <vector>
 #include <Node.h>
 #include <Instruction.h>
 class Function;
+class DomTreeUpdater;
 
 class BasicBlock : public Value, public NodeWithParent<BasicBlock, Function>, public NodeParent<BasicBlock, Instruction> {
     friend class Dominance;
+    friend class DomTreeUpdater;
 public:
     static BasicBlock *Create(Function *parent, StrView name);
     template<typename BBTy, typename UseIt>
@@ -147,6 +150,10 @@ public:
     SymbolTable *getSymbolTable() const;
     Context *getContext() const;
 
+    ///< The order of the blocks in the function, and of the instructions in this block.
+    using NodeWithParent::comesBefore;
+    using NodeParent::comesBefore;
+
     void replace(Instruction *node, Instruction *by) {
         ASSERT(node->getOpcode() != OpcodePhi && by->getOpcode() != OpcodePhi);
         removeInstr(node);
@@ -191,7 +198,9 @@ public:
         addInstr(before);
     }
 
-    BasicBlock *split(Instruction *i, std::string newName = "");
+    ///< Move the instructions before i into a new block, which takes the predecessors and branches to this.
+    ///< The dominator tree is kept up to date if an updater is given.
+    BasicBlock *split(Instruction *i, std::string newName = "", DomTreeUpdater *updater = nullptr);
 
     bool hasOnlyTerminator() {
         return getTerminator() && --iterator(getTerminator()) == list.end();
@@ -214,11 +223,16 @@ public:
     inline auto &getDomChildren() {
         return domChildren;
     }
+    ///< Dense number of the block in the function order, assigned by Dominance.
+    inline unsigned getNumber() const {
+        return number;
+    }
 
     inline void addPhi(Instruction *phi) {
         ASSERT(phi->getOpcode() == OpcodePhi);
         phi->setParent(this);
         lastPhi = list.insert_after(lastPhi, phi);
+        noteInserted(phi);
     }
 
     inline bool hasPhi() const {
@@ -302,16 +316,29 @@ public:
         return succ_iterator(this);
     }
 
-    // DFS visit the dominator tree and compute the dominator tree level
+    // Visit the dominator tree and compute the dominator tree level
     void calculateLevel(unsigned init = 0) {
-        this->level = init++;
-        for (auto &Child: domChildren) {
-            Child->calculateLevel(init);
+        this->level = init;
+        std::vector<BasicBlock *> Worklist = {this};
+        while (!Worklist.empty()) {
+            auto *BB = Worklist.back();
+            Worklist.pop_back();
+            for (auto *Child: BB->domChildren) {
+                Child->level = BB->level + 1;
+                Worklist.push_back(Child);
+            }
         }
     }
     inline unsigned getLevel() const {
         return level;
     }
+    ///< The interval of the block in the DFS of the dominator tree, 0 if it is not numbered.
+    inline unsigned getDFSIn() const {
+        return dfsIn;
+    }
+    inline unsigned getDFSOut() const {
+        return dfsOut;
+    }
     bool dominates(BasicBlock *rhs) const {
         if (rhs == nullptr /*|| getLevel() >= rhs->getLevel()*/) {
             return false;
@@ -319,6 +346,10 @@ public:
         if (this == rhs || this == rhs->dominator) {
             return true;
         }
+        if (dfsIn && rhs->dfsIn) {
+            // the subtree of this contains rhs
+            return dfsIn <= rhs->dfsIn && rhs->dfsOut <= dfsOut;
+        }
         if (dominator == rhs) {
             return false;
         }
@@ -399,19 +430,26 @@ private:
         dominator = dom;
     }
     inline void addDomFrontier(BasicBlock *bb) {
-        domFrontier.insert(bb);
+        // the frontiers are added block by block, so a duplicate is always the last one
+        if (domFrontier.empty() || domFrontier.back() != bb) {
+            domFrontier.push_back(bb);
+        }
     }
     inline void clearDomInfo() {
         dominator = nullptr;
+        dfsIn = dfsOut = 0;
         domFrontier.clear();
         domChildren.clear();
     }
 private:
     std::string name;
     unsigned level = 0;
-    std::set<BasicBlock *> domFrontier; ///< the dominance frontier of this label
-    std::set<BasicBlock *> domChildren; ///< children of the dominator
+    unsigned number = ~0u; ///< dense number in the function, ~0u before it is numbered
+    std::vector<BasicBlock *> domFrontier; ///< the dominance frontier of this label, sorted by number
+    std::vector<BasicBlock *> domChildren; ///< children of the dominator, sorted by number
     BasicBlock *dominator = nullptr; ///< immediate dominator
+    unsigned dfsIn = 0; ///< preorder number in the dominator tree, starts from 1
+    unsigned dfsOut = 0; ///< the largest preorder number in the subtree
     Instruction *terminator = nullptr; ///< the terminator instruction
     iterator lastPhi = list.end(); ///< last phi instruction
 
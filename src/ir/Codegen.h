@@ -10,6 +10,7 @@
 #include "Context.h"
 #include "Function.h"
 #include "IRBuilder.h"
+#include "SSABuilder.h"
 #include "parser.h"
 
 class Diagnostic {
@@ -77,6 +78,9 @@ public:
 
 /**
  * The code generator for SysY.
+ * The variables are allocas that SSAConstructor promotes later, or with buildSSA they are
+ * kept in SSA form while the code is generated, so no alloca, load or store is emitted.
+ * A block is sealed as soon as the statement creating it has emitted all its predecessors.
  * @Author Alex
  */
 class Codegen : public Visitor<Codegen, Value *> {
@@ -97,8 +101,11 @@ class Codegen : public Visitor<Codegen, Value *> {
     std::unordered_map<std::string, Function *> funcs;
     ///< The diagnostics data.
     Diagnostic diags;
+    ///< Build the SSA form on the fly instead of the allocas.
+    bool buildSSA;
+    SSABuilder ssa;
 public:
-    Codegen(Context &context) : context(context) {
+    Codegen(Context &context, bool buildSSA = false) : context(context), buildSSA(buildSSA) {
         table.addType("void", context.getVoidTy());
         table.addType("int", context.getInt32Ty());
         table.addType("float", context.getFloatTy());
@@ -148,6 +155,7 @@ public:
         // generate entry block
         auto *BB = BasicBlock::Create(curFunc, "entry");
         builder.setInsertPoint(BB);
+        seal(BB);
         // codegen params
         visit(value.getParams());
         // codegen body
@@ -159,6 +167,9 @@ public:
                 builder.createRet();
             }
         }
+        if (buildSSA) {
+            ssa.finish();
+        }
         return nullptr;
     }
 
@@ -166,6 +177,12 @@ public:
         ASSERT(curFunc);
         auto *Param = curFunc->addParam(value.getName(), table.getType(value.getType()));
         //table.addVar(value.getName(), Param);
+        if (buildSSA) {
+            auto *Var = ssa.createVariable(value.getName(), Param->getType());
+            ssa.writeVariable(Var, builder.getInsertBlock(), Param);
+            table.addVar(value.getName(), Var);
+            return Var;
+        }
         auto *Alloca = builder.createAlloca(Param->getType(), value.getName());
         builder.createStore(Alloca, Param);
         table.addVar(value.getName(), Alloca);
@@ -190,6 +207,14 @@ public:
             return nullptr;
         }
         // TODO: bounds?
+        if (buildSSA) {
+            auto *Var = ssa.createVariable(value.getName(), curDefType);
+            table.addVar(value.getName(), Var);
+            if (auto *Val = visit(value.getValue())) {
+                ssa.writeVariable(Var, builder.getInsertBlock(), Val);
+            }
+            return Var;
+        }
         auto *Alloca = builder.createAlloca(curDefType, value.getName());
         table.addVar(value.getName(), Alloca);
         auto *Val = visit(value.getValue());
@@ -257,6 +282,10 @@ public:
     Value *visitAssignStmt(AssignStmt value) override {
         if (auto *LHS = visit(value.getLval())){
             auto *RHS = visit(value.getValue());
+            if (auto *Var = LHS->as<Variable>()) {
+                ssa.writeVariable(Var, builder.getInsertBlock(), RHS);
+                return RHS;
+            }
             builder.createStore(LHS, RHS);
             return RHS;
         }
@@ -278,6 +307,9 @@ public:
             diags.addError("undefined variable: " + value.getName(), value);
             return nullptr;
         }
+        if (auto *Var = Alloca->as<Variable>()) {
+            return ssa.readVariable(Var, builder.getInsertBlock());
+        }
         if (auto *P = Alloca->as<Param>()) {
             ASSERT(false && "parameter cannot be used as a value");
             return P;
@@ -311,12 +343,15 @@ public:
         builder.setInsertPoint(Cond);
         auto *CondVal = visit(value.getCond());
         builder.createCondBr(CondVal, Body, Leave);
+        seal(Body);
+        seal(Leave);
 
         builder.setInsertPoint(Body);
         visit(value.getBody());
         if (!builder.getInsertBlock()->getTerminator()) {
             builder.createBr(Cond);
         }
+        seal(Cond);
 
         builder.setInsertPoint(Leave);
         return nullptr;
@@ -333,10 +368,13 @@ public:
         if (!builder.getInsertBlock()->getTerminator()) {
             builder.createBr(Cond);
         }
+        seal(Cond);
 
         builder.setInsertPoint(Cond);
         auto *CondVal = visit(value.getCond());
         builder.createCondBr(CondVal, Body, Leave);
+        seal(Body);
+        seal(Leave);
 
         builder.setInsertPoint(Leave);
         return nullptr;
@@ -348,9 +386,12 @@ public:
         auto *Else = BasicBlock::Create(curFunc, "if.else");
         auto *Leave = BasicBlock::Create(curFunc, "if.leave");
         builder.createBr(Cond);
+        seal(Cond);
         builder.setInsertPoint(Cond);
         auto *CondVal = visit(value.getCond());
         builder.createCondBr(CondVal, Then, Else);
+        seal(Then);
+        seal(Else);
 
         builder.setInsertPoint(Then);
         visit(value.getThen());
@@ -363,6 +404,7 @@ public:
         if (!builder.getInsertBlock()->getTerminator()) {
             builder.createBr(Leave);
         }
+        seal(Leave);
 
         builder.setInsertPoint(Leave);
         return nullptr;
@@ -373,12 +415,14 @@ public:
         auto *Leave = BasicBlock::Create(curFunc, "if.leave");
         auto *CondVal = visit(value.getCond());
         builder.createCondBr(CondVal, Then, Leave);
+        seal(Then);
 
         builder.setInsertPoint(Then);
         visit(value.getThen());
         if (!builder.getInsertBlock()->getTerminator()) {
             builder.createBr(Leave);
         }
+        seal(Leave);
 
         builder.setInsertPoint(Leave);
         return nullptr;
@@ -414,6 +458,14 @@ public:
         return Call;
     }
 
+private:
+    ///< All the predecessors of the block are emitted.
+    inline void seal(BasicBlock *bb) {
+        if (buildSSA) {
+            ssa.sealBlock(bb);
+        }
+    }
+
 };
 
 
@@ -13,6 +13,10 @@
  */
 class Undef : public Value {
 public:
+    Undef() {
+        shared = true;
+    }
+
     void dumpAsOperand(std::ostream &os) override {
         os << "undef";
     }
@@ -47,7 +51,9 @@ class Global : public Value {
     std::string name;
     Type *type;
 public:
-    Global(const std::string &name, Type *type) : name(name), type(type) {}
+    Global(const std::string &name, Type *type) : name(name), type(type) {
+        shared = true;
+    }
 
     const std::string &getName() const {
         return name;
@@ -70,7 +76,9 @@ class Constant : public Value {
 protected:
     Type *type;
 public:
-    Constant(Type *type) : type(type) {}
+    Constant(Type *type) : type(type) {
+        shared = true;
+    }
 
     Type *getType() override {
         return type;
@@ -39,6 +39,10 @@ public:
         return type;
     }
 
+    ///< The order of the functions in the module, and of the blocks in this function.
+    using NodeWithParent::comesBefore;
+    using NodeParent::comesBefore;
+
     inline Module *getModule() const {
         return module;
     }
@@ -75,7 +79,7 @@ public:
 
     BasicBlock *createBasicBlock(const std::string &bbName) {
         BasicBlock *BB = new BasicBlock(bbName);
-        list.push_back(BB);
+        append(BB);
         return BB;
     }
 
@@ -144,6 +148,20 @@ public:
         callees.insert(caller);
         caller->callers.insert(this);
     }
+    void clearCallees() {
+        for (auto *Callee: callees) {
+            Callee->callers.erase(this);
+        }
+        callees.clear();
+    }
+
+    ///< the function only reads and writes its own allocas and only calls pure functions, see FunctionAttrs
+    inline bool isPure() const {
+        return pure;
+    }
+    inline void setPure(bool value) {
+        pure = value;
+    }
 
     ///< dump the function
     void dump(std::ostream &os) override {
@@ -227,6 +245,7 @@ private:
     ///< CallGraph
     std::set<Function *> callers;
     std::set<Function *> callees;
+    bool pure = false;
 public:
     ///< target info
     TargetInfo *target;
@@ -5,10 +5,11 @@
 #ifndef DRAGON_IDFCALCULATOR_H
 #define DRAGON_IDFCALCULATOR_H
 #include <functional>
-#include <queue>
+#include <algorithm>
 #include <vector>
 #include "PassManager.h"
 #include "Function.h"
+#include "BitVector.h"
 template<typename T>
 inline auto pop_back_val(T &c) {
     auto V = c.back();
@@ -28,128 +29,120 @@ inline void SubTreeIterate(BasicBlock *bb, std::function<void(BasicBlock *)> ite
     }
 }
 
-struct BasicBlockCompare {
-    bool operator()(const BasicBlock *l, const BasicBlock *r) const {
-        return l->getLevel() >= r->getLevel();
-    }
-};
-
 /**
  * The iterated dominance frontier calculator.
+ * "A Linear Time Algorithm for Placing phi-Nodes" Vugranam C. Sreedhar, Guang R. Gao.
+ * The nodes are taken from the deepest level of the dominator tree, the subtree of a node
+ * is walked down and the J-edges that don't go below the level of the node reach the IDF.
+ * The pending nodes are kept in buckets by the level and the sets are BitVectors indexed by
+ * the block number, so one calculator is reused for all the variables without allocating again.
+ * Only the blocks reachable in the dominator tree are considered.
  */
 class IDFCalculator {
+    std::vector<std::vector<BasicBlock *>> buckets; ///< level -> the pending nodes
+    unsigned deepest = 0; ///< no pending node is deeper
+    BitVector defining; ///< the blocks of the definitions
+    BitVector walked;
+    BitVector found; ///< in the IDF
+    std::vector<BasicBlock *> worklist;
+    std::vector<BasicBlock *> walkedBlocks;
 public:
-    std::set<BasicBlock *> visited;
-    std::map<unsigned, std::priority_queue<BasicBlock *, std::vector<BasicBlock *>, BasicBlockCompare>> DAT;
-    std::set<BasicBlock *> S;
-    BasicBlock *currentNode = nullptr;
-    std::set<BasicBlock *> IDF;
-
-    void calulate(const std::vector<BasicBlock *> &blocks) {
-        DAT.clear();
-        S.clear();
-        visited.clear();
-        IDF.clear();
-
-        for (auto &BB: blocks) {
-            DAT[BB->getLevel()].push(BB);
-            S.insert(BB);
+    ///< numBlocks is the upper bound of the block numbers.
+    void reserve(unsigned numBlocks) {
+        if (defining.size() >= numBlocks) {
+            return;
         }
-
-        while (currentNode = getDeepestNode()) {
-            visited.insert(currentNode);
-            visit(currentNode);
-        }
-    }
-
-    void insertNode(BasicBlock *bb) {
-        DAT[bb->getLevel()].push(bb);
-    }
-
-    BasicBlock *getDeepestNode() {
-        for (auto Iter = DAT.rbegin(); Iter != DAT.rend(); ++Iter) {
-            if (!Iter->second.empty()) {
-                auto *BB = Iter->second.top();
-                Iter->second.pop();
-                return BB;
-            }
+        for (auto *Set: {&defining, &walked, &found}) {
+            Set->resize(numBlocks);
+            Set->fill(false);
         }
-        return nullptr;
     }
 
-    void visit(BasicBlock *bb) {
-        for (auto *Succ: bb->succs()) {
-            if (bb->getDomChildren().count(Succ)) {
-                continue;
-            }
-            if (Succ->hasMultiplePredecessor() && Succ->getLevel() <= currentNode->getLevel()) {
-                if (!IDF.count(Succ)) {
-                    IDF.insert(Succ);
-                    if (!S.count(Succ)) {
-                        insertNode(Succ);
-                    }
-                }
-            }
-        }
-        for (auto &DEdge : bb->getDomChildren()) {
-            if (!visited.count(DEdge)) {
-                visited.insert(DEdge);
-                visit(DEdge);
+    ///< The IDF of the blocks in the order they are found.
+    void calculate(const std::vector<BasicBlock *> &blocks, std::vector<BasicBlock *> &idf) {
+        idf.clear();
+        for (auto *BB: blocks) {
+            ASSERT(BB->getNumber() < defining.size());
+            if (isReachable(BB) && !defining.get(BB->getNumber())) {
+                defining.set(BB->getNumber());
+                push(BB);
             }
         }
-    }
-
-    std::set<BasicBlock *> calc(const std::set<BasicBlock *> &blocks) {
-        std::priority_queue<BasicBlock *, std::vector<BasicBlock *>, BasicBlockCompare> Queue;
-        std::vector<BasicBlock *> Worklist;
-        std::set<BasicBlock *> Visited;
-        std::set<BasicBlock *> IDFSet;
-        for (auto &BB: blocks) {
-            Queue.push(BB);
-            Visited.insert(BB);
-        }
-
-        while (!Queue.empty()) {
-            auto *Working = Queue.top();
-            Queue.pop();
-
-            Visited.insert(Working);
-            Worklist.push_back(Working);
-
-            while (!Worklist.empty()) {
-                auto *BB = Worklist.back();
-                Worklist.pop_back();
 
+        while (auto *Root = pop()) {
+            unsigned RootLevel = Root->getLevel();
+            worklist.push_back(Root);
+            markWalked(Root);
+            while (!worklist.empty()) {
+                auto *BB = pop_back_val(worklist);
                 for (auto *Succ: BB->succs()) {
-                    if (Working->getDomChildren().count(Succ)) {
-                        // make sure working -> succ is not d edge
-                        continue;
-                    }
-
-                    if (Succ->getLevel() > Working->getLevel()) {
+                    // the D-edges always go below the root
+                    if (!Succ || !isReachable(Succ) || Succ->getLevel() > RootLevel) {
                         continue;
                     }
-
-                    if (!IDFSet.insert(Succ).second) {
+                    if (found.get(Succ->getNumber())) {
                         continue;
                     }
-
-                    if (!blocks.count(Succ)) {
-                        Queue.push(Succ);
+                    found.set(Succ->getNumber());
+                    idf.push_back(Succ);
+                    if (!defining.get(Succ->getNumber())) {
+                        push(Succ);
                     }
                 }
-
-                // 沿着d边继续行进
-                for (auto *DEdge: BB->getDomChildren()) {
-                    if (Visited.insert(DEdge).second) {
-                        Worklist.push_back(DEdge);
+                for (auto *Child: BB->getDomChildren()) {
+                    if (!walked.get(Child->getNumber())) {
+                        markWalked(Child);
+                        worklist.push_back(Child);
                     }
                 }
+            }
+        }
+
+        // only the touched bits are reset
+        for (auto *BB: blocks) {
+            defining.clear(BB->getNumber());
+        }
+        for (auto *BB: idf) {
+            found.clear(BB->getNumber());
+        }
+        for (auto *BB: walkedBlocks) {
+            walked.clear(BB->getNumber());
+        }
+        walkedBlocks.clear();
+    }
 
+private:
+    static bool isReachable(BasicBlock *bb) {
+        return bb->getDominator() || bb == bb->getParent()->getEntryBlock();
+    }
+
+    void push(BasicBlock *bb) {
+        unsigned Level = bb->getLevel();
+        if (buckets.size() <= Level) {
+            buckets.resize(Level + 1);
+        }
+        buckets[Level].push_back(bb);
+        deepest = std::max(deepest, Level);
+    }
+
+    BasicBlock *pop() {
+        if (buckets.empty()) {
+            return nullptr;
+        }
+        while (buckets[deepest].empty()) {
+            if (deepest == 0) {
+                return nullptr;
             }
+            --deepest;
+        }
+        return pop_back_val(buckets[deepest]);
+    }
 
+    void markWalked(BasicBlock *bb) {
+        if (!walked.get(bb->getNumber())) {
+            walked.set(bb->getNumber());
+            walkedBlocks.push_back(bb);
         }
-        return IDFSet;
     }
 
 };
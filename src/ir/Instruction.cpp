@@ -6,67 +6,51 @@
 #include "BasicBlock.h"
 #include "Function.h"
 
+const char *getBinaryOpName(BinaryOp op) {
+    switch (op) {
+        case BinaryOp::Add:
+            return "add";
+        case BinaryOp::Sub:
+            return "sub";
+        case BinaryOp::Mul:
+            return "mul";
+        case BinaryOp::Div:
+            return "div";
+        case BinaryOp::Mod:
+            return "mod";
+        case BinaryOp::Shl:
+            return "shl";
+        case BinaryOp::Shr:
+            return "shr";
+        case BinaryOp::And:
+            return "and";
+        case BinaryOp::Or:
+            return "or";
+        case BinaryOp::Xor:
+            return "xor";
+        case BinaryOp::Eq:
+            return "eq";
+        case BinaryOp::Ne:
+            return "ne";
+        case BinaryOp::Lt:
+            return "lt";
+        case BinaryOp::Le:
+            return "le";
+        case BinaryOp::Gt:
+            return "gt";
+        case BinaryOp::Ge:
+            return "ge";
+        case BinaryOp::Rem:
+            return "rem";
+        default:
+            return "unknown";
+    }
+}
+
 void Instruction::dump(std::ostream &os) {
     // dump opcode
     if (opcode == OpcodeBinary) {
-        auto *Bin = this->cast<BinaryInst>();
-        // dump op
-        switch (Bin->getOp()) {
-            case BinaryOp::Add:
-                os << "add";
-                break;
-            case BinaryOp::Sub:
-                os << "sub";
-                break;
-            case BinaryOp::Mul:
-                os << "mul";
-                break;
-            case BinaryOp::Div:
-                os << "div";
-                break;
-            case BinaryOp::Mod:
-                os << "mod";
-                break;
-            case BinaryOp::Shl:
-                os << "shl";
-                break;
-            case BinaryOp::Shr:
-                os << "shr";
-                break;
-            case BinaryOp::And:
-                os << "and";
-                break;
-            case BinaryOp::Or:
-                os << "or";
-                break;
-            case BinaryOp::Xor:
-                os << "xor";
-                break;
-            case BinaryOp::Eq:
-                os << "eq";
-                break;
-            case BinaryOp::Ne:
-                os << "ne";
-                break;
-            case BinaryOp::Lt:
-                os << "lt";
-                break;
-            case BinaryOp::Le:
-                os << "le";
-                break;
-            case BinaryOp::Gt:
-                os << "gt";
-                break;
-            case BinaryOp::Ge:
-                os << "ge";
-                break;
-            case BinaryOp::Rem:
-                os << "rem";
-                break;
-            default:
-                os << "unknown";
-                break;
-        }
+        os << getBinaryOpName(this->cast<BinaryInst>()->getOp());
     } else {
         std::string opcodeStr;
         switch (opcode) {
@@ -102,6 +86,13 @@ SymbolTable *Instruction::getSymbolTable() const {
     return nullptr;
 }
 
+void Instruction::eraseFromParent() {
+    if (auto *ST = getSymbolTable()) {
+        ST->removeName(this);
+    }
+    NodeWithParent::eraseFromParent();
+}
+
 Instruction::Instruction(BasicBlock *parent, Opcode opcode) : Instruction(opcode, OpcodeNum[opcode]) {
     parent->append(this);
 }
@@ -155,7 +146,7 @@ PhiInst::PhiInst(const PhiInst &other) : OutputInst(other) {
     }
 }
 
-void PhiInst::fill(std::map<BasicBlock *, Value *> &values) {
+void PhiInst::fill(std::vector<std::pair<BasicBlock *, Value *>> &values) {
     numOperands = values.size();
     trailingOperands = std::unique_ptr<Use[]>(new Use[numOperands]);
     incomingBlocks = std::unique_ptr<Use[]>(new Use[numOperands]);
@@ -237,6 +228,34 @@ void CallInst::dump(std::ostream &os) {
     os << "(" << dump_str(operands()) << ")";
 }
 
+void VectorInst::dump(std::ostream &os) {
+    if (vectorOp != VectorOp::Store) {
+        dumpName(os) << " = ";
+    }
+    os << "vector.";
+    switch (vectorOp) {
+        case VectorOp::SetVL:
+            os << "setvl";
+            break;
+        case VectorOp::Load:
+            os << "load";
+            break;
+        case VectorOp::Store:
+            os << "store";
+            break;
+        case VectorOp::Splat:
+            os << "splat";
+            break;
+        case VectorOp::Binary:
+            os << getBinaryOpName(op);
+            break;
+        case VectorOp::Reduce:
+            os << "reduce." << getBinaryOpName(op);
+            break;
+    }
+    os << " " << dump_str(operands());
+}
+
 Type *CallInst::getCalleeType() const {
     return callee->getType();
 }
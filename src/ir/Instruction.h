@@ -45,6 +45,7 @@ inline bool isCommutative(BinaryOp op) {
             return false;
     }
 }
+const char *getBinaryOpName(BinaryOp op);
 
 class Function;
 class BasicBlock;
@@ -120,6 +121,9 @@ public:
         ST->setName(this, name);
         nameForDebug = name;
     }
+    ///< The symbol table is keyed by address, drop the name before the
+    ///< instruction is freed so a new instruction can't inherit it.
+    void eraseFromParent();
 
     inline bool hasSideEffects() const {
         switch (opcode) {
@@ -127,8 +131,8 @@ public:
             case OpcodeBr:
             case OpcodeCall:
             case OpcodeCondBr:
-            case OpcodeLoad:
             case OpcodeStore:
+            case OpcodeVector: // a vector instruction runs under the vl set by the last setvl
                 return true;
             default:
                 return false;
@@ -341,7 +345,7 @@ public:
     PhiInst(const PhiInst &other);
     ~PhiInst() override = default;
 
-    void fill(std::map<BasicBlock *, Value *> &values);
+    void fill(std::vector<std::pair<BasicBlock *, Value *>> &values);
     BasicBlock *getIncomingBlock(Use &use) const;
     BasicBlock *getIncomingBlock(size_t i) const;
     Use *findIncomingUse(BasicBlock *bb) {
@@ -387,7 +391,7 @@ public:
         size_t I = 0;
         for (auto &[val, bb] : incomings) {
             setOperand(I, val);
-            setIncomingBlock(I, bb);
+            setIncomingBlock(I++, bb);
         }
     }
 
@@ -519,6 +523,72 @@ public:
 
 };
 
+enum class VectorOp {
+    SetVL,  ///< the number of elements in the next strip, at most the elements left
+    Load,   ///< load a strip of elements from a pointer
+    Store,  ///< store a strip of elements to a pointer
+    Splat,  ///< a strip of copies of a scalar
+    Binary, ///< an element wise binary, a scalar rhs is used for every element
+    Reduce, ///< combine a scalar and the elements of a strip by the binary
+};
+
+/**
+ * An instruction on a strip of elements, the vector length of the strip is its last operand.
+ * The vector values have the type of their elements, a setvl and a reduce produce scalars.
+ */
+class VectorInst : public OutputInst {
+    VectorOp vectorOp;
+    BinaryOp op = BinNone;
+public:
+    static VectorInst *CreateSetVL(Value *avl) {
+        return new VectorInst(avl->getType(), VectorOp::SetVL, {avl});
+    }
+    static VectorInst *CreateLoad(Value *ptr, Value *vl) {
+        return new VectorInst(ptr->getType()->getPointerElementType(), VectorOp::Load, {ptr, vl});
+    }
+    static VectorInst *CreateStore(Value *ptr, Value *val, Value *vl) {
+        return new VectorInst(nullptr, VectorOp::Store, {ptr, val, vl});
+    }
+    static VectorInst *CreateSplat(Value *val, Value *vl) {
+        return new VectorInst(val->getType(), VectorOp::Splat, {val, vl});
+    }
+    static VectorInst *CreateBinary(BinaryOp op, Value *lhs, Value *rhs, Value *vl) {
+        return new VectorInst(lhs->getType(), VectorOp::Binary, {lhs, rhs, vl}, op);
+    }
+    static VectorInst *CreateReduce(BinaryOp op, Value *vec, Value *init, Value *vl) {
+        return new VectorInst(init->getType(), VectorOp::Reduce, {vec, init, vl}, op);
+    }
+public:
+    VectorInst(Type *ty, VectorOp vectorOp, const std::vector<Value *> &values, BinaryOp op = BinNone) :
+            OutputInst(ty, OpcodeVector, values), vectorOp(vectorOp), op(op) {}
+    VectorInst(const VectorInst &other) : OutputInst(other), vectorOp(other.vectorOp), op(other.op) {}
+
+    inline VectorOp getVectorOp() const { return vectorOp; }
+    inline BinaryOp getOp() const { return op; }
+
+    inline bool isMemoryAccess() const {
+        return vectorOp == VectorOp::Load || vectorOp == VectorOp::Store;
+    }
+
+    ///< Is the result a strip? A setvl and a reduce produce scalars, a store nothing.
+    inline bool isStrip() const {
+        return vectorOp == VectorOp::Load || vectorOp == VectorOp::Splat || vectorOp == VectorOp::Binary;
+    }
+
+    Value *getPtr() const {
+        ASSERT(isMemoryAccess());
+        return getOperand(0);
+    }
+
+    Value *getVL() const {
+        ASSERT(vectorOp != VectorOp::SetVL);
+        return getOperand(getOperandNum() - 1);
+    }
+
+    void dump(std::ostream &os) override;
+
+};
+
 class TerminatorInst : public Instruction {
 public:
     using Instruction::Instruction;
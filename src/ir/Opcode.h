@@ -21,7 +21,8 @@ S(GetPtr, 2, GetPtrInst)     \
 S(Ret,    0, RetInst)        \
 S(Call,   0, CallInst)       \
 S(Load,   1, LoadInst)       \
-S(Store,  2, StoreInst)
+S(Store,  2, StoreInst)      \
+S(Vector, 0, VectorInst)
 
 enum Opcode {
 #define DEFINE_OPCODE(name, c, k) Opcode##name,
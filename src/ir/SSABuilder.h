@@ -0,0 +1,271 @@
+//
+// Created by Alex on 2022/6/12.
+//
+
+#ifndef DRAGON_SSABUILDER_H
+#define DRAGON_SSABUILDER_H
+
+#include <memory>
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include "Context.h"
+#include "Constant.h"
+#include "BasicBlock.h"
+#include "Instruction.h"
+
+///< A source variable, it only names the values written by the SSABuilder and is never an operand.
+class Variable : public Value {
+    std::string name;
+    Type *type;
+    unsigned index;
+public:
+    Variable(StrView name, Type *type, unsigned index) : name(name), type(type), index(index) {}
+
+    std::string &getName() {
+        return name;
+    }
+
+    inline unsigned getIndex() const {
+        return index;
+    }
+
+    Type *getType() override {
+        return type;
+    }
+
+    void dumpAsOperand(std::ostream &os) override {
+        type->dump(os);
+        os << " $" << name;
+    }
+
+};
+
+/**
+ * Build the SSA form while the code is generated.
+ * "Simple and Efficient Construction of Static Single Assignment Form" Matthias Braun et al.
+ * The current definition of a variable is recorded per block, a read looks it up through
+ * the predecessors and places a phi at the joins. A block is sealed once all its predecessors
+ * are known, the reads of an unsealed block get an incomplete phi that is filled at the seal.
+ * The lookups and the removal of the trivial phis use worklists, so a long chain of blocks
+ * can't overflow the call stack.
+ * The removed phis are kept until finish(), so their addresses can't be reused by a new phi
+ * while the definitions still refer to them.
+ */
+class SSABuilder {
+    std::vector<std::unique_ptr<Variable>> variables;
+    std::vector<std::unordered_map<BasicBlock *, Value *>> currentDef; ///< variable index -> block -> def
+    std::unordered_map<BasicBlock *, std::vector<std::pair<Variable *, PhiInst *>>> incompletePhis;
+    std::unordered_set<BasicBlock *> sealed;
+    std::unordered_map<PhiInst *, Variable *> phiVars; ///< the phis placed and not removed yet
+    std::unordered_map<Value *, Value *> replaced; ///< removed phi -> the value replacing it
+    std::vector<PhiInst *> phis; ///< all the phis placed, in order
+    std::vector<PhiInst *> dead;
+    std::vector<std::pair<Variable *, PhiInst *>> pending; ///< the phis waiting for their operands
+    std::vector<PhiInst *> completed; ///< the filled phis to check for triviality
+    std::vector<BasicBlock *> chain;
+public:
+    Variable *createVariable(StrView name, Type *type) {
+        variables.push_back(std::make_unique<Variable>(name, type, variables.size()));
+        currentDef.emplace_back();
+        return variables.back().get();
+    }
+
+    void writeVariable(Variable *var, BasicBlock *bb, Value *val) {
+        ASSERT(var && bb && val);
+        currentDef[var->getIndex()][bb] = val;
+    }
+
+    Value *readVariable(Variable *var, BasicBlock *bb) {
+        auto *Val = lookup(var, bb);
+        fillPending();
+        // The code generator may hold the values read before, so the users are left to the seal.
+        removeTrivialPhis(false);
+        return resolve(Val);
+    }
+
+    ///< All the predecessors of the block are known.
+    void sealBlock(BasicBlock *bb) {
+        if (!sealed.insert(bb).second) {
+            return;
+        }
+        auto Iter = incompletePhis.find(bb);
+        if (Iter != incompletePhis.end()) {
+            for (auto &Incomplete: Iter->second) {
+                pending.push_back(Incomplete);
+            }
+            incompletePhis.erase(Iter);
+        }
+        fillPending();
+        removeTrivialPhis(true);
+    }
+
+    inline bool isSealed(BasicBlock *bb) const {
+        return sealed.count(bb);
+    }
+
+    ///< Seal the blocks left, remove the trivial phis to a fixpoint and reset for the next function.
+    void finish() {
+        std::vector<BasicBlock *> Unsealed;
+        for (auto &[BB, Phis]: incompletePhis) {
+            Unsealed.push_back(BB);
+        }
+        for (auto *BB: Unsealed) {
+            sealBlock(BB);
+        }
+        for (auto *Phi: phis) {
+            completed.push_back(Phi);
+        }
+        removeTrivialPhis(true);
+        for (auto *Phi: dead) {
+            delete Phi;
+        }
+        variables.clear();
+        currentDef.clear();
+        incompletePhis.clear();
+        sealed.clear();
+        phiVars.clear();
+        replaced.clear();
+        phis.clear();
+        dead.clear();
+    }
+
+private:
+    ///< Follow the removed phis to the value replacing them.
+    Value *resolve(Value *val) {
+        for (auto Iter = replaced.find(val); Iter != replaced.end(); Iter = replaced.find(val)) {
+            val = Iter->second;
+        }
+        return val;
+    }
+
+    PhiInst *placePhi(Variable *var, BasicBlock *bb) {
+        auto *Phi = PhiInst::Create(var->getType(), bb, var->getName());
+        phiVars[Phi] = var;
+        phis.push_back(Phi);
+        return Phi;
+    }
+
+    /**
+     * The definition of the variable reaching the block. The blocks with a single predecessor
+     * are walked up to a join, they get a null definition on the way to break a cycle of
+     * unreachable blocks, and all of them record the value found at the end.
+     */
+    Value *lookup(Variable *var, BasicBlock *bb) {
+        auto &Defs = currentDef[var->getIndex()];
+        Value *Val = nullptr;
+        chain.clear();
+        for (auto *BB = bb;;) {
+            auto Iter = Defs.find(BB);
+            if (Iter != Defs.end()) {
+                Val = Iter->second ? resolve(Iter->second) : BB->getContext()->getUndef();
+                break;
+            }
+            chain.push_back(BB);
+            if (!isSealed(BB)) {
+                auto *Phi = placePhi(var, BB);
+                incompletePhis[BB].emplace_back(var, Phi);
+                Val = Phi;
+                break;
+            }
+            BasicBlock *Single = nullptr;
+            bool Multiple = false;
+            for (auto *Pred: BB->preds()) {
+                if (Single && Single != Pred) {
+                    Multiple = true;
+                    break;
+                }
+                Single = Pred;
+            }
+            if (!Single) {
+                Val = BB->getContext()->getUndef();
+                break;
+            }
+            if (Multiple) {
+                auto *Phi = placePhi(var, BB);
+                pending.emplace_back(var, Phi);
+                Val = Phi;
+                break;
+            }
+            Defs[BB] = nullptr;
+            BB = Single;
+        }
+        for (auto *BB: chain) {
+            Defs[BB] = Val;
+        }
+        return Val;
+    }
+
+    ///< Fill the pending phis with the definitions reaching the end of the predecessors.
+    void fillPending() {
+        std::vector<std::pair<BasicBlock *, Value *>> Incomings;
+        while (!pending.empty()) {
+            auto [Var, Phi] = pending.back();
+            pending.pop_back();
+            Incomings.clear();
+            for (auto *Pred: Phi->getParent()->preds()) {
+                if (std::any_of(Incomings.begin(), Incomings.end(), [&](auto &incoming) {
+                    return incoming.first == Pred;
+                })) {
+                    continue;
+                }
+                Incomings.emplace_back(Pred, lookup(Var, Pred));
+            }
+            ASSERT(!Incomings.empty());
+            Phi->fill(Incomings);
+            completed.push_back(Phi);
+        }
+    }
+
+    ///< A phi is trivial if it merges a single value besides itself, propagate checks its phi users again.
+    void removeTrivialPhis(bool propagate) {
+        while (!completed.empty()) {
+            auto *Phi = completed.back();
+            completed.pop_back();
+            if (!phiVars.count(Phi)) {
+                continue;
+            }
+            Value *Same = nullptr;
+            bool Trivial = true;
+            for (size_t I = 0; I < Phi->getOperandNum(); ++I) {
+                auto *Op = Phi->getOperand(I);
+                if (Op == Same || Op == Phi) {
+                    continue;
+                }
+                if (Same) {
+                    Trivial = false;
+                    break;
+                }
+                Same = Op;
+            }
+            if (!Trivial) {
+                continue;
+            }
+            if (!Same) {
+                Same = Phi->getContext()->getUndef();
+            }
+            if (propagate) {
+                for (auto &User: Phi->getUsers()) {
+                    if (auto *UserPhi = User.as<PhiInst>(); UserPhi && UserPhi != Phi) {
+                        completed.push_back(UserPhi);
+                    }
+                }
+            }
+            Phi->replaceAllUsesWith(Same);
+            replaced[Phi] = Same;
+            phiVars.erase(Phi);
+            while (Phi->getOperandNum()) {
+                Phi->removeIncoming(size_t(0));
+            }
+            if (auto *ST = Phi->getSymbolTable()) {
+                ST->removeName(Phi);
+            }
+            Phi->getParent()->remove(Phi);
+            dead.push_back(Phi);
+        }
+    }
+
+};
+
+#endif //DRAGON_SSABUILDER_H
@@ -6,6 +6,7 @@
 #define DRAGONIR_VALUE_H
 #include <iostream>
 #include <sstream>
+#include <mutex>
 #include "Common.h"
 #include "Range.h"
 #include "Opcode.h"
@@ -136,6 +137,9 @@ public:
     using UserIterator = UseIteratorImpl<Use, UserGetter<Use, Value>>;
 protected:
     Use *users = nullptr;
+    ///< Shared values (constants, undef, globals) are used by every function,
+    ///< so their use list is locked when function passes run in parallel.
+    bool shared = false;
 public:
     Value();
     virtual ~Value();
@@ -149,6 +153,10 @@ public:
     bool isConstant() const;
     bool isConstantZero() const;
 
+    inline bool isShared() const {
+        return shared;
+    }
+
     bool isOnlyUsedOnce() const;
     bool isNotUsed() const;
     inline Use *getLastUse() const {
@@ -229,6 +237,27 @@ public:
 
 };
 
+///< Guard the use list of a shared value.
+class UseListGuard {
+    std::mutex *lock = nullptr;
+public:
+    static std::mutex &getSharedLock() {
+        static std::mutex Lock;
+        return Lock;
+    }
+    explicit UseListGuard(const Value *value) {
+        if (value && value->isShared()) {
+            lock = &getSharedLock();
+            lock->lock();
+        }
+    }
+    ~UseListGuard() {
+        if (lock) {
+            lock->unlock();
+        }
+    }
+};
+
 class Use {
     friend class Value;
     /// The user of this use.
@@ -270,6 +299,7 @@ public:
         unset();
         value = v;
         if (v) {
+            UseListGuard Guard(v);
             next = v->users;
             if (next) {
                 next->prev = &next;
@@ -283,6 +313,7 @@ public:
         ASSERT(parent);
         if (!value)
             return;
+        UseListGuard Guard(value);
         if (next)
             next->prev = prev;
         *prev = next;
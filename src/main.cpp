@@ -24,9 +24,13 @@
 #include "Liveness.h"
 #include "GraphColor.h"
 #include "MachineElim.h"
+#include "PassTimer.h"
+#include <fstream>
 static Context Context;
+static PassTimer *Timer = nullptr;
 
 value_t ParseCode(const char *str) {
+    TimeRegion Region(Timer, "Parse", "frontend");
     LRParser<> Parser(false);
     Parser.reset(str, str + strlen(str));
     Parser.parse();
@@ -36,9 +40,10 @@ value_t ParseCode(const char *str) {
     return Parser.value();
 }
 
-std::unique_ptr<Module> compileModule(const char *str) {
+std::unique_ptr<Module> compileModule(const char *str, bool buildSSA) {
     auto Val = ParseCode(str);
-    Codegen CG(Context);
+    TimeRegion Region(Timer, "Codegen", "frontend");
+    Codegen CG(Context, buildSSA);
     CG.visit(Val);
     return std::move(CG.getModule());
 }
@@ -77,50 +82,66 @@ Function *createFunc1() {
 }
 
 int main(int argc, char **argv) {
+    // -time-passes: print the timing report to stderr
+    // -trace=<file>: write a chrome trace_event timeline
+    // -O0: emit allocas and promote them with SSAConstructor, -O1 (default): build SSA in codegen
+    PassTimer PT;
+    bool TimePasses = false;
+    bool BuildSSA = true;
+    const char *TraceFile = nullptr;
+    for (int I = 1; I < argc; ++I) {
+        StrView Arg(argv[I]);
+        if (Arg == "-time-passes") {
+            TimePasses = true;
+        } else if (Arg.substr(0, 7) == "-trace=") {
+            TraceFile = argv[I] + 7;
+        } else if (Arg == "-O0") {
+            BuildSSA = false;
+        } else if (Arg == "-O1") {
+            BuildSSA = true;
+        }
+    }
+    if (TimePasses || TraceFile) {
+        Timer = &PT;
+        AllocStats::enabled = true;
+    }
+
     auto Module = compileModule(R"(
         int fib(int t){
             if(t < 2) return t;
             return fib(t-1) + fib(t-2);
         }
-    )");
-    auto &Fun = *Module->functions.begin()->second;
+    )", BuildSSA);
     // Module->dump(std::cout);
-    Dominance Dom;
-    SSAConstructor Cons;
-    GVN GVN;
-    LoopAnalyse LA;
-    BranchElim BE;
-    LoopSimplify LS;
-    SCCP SCCP;
-    SSADestructor Des;
-
-    Dom.runOnFunction(Fun);
-    Cons.runOnFunction(Fun);
-    GVN.runOnFunction(Fun);
-    Des.runOnFunction(Fun);
+    // The analyses (dominance, liveness ...) are computed on demand by the pass manager.
+    PassManager PM;
+    PM.setTimer(Timer);
+    if (!BuildSSA) {
+        PM.addPass(new SSAConstructor);
+    }
+    PM.addPass(new GVN);
+    PM.addPass(new SSADestructor);
     /*
-    BE.runOnFunction(Fun);
-    Dom.runOnFunction(Fun);
-    LA.runOnFunction(Fun);
-    LS.runOnFunction(Fun);
-    Dom.runOnFunction(Fun);*/
-    //SCCP.runOnFunction(Fun);
-
-    Lowering PD;
-    MachineSelect AS;
-    Liveness LV;
-    RISCVLowering RVL;
-    GraphColor GC;
-    MachineElim ME;
-    PD.runOnFunction(Fun);
-    //AS.runOnFunction(Fun);
-    RVL.runOnFunction(Fun);
-    LV.runOnFunction(Fun);
-
-    std::cout << "-------------------------------------------------------" << std::endl;
-    GC.runOnFunction(Fun);
-    ME.runOnFunction(Fun);
-
-    Module->dump(std::cout);
+    PM.addPass(new BranchElim);
+    PM.addPass(new LoopSimplify);*/
+    //PM.addPass(new SCCP);
+
+    PM.addPass(new Lowering);
+    PM.addPass(new RISCVLowering);
+    PM.addPass(new GraphColor);
+    PM.addPass(new MachineElim);
+    PM.run(Module.get());
+
+    {
+        TimeRegion Region(Timer, "Dump", "backend");
+        Module->dump(std::cout);
+    }
+    if (TimePasses) {
+        PT.print(std::cerr);
+    }
+    if (TraceFile) {
+        std::ofstream OS(TraceFile);
+        PT.writeTrace(OS);
+    }
     return 0;
 }
\ No newline at end of file
@@ -6,10 +6,17 @@
 #define DRAGON_ADCE_H
 
 #include "PassManager.h"
+#include "AnalysisManager.h"
+#include "Dominance.h"
+#include "LoopAnalyse.h"
 #include "Function.h"
 
 class ADCE : public FunctionPass {
 public:
+    FunctionPass *clone() const override { return new ADCE(); }
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses().preserve<Dominance>().preserve<LoopAnalyse>();
+    }
     std::set<Value *> lives;
     void runOnFunction(Function &function) override {
         lives.clear();
@@ -0,0 +1,148 @@
+//
+// Created by Alex on 2022/6/13.
+//
+
+#ifndef DRAGON_ALIASANALYSIS_H
+#define DRAGON_ALIASANALYSIS_H
+
+#include <vector>
+#include <unordered_map>
+#include "Instruction.h"
+#include "Constant.h"
+
+enum class AliasResult {
+    NoAlias,
+    MayAlias,
+    MustAlias,
+};
+
+/**
+ * A simple alias analysis by the types and the bases of the pointers.
+ * A pointer is decomposed into its base, an alloca, a global or an unknown pointer, and the
+ * constant offset of its GetPtr chain. The pointers to different types never alias, two different
+ * allocas or globals never alias, and an alloca whose address doesn't escape only aliases the
+ * pointers based on it, so a call can't touch it either.
+ */
+class AliasAnalysis {
+public:
+    struct Location {
+        Value *base = nullptr;
+        int64_t offset = 0;
+        bool hasOffset = true; ///< the offset from the base is a known constant
+    };
+
+    void clear() {
+        escapes.clear();
+    }
+
+    static Location decompose(Value *ptr) {
+        Location Loc;
+        while (auto *GetPtr = ptr->as<GetPtrInst>()) {
+            if (auto *Offset = GetPtr->getOffset()->as<IntConstant>()) {
+                Loc.offset += Offset->getVal();
+            } else {
+                Loc.hasOffset = false;
+            }
+            ptr = GetPtr->getBase();
+        }
+        Loc.base = ptr;
+        return Loc;
+    }
+
+    ///< The bases that are distinct objects.
+    static bool isIdentified(Value *base) {
+        return base->isa<AllocaInst>() || base->isa<Global>();
+    }
+
+    ///< Do the pointers compute the same address? The GetPtr chains with the same offsets from the same base do.
+    static bool isSamePointer(Value *lhs, Value *rhs) {
+        while (lhs != rhs) {
+            auto *L = lhs->as<GetPtrInst>(), *R = rhs->as<GetPtrInst>();
+            if (!L || !R || L->getOffset() != R->getOffset()) {
+                return false;
+            }
+            lhs = L->getBase();
+            rhs = R->getBase();
+        }
+        return true;
+    }
+
+    AliasResult alias(Value *lhs, Value *rhs) {
+        if (isSamePointer(lhs, rhs)) {
+            return AliasResult::MustAlias;
+        }
+        auto *LTy = lhs->getType(), *RTy = rhs->getType();
+        if (LTy && RTy && LTy->isPointerType() && RTy->isPointerType() &&
+            LTy->getPointerElementType() != RTy->getPointerElementType()) {
+            return AliasResult::NoAlias;
+        }
+        auto L = decompose(lhs), R = decompose(rhs);
+        if (L.base == R.base) {
+            if (L.hasOffset && R.hasOffset) {
+                return L.offset == R.offset ? AliasResult::MustAlias : AliasResult::NoAlias;
+            }
+            return AliasResult::MayAlias;
+        }
+        if (isIdentified(L.base) && isIdentified(R.base)) {
+            return AliasResult::NoAlias;
+        }
+        if (isLocal(L.base) || isLocal(R.base)) {
+            return AliasResult::NoAlias;
+        }
+        return AliasResult::MayAlias;
+    }
+
+    ///< Can a call read or write through the pointer?
+    bool mayCallAccess(Value *ptr) {
+        return !isLocal(decompose(ptr).base);
+    }
+
+    ///< Is the base an alloca whose address is only used to load and store?
+    bool isLocal(Value *base) {
+        auto *Alloca = base->as<AllocaInst>();
+        if (!Alloca) {
+            return false;
+        }
+        auto [Iter, Inserted] = escapes.emplace(Alloca, false);
+        if (Inserted) {
+            Iter->second = isEscaped(Alloca);
+        }
+        return !Iter->second;
+    }
+
+private:
+    std::unordered_map<Value *, bool> escapes; ///< alloca -> its address escapes
+
+    bool isEscaped(AllocaInst *alloca) {
+        std::vector<Value *> Worklist{alloca};
+        while (!Worklist.empty()) {
+            auto *Ptr = Worklist.back();
+            Worklist.pop_back();
+            for (auto &Use: Ptr->getUses()) {
+                auto *User = Use.getUser()->cast<Instruction>();
+                switch (User->getOpcode()) {
+                    case OpcodeLoad:
+                        break;
+                    case OpcodeStore:
+                        if (User->cast<StoreInst>()->getVal() == Ptr) {
+                            return true;
+                        }
+                        break;
+                    case OpcodeGetPtr:
+                        if (User->cast<GetPtrInst>()->getBase() != Ptr) {
+                            return true;
+                        }
+                        Worklist.push_back(User);
+                        break;
+                    default:
+                        return true;
+                }
+            }
+        }
+        return false;
+    }
+
+};
+
+
+#endif //DRAGON_ALIASANALYSIS_H
@@ -0,0 +1,24 @@
+//
+// Created by Alex on 2022/6/4.
+//
+
+#include "AnalysisManager.h"
+#include "Function.h"
+#include "PassTimer.h"
+
+FunctionPass &AnalysisManager::compute(std::type_index id, Function &function, FunctionPass *instance) {
+    ASSERT(instance);
+    std::unique_ptr<FunctionPass> Result(instance);
+    Result->setAnalysisManager(this);
+    Result->setTimer(timer);
+    {
+        // Only the worker running on the function computes its analyses,
+        // so the computation doesn't need to hold the lock.
+        TimeRegion Region(timer, timer ? Result->getPassName() : "", "analysis", function.getName());
+        Result->runOnFunction(function);
+    }
+    std::lock_guard<std::mutex> Guard(lock);
+    auto &Slot = results[{id, &function}];
+    Slot = std::move(Result);
+    return *Slot;
+}
@@ -0,0 +1,144 @@
+//
+// Created by Alex on 2022/6/4.
+//
+
+#ifndef DRAGON_ANALYSISMANAGER_H
+#define DRAGON_ANALYSISMANAGER_H
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <memory>
+#include <typeindex>
+#include <functional>
+#include "Common.h"
+#include "PassManager.h"
+
+class PassTimer;
+
+///< The analyses that are still valid after a pass ran on a function.
+class PreservedAnalyses {
+    bool preservedAll = false;
+    std::set<std::type_index> preservedSet;
+public:
+    static PreservedAnalyses none() {
+        return PreservedAnalyses();
+    }
+
+    static PreservedAnalyses all() {
+        PreservedAnalyses PA;
+        PA.preservedAll = true;
+        return PA;
+    }
+
+    template<typename T>
+    PreservedAnalyses &preserve() {
+        preservedSet.insert(typeid(T));
+        return *this;
+    }
+
+    template<typename T>
+    bool isPreserved() const {
+        return isPreserved(typeid(T));
+    }
+
+    bool isPreserved(std::type_index id) const {
+        return preservedAll || preservedSet.count(id);
+    }
+
+    bool areAllPreserved() const {
+        return preservedAll;
+    }
+};
+
+/**
+ * Cache the results of the analyses, keyed by the analysis type and the function.
+ * A result is computed lazily on the first request, and stays valid until a pass
+ * that doesn't preserve it runs on the function.
+ * The results themselves live in the analysis instance (or in the IR it annotates),
+ * so the cached instance is what the passes get.
+ */
+class AnalysisManager {
+    using Key = std::pair<std::type_index, Function *>;
+    std::map<Key, std::unique_ptr<FunctionPass>> results;
+    std::mutex lock;
+    PassTimer *timer = nullptr;
+public:
+    AnalysisManager() = default;
+    AnalysisManager(const AnalysisManager &) = delete;
+    AnalysisManager &operator=(const AnalysisManager &) = delete;
+
+    template<typename T>
+    T &getResult(Function &function) {
+        return static_cast<T &>(getResult(typeid(T), function, [] { return new T(); }));
+    }
+
+    ///< Get the result of the analysis with the type id, `create` makes a new instance on a miss.
+    FunctionPass &getResult(std::type_index id, Function &function, const std::function<FunctionPass *()> &create) {
+        {
+            std::lock_guard<std::mutex> Guard(lock);
+            auto Iter = results.find({id, &function});
+            if (Iter != results.end()) {
+                return *Iter->second;
+            }
+        }
+        return compute(id, function, create());
+    }
+
+    template<typename T>
+    T *getCachedResult(Function &function) {
+        std::lock_guard<std::mutex> Guard(lock);
+        auto Iter = results.find({typeid(T), &function});
+        return Iter == results.end() ? nullptr : static_cast<T *>(Iter->second.get());
+    }
+
+    ///< Drop the results of the function that are not preserved.
+    void invalidate(Function &function, const PreservedAnalyses &preserved = PreservedAnalyses::none()) {
+        if (preserved.areAllPreserved()) {
+            return;
+        }
+        std::lock_guard<std::mutex> Guard(lock);
+        for (auto Iter = results.begin(); Iter != results.end();) {
+            if (Iter->first.second == &function && !preserved.isPreserved(Iter->first.first)) {
+                Iter = results.erase(Iter);
+            } else {
+                ++Iter;
+            }
+        }
+    }
+
+    ///< Time the analyses computed on a miss.
+    void setTimer(PassTimer *passTimer) {
+        timer = passTimer;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> Guard(lock);
+        results.clear();
+    }
+
+private:
+    FunctionPass &compute(std::type_index id, Function &function, FunctionPass *instance);
+
+};
+
+template<typename T>
+T &FunctionPass::getAnalysis(Function &function) {
+    if (analysis) {
+        return analysis->getResult<T>(function);
+    }
+    // Run outside of a pass manager: nothing tracks the changes, so recompute.
+    if (!ownAnalysis) {
+        ownAnalysis = std::make_shared<AnalysisManager>();
+    }
+    ownAnalysis->invalidate(function);
+    return ownAnalysis->getResult<T>(function);
+}
+
+template<typename T>
+T *FunctionPass::getCachedAnalysis(Function &function) {
+    auto *Manager = analysis ? analysis : ownAnalysis.get();
+    return Manager ? Manager->getCachedResult<T>(function) : nullptr;
+}
+
+#endif //DRAGON_ANALYSISMANAGER_H
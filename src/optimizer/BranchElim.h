@@ -9,16 +9,27 @@
 #include "PassManager.h"
 #include "Function.h"
 #include "Dominance.h"
+#include "DomTreeUpdater.h"
+#include "AnalysisManager.h"
 #include <algorithm>
+/**
+ * Fold the conditional branches on a constant or to a single target, erase the blocks left
+ * unreachable and fuse a block into its only predecessor ending with a jump.
+ * Every removed or inserted edge and every erased block is reported to a DomTreeUpdater, which
+ * brings the dominator tree up to date, so Dominance is preserved and the later passes never see
+ * an erased block in it.
+ */
 class BranchElim : public FunctionPass {
 public:
-    /// After Branch elimination, the basicblock may be erased.
-    /// So we need to update the basicblock's dominator and dom tree children.
-    /// Otherwise, the program will crash.
+    FunctionPass *clone() const override { return new BranchElim(); }
     BranchElim() {}
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses().preserve<Dominance>();
+    }
 
     void runOnFunction(Function &f) override {
         std::vector<BasicBlock *> Worklist;
+        DomTreeUpdater Updater(f, getAnalysis<Dominance>(f));
 
         f.forEachBlock([&](BasicBlock *bb) {
             if (auto *Inst = bb->getTerminator()) {
@@ -31,8 +42,10 @@ public:
                         auto *NewInst = new BranchInst(
                                 Val->getVal() == 0 ? CondBr->getFalseTarget() : CondBr->getTrueTarget());
                         Inst->replaceBy(NewInst);
+                        Updater.deleteEdge(bb, Val->getVal() == 0 ? TrueBB : FalseBB);
                     } else if (TrueBB == FalseBB) {
                         Inst->replaceBy(new BranchInst(TrueBB));
+                        Updater.deleteEdge(bb, TrueBB);
                     }
                 }
             }
@@ -54,10 +67,14 @@ public:
                 }
             }*/
 
+        });
+
+        // the blocks without a dominator are unreachable
+        Updater.applyUpdates();
+        f.forEachBlock([&](BasicBlock *bb) {
             if (bb->isUnreachable()) {
                 Worklist.push_back(bb);
             }
-
         });
 
         std::set<BasicBlock *> Unreachable;
@@ -89,11 +106,14 @@ public:
                     }
                 }
             }
-            BB->eraseFromParent();
         }
+        // the unreachable blocks may branch to each other, so they are erased together
+        Updater.eraseBlocks({Unreachable.begin(), Unreachable.end()});
         Unreachable.clear();
 
         ///< Combine the redundant basic blocks.
+        ///< The fused blocks are erased at the end, so the tree is only rebuilt once.
+        std::vector<BasicBlock *> Fused;
         for (auto &BB : f) {
             if (auto *Inst = BB.getTerminator()) {
                 while (Inst->getOpcode() == OpcodeBr) {
@@ -109,6 +129,10 @@ public:
                     ASSERT(BBTarget != BBSource);
                     // first erase old terminator
                     Inst->eraseFromParent();
+                    Updater.deleteEdge(BBSource, BBTarget);
+                    for (auto *Succ: BBTarget->succs()) {
+                        Updater.insertEdge(BBSource, Succ);
+                    }
                     // fuse the following blocks
                     ASSERT(BBTarget->getTerminator());
                     auto First = BBTarget->begin();
@@ -120,10 +144,13 @@ public:
                     }
                     // erase target block
                     BBTarget->replaceAllUsesWith(BBSource);
-                    BBTarget->eraseFromParent();
+                    Fused.push_back(BBTarget);
                 }
             }
         }
+        for (auto *BB: Fused) {
+            Updater.eraseBlock(BB);
+        }
 
     }
 
@@ -3,3 +3,37 @@
 //
 
 #include "CallGraph.h"
+#include "ThreadPool.h"
+
+void CallGraphSCCPass::run(Module *module) {
+    callGraph.run(module);
+    auto &SCCs = callGraph.getSCCs();
+    std::unique_ptr<CallGraphSCCPass> Probe(threads > 1 ? clone() : nullptr);
+    if (!Probe) {
+        for (auto &S : SCCs) {
+            runOnSCC(S);
+        }
+        return;
+    }
+
+    // the components of a height only call the lower ones, which are finished
+    std::vector<std::vector<unsigned>> Heights(callGraph.getHeights());
+    for (unsigned I = 0; I < SCCs.size(); ++I) {
+        Heights[SCCs[I].height].push_back(I);
+    }
+    ThreadPool Pool(threads);
+    for (auto &Height : Heights) {
+        std::vector<std::unique_ptr<CallGraphSCCPass>> Clones(Height.size());
+        std::vector<ThreadPool::Task> Tasks;
+        for (size_t K = 0; K < Height.size(); ++K) {
+            Tasks.emplace_back([&, K] {
+                Clones[K].reset(clone());
+                Clones[K]->runOnSCC(SCCs[Height[K]]);
+            });
+        }
+        Pool.run(Tasks);
+        for (auto &Clone : Clones) {
+            merge(*Clone);
+        }
+    }
+}
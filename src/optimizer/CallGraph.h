@@ -5,14 +5,225 @@
 #ifndef DRAGON_CALLGRAPH_H
 #define DRAGON_CALLGRAPH_H
 
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
 #include "PassManager.h"
 #include "Function.h"
+#include "GraphTraversal.h"
+/**
+ * The call graph of a module: the call sites of every function and the strongly connected
+ * components of the calls. It also fills the callers and the callees of the functions.
+ * The components are found by Tarjan's algorithm from the functions in the module order, so they
+ * come out bottom-up, a component is after all the components it calls. The height of a component
+ * is the longest chain of components it calls, so the components of the same height never call
+ * each other.
+ * It is a module level analysis without a clone, so the AnalysisManager never caches it: every
+ * CallGraphSCCPass builds its own graph before it runs, and no pass has to preserve it.
+ */
 class CallGraph : public FunctionPass {
 public:
+    struct Node {
+        Function *function = nullptr;
+        std::vector<CallInst *> calls; ///< the call sites, in the function order
+        std::vector<Function *> callees; ///< the functions called, without duplicates, in the call order
+        unsigned scc = 0;
+    };
+    struct SCC {
+        std::vector<Function *> functions; ///< in the module order
+        std::vector<unsigned> callees; ///< the components called, without duplicates
+        unsigned height = 0; ///< 0 if it calls no other component
+        bool recursive = false; ///< a function calls itself or several functions call each other
+
+        inline bool contains(Function *function) const {
+            return std::find(functions.begin(), functions.end(), function) != functions.end();
+        }
+    };
+    bool isAnalysis() const override { return true; }
+
+    void initialize(Module *module) override {
+        nodes.clear();
+        index.clear();
+        sccs.clear();
+    }
+
     void runOnFunction(Function &function) override {
+        auto [Iter, Inserted] = index.emplace(&function, nodes.size());
+        if (Inserted) {
+            nodes.emplace_back();
+        }
+        auto &N = nodes[Iter->second];
+        N.function = &function;
+        N.calls.clear();
+        N.callees.clear();
+        function.clearCallees();
         function.forEach<CallInst>([&](CallInst *callInst) {
-            function.addCallee(callInst->getCallee());
+            N.calls.push_back(callInst);
+            // the call of an undefined function has no callee
+            if (auto *Callee = callInst->getCallee()) {
+                function.addCallee(Callee);
+                if (std::find(N.callees.begin(), N.callees.end(), Callee) == N.callees.end()) {
+                    N.callees.push_back(Callee);
+                }
+            }
+        });
+    }
+
+    void finalize(Module *module) override {
+        computeSCCs();
+    }
+
+    inline Node *getNode(Function *function) {
+        auto Iter = index.find(function);
+        return Iter == index.end() ? nullptr : &nodes[Iter->second];
+    }
+
+    ///< The components, bottom-up.
+    inline std::vector<SCC> &getSCCs() {
+        return sccs;
+    }
+
+    inline SCC &getSCC(Function *function) {
+        auto *N = getNode(function);
+        ASSERT(N);
+        return sccs[N->scc];
+    }
+
+    ///< The number of heights, the components of a height can be transformed at the same time.
+    unsigned getHeights() const {
+        unsigned Heights = 0;
+        for (auto &S: sccs) {
+            Heights = std::max(Heights, S.height + 1);
+        }
+        return Heights;
+    }
+
+private:
+    std::vector<Node> nodes; ///< in the module order
+    std::unordered_map<Function *, unsigned> index; ///< function -> node
+    std::vector<SCC> sccs;
+    TarjanSCC<Function *, std::vector<Function *>> tarjan;
+
+    void computeSCCs() {
+        sccs.clear();
+        tarjan.clear();
+        auto Children = [&](Function *function) -> std::vector<Function *> & {
+            return getNode(function)->callees;
+        };
+        auto AsNode = [&](Function *function) {
+            // the functions out of the module are not in the graph
+            return index.count(function) ? function : nullptr;
+        };
+        for (auto &N: nodes) {
+            tarjan.run(N.function, Children, AsNode, [&](std::vector<Function *> &group, Function *) {
+                auto &S = sccs.emplace_back();
+                S.functions = group;
+                std::sort(S.functions.begin(), S.functions.end(), [&](Function *lhs, Function *rhs) {
+                    return index[lhs] < index[rhs];
+                });
+                for (auto *F: S.functions) {
+                    getNode(F)->scc = sccs.size() - 1;
+                }
+            });
+        }
+        // the callees of a component are done before it
+        for (unsigned I = 0; I < sccs.size(); ++I) {
+            auto &S = sccs[I];
+            for (auto *F: S.functions) {
+                for (auto *Callee: getNode(F)->callees) {
+                    auto *CalleeNode = getNode(Callee);
+                    if (CalleeNode == nullptr) {
+                        continue;
+                    }
+                    if (CalleeNode->scc == I) {
+                        S.recursive = true;
+                    } else if (std::find(S.callees.begin(), S.callees.end(), CalleeNode->scc) == S.callees.end()) {
+                        S.callees.push_back(CalleeNode->scc);
+                        S.height = std::max(S.height, sccs[CalleeNode->scc].height + 1);
+                    }
+                }
+            }
+        }
+    }
+
+};
+
+/**
+ * A pass over the components of the call graph, bottom-up, so the callees are done before their
+ * callers. With more than one thread the components of the same height run in parallel, each on
+ * a fresh clone of the pass, and the clones are merged bottom-up before the next height, so the
+ * result doesn't depend on the scheduling. A pass that can't be cloned runs them one by one.
+ */
+class CallGraphSCCPass : public Pass {
+protected:
+    CallGraph callGraph;
+    unsigned threads = 1;
+    AnalysisManager *analysis = nullptr; ///< a pass changing a function invalidates its analyses here
+public:
+    virtual void runOnSCC(CallGraph::SCC &scc) = 0;
+    virtual CallGraphSCCPass *clone() const { return nullptr; }
+    ///< Merge the results of a clone back into this pass.
+    virtual void merge(CallGraphSCCPass &other) {}
+    void run(Module *module) override;
+
+    void setThreads(unsigned count) {
+        threads = count;
+    }
+
+    void setAnalysisManager(AnalysisManager *manager) {
+        analysis = manager;
+    }
+
+    CallGraph &getCallGraph() {
+        return callGraph;
+    }
+};
+
+/**
+ * Infer the pure functions: they only read and write their own allocas and only call pure functions.
+ * A recursive component is assumed pure and checked as a whole.
+ */
+class FunctionAttrs : public CallGraphSCCPass {
+public:
+    CallGraphSCCPass *clone() const override { return new FunctionAttrs(); }
+    void runOnSCC(CallGraph::SCC &scc) override {
+        bool Pure = std::all_of(scc.functions.begin(), scc.functions.end(), [&](Function *function) {
+            bool FunctionPure = true;
+            function->forEach([&](Instruction *inst) {
+                FunctionPure = FunctionPure && isPure(inst, scc);
+            });
+            return FunctionPure;
         });
+        for (auto *F: scc.functions) {
+            F->setPure(Pure);
+        }
+    }
+
+    static bool isPure(Instruction *inst, CallGraph::SCC &scc) {
+        switch (inst->getOpcode()) {
+            case OpcodeLoad:
+                return isLocal(inst->cast<LoadInst>()->getPtr());
+            case OpcodeStore:
+                return isLocal(inst->cast<StoreInst>()->getPtr());
+            case OpcodeVector: {
+                auto *Vector = inst->cast<VectorInst>();
+                return !Vector->isMemoryAccess() || isLocal(Vector->getPtr());
+            }
+            case OpcodeCall: {
+                auto *Callee = inst->cast<CallInst>()->getCallee();
+                return Callee && (Callee->isPure() || scc.contains(Callee));
+            }
+            default:
+                return true;
+        }
+    }
+
+    ///< Does the pointer point into an alloca?
+    static bool isLocal(Value *ptr) {
+        while (auto *GetPtr = ptr->as<GetPtrInst>()) {
+            ptr = GetPtr->getBase();
+        }
+        return ptr->isa<AllocaInst>();
     }
 
 };
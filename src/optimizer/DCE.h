@@ -6,10 +6,17 @@
 #define DRAGON_DCE_H
 
 #include "PassManager.h"
+#include "AnalysisManager.h"
+#include "Dominance.h"
+#include "LoopAnalyse.h"
 #include "Function.h"
 
 class DCE : public FunctionPass {
 public:
+    FunctionPass *clone() const override { return new DCE(); }
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses().preserve<Dominance>().preserve<LoopAnalyse>();
+    }
     void runOnFunction(Function &function) override {
         std::vector<Instruction *> Worklist;
         function.forEach([&](Instruction *instruction) {
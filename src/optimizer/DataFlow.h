@@ -0,0 +1,205 @@
+//
+// Created by Alex on 2022/6/9.
+//
+
+#ifndef DRAGON_DATAFLOW_H
+#define DRAGON_DATAFLOW_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+#include "BitVector.h"
+#include "BasicBlock.h"
+
+///< How the solver walks the edges of a block.
+template<typename Block>
+struct DataFlowTraits {
+    static auto preds(Block *bb) { return bb->preds(); }
+    static auto succs(Block *bb) { return bb->succs(); }
+};
+
+///< The statistics of the last solve.
+struct DataFlowStats {
+    unsigned sweeps = 0; ///< the passes over the worklist in the block order
+    unsigned visits = 0; ///< the transfer functions evaluated
+    unsigned changes = 0; ///< the visits that changed the output
+};
+
+/**
+ * A worklist solver for the bit vector dataflow problems.
+ * The blocks are ordered in the reverse post order from the first block, or in the post order
+ * for a backward problem, and the unreachable blocks follow. The worklist is a BitVector indexed
+ * by that order: a sweep visits the pending blocks in the order, and a block whose input changes
+ * is visited again in the same sweep if it comes later.
+ * The input of a block is boundary | meet(the outputs of the neighbors), where the neighbors are
+ * the preds for a forward problem and the succs for a backward one, and the meet is the union
+ * or the intersection. The boundary is a constant input, like the facts at the entry or the
+ * phi operands used on the out edges. The output is gen | (input - kill).
+ */
+template<typename Block, bool forward, bool intersect = false>
+class DataFlow {
+public:
+    struct BlockState {
+        BitVector gen, kill, boundary;
+        BitVector input; ///< at the block entry for a forward problem, at the exit for a backward one
+        BitVector output;
+    };
+    using Traits = DataFlowTraits<Block>;
+    DataFlowStats stats;
+
+    ///< Number the blocks and size the vectors, the first block is the entry.
+    template<typename Range>
+    void init(Range &blocks, size_t width) {
+        order.clear();
+        index.clear();
+        std::vector<Block *> List;
+        for (auto &BB: blocks) {
+            index[&BB] = List.size();
+            List.push_back(&BB);
+        }
+
+        // post order from the entry
+        BitVector Visited(List.size());
+        std::vector<std::pair<Block *, bool>> Stack;
+        if (!List.empty()) {
+            Stack.emplace_back(List.front(), false);
+        }
+        while (!Stack.empty()) {
+            auto [BB, Done] = Stack.back();
+            Stack.pop_back();
+            if (Done) {
+                order.push_back(BB);
+                continue;
+            }
+            if (Visited.get(index[BB])) {
+                continue;
+            }
+            Visited.set(index[BB]);
+            Stack.emplace_back(BB, true);
+            for (auto *Succ: Traits::succs(BB)) {
+                auto Iter = index.find(Succ);
+                if (Iter != index.end() && !Visited.get(Iter->second)) {
+                    Stack.emplace_back(Succ, false);
+                }
+            }
+        }
+        if (forward) {
+            std::reverse(order.begin(), order.end());
+        }
+        for (auto *BB: List) {
+            if (!Visited.get(index[BB])) {
+                order.push_back(BB);
+            }
+        }
+        for (unsigned I = 0; I < order.size(); ++I) {
+            index[order[I]] = I;
+        }
+
+        neighbors.assign(order.size(), {});
+        dependents.assign(order.size(), {});
+        for (unsigned I = 0; I < order.size(); ++I) {
+            for (auto *Pred: Traits::preds(order[I])) {
+                auto Iter = index.find(Pred);
+                if (Iter == index.end()) {
+                    continue;
+                }
+                (forward ? neighbors[I] : dependents[I]).push_back(Iter->second);
+                (forward ? dependents[Iter->second] : neighbors[Iter->second]).push_back(I);
+            }
+        }
+
+        states.resize(order.size());
+        for (auto &State: states) {
+            for (auto *Set: {&State.gen, &State.kill, &State.boundary, &State.input, &State.output}) {
+                Set->resize(width);
+                Set->fill(false);
+            }
+        }
+        scratch.resize(width);
+    }
+
+    inline size_t size() const {
+        return order.size();
+    }
+
+    inline unsigned getIndex(Block *bb) const {
+        auto Iter = index.find(bb);
+        ASSERT(Iter != index.end());
+        return Iter->second;
+    }
+
+    ///< The blocks in the solving order.
+    inline Block *getBlock(unsigned i) const {
+        return order[i];
+    }
+
+    inline BlockState &operator[](Block *bb) {
+        return states[getIndex(bb)];
+    }
+
+    inline BlockState &operator[](unsigned i) {
+        return states[i];
+    }
+
+    void solve() {
+        stats = DataFlowStats();
+        // the intersection starts from the top, everything holds
+        for (auto &State: states) {
+            State.output.fill(intersect);
+        }
+        BitVector Pending(size());
+        Pending.fill(true);
+        while (Pending.any()) {
+            stats.sweeps++;
+            for (auto I = Pending.find_first(); I < size(); I = Pending.find_next(I)) {
+                Pending.clear(I);
+                stats.visits++;
+                auto &State = states[I];
+                meet(I, State.input);
+                scratch = State.input;
+                scratch -= State.kill;
+                scratch |= State.gen;
+                if (scratch == State.output) {
+                    continue;
+                }
+                std::swap(scratch, State.output);
+                stats.changes++;
+                for (auto Dependent: dependents[I]) {
+                    Pending.set(Dependent);
+                }
+            }
+        }
+    }
+
+private:
+    std::vector<Block *> order;
+    std::unordered_map<Block *, unsigned> index;
+    std::vector<std::vector<unsigned>> neighbors; ///< the blocks whose outputs meet into the block
+    std::vector<std::vector<unsigned>> dependents; ///< the blocks to visit again when the output changes
+    std::vector<BlockState> states;
+    BitVector scratch;
+
+    void meet(unsigned i, BitVector &input) {
+        auto &Neighbors = neighbors[i];
+        input = states[i].boundary;
+        if (Neighbors.empty()) {
+            return;
+        }
+        if (intersect) {
+            scratch = states[Neighbors[0]].output;
+            for (unsigned J = 1; J < Neighbors.size(); ++J) {
+                scratch &= states[Neighbors[J]].output;
+            }
+            input |= scratch;
+        } else {
+            for (auto Neighbor: Neighbors) {
+                input |= states[Neighbor].output;
+            }
+        }
+    }
+
+};
+
+
+#endif //DRAGON_DATAFLOW_H
@@ -0,0 +1,5 @@
+//
+// Created by Alex on 2022/6/6.
+//
+
+#include "DomTreeUpdater.h"
@@ -0,0 +1,586 @@
+//
+// Created by Alex on 2022/6/6.
+//
+
+#ifndef DRAGON_DOMTREEUPDATER_H
+#define DRAGON_DOMTREEUPDATER_H
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include "Dominance.h"
+
+/**
+ * Keep the dominator tree and the dominance frontiers valid while a pass changes the CFG.
+ * The pass changes the terminators first and reports the inserted and deleted edges,
+ * the updates are batched until applyUpdates().
+ * The updates of a batch are applied one by one on a view of the CFG that hides the
+ * ones still pending, so every step starts from a tree that is valid for its CFG.
+ * An edge update only changes the dominators below the nearest common dominator of its
+ * ends, so only that subtree (and the blocks that become reachable) is rebuilt by Semi-NCA.
+ * The frontiers are rebuilt for the same subtrees at the end of the batch. The new blocks
+ * are numbered after the existing ones, the children and the frontiers stay sorted by the number.
+ */
+class DomTreeUpdater {
+    enum Mark : unsigned {
+        MarkSubtree = 1, ///< in the old subtree of the root being rebuilt
+        MarkRegion = 2, ///< unreachable before, reachable from an inserted edge
+        MarkRoot = 4,
+        MarkNewSubtree = 8, ///< in a rebuilt subtree
+        MarkJoin = 16,
+        MarkFixed = 32,
+        MarkAffected = 64,
+        MarkRunner = 128,
+    };
+    struct Update {
+        BasicBlock *from;
+        BasicBlock *to;
+        bool insert;
+    };
+    using BlockMap = std::unordered_map<BasicBlock *, std::vector<BasicBlock *>>;
+
+    ///< The CFG before the pending updates: the inserted edges are hidden, the deleted ones are visible.
+    struct PendingView {
+        BlockMap addedSuccs, removedSuccs, addedPreds, removedPreds;
+
+        template<typename Fn>
+        void forEachSucc(BasicBlock *bb, Fn fn) const {
+            visit(bb->succs(), bb, addedSuccs, removedSuccs, fn);
+        }
+        template<typename Fn>
+        void forEachPred(BasicBlock *bb, Fn fn) const {
+            visit(bb->preds(), bb, addedPreds, removedPreds, fn);
+        }
+
+        void add(const Update &update) {
+            if (update.insert) {
+                removedSuccs[update.from].push_back(update.to);
+                removedPreds[update.to].push_back(update.from);
+            } else {
+                addedSuccs[update.from].push_back(update.to);
+                addedPreds[update.to].push_back(update.from);
+            }
+        }
+        ///< The update is not pending any more.
+        void remove(const Update &update) {
+            if (update.insert) {
+                erase(removedSuccs, update.from, update.to);
+                erase(removedPreds, update.to, update.from);
+            } else {
+                erase(addedSuccs, update.from, update.to);
+                erase(addedPreds, update.to, update.from);
+            }
+        }
+
+    private:
+        template<typename Range, typename Fn>
+        static void visit(Range range, BasicBlock *bb, const BlockMap &added, const BlockMap &removed, Fn &fn) {
+            auto Removed = removed.find(bb);
+            for (auto *Edge: range) {
+                if (!Edge) {
+                    continue;
+                }
+                if (Removed != removed.end() &&
+                    std::find(Removed->second.begin(), Removed->second.end(), Edge) != Removed->second.end()) {
+                    continue;
+                }
+                fn(Edge);
+            }
+            auto Added = added.find(bb);
+            if (Added != added.end()) {
+                for (auto *Edge: Added->second) {
+                    fn(Edge);
+                }
+            }
+        }
+        static void erase(BlockMap &map, BasicBlock *key, BasicBlock *value) {
+            auto Iter = map.find(key);
+            ASSERT(Iter != map.end());
+            auto &Blocks = Iter->second;
+            Blocks.erase(std::find(Blocks.begin(), Blocks.end(), value));
+            if (Blocks.empty()) {
+                map.erase(Iter);
+            }
+        }
+    };
+
+    Function &function;
+    Dominance &dominance;
+    BasicBlock *root; ///< the entry block the tree was built from
+    std::vector<Update> updates;
+    PendingView view;
+    std::vector<unsigned> marks; ///< block number -> marks, cleared after every step
+    std::vector<BasicBlock *> marked;
+    std::vector<BasicBlock *> changed; ///< the blocks whose reachability changed
+    std::vector<BasicBlock *> subRoots; ///< the roots of the subtrees whose frontiers must be rebuilt
+    std::vector<BasicBlock *> touched; ///< the blocks of the old subtrees
+public:
+    ///< The dominance must be valid for the current CFG of the function.
+    DomTreeUpdater(Function &function, Dominance &dominance) : function(function), dominance(dominance) {
+        root = function.getEntryBlock();
+    }
+    ~DomTreeUpdater() {
+        applyUpdates();
+    }
+    DomTreeUpdater(const DomTreeUpdater &) = delete;
+    DomTreeUpdater &operator=(const DomTreeUpdater &) = delete;
+
+    ///< The edge from -> to has been added to the CFG.
+    void insertEdge(BasicBlock *from, BasicBlock *to) {
+        addBlock(from);
+        addBlock(to);
+        updates.push_back({from, to, true});
+    }
+
+    ///< The edge from -> to has been removed from the CFG.
+    void deleteEdge(BasicBlock *from, BasicBlock *to) {
+        addBlock(from);
+        addBlock(to);
+        updates.push_back({from, to, false});
+    }
+
+    ///< Erase a block that is unreachable once the pending updates are applied.
+    void eraseBlock(BasicBlock *bb) {
+        eraseBlocks({bb});
+    }
+
+    ///< Erase the blocks that are unreachable once the pending updates are applied. They may branch
+    ///< to each other, like the blocks of an unreachable loop, so all their terminators are removed
+    ///< before any of them is erased.
+    void eraseBlocks(const std::vector<BasicBlock *> &blocks) {
+        applyUpdates();
+        std::unordered_set<BasicBlock *> Erased(blocks.begin(), blocks.end());
+        std::vector<BasicBlock *> Succs;
+        for (auto *BB: blocks) {
+            ASSERT(BB != root && !BB->getDominator() && BB->getDomChildren().empty());
+            for (auto *Succ: BB->succs()) {
+                if (Succ && !Erased.count(Succ)) {
+                    Succs.push_back(Succ);
+                }
+            }
+            if (auto *Term = BB->getTerminator()) {
+                Term->eraseFromParent();
+            }
+        }
+        for (auto *BB: blocks) {
+            if (isKnown(BB)) {
+                dominance.blocks[BB->number] = nullptr;
+            }
+            BB->eraseFromParent();
+        }
+        // only the frontiers of the other unreachable predecessors may change
+        for (auto *Succ: Succs) {
+            if (isKnown(Succ)) {
+                changed.push_back(Succ);
+            }
+        }
+        fixUnreachableFrontiers();
+    }
+
+    bool hasPendingUpdates() const {
+        return !updates.empty();
+    }
+
+    void applyUpdates() {
+        if (updates.empty()) {
+            return;
+        }
+        if (function.getEntryBlock() != root) {
+            // the new entry dominates everything
+            recalculate();
+            return;
+        }
+        auto Legal = legalize();
+        for (auto &Update: Legal) {
+            view.add(Update);
+        }
+        for (auto &Update: Legal) {
+            view.remove(Update);
+            applyUpdate(Update);
+            clearMarks();
+        }
+        updateFrontiers(Legal);
+        for (auto &Update: updates) {
+            changed.push_back(Update.to);
+            if (!isReachable(Update.from)) {
+                changed.push_back(Update.from);
+            }
+        }
+        updates.clear();
+        fixUnreachableFrontiers();
+        dominance.numberTree(root);
+    }
+
+    ///< Rebuild the whole tree, the blocks are numbered again.
+    void recalculate() {
+        updates.clear();
+        changed.clear();
+        clearMarks();
+        dominance.runOnFunction(function);
+        root = function.getEntryBlock();
+    }
+
+private:
+    inline bool isKnown(BasicBlock *bb) const {
+        return bb->number < dominance.blocks.size() && dominance.blocks[bb->number] == bb;
+    }
+
+    ///< Number a new block.
+    void addBlock(BasicBlock *bb) {
+        if (!isKnown(bb)) {
+            bb->number = dominance.blocks.size();
+            bb->clearDomInfo();
+            dominance.blocks.push_back(bb);
+        }
+        if (marks.size() < dominance.blocks.size()) {
+            marks.resize(dominance.blocks.size(), 0);
+        }
+    }
+
+    inline bool isReachable(BasicBlock *bb) const {
+        return bb == root || bb->dominator != nullptr;
+    }
+
+    inline void mark(BasicBlock *bb, unsigned flag) {
+        if (marks[bb->number] == 0) {
+            marked.push_back(bb);
+        }
+        marks[bb->number] |= flag;
+    }
+
+    void clearMarks() {
+        for (auto *BB: marked) {
+            marks[BB->number] = 0;
+        }
+        marked.clear();
+    }
+
+    static BasicBlock *findNCA(BasicBlock *lhs, BasicBlock *rhs) {
+        while (lhs != rhs) {
+            if (lhs->level < rhs->level) {
+                std::swap(lhs, rhs);
+            }
+            lhs = lhs->dominator;
+            ASSERT(lhs);
+        }
+        return lhs;
+    }
+
+    static bool hasEdge(BasicBlock *from, BasicBlock *to) {
+        return std::find(from->succs_begin(), from->succs_end(), to) != from->succs_end();
+    }
+
+    /**
+     * Drop the duplicated updates and the ones the CFG doesn't agree with, like an edge
+     * inserted and deleted again, or one of two edges to the same block being deleted.
+     */
+    std::vector<Update> legalize() {
+        std::vector<Update> Legal;
+        for (auto &Update: updates) {
+            bool Exists = hasEdge(Update.from, Update.to);
+            if (Exists != Update.insert) {
+                continue;
+            }
+            auto Iter = std::find_if(Legal.begin(), Legal.end(), [&](const struct Update &update) {
+                return update.from == Update.from && update.to == Update.to;
+            });
+            if (Iter == Legal.end()) {
+                Legal.push_back(Update);
+            }
+        }
+        return Legal;
+    }
+
+    void applyUpdate(const Update &update) {
+        if (!isReachable(update.from)) {
+            // nothing reachable leads through the edge
+            return;
+        }
+        if (!isReachable(update.to)) {
+            ASSERT(update.insert);
+            insertUnreachable(update.from, update.to);
+            return;
+        }
+        // the target is either the common dominator or its child
+        auto *NCD = findNCA(update.from, update.to);
+        if (update.insert) {
+            // the dominators only change if the source is not dominated by the idom of the target
+            if (NCD != update.to && NCD != update.to->dominator) {
+                rebuild(NCD);
+            }
+        } else if (NCD != update.to) {
+            if (!hasProperSupport(update.to)) {
+                NCD = findUnsupportedRoot(update.to, NCD);
+            }
+            rebuild(NCD);
+        }
+    }
+
+    ///< The blocks that become reachable hang below the common dominator of the source and the reachable blocks they lead to.
+    void insertUnreachable(BasicBlock *from, BasicBlock *to) {
+        auto *RegionRoot = from;
+        std::vector<BasicBlock *> Stack = {to};
+        mark(to, MarkRegion);
+        while (!Stack.empty()) {
+            auto *BB = Stack.back();
+            Stack.pop_back();
+            view.forEachSucc(BB, [&](BasicBlock *Succ) {
+                addBlock(Succ);
+                if (isReachable(Succ)) {
+                    RegionRoot = findNCA(RegionRoot, Succ);
+                } else if (!(marks[Succ->number] & MarkRegion)) {
+                    mark(Succ, MarkRegion);
+                    Stack.push_back(Succ);
+                }
+            });
+        }
+        rebuild(RegionRoot);
+    }
+
+    ///< A predecessor not dominated by the block keeps it reachable.
+    bool hasProperSupport(BasicBlock *bb) {
+        bool Support = false;
+        view.forEachPred(bb, [&](BasicBlock *Pred) {
+            if (!Support && isKnown(Pred) && isReachable(Pred) && findNCA(bb, Pred) != bb) {
+                Support = true;
+            }
+        });
+        return Support;
+    }
+
+    /**
+     * The block loses its immediate dominator and has no other support, so its subtree
+     * becomes unreachable, and the blocks reached through it may get deeper dominators.
+     * Walk down from the block through the deeper blocks, the shallower ones it reaches are
+     * affected, and the subtree to rebuild is rooted at their common dominator with the block.
+     * See DeleteUnreachable in "An Experimental Study of Dynamic Dominators" Georgiadis et al.
+     */
+    BasicBlock *findUnsupportedRoot(BasicBlock *bb, BasicBlock *root) {
+        std::vector<BasicBlock *> Visited = {bb};
+        mark(bb, MarkAffected);
+        for (size_t I = 0; I < Visited.size(); ++I) {
+            view.forEachSucc(Visited[I], [&](BasicBlock *Succ) {
+                if (!isKnown(Succ) || !isReachable(Succ) || (marks[Succ->number] & MarkAffected)) {
+                    return;
+                }
+                if (Succ->level > bb->level) {
+                    mark(Succ, MarkAffected);
+                    Visited.push_back(Succ);
+                } else {
+                    auto *NCD = findNCA(bb, Succ);
+                    if (NCD != Succ) {
+                        root = findNCA(root, NCD);
+                    }
+                }
+            });
+        }
+        return root;
+    }
+
+    void rebuild(BasicBlock *subRoot) {
+        subRoots.push_back(subRoot);
+        std::vector<BasicBlock *> Subtree = {subRoot};
+        for (size_t I = 0; I < Subtree.size(); ++I) {
+            mark(Subtree[I], MarkSubtree);
+            for (auto *Child: Subtree[I]->domChildren) {
+                Subtree.push_back(Child);
+            }
+        }
+        touched.insert(touched.end(), Subtree.begin(), Subtree.end());
+
+        auto &SemiNCA = dominance.semiNCA;
+        SemiNCA.run(subRoot, dominance.blocks.size(), [&](BasicBlock *bb) {
+            return isKnown(bb) && (marks[bb->number] & (MarkSubtree | MarkRegion));
+        }, view);
+
+        for (auto *BB: Subtree) {
+            if (BB != subRoot) {
+                BB->dominator = nullptr;
+            }
+            BB->domChildren.clear();
+            if (!SemiNCA.isVisited(BB)) {
+                // not reachable any more
+                BB->clearDomInfo();
+                BB->level = 0;
+                changed.push_back(BB);
+            }
+        }
+
+        // a dominator is always visited before the blocks it dominates
+        std::vector<BasicBlock *> NewSubtree(SemiNCA.vertex.begin() + 2, SemiNCA.vertex.end());
+        for (unsigned I = 2; I < SemiNCA.vertex.size(); ++I) {
+            auto *BB = SemiNCA.vertex[I];
+            if (marks[BB->number] & MarkRegion) {
+                changed.push_back(BB);
+            }
+            BB->dominator = SemiNCA.getIDom(I);
+            BB->level = BB->dominator->level + 1;
+        }
+        std::sort(NewSubtree.begin(), NewSubtree.end(), [](BasicBlock *lhs, BasicBlock *rhs) {
+            return lhs->number < rhs->number;
+        });
+        for (auto *BB: NewSubtree) {
+            BB->dominator->domChildren.push_back(BB);
+        }
+    }
+
+    /**
+     * Only the blocks of the rebuilt subtrees get new frontiers, and the ancestors of the
+     * subtrees only change for the joins whose predecessors changed.
+     */
+    void updateFrontiers(const std::vector<Update> &legal) {
+        clearMarks();
+        std::vector<BasicBlock *> Roots;
+        for (auto *Root: subRoots) {
+            if (isReachable(Root) && !(marks[Root->number] & MarkRoot)) {
+                mark(Root, MarkRoot);
+                Roots.push_back(Root);
+            }
+        }
+        subRoots.clear();
+        // drop the roots below another root, the rest have disjoint subtrees
+        Roots.erase(std::remove_if(Roots.begin(), Roots.end(), [&](BasicBlock *Root) {
+            for (auto *Dom = Root->dominator; Dom; Dom = Dom->dominator) {
+                if (marks[Dom->number] & MarkRoot) {
+                    return true;
+                }
+            }
+            return false;
+        }), Roots.end());
+
+        std::vector<BasicBlock *> Subtree(Roots.begin(), Roots.end());
+        for (size_t I = 0; I < Subtree.size(); ++I) {
+            mark(Subtree[I], MarkNewSubtree);
+            Subtree[I]->domFrontier.clear();
+            for (auto *Child: Subtree[I]->domChildren) {
+                Subtree.push_back(Child);
+            }
+        }
+        std::vector<BasicBlock *> Joins;
+        for (auto *BB: Subtree) {
+            for (auto *Succ: BB->succs()) {
+                if (isReachable(Succ) && Succ->hasMultiplePredecessor() && !(marks[Succ->number] & MarkJoin)) {
+                    mark(Succ, MarkJoin);
+                    Joins.push_back(Succ);
+                }
+            }
+        }
+        for (auto *Join: Joins) {
+            marks[Join->number] &= ~MarkJoin;
+            for (auto *Pred: Join->preds()) {
+                auto *Runner = Pred;
+                while (Runner && Runner != Join->dominator && isKnown(Runner) &&
+                       (marks[Runner->number] & MarkNewSubtree)) {
+                    Runner->domFrontier.push_back(Join);
+                    Runner = Runner->dominator;
+                }
+            }
+        }
+        for (auto *BB: Subtree) {
+            sortFrontier(BB);
+        }
+
+        // The ancestors of a root dominate its whole subtree, so their frontiers only
+        // change with the reachability of the predecessors of the joins outside of it.
+        std::vector<BasicBlock *> OuterJoins;
+        for (auto *Blocks: {&touched, &Subtree}) {
+            for (auto *BB: *Blocks) {
+                for (auto *Succ: BB->succs()) {
+                    if (Succ && isKnown(Succ) && isReachable(Succ) &&
+                        !(marks[Succ->number] & (MarkNewSubtree | MarkJoin))) {
+                        mark(Succ, MarkJoin);
+                        OuterJoins.push_back(Succ);
+                    }
+                }
+            }
+        }
+        touched.clear();
+        for (auto *Join: OuterJoins) {
+            for (auto *Root: Roots) {
+                fixFrontier(Join, Root->dominator);
+            }
+        }
+        // the sources of the edges that don't change the dominators
+        for (auto &Update: legal) {
+            if (isReachable(Update.from) && isReachable(Update.to)) {
+                fixFrontier(Update.to, Update.from);
+            }
+        }
+        clearMarks();
+    }
+
+    ///< Check the join in the frontiers of the dominators from the block.
+    void fixFrontier(BasicBlock *join, BasicBlock *bb) {
+        std::vector<BasicBlock *> Runners;
+        for (auto *Pred: join->preds()) {
+            auto *Runner = Pred;
+            while (Runner && Runner != join->dominator && isKnown(Runner) && isReachable(Runner) &&
+                   !(marks[Runner->number] & MarkRunner)) {
+                mark(Runner, MarkRunner);
+                Runners.push_back(Runner);
+                Runner = Runner->dominator;
+            }
+        }
+        for (auto *Dom = bb; Dom && Dom != join->dominator; Dom = Dom->dominator) {
+            auto &Frontier = Dom->domFrontier;
+            auto Iter = std::lower_bound(Frontier.begin(), Frontier.end(), join, [](BasicBlock *lhs, BasicBlock *rhs) {
+                return lhs->number < rhs->number;
+            });
+            bool Exists = Iter != Frontier.end() && *Iter == join;
+            if ((marks[Dom->number] & MarkRunner) && !Exists) {
+                Frontier.insert(Iter, join);
+            } else if (!(marks[Dom->number] & MarkRunner) && Exists) {
+                Frontier.erase(Iter);
+            }
+        }
+        for (auto *Runner: Runners) {
+            marks[Runner->number] &= ~MarkRunner;
+        }
+    }
+
+    ///< An unreachable block has the reachable join successors as the frontier, like in Dominance.
+    void fixUnreachableFrontiers() {
+        marks.resize(dominance.blocks.size(), 0);
+        auto FixFrontier = [&](BasicBlock *bb) {
+            if (!isKnown(bb) || isReachable(bb) || (marks[bb->number] & MarkFixed)) {
+                return;
+            }
+            mark(bb, MarkFixed);
+            bb->domFrontier.clear();
+            auto *Term = bb->getTerminator();
+            if (!Term) {
+                return;
+            }
+            // an erased target leaves a null operand
+            for (auto &Use: Term->operands()) {
+                auto *Succ = Use.getValue() ? Use.getValue()->as<BasicBlock>() : nullptr;
+                if (Succ && isKnown(Succ) && isReachable(Succ) && Succ->hasMultiplePredecessor() &&
+                    std::find(bb->domFrontier.begin(), bb->domFrontier.end(), Succ) == bb->domFrontier.end()) {
+                    bb->domFrontier.push_back(Succ);
+                }
+            }
+            sortFrontier(bb);
+        };
+        for (auto *BB: changed) {
+            FixFrontier(BB);
+            for (auto *Pred: BB->preds()) {
+                FixFrontier(Pred);
+            }
+        }
+        changed.clear();
+        clearMarks();
+    }
+
+    static void sortFrontier(BasicBlock *bb) {
+        auto &Frontier = bb->domFrontier;
+        std::sort(Frontier.begin(), Frontier.end(), [](BasicBlock *lhs, BasicBlock *rhs) {
+            return lhs->number < rhs->number;
+        });
+        Frontier.erase(std::unique(Frontier.begin(), Frontier.end()), Frontier.end());
+    }
+
+};
+
+
+#endif //DRAGON_DOMTREEUPDATER_H
@@ -5,102 +5,259 @@
 #ifndef DRAGON_DOMINANCE_H
 #define DRAGON_DOMINANCE_H
 
-#include <functional>
-#include <numeric>
+#include <vector>
 #include "PassManager.h"
 #include "Function.h"
 #include "BasicBlock.h"
-class Dominance : public FunctionPass {
+#include "GraphTraversal.h"
+
+using DomTreeWalker = TreeWalker<BasicBlock *, std::vector<BasicBlock *>>;
+
+///< The children of a block in the dominator tree, for the walkers.
+inline std::vector<BasicBlock *> &domChildrenOf(BasicBlock *bb) {
+    return bb->getDomChildren();
+}
+
+///< Visit the edges of the CFG as it is.
+struct CFGView {
+    template<typename Fn>
+    void forEachSucc(BasicBlock *bb, Fn fn) const {
+        for (auto *Succ: bb->succs()) {
+            fn(Succ);
+        }
+    }
+    template<typename Fn>
+    void forEachPred(BasicBlock *bb, Fn fn) const {
+        for (auto *Pred: bb->preds()) {
+            fn(Pred);
+        }
+    }
+};
+
+/**
+ * The Semi-NCA algorithm.
+ * "Finding Dominators in Practice" Loukas Georgiadis, Renato F. Werneck, Robert E. Tarjan.
+ * The DFS is iterative and only descends into the blocks accepted by the filter,
+ * so the same engine builds the whole tree or rebuilds a subtree of it. The edges
+ * are visited through a view, which lets an updater hide the pending CFG updates.
+ * All the tables are vectors indexed by the DFS preorder number and kept between runs.
+ */
+class SemiNCA {
 public:
-    std::set<BasicBlock *> visited;
-    std::vector<BasicBlock *> bbReorder;
-    std::map<BasicBlock *, size_t> bbIndex;
+    std::vector<unsigned> preorder; ///< block number -> DFS preorder number, 0 if not visited
+    std::vector<BasicBlock *> vertex; ///< preorder number -> block, vertex[0] is unused
+    std::vector<unsigned> numbers; ///< preorder number -> block number, the blocks may be erased since the last run
+    std::vector<unsigned> parent; ///< the parent in the DFS tree
+    std::vector<unsigned> semi; ///< the semi-dominator
+    std::vector<unsigned> idom; ///< the immediate dominator
+    std::vector<unsigned> ancestor; ///< the linked forest of eval
+    std::vector<unsigned> label; ///< the vertex with the minimal semi on the compressed path
+    std::vector<std::pair<BasicBlock *, unsigned>> dfsStack;
+    std::vector<unsigned> evalStack;
 
-    void runOnFunction(Function &function) override {
-        visited.clear();
-        bbIndex.clear();
-        bbReorder.clear();
+    ///< numBlocks is the upper bound of the block numbers, only the blocks of the last run are reset.
+    template<typename Filter, typename View = CFGView>
+    void run(BasicBlock *root, unsigned numBlocks, Filter filter, const View &view = View()) {
+        for (auto Number: numbers) {
+            preorder[Number] = 0;
+        }
+        if (preorder.size() < numBlocks) {
+            preorder.resize(numBlocks, 0);
+        }
+        DFS(root, filter, view);
+        compute(view);
+    }
 
-        auto *EntryBlock = function.getEntryBlock();
-        ASSERT(EntryBlock);
-        // compute reverse post order
-        RPO(EntryBlock);
-
-        // compute immediate dominator
-        bool Changed;
-        do {
-            Changed = false;
-            for (auto &BB: iter_reverse(bbReorder)) {
-                BasicBlock *IDom = nullptr;
-                for (auto *Pred: BB->preds()) {
-                    if (IDom == nullptr) {
-                        IDom = Pred;
-                    } else {
-                        IDom = intersect(IDom, Pred);
-                    }
-                }
+    inline bool isVisited(BasicBlock *bb) const {
+        return bb->getNumber() < preorder.size() && preorder[bb->getNumber()] != 0;
+    }
 
-                if (IDom != BB->getDominator()) {
-                    BB->setDominator(IDom);
-                    Changed = true;
-                }
+    ///< The immediate dominator of the vertex, null for the root.
+    inline BasicBlock *getIDom(unsigned v) const {
+        return v > 1 ? vertex[idom[v]] : nullptr;
+    }
 
+private:
+    template<typename Filter, typename View>
+    void DFS(BasicBlock *root, Filter &filter, const View &view) {
+        vertex.assign(1, nullptr);
+        numbers.clear();
+        parent.assign(1, 0);
+        dfsStack.clear();
+        dfsStack.emplace_back(root, 0);
+        while (!dfsStack.empty()) {
+            auto [BB, Parent] = dfsStack.back();
+            dfsStack.pop_back();
+            if (preorder[BB->getNumber()]) {
+                continue;
             }
-        } while (Changed);
-
-        // dominance frontier
-        for (auto &BB: bbReorder) {
-            if (BB->hasMultiplePredecessor()) {
-                for (auto *Pred: BB->preds()) {
-                    auto *Runner = Pred;
-                    while (Runner && Runner != BB->getDominator()) {
-                        Runner->addDomFrontier(BB);
-                        Runner = Runner->getDominator();
-                    }
+            unsigned Number = vertex.size();
+            preorder[BB->getNumber()] = Number;
+            vertex.push_back(BB);
+            numbers.push_back(BB->getNumber());
+            parent.push_back(Parent);
+            view.forEachSucc(BB, [&](BasicBlock *Succ) {
+                if (!preorder[Succ->getNumber()] && filter(Succ)) {
+                    dfsStack.emplace_back(Succ, Number);
                 }
-            }
+            });
         }
+    }
 
-        for (auto &Item : bbReorder) {
-            if (auto *Dom = Item->getDominator()) {
-                Dom->domChildren.insert(Item);
-            }
+    template<typename View>
+    void compute(const View &view) {
+        unsigned Size = vertex.size();
+        semi.resize(Size);
+        idom.resize(Size);
+        label.resize(Size);
+        ancestor.assign(Size, 0);
+        for (unsigned I = 1; I < Size; ++I) {
+            semi[I] = label[I] = I;
+            idom[I] = parent[I];
         }
 
-        // calculate level
-        EntryBlock->calculateLevel();
+        // semi-dominators, in the reverse preorder
+        for (unsigned W = Size - 1; W >= 2; --W) {
+            view.forEachPred(vertex[W], [&](BasicBlock *Pred) {
+                if (Pred->getNumber() >= preorder.size()) {
+                    return;
+                }
+                unsigned V = preorder[Pred->getNumber()];
+                if (V == 0) {
+                    return;
+                }
+                unsigned U = eval(V);
+                if (semi[U] < semi[W]) {
+                    semi[W] = semi[U];
+                }
+            });
+            ancestor[W] = parent[W];
+        }
+
+        // the immediate dominator is the nearest common ancestor of the parent and the semi-dominator
+        for (unsigned W = 2; W < Size; ++W) {
+            unsigned Dom = idom[W];
+            while (Dom > semi[W]) {
+                Dom = idom[Dom];
+            }
+            idom[W] = Dom;
+        }
     }
 
-    void RPO(BasicBlock *bb) {
-        visited.insert(bb);
-        for (auto *Succ: bb->succs()) {
-            if (visited.find(Succ) == visited.end()) {
-                RPO(Succ);
+    unsigned eval(unsigned v) {
+        if (ancestor[v] == 0) {
+            return v;
+        }
+        // path compression, from the top of the path
+        evalStack.clear();
+        for (unsigned U = v; ancestor[ancestor[U]] != 0; U = ancestor[U]) {
+            evalStack.push_back(U);
+        }
+        for (auto Iter = evalStack.rbegin(); Iter != evalStack.rend(); ++Iter) {
+            unsigned U = *Iter;
+            unsigned A = ancestor[U];
+            if (semi[label[A]] < semi[label[U]]) {
+                label[U] = label[A];
             }
+            ancestor[U] = ancestor[A];
         }
-        bbIndex[bb] = bbReorder.size();
-        bbReorder.push_back(bb);
-        bb->clearDomInfo();
+        return label[v];
     }
 
-    BasicBlock *intersect(BasicBlock *b1, BasicBlock *b2) {
-        while (b1 != b2) {
-            while (bbIndex[b1] < bbIndex[b2]) {
-                b1 = b1->dominator;
-                //assert(b1);
-                if (!b1)
-                    return b2;
+};
+
+/**
+ * Build the dominator tree and the dominance frontiers.
+ * The blocks are numbered densely in the function order, so the children
+ * and the frontiers are sorted by the number.
+ * Passes that change the CFG can keep the result valid with a DomTreeUpdater.
+ */
+class Dominance : public FunctionPass {
+public:
+    FunctionPass *clone() const override { return new Dominance(); }
+    bool isAnalysis() const override { return true; }
+    std::vector<BasicBlock *> blocks; ///< block number -> block
+    SemiNCA semiNCA;
+
+    void runOnFunction(Function &function) override {
+        blocks.clear();
+        for (auto &BB: function) {
+            BB.number = blocks.size();
+            BB.clearDomInfo();
+            blocks.push_back(&BB);
+        }
+        auto *EntryBlock = function.getEntryBlock();
+        ASSERT(EntryBlock);
+
+        semiNCA.run(EntryBlock, blocks.size(), [](BasicBlock *) { return true; });
+
+        // immediate dominator and level, a dominator is always visited before the blocks it dominates
+        EntryBlock->level = 0;
+        auto &Vertex = semiNCA.vertex;
+        for (unsigned I = 2; I < Vertex.size(); ++I) {
+            Vertex[I]->dominator = semiNCA.getIDom(I);
+            Vertex[I]->level = Vertex[I]->dominator->level + 1;
+        }
+
+        // the children and the frontiers are filled in the block order, so they are sorted
+        for (auto *BB: blocks) {
+            if (auto *Dom = BB->dominator) {
+                Dom->domChildren.push_back(BB);
+            }
+        }
+        numberTree(EntryBlock);
+        for (auto *BB: blocks) {
+            if (!semiNCA.isVisited(BB) || !BB->hasMultiplePredecessor()) {
+                continue;
             }
-            while (bbIndex[b2] < bbIndex[b1]) {
-                b2 = b2->dominator;
-                //assert(b2);
-                if (!b2)
-                    return b1;
+            for (auto *Pred: BB->preds()) {
+                auto *Runner = Pred;
+                while (Runner && Runner != BB->dominator) {
+                    Runner->addDomFrontier(BB);
+                    Runner = Runner->dominator;
+                }
             }
         }
-        return b1;
     }
 
+    /**
+     * Number the dominator tree in DFS, a block dominates the blocks whose preorder number
+     * falls in its [dfsIn, dfsOut], so BasicBlock::dominates is two compares.
+     */
+    void numberTree(BasicBlock *root) {
+        unsigned Number = 0;
+        treeWalker.walk(root, domChildrenOf, [&](BasicBlock *bb) {
+            bb->dfsIn = ++Number;
+        }, [&](BasicBlock *bb) {
+            bb->dfsOut = Number;
+        });
+    }
+
+    inline bool dominates(BasicBlock *lhs, BasicBlock *rhs) const {
+        return lhs->dominates(rhs);
+    }
+
+    ///< Does the def dominate the user? An instruction doesn't dominate itself.
+    bool dominates(Instruction *def, Instruction *user) const {
+        auto *DefBB = def->getParent(), *UserBB = user->getParent();
+        if (DefBB != UserBB) {
+            return DefBB->dominates(UserBB);
+        }
+        return DefBB->comesBefore(def, user);
+    }
+
+    ///< Does the def dominate the use? The operand of a phi is used at the end of the incoming block.
+    bool dominates(Instruction *def, Use &use) const {
+        auto *User = use.getUser()->cast<Instruction>();
+        if (auto *Phi = User->as<PhiInst>()) {
+            return def->getParent()->dominates(Phi->getIncomingBlock(use));
+        }
+        return dominates(def, User);
+    }
+
+private:
+    DomTreeWalker treeWalker;
+
 };
 
 
@@ -8,6 +8,9 @@
 #include <unordered_map>
 #include <algorithm>
 #include "PassManager.h"
+#include "AnalysisManager.h"
+#include "Dominance.h"
+#include "LoopAnalyse.h"
 #include "Function.h"
 #include "Instruction.h"
 #include "ConstantFolder.h"
@@ -32,26 +35,47 @@ struct VNExprHasher {
 template<typename T>
 using VNTable = std::unordered_map<VNExpr, T, VNExprHasher>;
 
+///< The expressions available in the nested scopes of the dominator tree.
+///< One table for all the scopes, leaving a scope undoes the insertions made in it.
 class VNScope {
 private:
     VNTable<Value *> maps;
-    VNScope *outer = nullptr;
+    std::vector<std::pair<VNExpr, Value *>> undo; ///< the expression and the value it had before
+    std::vector<size_t> marks; ///< the size of the undo log when the scopes were entered
 public:
-    VNScope(VNScope *outer) : outer(outer) {}
+    void enter() {
+        marks.push_back(undo.size());
+    }
 
-    Value *get(BinaryInst *bin) {
-        VNExpr Exp{bin->getLHS(), bin->getRHS(), bin->getOp()};
-        for (auto *Iter = this; Iter; Iter = Iter->outer) {
-            if (Iter->maps.count(Exp)) {
-                return Iter->maps[Exp];
+    void exit() {
+        ASSERT(!marks.empty());
+        for (auto Mark = marks.back(); undo.size() > Mark; undo.pop_back()) {
+            auto &[Exp, Old] = undo.back();
+            if (Old) {
+                maps[Exp] = Old;
+            } else {
+                maps.erase(Exp);
             }
         }
-        return nullptr;
+        marks.pop_back();
+    }
+
+    void clear() {
+        maps.clear();
+        undo.clear();
+        marks.clear();
+    }
+
+    Value *get(BinaryInst *bin) {
+        auto Iter = maps.find(VNExpr{bin->getLHS(), bin->getRHS(), bin->getOp()});
+        return Iter == maps.end() ? nullptr : Iter->second;
     }
 
     void set(BinaryInst *bin, Value *obj) {
         VNExpr Exp{bin->getLHS(), bin->getRHS(), bin->getOp()};
-        maps[Exp] = obj;
+        auto [Iter, Inserted] = maps.try_emplace(Exp, obj);
+        undo.emplace_back(Exp, Inserted ? nullptr : Iter->second);
+        Iter->second = obj;
     }
 
 };
@@ -62,23 +86,36 @@ public:
 
 class GVN : public FunctionPass {
 public:
+    FunctionPass *clone() const override { return new GVN(); }
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses().preserve<Dominance>().preserve<LoopAnalyse>();
+    }
     std::map<Value *, Value *> mapVN;
     std::vector<Instruction *> needToDelete;
+    VNScope scope;
+    DomTreeWalker domWalker;
 
     void runOnFunction(Function &function) override {
         mapVN.clear();
+        scope.clear();
+        getAnalysis<Dominance>(function);
         for (auto &Param : function.getParams()) {
             mapVN[Param.get()] = Param.get();
         }
-        doGVN(function.getEntryBlock());
+        // the expressions of a block are available in its dominator subtree
+        domWalker.walk(function.getEntryBlock(), domChildrenOf, [&](BasicBlock *bb) {
+            scope.enter();
+            doGVN(bb);
+        }, [&](BasicBlock *) {
+            scope.exit();
+        });
         for (auto &Instr : needToDelete) {
             Instr->eraseFromParent();
         }
         needToDelete.clear();
     }
 
-    void doGVN(BasicBlock *bb, VNScope *outer = nullptr) {
-        VNScope Scope(outer);
+    void doGVN(BasicBlock *bb) {
         for (auto &Phi: bb->phis()) {
             if (isMeaningless(&Phi) || isRedundant(bb, &Phi)) {
                 ASSERT(Phi.getOperandNum() > 0);
@@ -103,14 +140,14 @@ public:
                     mapVN[BinOp] = Folder.fold();
                     continue;
                 }
-                if (auto *Res = Scope.get(BinOp)) {
+                if (auto *Res = scope.get(BinOp)) {
                     // Scope中之前已经存在相关表达式 x -> y op z 将x的user都替换为之前计算的结果
                     mapVN[BinOp] = Res;
                     needToDelete.push_back(BinOp);
                 } else {
                     // 不存在 新建一个VN
                     mapVN[BinOp] = BinOp;
-                    Scope.set(BinOp, BinOp);
+                    scope.set(BinOp, BinOp);
                 }
             }
         }
@@ -121,10 +158,6 @@ public:
                 adjustPhiNode(bb, &Phi);
             }
         }
-
-        for (auto &Dom : bb->getDomChildren()) {
-            doGVN(Dom, &Scope);
-        }
     }
 
     inline Value *getVN(Value *v) {
@@ -5,199 +5,231 @@
 #ifndef DRAGON_INLINER_H
 #define DRAGON_INLINER_H
 
+#include <vector>
+#include <unordered_map>
 #include "PassManager.h"
+#include "AnalysisManager.h"
 #include "Function.h"
-
-/*class Inliner : public FunctionPass {
+#include "CallGraph.h"
+#include "ConstantFolder.h"
+
+/**
+ * Inline the calls whose callee is small enough, bottom-up over the components of the call graph,
+ * so a callee has inlined its own calls before it is cloned into its callers.
+ * The cost of a call site is the growth of the caller: the size of the callee, less the call it
+ * saves (the call, the return, and the moves and the saves and restores of the registers around
+ * it), less what the constant arguments fold away. The instructions computed from the constants
+ * are folded, and a conditional branch on a folded condition drops the target it no longer takes.
+ * A call is inlined when its cost is at most Threshold. The calls in the same component and the
+ * recursive callees are never inlined.
+ * The blocks of the callee are cloned between the two halves of the call site block, a ret becomes
+ * a branch to the lower half, where a phi merges the returned values. The allocas are moved to the
+ * entry of the caller.
+ */
+class Inliner : public CallGraphSCCPass {
 public:
-    void runOnFunction(Function *function) override {
-        if (function->isDeclaration()) {
-            return;
-        }
-        std::map<Value *, Value *> ValueMap;
-
-        function->forEach<CallInst>([&](CallInst *inst) {
-            Function *Callee = inst->getCallee();
-            assert(!Callee->isDeclaration());
-
-            // Map the parameters
-            int I = 0;
-            for (auto &Param: Callee->getParams()) {
-                ValueMap[Param.get()] = inst->getArg(I++);
+    static constexpr int Threshold = 16;
+    static constexpr int InstCost = 1;
+    static constexpr int CallPenalty = 5; ///< the call and the return, and the registers saved around them
+
+    void runOnSCC(CallGraph::SCC &scc) override {
+        for (auto *F: scc.functions) {
+            if (F->getEntryBlock() == nullptr) {
+                continue;
+            }
+            std::vector<CallInst *> Calls;
+            F->forEach<CallInst>([&](CallInst *call) {
+                if (shouldInline(call, scc)) {
+                    Calls.push_back(call);
+                }
+            });
+            for (auto *Call: Calls) {
+                doInline(Call);
+            }
+            if (!Calls.empty() && analysis) {
+                analysis->invalidate(*F);
             }
+        }
+    }
 
-            AllocaInst *RetVal = nullptr;
-            if (auto *RetTy = Callee->getReturnType()) {
-                // create alloca to store return value
-                RetVal = new AllocaInst(RetTy);
-                inst->insertBeforeThis(RetVal);
+    bool shouldInline(CallInst *call, CallGraph::SCC &scc) {
+        auto *Callee = call->getCallee();
+        if (Callee == nullptr || Callee->getEntryBlock() == nullptr || scc.contains(Callee) ||
+            callGraph.getSCC(Callee).recursive) {
+            return false;
+        }
+        return getInlineCost(call, Callee) <= Threshold;
+    }
 
-                // replace call site with the load of return value
-                auto *RetLoad = new LoadInst(RetVal);
-                inst->insertAfterThis(RetLoad);
-                inst->replaceAllUsesWith(RetLoad);
+    ///< The growth of the caller if the call is inlined.
+    int getInlineCost(CallInst *call, Function *callee) {
+        int Cost = -CallPenalty - int(call->getArgNum());
+        known.clear();
+        unsigned I = 0;
+        for (auto &Param: callee->getParams()) {
+            if (auto *Const = call->getArg(I++)->as<IntConstant>()) {
+                known[Param.get()] = Const;
             }
-
-            auto *RetBlock = inst->getParent(); // return block
-            auto *CallSiteBlock = RetBlock->split(inst); // upper block
-
-            // Copy blocks and instructions
-            auto CopyBlock = [&](BasicBlock *bb) -> BasicBlock * {
-                auto *NewBB = new BasicBlock(bb->getName() + ".inlined");
-                for (auto &I : *bb) {
-                    if (I.getOpcode() == OpcodeRet) {
-                        auto *Ret = I.cast<RetInst>();
-                        if (!Ret->isVoidRet()) {
-                            assert(RetVal);
-                            NewBB->append(new StoreInst(RetVal, Ret->getRetVal()));
-                        }
-                        NewBB->append(new BranchInst(RetBlock));
-                    } else {
-                        auto *Cloned = I.clone();
-                        ValueMap[&I] = Cloned;
-                        NewBB->append(Cloned);
+        }
+        for (auto &BB: *callee) {
+            for (auto &Inst: BB) {
+                if (auto *Bin = Inst.as<BinaryInst>()) {
+                    if (auto *Folded = fold(Bin)) {
+                        known[Bin] = Folded;
+                        continue;
                     }
                 }
-                return NewBB;
-            };
-            for (auto &BB: Callee->getSubList()) {
-                // Copy every block and insert it after the call site
-                auto *NewBB = CopyBlock(&BB);
-                RetBlock->insertBeforeThis(NewBB);
-                ValueMap[&BB] = NewBB;
-            }
-
-            assert(ValueMap.count(Callee->getEntryBlock()));
-            auto *InlinedEntry = ValueMap[Callee->getEntryBlock()]->cast<BasicBlock>();
-
-            // jump to the entry block of inlined function
-            auto *Br = CallSiteBlock->getTerminator();
-            assert(Br && Br->getOpcode() == OpcodeBr);
-            // TODO: can optimize this?
-            Br->setSuccessor(0, InlinedEntry);
-
-            // replace the value of operands with the mapped value
-            for (auto &BB: iter(Function::iterator(InlinedEntry), Function::iterator(RetBlock))) {
-                for (auto &Inst : BB.getSubList()) {
-                    for (auto &Use: Inst.operands()) {
-                        auto *Value = Use.getValue();
-                        if (ValueMap.count(Value)) {
-                            Use.set(ValueMap[Value]);
-                        }
-                        if (auto *Phi = Use->as<PhiInst>()) {
-                            // replace incoming blocks
-                            for (auto K = 0; K < Phi->getOperandNum(); ++K) {
-                                if (ValueMap.count(Phi->getIncomingBlock(K))) {
-                                    Phi->setIncomingBlock(K, ValueMap[Phi->getIncomingBlock(K)]->cast<BasicBlock>());
-                                }
-                            }
+                if (auto *CondBr = Inst.as<CondBrInst>()) {
+                    auto Iter = known.find(CondBr->getCond());
+                    auto *Cond = Iter == known.end() ? nullptr : Iter->second->as<IntConstant>();
+                    if (Cond) {
+                        auto *Dead = Cond->getVal() ? CondBr->getFalseTarget() : CondBr->getTrueTarget();
+                        if (!Dead->hasMultiplePredecessor()) {
+                            Cost -= getBlockCost(Dead);
                         }
+                        continue;
                     }
                 }
+                Cost += getInstCost(&Inst);
             }
-
-            // erase the call inst
-            inst->eraseFromParent();
-        });
-
+        }
+        return Cost;
     }
-};*/
 
-class Inliner : public FunctionPass {
-public:
-    std::unordered_map<Value *, Value *> valueMap;
-    void runOnFunction(Function &function) override {
-        if (function.isDeclaration()) {
-            return;
+    static int getInstCost(Instruction *inst) {
+        switch (inst->getOpcode()) {
+            case OpcodePhi:
+            case OpcodeAlloca:
+            case OpcodeBr:
+            case OpcodeRet:
+                return 0;
+            default:
+                return InstCost;
         }
-        valueMap.clear();
-        function.forEach<CallInst>([this](CallInst *inst) {
-            doInline(inst);
-        });
     }
 
-    void doInline(CallInst *inst) {
-        Function *Callee = inst->getCallee();
-        ASSERT(!Callee->isDeclaration());
+    static int getBlockCost(BasicBlock *bb) {
+        int Cost = 0;
+        for (auto &Inst: *bb) {
+            Cost += getInstCost(&Inst);
+        }
+        return Cost;
+    }
 
-        // Map the parameters
-        int I = 0;
+    void doInline(CallInst *call) {
+        auto *Callee = call->getCallee();
+        auto *Caller = call->getParent()->getParent();
+        valueMap.clear();
+        unsigned I = 0;
         for (auto &Param: Callee->getParams()) {
-            valueMap[Param.get()] = inst->getArg(I++);
+            valueMap[Param.get()] = call->getArg(I++);
         }
 
-        AllocaInst *RetVal = nullptr;
-        if (auto *RetTy = Callee->getReturnType()) {
-            // create alloca to store return value
-            RetVal = new AllocaInst(RetTy);
-            inst->insertBeforeThis(RetVal);
-
-            // replace call site with the load of return value
-            auto *RetLoad = new LoadInst(RetVal);
-            inst->insertAfterThis(RetLoad);
-            inst->replaceAllUsesWith(RetLoad);
+        auto *RetBlock = call->getParent();
+        auto *CallSiteBlock = RetBlock->split(call);
+        std::vector<BasicBlock *> Blocks;
+        for (auto &BB: *Callee) {
+            auto *NewBB = new BasicBlock(BB.getName() + ".inlined");
+            RetBlock->insertBeforeThis(NewBB);
+            valueMap[&BB] = NewBB;
+            Blocks.push_back(NewBB);
         }
 
-        auto *RetBlock = inst->getParent(); // return block
-        auto *CallSiteBlock = RetBlock->split(inst); // upper block
-
-        // Copy blocks and instructions
-        auto CopyBlock = [&](BasicBlock *bb) -> BasicBlock * {
-            auto *NewBB = new BasicBlock(bb->getName() + ".inlined");
-            for (auto &I : *bb) {
-                if (I.getOpcode() == OpcodeRet) {
-                    auto *Ret = I.cast<RetInst>();
+        // clone the instructions, the rets branch to the lower half
+        auto &Names = Callee->getSymbolTable();
+        std::vector<std::pair<BasicBlock *, Value *>> Returns;
+        std::vector<Instruction *> Allocas;
+        auto BBIter = Blocks.begin();
+        for (auto &BB: *Callee) {
+            auto *NewBB = *BBIter++;
+            for (auto &Inst: BB) {
+                if (auto *Ret = Inst.as<RetInst>()) {
                     if (!Ret->isVoidRet()) {
-                        ASSERT(RetVal);
-                        NewBB->append(new StoreInst(RetVal, Ret->getRetVal()));
+                        Returns.emplace_back(NewBB, Ret->getRetVal());
                     }
                     NewBB->append(new BranchInst(RetBlock));
-                } else {
-                    auto *Cloned = I.clone();
-                    valueMap[&I] = Cloned;
-                    NewBB->append(Cloned);
+                    continue;
+                }
+                auto *Cloned = Inst.clone();
+                NewBB->append(Cloned);
+                if (Names.hasName(&Inst)) {
+                    Cloned->setName(Names.getName(&Inst));
+                }
+                valueMap[&Inst] = Cloned;
+                if (Cloned->isa<AllocaInst>()) {
+                    Allocas.push_back(Cloned);
                 }
             }
-            return NewBB;
-        };
-        for (auto &BB: Callee->getSubList()) {
-            // Copy every block and insert it after the call site
-            auto *NewBB = CopyBlock(&BB);
-            RetBlock->insertBeforeThis(NewBB);
-            valueMap[&BB] = NewBB;
         }
 
-        ASSERT(valueMap.count(Callee->getEntryBlock()));
-        auto *InlinedEntry = valueMap[Callee->getEntryBlock()]->cast<BasicBlock>();
+        // the operands and the incoming blocks of the phis refer to the callee
+        for (auto *BB: Blocks) {
+            for (auto &Inst: *BB) {
+                for (auto &Use: Inst.operands()) {
+                    Use.set(lookup(Use.getValue()));
+                }
+                if (auto *Phi = Inst.as<PhiInst>()) {
+                    for (size_t K = 0; K < Phi->getOperandNum(); ++K) {
+                        Phi->setIncomingBlock(K, lookup(Phi->getIncomingBlock(K))->cast<BasicBlock>());
+                    }
+                }
+            }
+        }
 
-        // jump to the entry block of inlined function
         auto *Br = CallSiteBlock->getTerminator();
         ASSERT(Br && Br->getOpcode() == OpcodeBr);
-        // TODO: can optimize this?
-        Br->setSuccessor(0, InlinedEntry);
+        Br->cast<BranchInst>()->setTarget(Blocks.front());
 
-        // replace the value of operands with the mapped value
-        for (auto &BB: iter(Function::iterator(InlinedEntry), Function::iterator(RetBlock))) {
-            for (auto &Inst : BB.getSubList()) {
-                for (auto &Use: Inst.operands()) {
-                    auto *Value = Use.getValue();
-                    if (valueMap.count(Value)) {
-                        Use.set(valueMap[Value]);
-                    }
-                    if (auto *Phi = Use->as<PhiInst>()) {
-                        // replace incoming blocks
-                        for (auto K = 0; K < Phi->getOperandNum(); ++K) {
-                            if (valueMap.count(Phi->getIncomingBlock(K))) {
-                                Phi->setIncomingBlock(K, valueMap[Phi->getIncomingBlock(K)]->cast<BasicBlock>());
-                            }
-                        }
-                    }
-                }
+        auto *Entry = Caller->getEntryBlock();
+        for (auto Iter = Allocas.rbegin(); Iter != Allocas.rend(); ++Iter) {
+            (*Iter)->getParent()->remove(*Iter);
+            Entry->insertBefore(&*Entry->begin(), *Iter);
+        }
+
+        if (Returns.size() == 1) {
+            call->replaceAllUsesWith(lookup(Returns.front().second));
+        } else if (!Returns.empty()) {
+            for (auto &Return: Returns) {
+                Return.second = lookup(Return.second);
             }
+            auto *Phi = PhiInst::Create(call->getType(), RetBlock, "inline");
+            Phi->fill(Returns);
+            call->replaceAllUsesWith(Phi);
         }
+        call->eraseFromParent();
+    }
 
-        // erase the call inst
-        inst->eraseFromParent();
+private:
+    std::unordered_map<Value *, Value *> valueMap; ///< callee value -> its clone in the caller
+    std::unordered_map<Value *, Value *> known; ///< callee value -> the constant it is at the call site
+
+    Value *lookup(Value *value) {
+        auto Iter = valueMap.find(value);
+        return Iter == valueMap.end() ? value : Iter->second;
+    }
+
+    ///< The constant the binary folds to at the call site, or null.
+    Value *fold(BinaryInst *bin) {
+        auto LIter = known.find(bin->getLHS()), RIter = known.find(bin->getRHS());
+        auto *LHS = LIter == known.end() ? bin->getLHS() : LIter->second;
+        auto *RHS = RIter == known.end() ? bin->getRHS() : RIter->second;
+        if (!ConstantFolder::canFoldBin(LHS, RHS)) {
+            return nullptr;
+        }
+        auto *Divisor = RHS->as<IntConstant>();
+        switch (bin->getOp()) {
+            case Rem:
+                return nullptr;
+            case Div:
+            case Mod:
+                if (Divisor == nullptr || Divisor->getVal() == 0) {
+                    return nullptr;
+                }
+                break;
+            default:
+                break;
+        }
+        return ConstantFolder::foldBin(bin->getOp(), LHS, RHS);
     }
 
 };
@@ -7,38 +7,141 @@
 
 /**
  * Loop invariant code motion.
+ * The loops are done from the inner ones out, so an instruction hoisted to the preheader of an
+ * inner loop is in the body of the outer one and may move again. The blocks of a loop are walked
+ * in the order of the dominator tree, the operands of an instruction are hoisted before it, so an
+ * instruction is invariant once all its operands are defined out of the loop.
+ * The pure instructions are hoisted if they can't trap, a division by a value that may be zero
+ * only if it runs on every iteration. A load is hoisted when no store and no call in the loop may
+ * write its memory, and when it points into an alloca or a global at a constant offset or it runs
+ * on every iteration.
+ * The loops without a preheader get one from LoopSimplify first.
  */
 
+#include <vector>
+#include <algorithm>
 #include "PassManager.h"
 #include "Function.h"
 #include "LoopAnalyse.h"
+#include "LoopSimplify.h"
+#include "AliasAnalysis.h"
 
 class LICM : public LoopPass {
 public:
+    FunctionPass *clone() const override { return new LICM(); }
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses().preserve<Dominance>().preserve<LoopAnalyse>();
+    }
+    void runOnFunction(Function &function) override {
+        LoopSimplify::ensurePreheaders(*this, function);
+        aliasAnalysis.clear();
+        // the inner loops are discovered first
+        for (auto &Loop: function.loops) {
+            runOnLoop(Loop);
+        }
+    }
+
     void runOnLoop(Loop &loop) override {
-        std::vector<Instruction *> Invariants;
         auto *Preheader = loop.getPreheader();
-        for (auto &BB: loop) {
+        if (Preheader == nullptr) {
+            return;
+        }
+        blocks = loop.getBlocks();
+        std::sort(blocks.begin(), blocks.end(), [](BasicBlock *lhs, BasicBlock *rhs) {
+            return lhs->getDFSIn() < rhs->getDFSIn();
+        });
+        stores.clear();
+        hasCalls = false;
+        exiting.clear();
+        for (auto *BB: blocks) {
             for (auto &Inst: *BB) {
-                if (loop.isLoopInvariant(&Inst)) {
-                    Invariants.push_back(&Inst);
+                if (auto *Store = Inst.as<StoreInst>()) {
+                    stores.push_back(Store);
+                } else if (auto *Call = Inst.as<CallInst>()) {
+                    hasCalls = hasCalls || !(Call->getCallee() && Call->getCallee()->isPure());
+                } else if (auto *Vector = Inst.as<VectorInst>()) {
+                    hasCalls = hasCalls || Vector->isMemoryAccess();
+                }
+            }
+            for (auto *Succ: BB->succs()) {
+                if (!loop.contains(Succ)) {
+                    exiting.push_back(BB);
+                    break;
+                }
+            }
+        }
+
+        std::vector<Instruction *> Insts;
+        for (auto *BB: blocks) {
+            Insts.clear();
+            for (auto &Inst: *BB) {
+                Insts.push_back(&Inst);
+            }
+            for (auto *Inst: Insts) {
+                if (canHoist(Inst, loop)) {
+                    Preheader->append(Inst);
                 }
             }
         }
+    }
+
+    ///< A pointer into an alloca or a global at a constant offset can be loaded anywhere.
+    static bool isDereferenceable(Value *ptr) {
+        auto Loc = AliasAnalysis::decompose(ptr);
+        return Loc.hasOffset && AliasAnalysis::isIdentified(Loc.base);
+    }
+
+private:
+    std::vector<BasicBlock *> blocks; ///< the blocks of the loop in the preorder of the dominator tree
+    std::vector<StoreInst *> stores;
+    std::vector<BasicBlock *> exiting; ///< the blocks of the loop with an edge out of it
+    bool hasCalls = false; ///< the loop calls a function that isn't pure or accesses memory by vectors
+    AliasAnalysis aliasAnalysis;
 
-        while (!Invariants.empty()) {
-            auto *Inst = Invariants.back();
-            Invariants.pop_back();
-            /*auto *BB = Inst->getParent();
-            if (Preheader->getTerminator()->getNumSuccessors() == 1) {
-                Preheader->getTerminator()->eraseFromParent();
+    bool canHoist(Instruction *inst, Loop &loop) {
+        if (!loop.hasLoopInvariantOperands(inst)) {
+            return false;
+        }
+        switch (inst->getOpcode()) {
+            case OpcodeBinary: {
+                auto *Bin = inst->cast<BinaryInst>();
+                if (Bin->getOp() != Div && Bin->getOp() != Rem && Bin->getOp() != Mod) {
+                    return true;
+                }
+                auto *Divisor = Bin->getRHS()->as<IntConstant>();
+                return (Divisor && Divisor->getVal() != 0) || isGuaranteedToExecute(inst);
+            }
+            case OpcodeGetPtr:
+            case OpcodeCast:
+            case OpcodeNot:
+            case OpcodeNeg:
+                return true;
+            case OpcodeLoad: {
+                auto *Ptr = inst->cast<LoadInst>()->getPtr();
+                return !mayBeWritten(Ptr) && (isDereferenceable(Ptr) || isGuaranteedToExecute(inst));
             }
-            Inst->moveBefore(Preheader->getTerminator());
-            if (loop.isLoopInvariant(Inst)) {
-                Invariants.push_back(Inst);
-            }*/
+            default:
+                return false;
         }
     }
+
+    bool mayBeWritten(Value *ptr) {
+        if (hasCalls && aliasAnalysis.mayCallAccess(ptr)) {
+            return true;
+        }
+        return std::any_of(stores.begin(), stores.end(), [&](StoreInst *store) {
+            return aliasAnalysis.alias(store->getPtr(), ptr) != AliasResult::NoAlias;
+        });
+    }
+
+    ///< Does the instruction run whenever the loop is entered?
+    bool isGuaranteedToExecute(Instruction *inst) const {
+        auto *BB = inst->getParent();
+        return std::all_of(exiting.begin(), exiting.end(), [&](BasicBlock *exit) {
+            return BB->dominates(exit);
+        });
+    }
+
 };
 
 
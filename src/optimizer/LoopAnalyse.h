@@ -6,51 +6,159 @@
 #define DRAGON_LOOPANALYSE_H
 
 #include "PassManager.h"
+#include "AnalysisManager.h"
+#include "Dominance.h"
 #include "Function.h"
 #include "LoopInfo.h"
+/**
+ * Build the loop nesting forest of the natural loops.
+ * A loop is identified by its header, the back edges of a header are merged into one loop.
+ * The headers are visited in the post order of the dominator tree, so the inner loops are
+ * discovered first and the body walk of an outer loop jumps over them by their headers.
+ * The innermost loop of every block is kept in a vector indexed by the block number.
+ */
 class LoopAnalyse : public FunctionPass {
 public:
+    FunctionPass *clone() const override { return new LoopAnalyse(); }
+    bool isAnalysis() const override { return true; }
+    std::vector<Loop *> innermost; ///< block number -> the innermost loop containing the block
+    std::vector<Loop *> topLevel; ///< the outermost loops
     void runOnFunction(Function &function) override {
-        for (auto &BB: function.getBasicBlockList()) {
-            for (auto *Pred: BB.preds()) {
-                if (BB.dominates(Pred)) {
-                    discover(function.loops.emplace_back(&BB, Pred));
+        auto &Dom = getAnalysis<Dominance>(function);
+        function.loops.clear();
+        innermost.assign(Dom.blocks.size(), nullptr);
+        topLevel.clear();
+        if (function.getEntryBlock() == nullptr) {
+            return;
+        }
+
+        // the post order of the dominator tree, inner headers come before the outer ones
+        std::vector<Loop *> Discovered;
+        postOrder.clear();
+        domWalker.postorder(function.getEntryBlock(), domChildrenOf, [&](BasicBlock *bb) {
+            postOrder.push_back(bb);
+        });
+        for (auto *Header: postOrder) {
+            Loop *Current = nullptr;
+            for (auto *Pred: Header->preds()) {
+                if (isReachable(Pred) && Header->dominates(Pred)) {
+                    if (Current == nullptr) {
+                        Current = &function.loops.emplace_back(Header, Pred);
+                    } else if (std::find(Current->latches.begin(), Current->latches.end(), Pred) == Current->latches.end()) {
+                        Current->latches.push_back(Pred);
+                    }
                 }
             }
+            if (Current) {
+                discover(*Current);
+                Discovered.push_back(Current);
+            }
+        }
+
+        for (auto I = Discovered.rbegin(); I != Discovered.rend(); ++I) {
+            auto *L = *I;
+            L->level = L->parent ? L->parent->level + 1 : 1;
+            if (L->parent == nullptr) {
+                topLevel.push_back(L);
+            }
+            setExitsAndPreheader(*L);
         }
     }
 
+    ///< The innermost loop containing the block, null if it is not in a loop.
+    inline Loop *getLoopFor(BasicBlock *bb) const {
+        auto Number = bb->getNumber();
+        return Number < innermost.size() ? innermost[Number] : nullptr;
+    }
+
+    ///< The nesting depth of the block, 0 if it is not in a loop.
+    inline unsigned getLoopDepth(BasicBlock *bb) const {
+        auto *L = getLoopFor(bb);
+        return L ? L->getLevel() : 0;
+    }
+
+private:
     std::vector<BasicBlock *> cfgWorklist;
+    std::vector<BasicBlock *> postOrder;
+    DomTreeWalker domWalker;
+
+    inline bool isReachable(BasicBlock *bb) const {
+        return bb->getDominator() || bb->getParent()->getEntryBlock() == bb;
+    }
+
+    ///< Outermost loop of the block discovered so far.
+    inline Loop *getOutermost(BasicBlock *bb) const {
+        auto *L = innermost[bb->getNumber()];
+        while (L && L->parent) {
+            L = L->parent;
+        }
+        return L;
+    }
+
     void discover(Loop &loop) {
-        // discover the loop
-        cfgWorklist.push_back(loop.getBackedge());
+        auto *Header = loop.getHeader();
+        innermost[Header->getNumber()] = &loop;
+        // walk the body backward from the latches
+        cfgWorklist = loop.latches;
         while (!cfgWorklist.empty()) {
-            auto *PredBB = cfgWorklist.back();
+            auto *BB = cfgWorklist.back();
             cfgWorklist.pop_back();
-            if (loop.addBlock(PredBB)) {
-                cfgWorklist.insert(cfgWorklist.end(), PredBB->preds_begin(), PredBB->preds_end());
+            if (BB == Header) {
+                continue;
             }
-        }
-
-        // Set the preheader of the loop
-        if (loop.getHeader()->hasOnlyTwoPreds()) {
-            for (auto *Pred : loop.getHeader()->preds()) {
-                if (!loop.contains(Pred)) {
-                    loop.setPreheader(Pred);
+            if (auto *Sub = getOutermost(BB)) {
+                if (Sub == &loop) {
+                    continue;
+                }
+                // a sub loop, continue from the preds of its header outside of it
+                Sub->parent = &loop;
+                loop.subLoops.push_back(Sub);
+                for (auto *Pred: Sub->getHeader()->preds()) {
+                    if (isReachable(Pred) && !Sub->contains(Pred)) {
+                        cfgWorklist.push_back(Pred);
+                    }
                 }
+                continue;
+            }
+            innermost[BB->getNumber()] = &loop;
+            loop.addBlock(BB);
+            for (auto *Pred: BB->preds()) {
+                if (isReachable(Pred)) {
+                    cfgWorklist.push_back(Pred);
+                }
+            }
+        }
+        // the sub loops are complete before their parent
+        for (auto *Sub: loop.subLoops) {
+            for (auto *BB: Sub->blocks) {
+                loop.addBlock(BB);
             }
         }
+    }
 
-        // Set outers of the loop
-        for (auto &BB: loop.blocks) {
+    void setExitsAndPreheader(Loop &loop) {
+        for (auto *BB: loop.blocks) {
             for (auto *Succ: BB->succs()) {
-                if (!loop.contains(Succ)) {
-                    loop.exits.insert(Succ);
+                if (!loop.contains(Succ) &&
+                    std::find(loop.exits.begin(), loop.exits.end(), Succ) == loop.exits.end()) {
+                    loop.exits.push_back(Succ);
                 }
             }
         }
-
-        // Done
+        // the preheader is the only pred outside, and the header is its only successor
+        BasicBlock *Preheader = nullptr;
+        for (auto *Pred: loop.getHeader()->preds()) {
+            if (loop.contains(Pred)) {
+                continue;
+            }
+            if (Preheader && Preheader != Pred) {
+                return;
+            }
+            Preheader = Pred;
+        }
+        if (Preheader && Preheader->getNumSuccessors() == 1) {
+            loop.setPreheader(Preheader);
+        }
     }
 
 };
@@ -59,6 +167,7 @@ class LoopPass : public FunctionPass {
 public:
     virtual void runOnLoop(Loop &loop) = 0;
     void runOnFunction(Function &function) override {
+        getAnalysis<LoopAnalyse>(function);
         for (auto &Loop: function.loops) {
             runOnLoop(Loop);
         }
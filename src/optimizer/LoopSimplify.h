@@ -5,14 +5,52 @@
 #ifndef DRAGON_LOOPSIMPLIFY_H
 #define DRAGON_LOOPSIMPLIFY_H
 
+#include <algorithm>
 #include "PassManager.h"
+#include "AnalysisManager.h"
+#include "DomTreeUpdater.h"
 #include "LoopAnalyse.h"
 
+/**
+ * Give every loop a preheader: a block out of the loop that only jumps to the header and is
+ * its only pred out of the loop. The edges entering the header from out of the loop go to the
+ * new preheader, and the header phis take the values merged there.
+ */
 class LoopSimplify : public LoopPass {
+    DomTreeUpdater *updater = nullptr;
 public:
+    FunctionPass *clone() const override { return new LoopSimplify(); }
+    ///< The preheaders are inserted with the dominator tree kept up to date.
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses().preserve<Dominance>();
+    }
+    void runOnFunction(Function &function) override {
+        getAnalysis<LoopAnalyse>(function);
+        DomTreeUpdater Updater(function, getAnalysis<Dominance>(function));
+        updater = &Updater;
+        for (auto &Loop: function.loops) {
+            runOnLoop(Loop);
+        }
+        Updater.applyUpdates();
+        updater = nullptr;
+    }
+    ///< Give the loops of the function preheaders before the pass transforms them, the loops are analysed again.
+    static void ensurePreheaders(FunctionPass &pass, Function &function) {
+        pass.getAnalysis<LoopAnalyse>(function);
+        if (std::all_of(function.loops.begin(), function.loops.end(), [](Loop &loop) {
+            return loop.getPreheader() != nullptr;
+        })) {
+            return;
+        }
+        LoopSimplify Simplify;
+        Simplify.setAnalysisManager(pass.getAnalysisManager());
+        Simplify.runWithAnalysis(function);
+        pass.getAnalysis<LoopAnalyse>(function);
+    }
+
     void runOnLoop(Loop &loop) override {
         if (auto *Header = loop.getHeader()) {
-            if (!Header->hasMultiplePredecessor()) {
+            if (loop.getPreheader() || !Header->hasMultiplePredecessor()) {
                 return;
             }
             auto *F = Header->getParent();
@@ -20,10 +58,13 @@ public:
             auto *NewPreheader = new BasicBlock(Header->getName() + ".preheader");
             F->insertBefore(Header, NewPreheader);
 
+            std::vector<BasicBlock *> Preds;
             for (auto I = Header->use_begin(); I != Header->use_end(); ) {
                 auto &Use = *I++;
+                // the phis of the exits also use the header as their incoming block
                 if (auto *Instr = Use.getUser()->as<Instruction>()) {
-                    if (!loop.contains(Instr->getParent())) {
+                    if (!loop.contains(Instr->getParent()) && Instr->isTerminator()) {
+                        Preds.push_back(Instr->getParent());
                         Use.set(NewPreheader);
                     }
                 }
@@ -31,6 +72,47 @@ public:
 
             // append branch to loop header
             NewPreheader->append(new BranchInst(Header));
+            updatePhis(loop, NewPreheader);
+            loop.setPreheader(NewPreheader);
+            if (updater) {
+                for (auto *Pred: Preds) {
+                    updater->deleteEdge(Pred, Header);
+                    updater->insertEdge(Pred, NewPreheader);
+                }
+                updater->insertEdge(NewPreheader, Header);
+            }
+        }
+    }
+
+    ///< The incomings from out of the loop are merged in the preheader, by a new phi if they differ.
+    static void updatePhis(Loop &loop, BasicBlock *preheader) {
+        std::vector<std::pair<Value *, BasicBlock *>> Incomings;
+        std::vector<std::pair<BasicBlock *, Value *>> Outside;
+        for (auto &Phi: loop.getHeader()->phis()) {
+            Incomings.clear();
+            Outside.clear();
+            for (size_t I = 0; I < Phi.getOperandNum(); ++I) {
+                auto *BB = Phi.getIncomingBlock(I);
+                if (loop.contains(BB)) {
+                    Incomings.emplace_back(Phi.getOperand(I), BB);
+                } else {
+                    Outside.emplace_back(BB, Phi.getOperand(I));
+                }
+            }
+            if (Outside.empty()) {
+                continue;
+            }
+            Value *Merged = Outside.front().second;
+            for (auto &[BB, Val]: Outside) {
+                if (Val != Merged) {
+                    auto *NewPhi = PhiInst::Create(Phi.getType(), preheader, Phi.getName());
+                    NewPhi->fill(Outside);
+                    Merged = NewPhi;
+                    break;
+                }
+            }
+            Incomings.emplace_back(Merged, preheader);
+            Phi.setIncomings(Incomings);
         }
     }
 };
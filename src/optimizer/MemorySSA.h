@@ -0,0 +1,305 @@
+//
+// Created by Alex on 2022/6/13.
+//
+
+#ifndef DRAGON_MEMORYSSA_H
+#define DRAGON_MEMORYSSA_H
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include "PassManager.h"
+#include "AnalysisManager.h"
+#include "Function.h"
+#include "Dominance.h"
+#include "IDFCalculator.h"
+#include "AliasAnalysis.h"
+
+/**
+ * A def, a use or a phi of the memory. The memory is one variable in SSA form: a store or a call
+ * defines a new version, a load uses the version reaching it.
+ */
+class MemoryAccess {
+    friend class MemorySSA;
+public:
+    enum Kind {
+        Def,
+        Use,
+        Phi,
+    };
+private:
+    Kind kind;
+    unsigned id; ///< 0 is the live on entry def
+    BasicBlock *block;
+    Instruction *inst; ///< null for a phi and the live on entry def
+    MemoryAccess *defining = nullptr; ///< the version used by a use or overwritten by a def
+    std::vector<std::pair<BasicBlock *, MemoryAccess *>> incomings; ///< the versions merged by a phi
+public:
+    MemoryAccess(Kind kind, unsigned id, BasicBlock *block, Instruction *inst) :
+            kind(kind), id(id), block(block), inst(inst) {}
+
+    inline Kind getKind() const { return kind; }
+    inline bool isDef() const { return kind == Def; }
+    inline bool isUse() const { return kind == Use; }
+    inline bool isPhi() const { return kind == Phi; }
+    inline bool isLiveOnEntry() const { return kind == Def && inst == nullptr; }
+    inline unsigned getId() const { return id; }
+    inline BasicBlock *getBlock() const { return block; }
+    inline Instruction *getInst() const { return inst; }
+    inline MemoryAccess *getDefiningAccess() const { return defining; }
+
+    inline const std::vector<std::pair<BasicBlock *, MemoryAccess *>> &getIncomings() const {
+        return incomings;
+    }
+
+    void dumpAsOperand(std::ostream &os) const {
+        if (isLiveOnEntry()) {
+            os << "liveOnEntry";
+        } else {
+            os << id;
+        }
+    }
+
+    void dump(std::ostream &os) const {
+        switch (kind) {
+            case Def:
+                os << id << " = MemoryDef(";
+                defining->dumpAsOperand(os);
+                os << ")";
+                break;
+            case Use:
+                os << "MemoryUse(";
+                defining->dumpAsOperand(os);
+                os << ")";
+                break;
+            case Phi:
+                os << id << " = MemoryPhi(";
+                for (size_t I = 0; I < incomings.size(); ++I) {
+                    os << (I ? ", " : "") << "{";
+                    incomings[I].first->dumpAsOperand(os);
+                    os << ", ";
+                    incomings[I].second->dumpAsOperand(os);
+                    os << "}";
+                }
+                os << ")";
+                break;
+        }
+    }
+};
+
+/**
+ * Memory SSA, the loads, the stores and the calls are linked by the versions of the memory.
+ * The phis are placed at the IDF of the blocks defining the memory and the versions are renamed
+ * in a walk of the dominator tree, like SSAConstructor does for the allocas.
+ * A call of a pure function doesn't access the memory of its caller, other calls are defs.
+ * A vector load is a use and a vector store a def, it clobbers what a call may access.
+ * The walker finds the def that really clobbers a pointer: it skips the defs that don't alias it
+ * and looks through a phi when all its incoming paths reach the same clobber.
+ */
+class MemorySSA : public FunctionPass {
+public:
+    FunctionPass *clone() const override { return new MemorySSA(); }
+    bool isAnalysis() const override { return true; }
+    ///< the phis looked through by one query of the walker, it gives up on the first phi past that
+    static constexpr unsigned WalkLimit = 100;
+
+    void runOnFunction(Function &function) override {
+        auto &Dom = getAnalysis<Dominance>(function);
+        accesses.clear();
+        instAccesses.clear();
+        aliasAnalysis.clear();
+        blockAccesses.assign(Dom.blocks.size(), {});
+        phis.assign(Dom.blocks.size(), nullptr);
+        auto *Entry = function.getEntryBlock();
+        liveOnEntry = create(MemoryAccess::Def, Entry, nullptr);
+
+        std::vector<BasicBlock *> DefBlocks{Entry};
+        for (auto &BB: function) {
+            for (auto &I: BB) {
+                MemoryAccess::Kind Kind;
+                if (!classify(&I, Kind)) {
+                    continue;
+                }
+                auto *MA = create(Kind, &BB, &I);
+                blockAccesses[BB.getNumber()].push_back(MA);
+                instAccesses[&I] = MA;
+                if (Kind == MemoryAccess::Def && DefBlocks.back() != &BB) {
+                    DefBlocks.push_back(&BB);
+                }
+            }
+        }
+
+        std::vector<BasicBlock *> PhiBlocks;
+        idfCalculator.reserve(Dom.blocks.size());
+        idfCalculator.calculate(DefBlocks, PhiBlocks);
+        for (auto *BB: PhiBlocks) {
+            phis[BB->getNumber()] = create(MemoryAccess::Phi, BB, nullptr);
+        }
+
+        // the versions defined in a block are popped after its dominator subtree
+        versions.assign(1, liveOnEntry);
+        marks.clear();
+        domWalker.walk(Entry, domChildrenOf, [&](BasicBlock *bb) {
+            marks.push_back(versions.size());
+            rename(bb);
+        }, [&](BasicBlock *) {
+            versions.resize(marks.back());
+            marks.pop_back();
+        });
+    }
+
+    inline MemoryAccess *getLiveOnEntry() const {
+        return liveOnEntry;
+    }
+
+    ///< The access of a load, a store or a call, null if it doesn't access the memory.
+    inline MemoryAccess *getMemoryAccess(Instruction *inst) const {
+        auto Iter = instAccesses.find(inst);
+        return Iter == instAccesses.end() ? nullptr : Iter->second;
+    }
+
+    inline MemoryAccess *getMemoryPhi(BasicBlock *bb) const {
+        return bb->getNumber() < phis.size() ? phis[bb->getNumber()] : nullptr;
+    }
+
+    ///< The accesses of the block in order, without its phi.
+    inline const std::vector<MemoryAccess *> &getBlockAccesses(BasicBlock *bb) const {
+        return blockAccesses[bb->getNumber()];
+    }
+
+    inline AliasAnalysis &getAliasAnalysis() {
+        return aliasAnalysis;
+    }
+
+    ///< The def clobbering the memory read by the load or overwritten by the store.
+    MemoryAccess *getClobberingAccess(Instruction *inst) {
+        auto *MA = getMemoryAccess(inst);
+        ASSERT(MA);
+        if (auto *Load = inst->as<LoadInst>()) {
+            return getClobberingAccess(MA->defining, Load->getPtr());
+        }
+        if (auto *Store = inst->as<StoreInst>()) {
+            return getClobberingAccess(MA->defining, Store->getPtr());
+        }
+        return MA->defining;
+    }
+
+    ///< The nearest def from start up that may write the pointer, or a phi merging different ones.
+    MemoryAccess *getClobberingAccess(MemoryAccess *start, Value *ptr) {
+        if (start == nullptr) {
+            return nullptr;
+        }
+        MemoryAccess *Found = nullptr, *FirstPhi = nullptr;
+        visitedPhis.clear();
+        walkList.assign(1, start);
+        while (!walkList.empty()) {
+            auto *MA = walkList.back();
+            walkList.pop_back();
+            while (MA->isDef() && !MA->isLiveOnEntry() && !clobbers(MA, ptr)) {
+                MA = MA->defining;
+            }
+            if (MA->isPhi()) {
+                if (FirstPhi == nullptr) {
+                    FirstPhi = MA;
+                }
+                if (visitedPhis.insert(MA).second) {
+                    if (visitedPhis.size() > WalkLimit) {
+                        return FirstPhi;
+                    }
+                    for (auto &[BB, Incoming]: MA->incomings) {
+                        walkList.push_back(Incoming);
+                    }
+                }
+                continue;
+            }
+            if (Found && Found != MA) {
+                return FirstPhi;
+            }
+            Found = MA;
+        }
+        return Found ? Found : FirstPhi;
+    }
+
+    ///< May the def write the memory the pointer points to?
+    bool clobbers(MemoryAccess *def, Value *ptr) {
+        ASSERT(def->isDef());
+        if (def->isLiveOnEntry()) {
+            return true;
+        }
+        if (auto *Store = def->inst->as<StoreInst>()) {
+            return aliasAnalysis.alias(Store->getPtr(), ptr) != AliasResult::NoAlias;
+        }
+        return aliasAnalysis.mayCallAccess(ptr);
+    }
+
+    void dump(std::ostream &os) {
+        for (auto &MA: accesses) {
+            MA->dump(os);
+            os << std::endl;
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<MemoryAccess>> accesses;
+    std::unordered_map<Instruction *, MemoryAccess *> instAccesses;
+    std::vector<std::vector<MemoryAccess *>> blockAccesses; ///< block number -> the accesses in order
+    std::vector<MemoryAccess *> phis; ///< block number -> the phi of the block
+    MemoryAccess *liveOnEntry = nullptr;
+    AliasAnalysis aliasAnalysis;
+    IDFCalculator idfCalculator;
+    DomTreeWalker domWalker;
+    std::vector<MemoryAccess *> versions; ///< the stack of the versions in the renaming
+    std::vector<size_t> marks;
+    std::vector<MemoryAccess *> walkList;
+    std::unordered_set<MemoryAccess *> visitedPhis;
+
+    MemoryAccess *create(MemoryAccess::Kind kind, BasicBlock *bb, Instruction *inst) {
+        accesses.push_back(std::make_unique<MemoryAccess>(kind, accesses.size(), bb, inst));
+        return accesses.back().get();
+    }
+
+    static bool classify(Instruction *inst, MemoryAccess::Kind &kind) {
+        switch (inst->getOpcode()) {
+            case OpcodeStore:
+                kind = MemoryAccess::Def;
+                return true;
+            case OpcodeLoad:
+                kind = MemoryAccess::Use;
+                return true;
+            case OpcodeCall: {
+                auto *Callee = inst->cast<CallInst>()->getCallee();
+                kind = MemoryAccess::Def;
+                return !(Callee && Callee->isPure());
+            }
+            case OpcodeVector: {
+                auto *Vector = inst->cast<VectorInst>();
+                kind = Vector->getVectorOp() == VectorOp::Load ? MemoryAccess::Use : MemoryAccess::Def;
+                return Vector->isMemoryAccess();
+            }
+            default:
+                return false;
+        }
+    }
+
+    void rename(BasicBlock *bb) {
+        if (auto *Phi = phis[bb->getNumber()]) {
+            versions.push_back(Phi);
+        }
+        for (auto *MA: blockAccesses[bb->getNumber()]) {
+            MA->defining = versions.back();
+            if (MA->isDef()) {
+                versions.push_back(MA);
+            }
+        }
+        for (auto *Succ: bb->succs()) {
+            if (auto *Phi = phis[Succ->getNumber()]) {
+                Phi->incomings.emplace_back(bb, versions.back());
+            }
+        }
+    }
+
+};
+
+
+#endif //DRAGON_MEMORYSSA_H
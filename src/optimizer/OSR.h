@@ -5,35 +5,64 @@
 #ifndef DRAGON_OSR_H
 #define DRAGON_OSR_H
 
+#include <map>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
 #include "PassManager.h"
+#include "AnalysisManager.h"
+#include "Dominance.h"
+#include "LoopAnalyse.h"
+#include "ScalarEvolution.h"
+#include "GraphTraversal.h"
 #include "BasicBlock.h"
 #include "Instruction.h"
+#include "ConstantFolder.h"
 #include "GVN.h"
 
 struct SCCInfo {
-    unsigned num = 0;
-    unsigned low = 0;
-    bool instack = false;
-    bool visited = false;
-    Instruction *header = nullptr;
+    Instruction *header = nullptr; ///< the header phi of the induction variable, null if it isn't one
 };
 
+///< An induction variable reduced to `IV op RC`, the edges followed by the test replacement.
 struct ReduceInfo {
-    Opcode opcode = OpcodeNop;
-    Value *IV = nullptr;
+    BinaryOp op = BinNone;
     Value *RC = nullptr;
-    ReduceInfo *outer = nullptr;
+    Instruction *reduced = nullptr;
 
-    ReduceInfo(Opcode opcode, Value *iv, Value *rc, ReduceInfo *outer) : opcode(opcode), IV(iv), RC(rc), outer(outer) {}
-    ReduceInfo(Opcode opcode, Value *iv, Value *rc) : opcode(opcode), IV(iv), RC(rc) {}
+    ReduceInfo(BinaryOp op, Value *rc, Instruction *reduced) : op(op), RC(rc), reduced(reduced) {}
 };
 
+/**
+ * Operator Strength Reduction, "Operator Strength Reduction" Keith D. Cooper, L. Taylor Simpson,
+ * Christopher A. Vick.
+ * The SSA graph is walked by Tarjan's algorithm, the SCCs come out with their operands before them.
+ * An SCC of phis and of adds and subs of region constants is an induction variable, its header is
+ * the phi dominating the others. Any other instruction `IV * RC`, `IV + RC` or `IV - RC` is replaced
+ * by a new induction variable computing it: the SCC of the IV is copied with the initial values and,
+ * for a multiplication, the steps scaled by the RC. The copies are hash-consed by the IV, the RC and
+ * the op, so `i * n + j` of nested loops becomes one add per iteration of each loop.
+ * Then the linear function test replacement rewrites a compare of an IV with a region constant into
+ * a compare of its reduced value, and the IVs only used by themselves are removed. A multiplication
+ * is only followed by a positive constant, which keeps the order of the compare. The reduced IV steps
+ * on every iteration, not only while the compare holds, so an edge is only followed when the bound
+ * and every value the IV takes are reduced within i32. The values come from the scalar evolution of
+ * the IV, a recurrence with a constant start and step in a loop with a constant trip count.
+ */
 class OSR : public FunctionPass {
 public:
+    FunctionPass *clone() const override { return new OSR(); }
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses().preserve<Dominance>().preserve<LoopAnalyse>();
+    }
     std::map<Instruction *, SCCInfo> mapSCCInfo;
-    std::vector<Instruction *> stack;
+    TarjanSCC<Instruction *, IterRange<Use *>> tarjan;
     std::vector<Instruction *> group;
-    std::vector<Instruction *> worklist;
+    std::vector<Instruction *> dead; ///< the replaced instructions, erased at the end
+    std::unordered_map<Instruction *, std::vector<Instruction *>> inductions; ///< header -> the members
+    std::unordered_map<Instruction *, std::vector<ReduceInfo>> reduces; ///< the edges of LFTR
+    std::unordered_map<Instruction *, std::pair<int64_t, int64_t>> ranges; ///< the compared IV -> its min and max
 
     /***
      * 归纳变量属于在SSA图中的一个强连通分量(SCC), 即忽略掉下面的a_1, 存在一个环路
@@ -42,135 +71,102 @@ public:
      * t_0 = a_0 + 1;
      * a_2 = t_0;
      */
-    unsigned nextNum = 0;
     void DFS(Instruction *Inst) {
-        auto &Info = mapSCCInfo[Inst];
-        if (Info.visited) {
-            return;
-        }
-        Info.num = nextNum++;
-        Info.low = Info.num;
-        Info.visited = true;
-        Info.instack = true;
-        stack.push_back(Inst);
-        for (auto &Op : Inst->operands()) {
-            if (auto *Var = Op->as<Instruction>()) {
-                auto &Cur = mapSCCInfo[Var];
-                if (!Cur.visited) {
-                    DFS(Var);
-                    Info.low = std::min(Cur.low, Info.low);
-                }
-                // 发现先前已经在栈中的子图的num比自己小, 设置当前的low为栈中的num, 表示分在了同一组中
-                if (Cur.instack && Cur.num < Info.num) {
-                    Info.low = std::min(Cur.num, Info.low);
-                }
-            }
-        }
-
-        if (Info.num == Info.low) {
-            Instruction *Cur;
-            do {
-                Cur = stack.back();
-                stack.pop_back();
-                group.push_back(Cur);
-                mapSCCInfo[Cur].header = Inst;
-                mapSCCInfo[Cur].instack = false;
-            } while (Cur != Inst);
+        // the operands are the edges of the SSA graph
+        tarjan.run(Inst, [](Instruction *inst) {
+            return inst->operands();
+        }, [](Use &op) {
+            return op->as<Instruction>();
+        }, [&](const std::vector<Instruction *> &members, Instruction *root) {
+            group = members;
             classify();
             group.clear();
-        }
+        });
     }
 
     void classify() {
-        //dump();
-        if (group.size() == 1) {
-            auto &Cur = group.back();
+        if (group.size() > 1 && collect()) {
+            return;
+        }
+        for (auto *Cur: group) {
+            mapSCCInfo[Cur].header = nullptr;
+        }
+        for (auto *Cur: group) {
             Value *IV, *RC;
             if (isCandidateOperation(Cur, IV, RC)) {
-                worklist.push_back(Cur);
-                mapSCCInfo[Cur].header = getOperandHeader(IV);
-            } else {
-                mapSCCInfo[Cur].header = nullptr;
+                doReplace(Cur, IV, RC);
             }
-        } else {
-            collect();
         }
     }
 
     /**
      * 收集归纳变量
-     * 1. phi只能有1个
-     * 2. 只能包含加法减法操作, 并且减法的右操作数不能是归纳变量
-     * 3. 加法/减法的另外一个操作数必须是循环不变量
+     * 1. 头部是支配其他成员的phi
+     * 2. 只能包含phi, 加法减法操作, 并且减法的右操作数不能是归纳变量
+     * 3. 其他操作数必须是区域常量
      */
-    void collect() {
-        Instruction *header = nullptr;
-        bool isInd = true;
-        for (auto &item : group) {
-            auto &Cur = mapSCCInfo[item];
-            switch (item->getOpcode()) {
-                case OpcodePhi:
-                    if (!header) {
-                        header = item;
-                    } else {
-                        isInd = false;
-                        goto leave;
-                    }
-                case OpcodeBinary:
-                    ASSERT(item->getOperandNum() > 1);
-                    if (getOperandHeader(item->getOperand(1)) == Cur.header) {
-                        // i = c - i 这种不属于归纳变量
-                        isInd = false;
-                        goto leave;
-                    }
-                    break;
-                default:
-                    isInd = false;
-                    goto leave;
+    bool collect() {
+        Instruction *Header = nullptr;
+        for (auto *Cur: group) {
+            if (Cur->isa<PhiInst>() && (!Header || Cur->getParent()->getDFSIn() < Header->getParent()->getDFSIn())) {
+                Header = Cur;
             }
         }
-        leave:
-        if (!isInd) {
-            for (auto &Inst : group) {
-                Value *IV, *RC;
-                if (isCandidateOperation(Inst, IV, RC)) {
-                    worklist.push_back(Inst);
-                    doReplace(Inst, IV, RC);
-                    mapSCCInfo[Inst].header = getOperandHeader(IV);
-                } else {
-                    mapSCCInfo[Inst].header = nullptr;
+        if (!Header || !Header->getType()->isIntegerType() || !Header->getParent()->getDominator()) {
+            return false;
+        }
+        for (auto *Cur: group) {
+            mapSCCInfo[Cur].header = Header;
+        }
+        auto IsMember = [&](Value *op) {
+            return getOperandHeader(op) == Header;
+        };
+        for (auto *Cur: group) {
+            if (!Header->getParent()->dominates(Cur->getParent())) {
+                return false;
+            }
+            if (Cur->isa<PhiInst>()) {
+                for (auto &Use: Cur->operands()) {
+                    if (!IsMember(Use.getValue()) && !isRC(Use.getValue(), Header)) {
+                        return false;
+                    }
                 }
+                continue;
+            }
+            auto *Bin = Cur->as<BinaryInst>();
+            if (!Bin || (Bin->getOp() != Add && Bin->getOp() != Sub)) {
+                return false;
+            }
+            // i = c - i 这种不属于归纳变量
+            bool LHS = IsMember(Bin->getLHS()), RHS = IsMember(Bin->getRHS());
+            if (!((LHS && !RHS && isRC(Bin->getRHS(), Header)) ||
+                  (!LHS && RHS && Bin->getOp() == Add && isRC(Bin->getLHS(), Header)))) {
+                return false;
             }
         }
+        inductions[Header] = group;
+        return true;
     }
 
     /**
      * 是否为归纳变量
      */
     bool isIV(Value *Op) {
-        auto *Var = Op->as<Instruction>();
-        if (Var) {
-            auto &Info = mapSCCInfo[Var];
-            return Info.header;
-        }
-        return false;
+        return getOperandHeader(Op) != nullptr;
     }
 
     /**
      * 是否为区域常量/循环不变量
      */
-    bool isRC(Value *Op, Instruction *Inst) {
+    bool isRC(Value *Op, Instruction *Header) {
         // Op定义所在的CFG严格支配IV的header所在的CFG即为区域常量
         if (auto *Var = Op->as<Instruction>()) {
             auto *Def = Var->getParent();
-            auto *Cur = Inst->getParent();
+            auto *Cur = Header->getParent();
             ASSERT(Def && Cur);
-            // FIXME: problem?
-            return Def->dominates(Cur);
-        } else if (Op->as<Constant>()) {
-            return true;
+            return Def != Cur && Def->dominates(Cur);
         }
-        return false;
+        return Op->isa<Constant>() || Op->isa<Param>();
     }
 
     /**
@@ -181,48 +177,40 @@ public:
      * x = IV ± RC
      */
     bool isCandidateOperation(Instruction *Inst, Value *&IV, Value *&RC) {
-        if (Inst->getOperandNum() < 2) {
+        auto *Bin = Inst->as<BinaryInst>();
+        if (!Bin || !Bin->getType()->isIntegerType()) {
             return false;
         }
-        Value *Op1 = Inst->getOperand(0);
-        Value *Op2 = Inst->getOperand(1);
-
-        if (auto *Bin = Inst->as<BinaryInst>()) {
-            if (Bin->getOp() == BinaryOp::Mul || Bin->getOp() == BinaryOp::Add) {
-                if (isIV(Op1) && isRC(Op2, getOperandHeader(Op1))) {
-                    IV = Op1;
-                    RC = Op2;
-                    return true;
-                }
-                if (isIV(Op2) && isRC(Op1, getOperandHeader(Op2))) {
-                    IV = Op2;
-                    RC = Op1;
-                    return true;
-                }
+        Value *Op1 = Bin->getLHS();
+        Value *Op2 = Bin->getRHS();
+        if (Bin->getOp() == BinaryOp::Mul || Bin->getOp() == BinaryOp::Add || Bin->getOp() == BinaryOp::Sub) {
+            if (isIV(Op1) && isRC(Op2, getOperandHeader(Op1))) {
+                IV = Op1;
+                RC = Op2;
+                return true;
             }
-            if (Bin->getOp() == BinaryOp::Sub) {
-                if (isIV(Op1) && isRC(Op2, getOperandHeader(Op1))) {
-                    IV = Op1;
-                    RC = Op2;
-                    return true;
-                }
+            if (Bin->getOp() != BinaryOp::Sub && isIV(Op2) && isRC(Op1, getOperandHeader(Op2))) {
+                IV = Op2;
+                RC = Op1;
+                return true;
             }
         }
         return false;
     }
+
     Instruction *getOperandHeader(Value *Op) {
         if (auto *Var = Op->as<Instruction>()) {
-            return mapSCCInfo[Var].header;
+            auto Iter = mapSCCInfo.find(Var);
+            return Iter == mapSCCInfo.end() ? nullptr : Iter->second.header;
         }
         return nullptr;
     }
 
     // 将指令替换为强度削弱后的指令
     void doReplace(Instruction *Inst, Value *IV, Value *RC) {
-        if (auto *Bin = Inst->as<BinaryInst>()) {
-            auto *NewInst = doReduce(Bin->getOp(), IV, RC);
-            Bin->replaceAllUsesWith(NewInst);
-        }
+        auto *NewInst = doReduce(Inst->cast<BinaryInst>()->getOp(), IV, RC);
+        Inst->replaceAllUsesWith(NewInst);
+        dead.push_back(Inst);
     }
 
     // 记录强度削减后的表达式
@@ -238,71 +226,260 @@ public:
         if (iter != ReduceTable.end()) {
             return iter->second;
         }
-        auto *New = IV->cast<Instruction>()->clone();
+        auto *Inst = IV->cast<Instruction>();
         auto *IVHeader = getOperandHeader(IV);
-        mapSCCInfo[New].header = IVHeader;
+        Instruction *New;
+        if (Inst->isa<PhiInst>()) {
+            New = PhiInst::Create(Inst->getType(), Inst->getParent(), "osr");
+        } else {
+            auto *Bin = Inst->cast<BinaryInst>();
+            New = BinaryInst::Create(Bin->getOp(), Bin->getLHS(), Bin->getRHS());
+            Inst->getParent()->insertAfter(Inst, New);
+            New->setName("osr");
+        }
         ReduceTable[entry] = New;
-        for (auto &Use : New->operands()) {
-            /**
-             * i_2 = i_1 + 1
-             * i_1 = phi (0, i_2)
-             * 首先对归纳变量i_0所在的SCC递归的Clone出一个新的操作直到遇到Phi
-             * 遇到i_1的时候会复制 i_1 = phi(0, i_2) 这个语句
-             * 当遇到区域常量操作数我们应用doApply将归纳变量的递增大小按照RC扩大
-             * 如遇到1的时候应用doApply, 将常数变为4, 如果遇到的不是常数则可以生成 x = y * rc指令进行扩大
-             */
-            auto *Op = Use.getValue();
-            auto *OpHeader = getOperandHeader(Op);
-            if (OpHeader == IVHeader) {
-                Use.set(doReduce(opcode, Op, RC));
-            } else if (opcode == BinaryOp::Mul || New->getOpcode() == OpcodePhi) {
-                // 当复制的语句为Phi节点时, 而且当前的操作数不是SCC中的节点, 说明为初始值, 也需要调用doApply进行范围扩大
-                // 当遇到的需要进行削减的是乘法指令并且操作数是另外一个归纳变量
-                // a_0 = i_1 * 4  ==> IV = i_1,  RC = 4,  Opcode = Mul
-                // i_1 = phi (0, i_2)
-                // i_2 = i_1 + f_2
-                // 如果此时f_2为归纳变量则需要递归调用doReduce使用RC进行扩大
-                if (OpHeader) {
-                    // 此时的Op属于另外一个归纳变量
-                    Op = doReduce(opcode, Op, RC);
-                } else {
-                    Op = doApply(New, opcode, Op, RC);
+        reduces[Inst].emplace_back(opcode, RC, New);
+        // 新的SCC的头部是IV头部的副本
+        auto *NewHeader = Inst == IVHeader ? New : doReduce(opcode, IVHeader, RC);
+        mapSCCInfo[New].header = NewHeader;
+        inductions[NewHeader].push_back(New);
+        /**
+         * i_2 = i_1 + 1
+         * i_1 = phi (0, i_2)
+         * 首先对归纳变量i_0所在的SCC递归的Clone出一个新的操作直到遇到Phi
+         * 遇到i_1的时候会复制 i_1 = phi(0, i_2) 这个语句
+         * 当遇到区域常量操作数我们应用doApply将归纳变量的递增大小按照RC扩大
+         * 如遇到1的时候应用doApply, 将常数变为4, 如果遇到的不是常数则可以生成 x = y * rc指令进行扩大
+         * Phi的初始值在对应的前驱末尾计算, 递增值在IV头部的支配节点末尾计算
+         */
+        if (auto *Phi = Inst->as<PhiInst>()) {
+            std::vector<std::pair<BasicBlock *, Value *>> Incomings;
+            for (size_t I = 0; I < Phi->getOperandNum(); ++I) {
+                auto *Op = Phi->getOperand(I);
+                auto *BB = Phi->getIncomingBlock(I);
+                Incomings.emplace_back(BB, getOperandHeader(Op) == IVHeader ? doReduce(opcode, Op, RC) :
+                                           doApply(BB, opcode, Op, RC));
+            }
+            New->cast<PhiInst>()->fill(Incomings);
+        } else {
+            for (size_t I = 0; I < New->getOperandNum(); ++I) {
+                auto *Op = New->getOperand(I);
+                if (getOperandHeader(Op) == IVHeader) {
+                    New->setOperand(I, doReduce(opcode, Op, RC));
+                } else if (opcode == BinaryOp::Mul) {
+                    New->setOperand(I, doApply(IVHeader->getParent()->getDominator(), opcode, Op, RC));
                 }
-                Use.set(Op);
             }
         }
         return New;
     }
 
-    Value *doApply(Instruction *Inst, BinaryOp opcode, Value *Left, Value *RC) {
+    ///< Compute `Left op RC` at the end of the block, an induction variable is reduced again.
+    Value *doApply(BasicBlock *Where, BinaryOp opcode, Value *Left, Value *RC) {
+        if (ConstantFolder::canFoldBin(Left, RC)) {
+            return ConstantFolder::foldBin(opcode, Left, RC);
+        }
+        auto IsInt = [](Value *val, int64_t num) {
+            auto *Const = val->as<IntConstant>();
+            return Const && Const->getVal() == num;
+        };
+        if ((opcode != BinaryOp::Mul && IsInt(RC, 0)) || (opcode == BinaryOp::Mul && IsInt(RC, 1))) {
+            return Left;
+        }
+        if ((opcode == BinaryOp::Add && IsInt(Left, 0)) || (opcode == BinaryOp::Mul && IsInt(Left, 1))) {
+            return RC;
+        }
+        if (opcode == BinaryOp::Mul && (IsInt(Left, 0) || IsInt(RC, 0))) {
+            return Where->getContext()->getInt(0);
+        }
+        if (isIV(Left) && isRC(RC, getOperandHeader(Left))) {
+            return doReduce(opcode, Left, RC);
+        }
+        if (isCommutative(opcode) && isIV(RC) && isRC(Left, getOperandHeader(RC))) {
+            return doReduce(opcode, RC, Left);
+        }
         auto entry = VNExpr{Left, RC, opcode};
         auto iter = ReduceTable.find(entry);
-        if (iter != ReduceTable.end()) {
+        if (iter != ReduceTable.end() && iter->second->getParent()->dominates(Where)) {
             return iter->second;
         }
-        ConstantFolder folder(opcode, Left, RC);
-        if (auto *Res = folder.fold()) {
-            return Res;
-        }
         auto *Res = BinaryInst::Create(opcode, Left, RC);
         ReduceTable[entry] = Res;
-        auto *Dom = Inst->getParent()->getDominator();
-        ASSERT(Dom);
-        Dom->append(Res);
+        Where->append(Res);
+        Res->setName("osr");
         return Res;
     }
 
+    ///< `val op RC` for a constant RC, false if the RC isn't one or the result wraps around i32.
+    static bool applyInt32(BinaryOp op, int64_t &val, Value *RC) {
+        auto *Const = RC->as<IntConstant>();
+        if (!Const) {
+            return false;
+        }
+        val = op == BinaryOp::Mul ? val * Const->getVal() :
+              op == BinaryOp::Add ? val + Const->getVal() : val - Const->getVal();
+        return val >= INT32_MIN && val <= INT32_MAX;
+    }
+
+    ///< Record the values of the IVs compared before the IR changes, `{start,+,step}` takes the values
+    ///< from start to `start + step * trip count` in the loop, and the last one after it.
+    void collectRanges(Function &function, ScalarEvolution &SE) {
+        function.forEach<BinaryInst>([&](BinaryInst *Cmp) {
+            if (Cmp->getOp() < BinaryOp::Eq || Cmp->getOp() > BinaryOp::Ge) {
+                return;
+            }
+            for (auto &Use: Cmp->operands()) {
+                auto *IV = Use.getValue()->as<Instruction>();
+                auto *Rec = IV ? SE.getSCEV(IV) : nullptr;
+                int64_t Count;
+                if (!Rec || !Rec->isAddRec() || !Rec->getStart()->isConstant() || !Rec->getStep()->isConstant() ||
+                    !SE.getConstantTripCount(Rec->getLoop(), Count)) {
+                    continue;
+                }
+                int64_t First = Rec->getStart()->getConstant();
+                int64_t Last = First + Rec->getStep()->getConstant() * Count;
+                ranges[IV] = std::minmax(First, Last);
+            }
+        });
+    }
+
+    ///< The reduction a compare of the IV with the bound may use instead, null if there is none.
+    ///< The bound and the range of the IV must be reduced without overflow, the range is reduced too.
+    ReduceInfo *getTestEdge(Instruction *IV, Value *bound, std::pair<int64_t, int64_t> &range) {
+        auto Iter = reduces.find(IV);
+        auto *Bound = bound->as<IntConstant>();
+        if (Iter == reduces.end() || !Bound) {
+            return nullptr;
+        }
+        for (auto &Info: Iter->second) {
+            auto *Const = Info.RC->as<IntConstant>();
+            if (Info.op == BinaryOp::Mul && !(Const && Const->getVal() > 0)) {
+                continue;
+            }
+            int64_t Val = Bound->getVal(), Min = range.first, Max = range.second;
+            if (applyInt32(Info.op, Val, Info.RC) && applyInt32(Info.op, Min, Info.RC) &&
+                applyInt32(Info.op, Max, Info.RC)) {
+                range = {Min, Max};
+                return &Info;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * 线性函数测试替换(LFTR)
+     * i < n 沿着削减的边替换为 i * 4 + 1 < n * 4 + 1, 只有常量的n和取值范围已知的i不会溢出
+     */
+    void replaceTests(Function &function) {
+        function.forEach<BinaryInst>([&](BinaryInst *Cmp) {
+            if (Cmp->getOp() < BinaryOp::Eq || Cmp->getOp() > BinaryOp::Ge) {
+                return;
+            }
+            for (size_t I = 0; I < 2; ++I) {
+                auto *IV = Cmp->getOperand(I)->as<Instruction>();
+                auto *Bound = Cmp->getOperand(1 - I);
+                auto *Header = IV ? getOperandHeader(IV) : nullptr;
+                if (!Header || !isRC(Bound, Header)) {
+                    continue;
+                }
+                auto Range = ranges.find(IV);
+                if (Range == ranges.end()) {
+                    break;
+                }
+                auto *Where = Header->getParent()->getDominator();
+                auto *Cur = IV;
+                while (auto *Edge = getTestEdge(Cur, Bound, Range->second)) {
+                    Bound = doApply(Where, Edge->op, Bound, Edge->RC);
+                    Cur = Edge->reduced;
+                }
+                if (Cur != IV) {
+                    Cmp->setOperand(I, Cur);
+                    Cmp->setOperand(1 - I, Bound);
+                }
+                break;
+            }
+        });
+    }
+
+    ///< Remove the induction variables only used by themselves, in program order until nothing changes,
+    ///< since an induction may only be used by the ones removed.
+    void removeDeadInductions(Function &function) {
+        std::vector<Instruction *> Headers;
+        function.forEach([&](Instruction *inst) {
+            if (inductions.count(inst)) {
+                Headers.push_back(inst);
+            }
+        });
+        bool Changed = true;
+        while (Changed) {
+            Changed = false;
+            for (auto &Header: Headers) {
+                if (Header && removeIfDead(Header, inductions[Header])) {
+                    Header = nullptr;
+                    Changed = true;
+                }
+            }
+        }
+    }
+
+    ///< Remove the members of the induction if they are only used by themselves.
+    bool removeIfDead(Instruction *header, std::vector<Instruction *> &members) {
+        bool IsDead = std::all_of(members.begin(), members.end(), [&](Instruction *member) {
+            for (auto &Use: member->getUses()) {
+                if (getOperandHeader(Use.getUser()) != header) {
+                    return false;
+                }
+            }
+            return true;
+        });
+        if (!IsDead) {
+            return false;
+        }
+        for (auto *Member: members) {
+            if (auto *Phi = Member->as<PhiInst>()) {
+                while (Phi->getOperandNum()) {
+                    Phi->removeIncoming(size_t(0));
+                }
+            } else {
+                for (auto &Use: Member->operands()) {
+                    Use.set(nullptr);
+                }
+            }
+        }
+        for (auto *Member: members) {
+            Member->eraseFromParent();
+        }
+        return true;
+    }
+
     void runOnFunction(Function &function) override {
+        if (function.getEntryBlock() == nullptr) {
+            return;
+        }
+        getAnalysis<Dominance>(function);
+        collectRanges(function, getAnalysis<ScalarEvolution>(function));
+        tarjan.clear();
+        // the new instructions are not walked
+        std::vector<Instruction *> Insts;
         function.forEach([&](Instruction *Inst) {
-            DFS(Inst);
+            Insts.push_back(Inst);
         });
-        for (auto *Cur : worklist) {
-            Value *IV, *RC;
-            if (isCandidateOperation(Cur, IV, RC)) {
-                doReplace(Cur, IV, RC);
-            }
+        for (auto *Inst: Insts) {
+            DFS(Inst);
+        }
+        for (auto *Inst: dead) {
+            mapSCCInfo.erase(Inst);
+            ranges.erase(Inst);
+            Inst->eraseFromParent();
         }
-        worklist.clear();
+        replaceTests(function);
+        removeDeadInductions(function);
+        mapSCCInfo.clear();
+        ReduceTable.clear();
+        dead.clear();
+        inductions.clear();
+        reduces.clear();
+        ranges.clear();
     }
 
 };
@@ -5,20 +5,334 @@
 #ifndef DRAGON_PRE_H
 #define DRAGON_PRE_H
 
+#include <vector>
 #include "PassManager.h"
-
-struct PhiState {
-
-};
+#include "AnalysisManager.h"
+#include "Dominance.h"
+#include "LoopAnalyse.h"
+#include "MemorySSA.h"
+#include "GVN.h"
 
 /**
- * The class performs the Partial Redundancy Elimination (PRE) optimization
+ * The class performs the Partial Redundancy Elimination (PRE) optimization on the SSA form.
+ * "Value-Based Partial Redundancy Elimination" Thomas VanDrunen, Antony L. Hosking.
+ * An expression computed at a join is translated through the phis of the join into each
+ * predecessor. When the translation is available at the end of all the predecessors but one,
+ * it is computed at the end of the missing one and a phi of the join merges the values, so the
+ * expression is computed once on every path. The missing predecessor must only go to the join,
+ * or the new computation would run on paths that didn't compute it before.
+ * An expression of a loop header available from the latch ends up in the preheader, its phi merges
+ * the new computation with itself and is removed.
+ * The binaries and the GetPtrs are matched by their operands. A load is matched by its pointer
+ * and by the def MemorySSA finds clobbering it, a store to the same pointer forwards its value.
+ * The removed instructions are kept until the end of the pass, so their addresses can't be reused
+ * by a new instruction while the tables still refer to them.
  */
 class PRE : public FunctionPass {
 public:
+    FunctionPass *clone() const override { return new PRE(); }
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses().preserve<Dominance>().preserve<LoopAnalyse>();
+    }
+    ///< a new phi may make its users partially redundant, the function is walked again up to this
+    static constexpr unsigned MaxRounds = 4;
+
     void runOnFunction(Function &function) override {
+        if (function.getEntryBlock() == nullptr) {
+            return;
+        }
+        getAnalysis<Dominance>(function);
+        memorySSA = &getAnalysis<MemorySSA>(function);
+        exprs.clear();
+        for (auto &BB: function) {
+            for (auto &I: BB) {
+                addToTable(&I);
+            }
+        }
+        order.clear();
+        domWalker.walk(function.getEntryBlock(), domChildrenOf, [&](BasicBlock *bb) {
+            order.push_back(bb);
+        }, [](BasicBlock *) {});
+        for (unsigned Round = 0; Round < MaxRounds; ++Round) {
+            bool Changed = false;
+            for (auto *BB: order) {
+                candidates.clear();
+                for (auto &I: *BB) {
+                    if (isCandidate(&I)) {
+                        candidates.push_back(&I);
+                    }
+                }
+                for (auto *I: candidates) {
+                    Changed |= performPRE(I);
+                }
+            }
+            if (!Changed) {
+                break;
+            }
+        }
+        for (auto *I: dead) {
+            delete I;
+        }
+        dead.clear();
+        exprs.clear();
+    }
+
+    ///< Remove the instruction as a redundancy at its block, return true if it is gone.
+    bool performPRE(Instruction *inst) {
+        auto *BB = inst->getParent();
+        auto *Load = inst->as<LoadInst>();
+        auto Expr = getExpr(inst);
+        // fully redundant with a computation in a dominator
+        if (auto Iter = exprs.find(Expr); Iter != exprs.end()) {
+            for (auto *Other: Iter->second) {
+                if (Other == inst || Other->getParent() == BB || !Other->getParent()->dominates(BB)) {
+                    continue;
+                }
+                if (Load && !isSameMemory(Other, memorySSA->getClobberingAccess(inst))) {
+                    continue;
+                }
+                replace(inst, Other);
+                return true;
+            }
+        }
+
+        preds.clear();
+        for (auto *Pred: BB->preds()) {
+            if (std::find(preds.begin(), preds.end(), Pred) == preds.end()) {
+                preds.push_back(Pred);
+            }
+        }
+        if (preds.size() < 2) {
+            return false;
+        }
+        // the memory at the load must be the memory at the entry of the block
+        if (Load) {
+            auto *MA = memorySSA->getMemoryAccess(Load)->getDefiningAccess();
+            for (; MA->isDef() && MA->getBlock() == BB; MA = MA->getDefiningAccess()) {
+                if (memorySSA->clobbers(MA, Load->getPtr())) {
+                    return false;
+                }
+            }
+        }
+
+        incomings.clear();
+        BasicBlock *Missing = nullptr;
+        VNExpr MissingExpr;
+        for (auto *Pred: preds) {
+            VNExpr PredExpr;
+            if (!translate(Expr, BB, Pred, PredExpr)) {
+                return false;
+            }
+            auto *Avail = findAvailable(inst, PredExpr, Pred);
+            if (Avail == nullptr) {
+                if (Missing) {
+                    return false;
+                }
+                Missing = Pred;
+                MissingExpr = PredExpr;
+            }
+            incomings.emplace_back(Pred, Avail);
+        }
+        if (Missing) {
+            for (auto *Succ: Missing->succs()) {
+                if (Succ != BB) {
+                    return false;
+                }
+            }
+            auto *New = createExpr(inst, MissingExpr);
+            Missing->append(New);
+            New->setName("pre");
+            addToTable(New);
+            for (auto &Incoming: incomings) {
+                if (Incoming.first == Missing) {
+                    Incoming.second = New;
+                }
+            }
+        }
+
+        // the incoming of the instruction itself becomes the phi
+        auto *Phi = PhiInst::Create(inst->getType(), BB, "pre");
+        Phi->fill(incomings);
+        replace(inst, Phi);
+        Value *Same = nullptr;
+        for (size_t I = 0; I < Phi->getOperandNum(); ++I) {
+            auto *Op = Phi->getOperand(I);
+            if (Op == Phi || Op == Same) {
+                continue;
+            }
+            if (Same) {
+                return true;
+            }
+            Same = Op;
+        }
+        ASSERT(Same);
+        replace(Phi, Same);
+        return true;
+    }
+
+private:
+    MemorySSA *memorySSA = nullptr;
+    VNTable<std::vector<Instruction *>> exprs; ///< the instructions computing an expression
+    std::vector<BasicBlock *> order; ///< the blocks in the preorder of the dominator tree
+    std::vector<BasicBlock *> preds;
+    std::vector<Instruction *> candidates;
+    std::vector<std::pair<BasicBlock *, Value *>> incomings;
+    std::vector<Instruction *> dead;
+    DomTreeWalker domWalker;
+
+    bool isCandidate(Instruction *inst) const {
+        switch (inst->getOpcode()) {
+            case OpcodeBinary:
+            case OpcodeGetPtr:
+                return true;
+            case OpcodeLoad:
+                return memorySSA->getMemoryAccess(inst) != nullptr;
+            default:
+                return false;
+        }
+    }
+
+    ///< A load is keyed by its pointer alone, a GetPtr by its base and its offset.
+    static VNExpr getExpr(Instruction *inst) {
+        if (auto *Bin = inst->as<BinaryInst>()) {
+            return VNExpr{Bin->getLHS(), Bin->getRHS(), Bin->getOp()};
+        }
+        if (auto *GetPtr = inst->as<GetPtrInst>()) {
+            return VNExpr{GetPtr->getBase(), GetPtr->getOffset(), BinNone};
+        }
+        return VNExpr{inst->cast<LoadInst>()->getPtr(), nullptr, BinNone};
+    }
 
+    static Instruction *createExpr(Instruction *inst, VNExpr &expr) {
+        if (auto *Bin = inst->as<BinaryInst>()) {
+            return new BinaryInst(Bin->getType(), expr.op, expr.lhs, expr.rhs);
+        }
+        if (inst->isa<GetPtrInst>()) {
+            return new GetPtrInst(expr.lhs, expr.rhs);
+        }
+        return new LoadInst(expr.lhs);
     }
+
+    ///< The operands at the end of the predecessor, false if one is computed in the block.
+    static bool translate(VNExpr &expr, BasicBlock *bb, BasicBlock *pred, VNExpr &result) {
+        result = expr;
+        for (auto *Op: {&result.lhs, &result.rhs}) {
+            auto *Inst = *Op ? (*Op)->as<Instruction>() : nullptr;
+            if (Inst == nullptr || Inst->getParent() != bb) {
+                continue;
+            }
+            auto *Phi = Inst->as<PhiInst>();
+            if (Phi == nullptr) {
+                return false;
+            }
+            *Op = Phi->findIncomingValue(pred);
+            ASSERT(*Op);
+        }
+        return true;
+    }
+
+    ///< The value of the expression at the end of the block, null if it isn't computed on every path.
+    Value *findAvailable(Instruction *inst, VNExpr &expr, BasicBlock *bb) {
+        MemoryAccess *Clobber = nullptr;
+        if (inst->isa<LoadInst>()) {
+            Clobber = memorySSA->getClobberingAccess(getExitAccess(bb), expr.lhs);
+            if (Clobber && Clobber->isDef() && !Clobber->isLiveOnEntry()) {
+                auto *Store = Clobber->getInst()->as<StoreInst>();
+                if (Store && Store->getParent()->dominates(bb) &&
+                    Store->getVal()->getType() == inst->getType() &&
+                    memorySSA->getAliasAnalysis().alias(Store->getPtr(), expr.lhs) == AliasResult::MustAlias) {
+                    return Store->getVal();
+                }
+            }
+        }
+        auto Iter = exprs.find(expr);
+        if (Iter == exprs.end()) {
+            return nullptr;
+        }
+        for (auto *Other: Iter->second) {
+            if (!Other->getParent()->dominates(bb)) {
+                continue;
+            }
+            if (Clobber && !isSameMemory(Other, Clobber)) {
+                continue;
+            }
+            return Other;
+        }
+        return nullptr;
+    }
+
+    ///< Does the load read the memory the clobber leaves? The new loads have no access and never do.
+    bool isSameMemory(Instruction *load, MemoryAccess *clobber) {
+        if (clobber == nullptr || memorySSA->getMemoryAccess(load) == nullptr) {
+            return false;
+        }
+        return memorySSA->getClobberingAccess(load) == clobber;
+    }
+
+    ///< The memory version at the end of the block.
+    MemoryAccess *getExitAccess(BasicBlock *bb) {
+        for (auto *BB = bb; BB; BB = BB->getDominator()) {
+            auto &Accesses = memorySSA->getBlockAccesses(BB);
+            for (auto Iter = Accesses.rbegin(); Iter != Accesses.rend(); ++Iter) {
+                if ((*Iter)->isDef()) {
+                    return *Iter;
+                }
+            }
+            if (auto *Phi = memorySSA->getMemoryPhi(BB)) {
+                return Phi;
+            }
+        }
+        return memorySSA->getLiveOnEntry();
+    }
+
+    void addToTable(Instruction *inst) {
+        if (isCandidate(inst)) {
+            exprs[getExpr(inst)].push_back(inst);
+        }
+    }
+
+    void removeFromTable(Instruction *inst) {
+        auto Iter = exprs.find(getExpr(inst));
+        if (Iter == exprs.end()) {
+            return;
+        }
+        auto &Insts = Iter->second;
+        Insts.erase(std::remove(Insts.begin(), Insts.end(), inst), Insts.end());
+    }
+
+    ///< Replace the instruction and rehash its users, their operands change.
+    void replace(Instruction *inst, Value *value) {
+        std::vector<Instruction *> Users;
+        for (auto &Use: inst->getUses()) {
+            auto *User = Use.getUser()->cast<Instruction>();
+            if (isCandidate(User) && std::find(Users.begin(), Users.end(), User) == Users.end()) {
+                removeFromTable(User);
+                Users.push_back(User);
+            }
+        }
+        if (isCandidate(inst)) {
+            removeFromTable(inst);
+        }
+        inst->replaceAllUsesWith(value);
+        for (auto *User: Users) {
+            addToTable(User);
+        }
+        if (auto *ST = inst->getSymbolTable()) {
+            ST->removeName(inst);
+        }
+        if (auto *Phi = inst->as<PhiInst>()) {
+            while (Phi->getOperandNum()) {
+                Phi->removeIncoming(size_t(0));
+            }
+        } else {
+            for (auto &Use: inst->operands()) {
+                Use.set(nullptr);
+            }
+        }
+        inst->getParent()->remove(inst);
+        dead.push_back(inst);
+    }
+
 };
 
 
@@ -3,18 +3,181 @@
 //
 
 #include "PassManager.h"
+#include "AnalysisManager.h"
 #include "Module.h"
+#include "ThreadPool.h"
+#include "PassTimer.h"
+#include "CallGraph.h"
+#include <typeinfo>
+#ifdef __GNUG__
+#include <cxxabi.h>
+#endif
+
+std::string Pass::getPassName() const {
+    const char *Name = typeid(*this).name();
+#ifdef __GNUG__
+    int Status = 0;
+    if (char *Demangled = abi::__cxa_demangle(Name, nullptr, nullptr, &Status)) {
+        std::string Result(Demangled);
+        std::free(Demangled);
+        return Result;
+    }
+    return Name;
+#else
+    // msvc: "class Dominance"
+    std::string Result(Name);
+    auto Pos = Result.find(' ');
+    return Pos == std::string::npos ? Result : Result.substr(Pos + 1);
+#endif
+}
 
 void FunctionPass::run(Module *module) {
     initialize(module);
     for (auto &Function : *module) {
-        runOnFunction(Function);
+        runWithAnalysis(Function);
     }
     finalize(module);
 }
 
+PreservedAnalyses FunctionPass::preserved() const {
+    return isAnalysis() ? PreservedAnalyses::all() : PreservedAnalyses::none();
+}
+
+void FunctionPass::runWithAnalysis(Function &function) {
+    if (!analysis) {
+        TimeRegion Region(timer, timerName, isAnalysis() ? "analysis" : "pass", function.getName());
+        runOnFunction(function);
+        return;
+    }
+    if (isAnalysis()) {
+        // Computed once until it is invalidated, module level analyses can't be cloned and just rerun.
+        std::unique_ptr<FunctionPass> Instance(clone());
+        if (Instance) {
+            analysis->getResult(typeid(*this), function, [&] { return Instance.release(); });
+        } else {
+            TimeRegion Region(timer, timerName, "analysis", function.getName());
+            runOnFunction(function);
+        }
+        return;
+    }
+    {
+        TimeRegion Region(timer, timerName, "pass", function.getName());
+        runOnFunction(function);
+    }
+    analysis->invalidate(function, preserved());
+}
+
 void BasicBlockPass::runOnFunction(Function &function) {
     for (auto &BasicBlock: function) {
         runOnBasicBlock(&BasicBlock);
     }
 }
+
+PassManager::PassManager() : analyses(std::make_unique<AnalysisManager>()) {}
+
+PassManager::~PassManager() = default;
+
+void PassManager::addPass(Pass *pass) {
+    if (auto *FP = dynamic_cast<FunctionPass *>(pass)) {
+        FP->setAnalysisManager(analyses.get());
+        FP->setTimer(timer);
+    } else if (auto *SP = dynamic_cast<CallGraphSCCPass *>(pass)) {
+        SP->setThreads(threads);
+        SP->setAnalysisManager(analyses.get());
+    }
+    passes.emplace_back(pass);
+}
+
+void PassManager::setTimer(PassTimer *passTimer) {
+    timer = passTimer;
+    analyses->setTimer(passTimer);
+    for (auto &Pass : passes) {
+        if (auto *FP = dynamic_cast<FunctionPass *>(Pass.get())) {
+            FP->setTimer(passTimer);
+        }
+    }
+}
+
+void PassManager::setThreads(unsigned count) {
+    threads = count ? count : ThreadPool::getDefaultThreads();
+    for (auto &Pass : passes) {
+        if (auto *SP = dynamic_cast<CallGraphSCCPass *>(Pass.get())) {
+            SP->setThreads(threads);
+        }
+    }
+}
+
+void PassManager::run(Module *module) {
+    if (threads <= 1) {
+        for (auto &Pass : passes) {
+            Pass->run(module);
+        }
+        return;
+    }
+
+    // A function pass that can be cloned for the workers runs in parallel.
+    std::vector<bool> Parallel;
+    for (auto &Pass : passes) {
+        std::unique_ptr<FunctionPass> Clone;
+        if (auto *FP = dynamic_cast<FunctionPass *>(Pass.get())) {
+            Clone.reset(FP->clone());
+        }
+        Parallel.push_back(Clone != nullptr);
+    }
+
+    ThreadPool Pool(threads);
+    size_t First = 0;
+    while (First < passes.size()) {
+        // Collect the longest run of function passes, a module pass is a barrier.
+        size_t Last = First;
+        while (Last < passes.size() && Parallel[Last]) {
+            Last++;
+        }
+        if (Last == First) {
+            passes[First++]->run(module);
+            continue;
+        }
+        runParallel(Pool, module, First, Last);
+        First = Last;
+    }
+}
+
+void PassManager::runParallel(ThreadPool &pool, Module *module, size_t first, size_t last) {
+    std::vector<FunctionPass *> Pipeline;
+    for (size_t I = first; I < last; ++I) {
+        auto *FP = static_cast<FunctionPass *>(passes[I].get());
+        FP->initialize(module);
+        Pipeline.push_back(FP);
+    }
+
+    std::vector<Function *> Functions;
+    for (auto &F : *module) {
+        Functions.push_back(&F);
+    }
+
+    // Every task runs the whole pipeline on one function with its own pass instances.
+    std::vector<std::vector<std::unique_ptr<FunctionPass>>> Clones(Functions.size());
+    std::vector<ThreadPool::Task> Tasks;
+    for (size_t K = 0; K < Functions.size(); ++K) {
+        Tasks.emplace_back([&, K] {
+            auto &Local = Clones[K];
+            for (auto *FP : Pipeline) {
+                Local.emplace_back(FP->clone());
+                Local.back()->setAnalysisManager(analyses.get());
+                Local.back()->setTimer(timer);
+                Local.back()->runWithAnalysis(*Functions[K]);
+            }
+        });
+    }
+    pool.run(Tasks);
+
+    // Merge in module order, so the result doesn't depend on the scheduling.
+    for (auto &Local : Clones) {
+        for (size_t I = 0; I < Pipeline.size(); ++I) {
+            Pipeline[I]->merge(*Local[I]);
+        }
+    }
+    for (auto *FP : Pipeline) {
+        FP->finalize(module);
+    }
+}
@@ -5,25 +5,72 @@
 #ifndef DRAGONIR_PASSMANAGER_H
 #define DRAGONIR_PASSMANAGER_H
 #include <memory>
+#include <string>
 #include <vector>
 #include <unordered_map>
 
 class Module;
 class Function;
 class BasicBlock;
+class ThreadPool;
+class AnalysisManager;
+class PreservedAnalyses;
+class PassTimer;
 
 class Pass {
 public:
     virtual ~Pass() = default;
     virtual void run(Module *module) = 0;
+    ///< The class name of the pass, used by the timing report.
+    std::string getPassName() const;
 };
 
 class FunctionPass : public Pass {
+protected:
+    AnalysisManager *analysis = nullptr;
+    std::shared_ptr<AnalysisManager> ownAnalysis; ///< used when the pass runs without a manager
+    PassTimer *timer = nullptr;
+    std::string timerName; ///< the pass name, computed once the timer is set
 public:
     virtual void runOnFunction(Function &function) = 0;
     virtual void initialize(Module *module) {}
     virtual void finalize(Module *module) {}
     void run(Module *module) override;
+
+    ///< Create a fresh instance of the pass for a worker of the parallel pass manager.
+    ///< Passes that look beyond the function they run on return nullptr (the default),
+    ///< they act as barriers and see the whole module alone.
+    virtual FunctionPass *clone() const { return nullptr; }
+    ///< Merge the module level results of a cloned instance back into this pass.
+    ///< The clones are merged in the order of the functions in the module.
+    virtual void merge(FunctionPass &) {}
+
+    ///< Analyses are cached by the analysis manager instead of being run every time.
+    virtual bool isAnalysis() const { return false; }
+    ///< The analyses that are still valid after running this pass, nothing by default.
+    virtual PreservedAnalyses preserved() const;
+
+    void setAnalysisManager(AnalysisManager *manager) {
+        analysis = manager;
+    }
+    AnalysisManager *getAnalysisManager() const {
+        return analysis;
+    }
+    void setTimer(PassTimer *passTimer) {
+        timer = passTimer;
+        if (timer && timerName.empty()) {
+            timerName = getPassName();
+        }
+    }
+    ///< Get the (cached) result of an analysis on the function.
+    template<typename T>
+    T &getAnalysis(Function &function);
+    ///< Get the result of an analysis only if it is already computed and valid, or null.
+    template<typename T>
+    T *getCachedAnalysis(Function &function);
+
+    ///< Run on the function and keep the analysis manager up to date.
+    void runWithAnalysis(Function &function);
 };
 
 class BasicBlockPass : public FunctionPass {
@@ -34,19 +81,39 @@ public:
 
 class PassManager {
     std::vector<std::unique_ptr<Pass>> passes;
+    std::unique_ptr<AnalysisManager> analyses;
+    PassTimer *timer = nullptr;
+    ///< worker count, the passes run sequentially when it is 1
+    unsigned threads = 1;
 public:
-    PassManager() = default;
+    PassManager();
+    ~PassManager();
 
-    void addPass(Pass *pass) {
-        passes.emplace_back(pass);
+    void addPass(Pass *pass);
+
+    AnalysisManager &getAnalysisManager() {
+        return *analyses;
     }
 
-    void run(Module *module) {
-        for (auto &Pass : passes) {
-            Pass->run(module);
-        }
+    ///< Record the time and the allocations of every pass on every function, null to disable.
+    void setTimer(PassTimer *passTimer);
+
+    PassTimer *getTimer() const {
+        return timer;
+    }
+
+    ///< Run the function passes on several functions at the same time, 0 means one thread per core.
+    void setThreads(unsigned count);
+
+    unsigned getThreads() const {
+        return threads;
     }
 
+    void run(Module *module);
+
+private:
+    void runParallel(ThreadPool &pool, Module *module, size_t first, size_t last);
+
 };
 
 
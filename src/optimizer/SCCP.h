@@ -4,6 +4,8 @@
 
 #ifndef DRAGONIR_SCCP_H
 #define DRAGONIR_SCCP_H
+#include <memory>
+#include "Module.h"
 #include "Function.h"
 #include "PassManager.h"
 #include "ConstantFolder.h"
@@ -75,14 +77,18 @@ struct LatticeValue {
 };
 
 class SCCPFunction {
+protected:
     Function *fun;
+    const SCCPFunction *caller = nullptr; ///< the evaluation of the call this one runs for
     std::vector<BasicBlock *> cfgWorklist;
     std::vector<Instruction *> ssaWorklist;
     std::map<BasicBlock *, bool> mapBBExcuted;
     std::map<Value *, LatticeValue> mapValToLatVal;
     LatticeValue returnVal;
+    bool eraseCalls = true; ///< a call folded to a constant is erased, or only its uses are replaced
 public:
     SCCPFunction(Function *f) : fun(f) {}
+    virtual ~SCCPFunction() = default;
     LatticeValue getLatticeVal(Value *val) {
         if (!val) {
             return LatticeValue::getNaC();
@@ -92,7 +98,7 @@ public:
         }
         return mapValToLatVal[val];
     }
-    void setLatticeVal(Instruction *val, LatticeValue latVal) {
+    void setLatticeVal(Value *val, LatticeValue latVal) {
         if (mapValToLatVal[val] != latVal) {
             mapValToLatVal[val] = latVal;
             for (auto &User: val->getUsers()) {
@@ -153,6 +159,8 @@ public:
                 evalOnRet(instr->cast<RetInst>());
                 break;
             }
+            case OpcodeStore:
+                break;
             case OpcodeAlloca:
             case OpcodeCast:
             case OpcodeCopy:
@@ -160,7 +168,8 @@ public:
             case OpcodeNot:
             case OpcodeGetPtr:
             case OpcodeLoad:
-            case OpcodeStore:
+            case OpcodeVector:
+                setLatticeVal(instr, LatticeValue::getNaC());
                 break;
         }
     }
@@ -177,6 +186,10 @@ public:
     void evalOnBinary(BinaryInst *bin) {
         auto LHS = getLatticeVal(bin->getLHS());
         auto RHS = getLatticeVal(bin->getRHS());
+        // an operand is undef until its definition is reached, a call until its callee returns
+        if (LHS.isUndef() || RHS.isUndef()) {
+            return;
+        }
         LatticeValue Val = LatticeValue::getNaC();
 
         if (LHS.isConstant() && RHS.isConstant()) {
@@ -203,21 +216,32 @@ public:
             }
         }
 
-        ASSERT(!LHS.isUndef() && !RHS.isUndef());
-
         setLatticeVal(bin, Val);
 
     }
-    void evalOnCall(CallInst *call) {
-        SCCPFunction Func(call->getCallee());
+    ///< The callee is evaluated with the arguments of the call, a recursive call is not a constant.
+    virtual void evalOnCall(CallInst *call) {
+        auto *Callee = call->getCallee();
+        bool Recursive = false;
+        for (const SCCPFunction *F = this; F; F = F->caller) {
+            Recursive = Recursive || F->fun == Callee;
+        }
+        if (Callee == nullptr || Callee->getEntryBlock() == nullptr || Recursive) {
+            setLatticeVal(call, LatticeValue::getNaC());
+            return;
+        }
+        SCCPFunction Func(Callee);
+        Func.caller = this;
         for (auto I = 0; I < call->getOperandNum(); ++I) {
             Func.mapParam(I, getLatticeVal(call->getOperand(I)));
         }
         Func.runOnEntry();
         setLatticeVal(call, Func.getReturnValue());
     }
-    void evalOnRet(RetInst *ret) {
-        returnVal ^= getLatticeVal(ret->getOperand(0));
+    virtual void evalOnRet(RetInst *ret) {
+        if (!ret->isVoidRet()) {
+            returnVal ^= getLatticeVal(ret->getRetVal());
+        }
     }
     LatticeValue getReturnValue() {
         return returnVal;
@@ -241,6 +265,9 @@ public:
     }
     void run(BasicBlock *entry) {
         cfgWorklist.push_back(entry);
+        runWorklists();
+    }
+    void runWorklists() {
         while (!cfgWorklist.empty() || !ssaWorklist.empty()) {
             if (!cfgWorklist.empty()) {
                 auto *Cur = cfgWorklist.back();
@@ -263,25 +290,25 @@ public:
         }
     }
 
-};
-
-class SCCP : public FunctionPass {
-public:
-    void runOnFunction(Function &function) override {
-        SCCPFunction Func(&function);
+    ///< Replace the constants and remove the blocks never executed.
+    void rewrite(Function &function) {
         for (auto &Param: function.getParams()) {
-            Func.mapLatticeVal(Param.get(), LatticeValue::getNaC());
+            auto Val = getMapValue(Param.get());
+            if (Val.isConstant()) {
+                Param->replaceAllUsesWith(Val.getValue());
+            }
         }
-        Func.runOnEntry();
         std::vector<BasicBlock *> BBNeedToRemove;
         for (auto &BB: function) {
-            if (Func.isExecutable(&BB)) {
+            if (isExecutable(&BB)) {
                 for (auto Iter = BB.begin(); Iter != BB.end();) {
                     auto &Inst = *Iter++;
-                    auto Val = Func.getMapValue(&Inst);
+                    auto Val = getMapValue(&Inst);
                     if (Val.isConstant()) {
                         Inst.replaceAllUsesWith(Val.getValue());
-                        Inst.eraseFromParent();
+                        if (eraseCalls || !Inst.isa<CallInst>()) {
+                            Inst.eraseFromParent();
+                        }
                     }
                 }
             } else {
@@ -304,6 +331,113 @@ public:
             BB->eraseFromParent();
         }
     }
+
+};
+
+class SCCP : public FunctionPass {
+public:
+    void runOnFunction(Function &function) override {
+        SCCPFunction Func(&function);
+        for (auto &Param: function.getParams()) {
+            Func.mapLatticeVal(Param.get(), LatticeValue::getNaC());
+        }
+        Func.runOnEntry();
+        Func.rewrite(function);
+    }
+};
+
+/**
+ * The solver of the interprocedural SCCP, all the functions of the module share the lattice values
+ * and the two worklists. The arguments of an executable call meet into the params of its callee,
+ * whose entry becomes executable, and the values of the rets of a function meet into the results
+ * of all its calls. The values only go down the lattice, so a recursive function meets its own
+ * results until they settle. A function called from nowhere in the module, like main, is entered
+ * with unknown params.
+ */
+class IPSCCPSolver : public SCCPFunction {
+    std::map<Function *, LatticeValue> returnVals; ///< the meet of the values a function returns
+    std::map<Function *, std::vector<CallInst *>> callSites;
+public:
+    IPSCCPSolver() : SCCPFunction(nullptr) {
+        // the callee may write memory, only the result of its call is replaced
+        eraseCalls = false;
+    }
+
+    void solve(Module *module) {
+        for (auto &F: *module) {
+            F.forEach<CallInst>([&](CallInst *call) {
+                if (call->getCallee()) {
+                    callSites[call->getCallee()].push_back(call);
+                }
+            });
+        }
+        for (auto &F: *module) {
+            if (F.getEntryBlock() == nullptr || callSites.count(&F)) {
+                continue;
+            }
+            for (auto &Param: F.getParams()) {
+                mapLatticeVal(Param.get(), LatticeValue::getNaC());
+            }
+            cfgWorklist.push_back(F.getEntryBlock());
+        }
+        runWorklists();
+    }
+
+    void evalOnCall(CallInst *call) override {
+        auto *Callee = call->getCallee();
+        if (Callee == nullptr || Callee->getEntryBlock() == nullptr) {
+            setLatticeVal(call, LatticeValue::getNaC());
+            return;
+        }
+        for (unsigned I = 0; I < call->getArgNum(); ++I) {
+            auto *Param = Callee->getParam(I);
+            setLatticeVal(Param, getLatticeVal(Param) ^ getLatticeVal(call->getArg(I)));
+        }
+        cfgWorklist.push_back(Callee->getEntryBlock());
+        setLatticeVal(call, returnVals[Callee]);
+    }
+
+    void evalOnRet(RetInst *ret) override {
+        if (ret->isVoidRet()) {
+            return;
+        }
+        auto *F = ret->getParent()->getParent();
+        auto &Val = returnVals[F];
+        auto NewVal = Val ^ getLatticeVal(ret->getRetVal());
+        if (NewVal != Val) {
+            Val = NewVal;
+            for (auto *Call: callSites[F]) {
+                ssaWorklist.push_back(Call);
+            }
+        }
+    }
+
+};
+
+/**
+ * Interprocedural sparse conditional constant propagation.
+ * The whole module is solved before the first function is rewritten, the params and the results
+ * of the calls found constant are replaced, and the blocks never executed are removed. A function
+ * never reached from a root is left alone.
+ */
+class IPSCCP : public FunctionPass {
+    std::unique_ptr<IPSCCPSolver> solver;
+public:
+    void initialize(Module *module) override {
+        solver = std::make_unique<IPSCCPSolver>();
+        solver->solve(module);
+    }
+
+    void runOnFunction(Function &function) override {
+        auto *Entry = function.getEntryBlock();
+        if (Entry && solver->isExecutable(Entry)) {
+            solver->rewrite(function);
+        }
+    }
+
+    void finalize(Module *module) override {
+        solver.reset();
+    }
 };
 
 #endif //DRAGONIR_SCCP_H
@@ -6,6 +6,9 @@
 #define DRAGONIR_SSABUILDER_H
 
 #include "PassManager.h"
+#include "AnalysisManager.h"
+#include "Dominance.h"
+#include "LoopAnalyse.h"
 #include "Context.h"
 #include "Function.h"
 #include "IDFCalculator.h"
@@ -40,7 +43,7 @@ struct VarStatus {
 struct PhiStatus {
     Value *allocaFor = nullptr;
     bool useless = true; // 用来标记Phi语句是否被使用
-    std::map<BasicBlock *, Value *> incomings; // 标记来边和对应的SSA值
+    std::vector<std::pair<BasicBlock *, Value *>> incomings; // 标记来边和对应的SSA值, in the order of renaming
 
     void setAlloca(Value *a) {
         ASSERT(allocaFor == nullptr);
@@ -60,7 +63,13 @@ struct PhiStatus {
     }
 
     void addIncoming(BasicBlock *bb, Value *val) {
-        incomings[bb] = val;
+        for (auto &[Block, Value]: incomings) {
+            if (Block == bb) {
+                Value = val;
+                return;
+            }
+        }
+        incomings.emplace_back(bb, val);
     }
 
     void fill(PhiInst *node) {
@@ -71,70 +80,73 @@ struct PhiStatus {
 
 class SSAConstructor : public FunctionPass {
 public:
+    FunctionPass *clone() const override { return new SSAConstructor(); }
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses().preserve<Dominance>().preserve<LoopAnalyse>();
+    }
+    using DefList = std::vector<std::pair<AllocaInst *, std::vector<BasicBlock *>>>; ///< alloca -> def blocks
     std::map<Value *, VarStatus> varStatus; // Var state for alloca
     std::map<PhiInst *, PhiStatus> phiStatus; // Phi state for phi inst
     std::vector<PhiInst *> phiStack;
+    IDFCalculator idfCalculator;
+    DomTreeWalker domWalker;
 
     void runOnFunction(Function &function) override {
         phiStack.clear();
         varStatus.clear();
         phiStatus.clear();
-        std::map<AllocaInst *, std::set<BasicBlock *>> DefBlocks;
-        // Find all allocas def blocks
+        auto &Dom = getAnalysis<Dominance>(function);
+        // Find all allocas def blocks, the allocas in program order so the phis are placed in it
+        DefList DefBlocks;
+        std::unordered_map<AllocaInst *, unsigned> DefIndex;
+        function.forEach<AllocaInst>([&](AllocaInst *alloca) {
+            DefIndex[alloca] = DefBlocks.size();
+            DefBlocks.emplace_back(alloca, std::vector<BasicBlock *>());
+        });
         for (auto &BB: function) {
             for (auto &I : BB) {
                 if (I.getOpcode() == OpcodeStore) {
                     auto *Store = I.as<StoreInst>();
                     auto *Ptr = Store->getPtr();
                     if (auto *Alloca = Ptr->as<AllocaInst>()) {
-                        DefBlocks[Alloca].insert(&BB);
+                        auto &Blocks = DefBlocks[DefIndex[Alloca]].second;
+                        if (Blocks.empty() || Blocks.back() != &BB) {
+                            Blocks.push_back(&BB);
+                        }
                     }
                 }
             }
         }
 
         // place phi nodes
+        idfCalculator.reserve(Dom.blocks.size());
         placing(DefBlocks);
 
-        // rename phi nodes
-        rename(function.getEntryBlock());
+        // rename phi nodes, the versions defined in a block are popped after its dominator subtree
+        domWalker.walk(function.getEntryBlock(), domChildrenOf, [&](BasicBlock *bb) {
+            rename(bb);
+        }, [&](BasicBlock *bb) {
+            popVersions(bb);
+        });
 
         // prune unless phi nodes
-        prune(function.getEntryBlock());
+        domWalker.preorder(function.getEntryBlock(), domChildrenOf, [&](BasicBlock *bb) {
+            prune(bb);
+        });
 
         install();
     }
 
-    void placing(const std::map<AllocaInst *, std::set<BasicBlock *>> &defs) {
-        std::vector<BasicBlock *> Worklist;
-        std::map<BasicBlock *, Value *> InWorklist;
+    ///< A phi node for every block in the IDF of the definitions.
+    void placing(const DefList &defs) {
+        std::vector<BasicBlock *> IDF;
         for (auto &[Value, Blocks]: defs) {
-            for (auto *BB: Blocks) {
-                Worklist.push_back(BB);
-                InWorklist[BB] = Value;
-            }
-
-            while (!Worklist.empty()) {
-                auto *BB = Worklist.back();
-                Worklist.pop_back();
-                for (auto *D: BB->getDomFrontier()) {
-                    StrView Name = Value->getName();
-                    auto *PhiNode = PhiInst::Create(Value->getAllocatedType(), D, Name);
-                    phiStatus[PhiNode].setAlloca(Value);
-                    if (InWorklist[D] != Value) {
-                        InWorklist[D] = Value;
-                        Worklist.push_back(D);
-                    }
-                }
+            if (Blocks.empty()) {
+                continue;
             }
-        }
-    }
-
-    void placingByIDF(const std::map<AllocaInst *, std::set<BasicBlock *>> &defs) {
-        for (auto &[Value, Blocks]: defs) {
-            IDFCalculator IDF;
-            for (auto &BB: IDF.calc(Blocks)) {
-                StrView Name = Value->template cast<Instruction>()->getName();
+            idfCalculator.calculate(Blocks, IDF);
+            StrView Name = Value->getName();
+            for (auto *BB: IDF) {
                 auto *PhiNode = PhiInst::Create(Value->getAllocatedType(), BB, Name);
                 phiStatus[PhiNode].setAlloca(Value);
             }
@@ -185,12 +197,10 @@ public:
                 }
             }
         }
+    }
 
-        for (auto &Dom: bb->getDomChildren()) {
-            rename(Dom);
-        }
-
-        // Pop all versions
+    // Pop all versions
+    void popVersions(BasicBlock *bb) {
         for (auto &Instr: bb->getPhis()) {
             auto *Phi = Instr.cast<PhiInst>();
             if (phiStatus.find(Phi) == phiStatus.end()) {
@@ -239,10 +249,6 @@ public:
                 }
             }
         }
-
-        for (BasicBlock *Dom : bb->getDomChildren()) {
-            prune(Dom);
-        }
     }
 
     void install() {
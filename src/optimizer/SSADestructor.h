@@ -6,11 +6,25 @@
 #define DRAGON_SSADESTRUCTOR_H
 
 #include "PassManager.h"
+#include "AnalysisManager.h"
+#include "DomTreeUpdater.h"
 #include "Function.h"
 class SSADestructor : public FunctionPass {
 public:
+    FunctionPass *clone() const override { return new SSADestructor(); }
+    bool updatedDominance = false; ///< the cached dominator tree is updated along with the split edges
+    PreservedAnalyses preserved() const override {
+        return updatedDominance ? PreservedAnalyses().preserve<Dominance>() : PreservedAnalyses::none();
+    }
     void runOnFunction(Function &function) override {
-        splitCriticalEdge(&function);
+        updatedDominance = false;
+        if (auto *Dom = getCachedAnalysis<Dominance>(function)) {
+            DomTreeUpdater Updater(function, *Dom);
+            splitCriticalEdge(&function, &Updater);
+            updatedDominance = true;
+        } else {
+            splitCriticalEdge(&function);
+        }
         //isolatePhiByCopy(&function);
         //splitCriticalEdge(&function);
         //addAssignForPhi(&function);
@@ -31,7 +45,7 @@ public:
             }
         }
     }
-    void splitCriticalEdge(Function *function) {
+    void splitCriticalEdge(Function *function, DomTreeUpdater *updater = nullptr) {
         std::vector<BasicBlock *> Worklist;
         for (auto &BB: function->getBasicBlockList()) {
             if (BB.hasMultiplePredecessor()) {
@@ -55,6 +69,11 @@ public:
                     }*/
                     updateBasicBlock(&BB, Pred, NewBB);
                     NewBB->append(new BranchInst(&BB));
+                    if (updater) {
+                        updater->deleteEdge(Pred, &BB);
+                        updater->insertEdge(Pred, NewBB);
+                        updater->insertEdge(NewBB, &BB);
+                    }
                 }
             }
         }
@@ -5,50 +5,142 @@
 #ifndef DRAGON_SSALIVENESS_H
 #define DRAGON_SSALIVENESS_H
 #include "PassManager.h"
+#include "AnalysisManager.h"
 #include "Function.h"
-///< Compute the liveness of ssa.
+#include "Dominance.h"
+#include "LoopAnalyse.h"
+#include "BitVector.h"
+#include "GraphTraversal.h"
+/**
+ * Liveness queries on the SSA form, no live set is built.
+ * "Fast Liveness Checking for SSA-Form Programs" Benoit Boissinot, Sebastian Hack, Daniel Grund,
+ * Benoit Dupont de Dinechin, Fabrice Rastello.
+ * A value is live-in at a block if its def strictly dominates the block and one of its uses is
+ * reachable in the reduced graph (the CFG without the back edges) from the header of the outermost
+ * loop that contains the block but not the def, or from the block itself out of such loops.
+ * Only the reduced reachability of every block is computed ahead, the uses are walked on the def-use
+ * chains, so the answers stay valid while the instructions change as long as the CFG doesn't.
+ * The back edges are the edges to a dominator, so the CFG must be reducible.
+ */
 class SSALiveness : public FunctionPass {
 public:
-    std::map<BasicBlock *, std::set<Value *>> liveOut;
-    std::map<BasicBlock *, std::set<Value *>> liveIn;
+    FunctionPass *clone() const override { return new SSALiveness(); }
+    bool isAnalysis() const override { return true; }
+    std::vector<BitVector> reachable; ///< block number -> the blocks reachable in the reduced graph, itself included
     SSALiveness() {}
 
     void runOnFunction(Function &function) override {
+        auto &Dom = getAnalysis<Dominance>(function);
+        loops = &getAnalysis<LoopAnalyse>(function);
+        entry = function.getEntryBlock();
+        auto NumBlocks = Dom.blocks.size();
+        reachable.assign(NumBlocks, BitVector(NumBlocks));
+        if (entry == nullptr) {
+            return;
+        }
+        // a back edge only goes up in the post order, so the successors over the other edges are done first
+        visited.assign(NumBlocks, false);
+        auto &Order = postOrder.postOrder(entry, [](BasicBlock *bb) {
+            return bb->succs();
+        }, [&](BasicBlock *bb) {
+            if (visited[bb->getNumber()]) {
+                return false;
+            }
+            visited[bb->getNumber()] = true;
+            return true;
+        });
+        for (auto *BB: Order) {
+            auto &Reachable = reachable[BB->getNumber()];
+            Reachable.set(BB->getNumber());
+            for (auto *Succ: BB->succs()) {
+                if (!Succ->dominates(BB)) {
+                    Reachable |= reachable[Succ->getNumber()];
+                }
+            }
+        }
+    }
 
+    ///< Is the value live at the entry of the block? A phi is not live-in at its own block.
+    bool isLiveIn(Value *value, BasicBlock *block) {
+        auto *Def = getDefBlock(value);
+        if (Def == nullptr || Def == block || !Def->dominates(block)) {
+            return false;
+        }
+        auto &Reachable = reachable[getTarget(block, Def)->getNumber()];
+        for (auto &Use: value->getUses()) {
+            if (Reachable.get(getUseBlock(Use)->getNumber())) {
+                return true;
+            }
+        }
+        return false;
     }
-    void setBasicBlockLiveIn(BasicBlock *block, std::set<Value *> in) {
-        this->liveIn[block] = in;
+
+    ///< Is the value live at the exit of the block? A phi operand is live-out of the incoming block.
+    bool isLiveOut(Value *value, BasicBlock *block) {
+        auto *Def = getDefBlock(value);
+        if (Def == nullptr || !Def->dominates(block)) {
+            return false;
+        }
+        if (Def == block) {
+            for (auto &Use: value->getUses()) {
+                if (getUseBlock(Use) != block || isPhiUse(Use)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        auto *Target = getTarget(block, Def);
+        auto &Reachable = reachable[Target->getNumber()];
+        for (auto &Use: value->getUses()) {
+            auto *UseBlock = getUseBlock(Use);
+            // a use in the block itself is before its exit, unless a loop brings it back
+            if (Target == block && UseBlock == block && !isPhiUse(Use)) {
+                continue;
+            }
+            if (Reachable.get(UseBlock->getNumber())) {
+                return true;
+            }
+        }
+        return false;
     }
-    void setBasicBlockLiveOut(BasicBlock *block, std::set<Value *> out) {
-        this->liveOut[block] = out;
+
+    ///< The block defining the value, the params are defined at the entry. Null if it isn't a variable.
+    BasicBlock *getDefBlock(Value *value) const {
+        if (auto *Inst = value->as<Instruction>()) {
+            return Inst->getParent();
+        }
+        if (value->isa<Param>()) {
+            return entry;
+        }
+        return nullptr;
     }
-    std::set<Value *> &getBasicBlockLiveIn(BasicBlock *block) {
-        return this->liveIn[block];
+
+    ///< The operand of a phi is used at the end of the incoming block.
+    static BasicBlock *getUseBlock(Use &use) {
+        auto *User = use.getUser()->cast<Instruction>();
+        if (auto *Phi = User->as<PhiInst>()) {
+            return Phi->getIncomingBlock(use);
+        }
+        return User->getParent();
     }
-    std::set<Value *> &getBasicBlockLiveOut(BasicBlock *block) {
-        return this->liveOut[block];
+
+    static bool isPhiUse(Use &use) {
+        return use.getUser()->cast<Instruction>()->getOpcode() == OpcodePhi;
     }
 
-    void computeLivenessOnBlock(BasicBlock &block) {
-        std::set<Value *> Live;
-        for (auto *Succ: block.succs()) {
-            for (auto &Phi: Succ->phis()) {
-                Value *V = Phi.findIncomingValue(&block);
-                ASSERT(V);
-                Live.insert(V);
-            }
-            auto &SuccLiveIn = getBasicBlockLiveIn(Succ);
-            Live.insert(SuccLiveIn.begin(), SuccLiveIn.end());
-        }
+private:
+    LoopAnalyse *loops = nullptr;
+    BasicBlock *entry = nullptr;
+    std::vector<bool> visited;
+    PostOrderTraversal<BasicBlock *, decltype(std::declval<BasicBlock &>().succs())> postOrder;
 
-        for (auto &I: block.instrs().reverse()) {
-            Live.erase(&I);
-            for (auto *Op: I.ops()) {
-                Live.insert(Op);
-            }
+    ///< The header of the outermost loop containing the block but not the def, or the block itself.
+    BasicBlock *getTarget(BasicBlock *block, BasicBlock *def) const {
+        auto *Target = block;
+        for (auto *L = loops->getLoopFor(block); L && !L->contains(def); L = L->getParent()) {
+            Target = L->getHeader();
         }
-
-        setBasicBlockLiveIn(&block, Live);
+        return Target;
     }
 
 };
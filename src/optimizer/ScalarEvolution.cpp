@@ -0,0 +1,5 @@
+//
+// Created by Alex on 2022/6/14.
+//
+
+#include "ScalarEvolution.h"
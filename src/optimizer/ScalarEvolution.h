@@ -0,0 +1,507 @@
+//
+// Created by Alex on 2022/6/14.
+//
+
+#ifndef DRAGON_SCALAREVOLUTION_H
+#define DRAGON_SCALAREVOLUTION_H
+
+#include <map>
+#include <memory>
+#include <vector>
+#include <sstream>
+#include <iterator>
+#include <algorithm>
+#include <unordered_map>
+#include "PassManager.h"
+#include "AnalysisManager.h"
+#include "Function.h"
+#include "LoopAnalyse.h"
+
+///< An expression of the scalar evolution, the nodes are owned by the analysis.
+class SCEV {
+public:
+    enum Kind {
+        Constant,
+        Unknown, ///< a value the analysis can't see through
+        Add,
+        Mul,
+        SMax,
+        AddRec, ///< {start,+,step}, the start on the first iteration of the loop plus the step on every other
+    };
+private:
+    Kind kind;
+    int64_t constant = 0;
+    Value *value = nullptr;
+    Loop *loop = nullptr;
+    std::vector<SCEV *> operands; ///< the start and the step of an add recurrence
+public:
+    SCEV(Kind kind, int64_t constant, Value *value, Loop *loop, std::vector<SCEV *> operands) :
+            kind(kind), constant(constant), value(value), loop(loop), operands(std::move(operands)) {}
+
+    inline Kind getKind() const { return kind; }
+    inline bool isConstant() const { return kind == Constant; }
+    inline bool isAddRec() const { return kind == AddRec; }
+    inline int64_t getConstant() const { return constant; }
+    inline Value *getValue() const { return value; }
+    inline Loop *getLoop() const { return loop; }
+    inline const std::vector<SCEV *> &getOperands() const { return operands; }
+    inline SCEV *getStart() const { return operands[0]; }
+    inline SCEV *getStep() const { return operands[1]; }
+
+    void dump(std::ostream &os) const {
+        switch (kind) {
+            case Constant:
+                os << constant;
+                break;
+            case Unknown:
+                value->dumpAsOperand(os);
+                break;
+            case Add:
+            case Mul:
+                os << "(";
+                for (size_t I = 0; I < operands.size(); ++I) {
+                    os << (I ? (kind == Add ? " + " : " * ") : "");
+                    operands[I]->dump(os);
+                }
+                os << ")";
+                break;
+            case SMax:
+                os << "smax(";
+                operands[0]->dump(os);
+                os << ", ";
+                operands[1]->dump(os);
+                os << ")";
+                break;
+            case AddRec:
+                os << "{";
+                getStart()->dump(os);
+                os << ",+,";
+                getStep()->dump(os);
+                os << "}<";
+                loop->getHeader()->dumpAsOperand(os);
+                os << ">";
+                break;
+        }
+    }
+
+    std::string dumpToString() const {
+        std::stringstream SS;
+        dump(SS);
+        return SS.str();
+    }
+};
+
+/**
+ * Scalar evolution, the integer values of a function as expressions of the iterations of the loops.
+ * A phi of a loop header with a start from outside the loop and a next value of the phi plus a loop
+ * invariant is the add recurrence {start,+,step}. The adds, the subs and the multiplications by
+ * invariants of the recurrences are folded into recurrences, everything else is an unknown.
+ * The arithmetic is assumed not to wrap.
+ * The trip count of a loop is the number of times its backedge is taken. It is computed when the
+ * loop has one exiting block, the header or the only latch, branching on the compare of a recurrence
+ * of the loop with a constant step against a loop invariant. The count is symbolic for the steps
+ * of 1 and -1, constant when the start and the bound are, and null when it can't be computed.
+ * The expressions are computed lazily on the queries.
+ */
+class ScalarEvolution : public FunctionPass {
+public:
+    FunctionPass *clone() const override { return new ScalarEvolution(); }
+    bool isAnalysis() const override { return true; }
+
+    void runOnFunction(Function &function) override {
+        loopAnalyse = &getAnalysis<LoopAnalyse>(function);
+        nodes.clear();
+        constants.clear();
+        unknowns.clear();
+        values.clear();
+        computed.clear();
+        tripCounts.clear();
+    }
+
+    ///< The expression of an integer value.
+    SCEV *getSCEV(Value *val) {
+        if (auto Iter = values.find(val); Iter != values.end()) {
+            return Iter->second;
+        }
+        auto *Expr = createSCEV(val);
+        values[val] = Expr;
+        computed.push_back(val);
+        return Expr;
+    }
+
+    ///< Does the expression have the same value on every iteration of the loop?
+    bool isLoopInvariant(SCEV *expr, Loop *loop) {
+        if (expr->getKind() == SCEV::Unknown) {
+            auto *Inst = expr->getValue()->as<Instruction>();
+            return !Inst || !loop->contains(Inst->getParent());
+        }
+        // a recurrence of the loop or of a loop in it changes on the iterations
+        if (expr->isAddRec() && loop->contains(expr->getLoop())) {
+            return false;
+        }
+        return std::all_of(expr->getOperands().begin(), expr->getOperands().end(), [&](SCEV *op) {
+            return isLoopInvariant(op, loop);
+        });
+    }
+
+    ///< The number of times the backedge of the loop is taken, null if it can't be computed.
+    SCEV *getTripCount(Loop *loop) {
+        auto [Iter, Inserted] = tripCounts.emplace(loop, nullptr);
+        if (Inserted) {
+            Iter->second = computeTripCount(loop);
+        }
+        return Iter->second;
+    }
+
+    bool getConstantTripCount(Loop *loop, int64_t &count) {
+        auto *Count = getTripCount(loop);
+        if (Count && Count->isConstant()) {
+            count = Count->getConstant();
+            return true;
+        }
+        return false;
+    }
+
+    ///< The value of a recurrence on the iteration, a phi of the header leaves the loop with the trip count.
+    SCEV *evaluateAtIteration(SCEV *rec, SCEV *iteration) {
+        if (!rec->isAddRec()) {
+            return rec;
+        }
+        return getAdd({rec->getStart(), getMul({rec->getStep(), iteration})});
+    }
+
+    SCEV *getConstant(int64_t val) {
+        auto &Expr = constants[val];
+        if (Expr == nullptr) {
+            Expr = create(SCEV::Constant, val, nullptr, nullptr, {});
+        }
+        return Expr;
+    }
+
+    SCEV *getUnknown(Value *val) {
+        auto &Expr = unknowns[val];
+        if (Expr == nullptr) {
+            Expr = create(SCEV::Unknown, 0, val, nullptr, {});
+        }
+        return Expr;
+    }
+
+    ///< The sum with the constants folded, the like terms combined and the invariants taken into the recurrences.
+    SCEV *getAdd(std::vector<SCEV *> ops) {
+        std::vector<SCEV *> Flat;
+        for (auto *Op: ops) {
+            if (Op->getKind() == SCEV::Add) {
+                Flat.insert(Flat.end(), Op->getOperands().begin(), Op->getOperands().end());
+            } else {
+                Flat.push_back(Op);
+            }
+        }
+        for (auto *Rec: Flat) {
+            if (!Rec->isAddRec()) {
+                continue;
+            }
+            std::vector<SCEV *> Starts, Steps, Rest;
+            for (auto *Op: Flat) {
+                if (Op->isAddRec() && Op->getLoop() == Rec->getLoop()) {
+                    Starts.push_back(Op->getStart());
+                    Steps.push_back(Op->getStep());
+                } else if (isLoopInvariant(Op, Rec->getLoop())) {
+                    Starts.push_back(Op);
+                } else {
+                    Rest.push_back(Op);
+                }
+            }
+            if (Starts.size() > 1) {
+                Rest.push_back(getAddRec(getAdd(Starts), getAdd(Steps), Rec->getLoop()));
+                return getAdd(Rest);
+            }
+        }
+
+        // the terms are coefficient * expression
+        int64_t Sum = 0;
+        std::vector<std::pair<int64_t, SCEV *>> Terms;
+        for (auto *Op: Flat) {
+            if (Op->isConstant()) {
+                Sum += Op->getConstant();
+                continue;
+            }
+            int64_t Coef = 1;
+            auto &Ops = Op->getOperands();
+            if (Op->getKind() == SCEV::Mul && Ops.size() == 2 && Ops[0]->isConstant()) {
+                Coef = Ops[0]->getConstant();
+                Op = Ops[1];
+            }
+            auto Iter = std::find_if(Terms.begin(), Terms.end(), [&](auto &term) { return term.second == Op; });
+            if (Iter == Terms.end()) {
+                Terms.emplace_back(Coef, Op);
+            } else {
+                Iter->first += Coef;
+            }
+        }
+        std::vector<SCEV *> Result;
+        if (Sum != 0) {
+            Result.push_back(getConstant(Sum));
+        }
+        for (auto &[Coef, Term]: Terms) {
+            if (Coef != 0) {
+                Result.push_back(Coef == 1 ? Term : getMul({getConstant(Coef), Term}));
+            }
+        }
+        if (Result.empty()) {
+            return getConstant(0);
+        }
+        return Result.size() == 1 ? Result[0] : create(SCEV::Add, 0, nullptr, nullptr, Result);
+    }
+
+    ///< The product with the constants folded, a constant is distributed over a sum and the invariants into a recurrence.
+    SCEV *getMul(std::vector<SCEV *> ops) {
+        int64_t Product = 1;
+        std::vector<SCEV *> Rest;
+        for (auto *Op: ops) {
+            std::vector<SCEV *> Factors = Op->getKind() == SCEV::Mul ? Op->getOperands() : std::vector<SCEV *>{Op};
+            for (auto *Factor: Factors) {
+                if (Factor->isConstant()) {
+                    Product *= Factor->getConstant();
+                } else {
+                    Rest.push_back(Factor);
+                }
+            }
+        }
+        if (Product == 0 || Rest.empty()) {
+            return getConstant(Product);
+        }
+        for (auto *Rec: Rest) {
+            if (!Rec->isAddRec()) {
+                continue;
+            }
+            std::vector<SCEV *> Factors{getConstant(Product)};
+            for (auto *Op: Rest) {
+                if (Op != Rec) {
+                    Factors.push_back(Op);
+                }
+            }
+            if (std::all_of(Factors.begin(), Factors.end(), [&](SCEV *op) { return isLoopInvariant(op, Rec->getLoop()); })) {
+                auto Start = Factors, Step = Factors;
+                Start.push_back(Rec->getStart());
+                Step.push_back(Rec->getStep());
+                return getAddRec(getMul(Start), getMul(Step), Rec->getLoop());
+            }
+        }
+        if (Product == 1 && Rest.size() == 1) {
+            return Rest[0];
+        }
+        if (Rest.size() == 1 && Rest[0]->getKind() == SCEV::Add) {
+            std::vector<SCEV *> Terms;
+            for (auto *Op: Rest[0]->getOperands()) {
+                Terms.push_back(getMul({getConstant(Product), Op}));
+            }
+            return getAdd(Terms);
+        }
+        if (Product != 1) {
+            Rest.insert(Rest.begin(), getConstant(Product));
+        }
+        return create(SCEV::Mul, 0, nullptr, nullptr, Rest);
+    }
+
+    SCEV *getSMax(SCEV *lhs, SCEV *rhs) {
+        if (lhs->isConstant() && rhs->isConstant()) {
+            return getConstant(std::max(lhs->getConstant(), rhs->getConstant()));
+        }
+        return lhs == rhs ? lhs : create(SCEV::SMax, 0, nullptr, nullptr, {lhs, rhs});
+    }
+
+    SCEV *getAddRec(SCEV *start, SCEV *step, Loop *loop) {
+        if (step->isConstant() && step->getConstant() == 0) {
+            return start;
+        }
+        return create(SCEV::AddRec, 0, nullptr, loop, {start, step});
+    }
+
+private:
+    LoopAnalyse *loopAnalyse = nullptr;
+    std::vector<std::unique_ptr<SCEV>> nodes;
+    std::map<int64_t, SCEV *> constants;
+    std::unordered_map<Value *, SCEV *> unknowns;
+    std::unordered_map<Value *, SCEV *> values;
+    std::vector<Value *> computed; ///< the values in the order their expressions were cached
+    std::unordered_map<Loop *, SCEV *> tripCounts;
+
+    SCEV *create(SCEV::Kind kind, int64_t constant, Value *value, Loop *loop, std::vector<SCEV *> operands) {
+        nodes.emplace_back(std::make_unique<SCEV>(kind, constant, value, loop, std::move(operands)));
+        return nodes.back().get();
+    }
+
+    SCEV *createSCEV(Value *val) {
+        if (auto *Const = val->as<IntConstant>()) {
+            return getConstant(Const->getVal());
+        }
+        auto *Inst = val->as<Instruction>();
+        if (!Inst || !Inst->getType() || !Inst->getType()->isIntegerType()) {
+            return getUnknown(val);
+        }
+        if (auto *Phi = Inst->as<PhiInst>()) {
+            return createPhiSCEV(Phi);
+        }
+        auto *Bin = Inst->as<BinaryInst>();
+        if (!Bin) {
+            return getUnknown(val);
+        }
+        switch (Bin->getOp()) {
+            case BinaryOp::Add:
+                return getAdd({getSCEV(Bin->getLHS()), getSCEV(Bin->getRHS())});
+            case BinaryOp::Sub:
+                return getAdd({getSCEV(Bin->getLHS()), getMul({getConstant(-1), getSCEV(Bin->getRHS())})});
+            case BinaryOp::Mul: {
+                auto *Product = getMul({getSCEV(Bin->getLHS()), getSCEV(Bin->getRHS())});
+                // a product of two recurrences isn't affine
+                return Product->getKind() == SCEV::Mul && !isAffineProduct(Product) ? getUnknown(val) : Product;
+            }
+            default:
+                return getUnknown(val);
+        }
+    }
+
+    static bool isAffineProduct(SCEV *product) {
+        return std::none_of(product->getOperands().begin(), product->getOperands().end(), [](SCEV *op) {
+            return op->isAddRec();
+        });
+    }
+
+    ///< A phi of a header is a recurrence when its next value is the phi plus an invariant.
+    SCEV *createPhiSCEV(PhiInst *phi) {
+        auto *L = loopAnalyse->getLoopFor(phi->getParent());
+        if (!L || L->getHeader() != phi->getParent() || phi->getOperandNum() != 2) {
+            return getUnknown(phi);
+        }
+        Value *Start = nullptr, *Next = nullptr;
+        for (size_t I = 0; I < 2; ++I) {
+            (L->contains(phi->getIncomingBlock(I)) ? Next : Start) = phi->getOperand(I);
+        }
+        if (!Start || !Next) {
+            return getUnknown(phi);
+        }
+        // the phi stands for itself while its next value is analysed, the expressions made of it are dropped
+        auto *Self = getUnknown(phi);
+        auto Mark = computed.size();
+        values[phi] = Self;
+        computed.push_back(phi);
+        auto *NextExpr = getSCEV(Next);
+        for (auto I = computed.size(); I > Mark; --I) {
+            values.erase(computed[I - 1]);
+        }
+        computed.resize(Mark);
+        if (NextExpr->getKind() != SCEV::Add) {
+            return getUnknown(phi);
+        }
+        auto &Ops = NextExpr->getOperands();
+        if (std::count(Ops.begin(), Ops.end(), Self) != 1) {
+            return getUnknown(phi);
+        }
+        std::vector<SCEV *> Steps;
+        std::copy_if(Ops.begin(), Ops.end(), std::back_inserter(Steps), [&](SCEV *op) { return op != Self; });
+        auto *Step = getAdd(Steps);
+        if (!isLoopInvariant(Step, L)) {
+            return getUnknown(phi);
+        }
+        return getAddRec(getSCEV(Start), Step, L);
+    }
+
+    static BinaryOp getInversePredicate(BinaryOp op) {
+        switch (op) {
+            case BinaryOp::Eq: return BinaryOp::Ne;
+            case BinaryOp::Ne: return BinaryOp::Eq;
+            case BinaryOp::Lt: return BinaryOp::Ge;
+            case BinaryOp::Ge: return BinaryOp::Lt;
+            case BinaryOp::Le: return BinaryOp::Gt;
+            case BinaryOp::Gt: return BinaryOp::Le;
+            default: UNREACHEABLE();
+        }
+    }
+
+    static BinaryOp getSwappedPredicate(BinaryOp op) {
+        switch (op) {
+            case BinaryOp::Lt: return BinaryOp::Gt;
+            case BinaryOp::Gt: return BinaryOp::Lt;
+            case BinaryOp::Le: return BinaryOp::Ge;
+            case BinaryOp::Ge: return BinaryOp::Le;
+            default: return op;
+        }
+    }
+
+    SCEV *computeTripCount(Loop *loop) {
+        BasicBlock *Exiting = nullptr;
+        for (auto *BB: loop->getBlocks()) {
+            for (auto *Succ: BB->succs()) {
+                if (!loop->contains(Succ)) {
+                    if (Exiting && Exiting != BB) {
+                        return nullptr;
+                    }
+                    Exiting = BB;
+                }
+            }
+        }
+        auto &Latches = loop->getLatches();
+        if (!Exiting || (Exiting != loop->getHeader() && (Latches.size() != 1 || Latches[0] != Exiting))) {
+            return nullptr;
+        }
+        auto *Br = Exiting->getTerminator()->as<CondBrInst>();
+        auto *Cmp = Br ? Br->getCond()->as<BinaryInst>() : nullptr;
+        if (!Cmp || Cmp->getOp() < BinaryOp::Eq || Cmp->getOp() > BinaryOp::Ge) {
+            return nullptr;
+        }
+        // the loop goes on while the predicate holds
+        auto Pred = loop->contains(Br->getTrueTarget()) ? Cmp->getOp() : getInversePredicate(Cmp->getOp());
+        auto *IV = getSCEV(Cmp->getLHS()), *Bound = getSCEV(Cmp->getRHS());
+        if (!IV->isAddRec() || IV->getLoop() != loop) {
+            std::swap(IV, Bound);
+            Pred = getSwappedPredicate(Pred);
+        }
+        if (!IV->isAddRec() || IV->getLoop() != loop || !IV->getStep()->isConstant() || !isLoopInvariant(Bound, loop)) {
+            return nullptr;
+        }
+        return computeTripCount(Pred, IV->getStart(), IV->getStep()->getConstant(), Bound);
+    }
+
+    ///< The iterations of `{start,+,step} pred bound` before the predicate fails.
+    SCEV *computeTripCount(BinaryOp pred, SCEV *start, int64_t step, SCEV *bound) {
+        auto *Minus = getConstant(-1);
+        SCEV *Distance; // what the strides cover, counted by the positive stride
+        int64_t Stride = step > 0 ? step : -step;
+        switch (pred) {
+            case BinaryOp::Lt:
+            case BinaryOp::Le:
+                if (step < 0) {
+                    return nullptr;
+                }
+                Distance = getAdd({bound, getMul({Minus, start}), getConstant(pred == BinaryOp::Le)});
+                break;
+            case BinaryOp::Gt:
+            case BinaryOp::Ge:
+                if (step > 0) {
+                    return nullptr;
+                }
+                Distance = getAdd({start, getMul({Minus, bound}), getConstant(pred == BinaryOp::Ge)});
+                break;
+            case BinaryOp::Ne: {
+                // the recurrence must hit the bound
+                Distance = step > 0 ? getAdd({bound, getMul({Minus, start})}) : getAdd({start, getMul({Minus, bound})});
+                if (Distance->isConstant()) {
+                    auto D = Distance->getConstant();
+                    return D >= 0 && D % Stride == 0 ? getConstant(D / Stride) : nullptr;
+                }
+                return Stride == 1 ? Distance : nullptr;
+            }
+            default:
+                return nullptr;
+        }
+        if (Distance->isConstant()) {
+            auto D = Distance->getConstant();
+            return getConstant(D > 0 ? (D + Stride - 1) / Stride : 0);
+        }
+        return Stride == 1 ? getSMax(Distance, getConstant(0)) : nullptr;
+    }
+
+};
+
+
+#endif //DRAGON_SCALAREVOLUTION_H
@@ -0,0 +1,241 @@
+//
+// Created by Alex on 2022/6/14.
+//
+
+#ifndef DRAGON_SCALARPROMOTION_H
+#define DRAGON_SCALARPROMOTION_H
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include "PassManager.h"
+#include "Function.h"
+#include "LoopAnalyse.h"
+#include "LoopSimplify.h"
+#include "LICM.h"
+#include "AliasAnalysis.h"
+#include "SSABuilder.h"
+
+/**
+ * Promote the memory locations accessed in a loop to SSA values (register promotion).
+ * A location is promoted when its address is loop invariant, all its accesses in the loop are
+ * loads and stores of must alias pointers, and no other access or call in the loop may touch it.
+ * It is loaded once in the preheader and stored once at the start of every exit, the loads and
+ * the stores in the loop are rewritten by the SSABuilder, with the phis it places at the joins.
+ * The exits must only be entered from the loop, and the location must be safe to load in the
+ * preheader: into an alloca or a global at a constant offset, or accessed on every iteration.
+ * The loops are done from the inner ones out, the load and the stores left around an inner loop
+ * are promoted again with the outer one.
+ */
+class ScalarPromotion : public LoopPass {
+public:
+    FunctionPass *clone() const override { return new ScalarPromotion(); }
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses().preserve<Dominance>().preserve<LoopAnalyse>();
+    }
+    void runOnFunction(Function &function) override {
+        LoopSimplify::ensurePreheaders(*this, function);
+        aliasAnalysis.clear();
+        for (auto &Loop: function.loops) {
+            runOnLoop(Loop);
+        }
+    }
+
+    void runOnLoop(Loop &loop) override {
+        auto *Preheader = loop.getPreheader();
+        if (Preheader == nullptr || !hasDedicatedExits(loop)) {
+            return;
+        }
+        collect(loop);
+        std::vector<Location *> Promotable;
+        for (auto &Loc: locations) {
+            if (canPromote(Loc)) {
+                Promotable.push_back(&Loc);
+            }
+        }
+        for (auto *Loc: Promotable) {
+            promote(*Loc, loop);
+        }
+    }
+
+private:
+    ///< The loads and the stores of must alias pointers.
+    struct Location {
+        Value *ptr = nullptr;
+        Type *type = nullptr;
+        std::vector<Instruction *> accesses;
+        bool hasStore = false;
+    };
+    std::vector<Location> locations;
+    std::unordered_map<Instruction *, size_t> locationOf; ///< access -> the index of its location
+    std::vector<Instruction *> accesses; ///< all the loads and the stores of the loop
+    std::vector<BasicBlock *> blocks; ///< the blocks of the loop in the preorder of the dominator tree
+    std::vector<BasicBlock *> exiting;
+    bool hasCalls = false; ///< like a call, a vector access may touch any escaped memory
+    AliasAnalysis aliasAnalysis;
+    SSABuilder builder;
+    std::unordered_map<BasicBlock *, unsigned> unfilledPreds;
+
+    static Value *getPtr(Instruction *inst) {
+        if (auto *Load = inst->as<LoadInst>()) {
+            return Load->getPtr();
+        }
+        return inst->cast<StoreInst>()->getPtr();
+    }
+
+    static Type *getAccessType(Instruction *inst) {
+        if (auto *Store = inst->as<StoreInst>()) {
+            return Store->getVal()->getType();
+        }
+        return inst->getType();
+    }
+
+    bool isAccessOf(Instruction *inst, Location &loc) const {
+        auto Iter = locationOf.find(inst);
+        return Iter != locationOf.end() && &locations[Iter->second] == &loc;
+    }
+
+    ///< Every exit is only entered from the loop, so the stores there only run after it.
+    static bool hasDedicatedExits(Loop &loop) {
+        return std::all_of(loop.getExits().begin(), loop.getExits().end(), [&](BasicBlock *exit) {
+            for (auto *Pred: exit->preds()) {
+                if (!loop.contains(Pred)) {
+                    return false;
+                }
+            }
+            return true;
+        });
+    }
+
+    void collect(Loop &loop) {
+        blocks = loop.getBlocks();
+        std::sort(blocks.begin(), blocks.end(), [](BasicBlock *lhs, BasicBlock *rhs) {
+            return lhs->getDFSIn() < rhs->getDFSIn();
+        });
+        locations.clear();
+        locationOf.clear();
+        accesses.clear();
+        exiting.clear();
+        hasCalls = false;
+        for (auto *BB: blocks) {
+            for (auto &Inst: *BB) {
+                if (auto *Call = Inst.as<CallInst>()) {
+                    hasCalls = hasCalls || !(Call->getCallee() && Call->getCallee()->isPure());
+                    continue;
+                }
+                if (auto *Vector = Inst.as<VectorInst>()) {
+                    hasCalls = hasCalls || Vector->isMemoryAccess();
+                    continue;
+                }
+                if (!Inst.isa<LoadInst>() && !Inst.isa<StoreInst>()) {
+                    continue;
+                }
+                accesses.push_back(&Inst);
+                auto *Ptr = getPtr(&Inst);
+                if (!loop.isLoopInvariant(Ptr)) {
+                    continue;
+                }
+                auto Iter = std::find_if(locations.begin(), locations.end(), [&](Location &loc) {
+                    return aliasAnalysis.alias(loc.ptr, Ptr) == AliasResult::MustAlias;
+                });
+                auto &Loc = Iter == locations.end() ? locations.emplace_back() : *Iter;
+                if (Loc.ptr == nullptr) {
+                    Loc.ptr = Ptr;
+                    Loc.type = getAccessType(&Inst);
+                }
+                locationOf[&Inst] = &Loc - locations.data();
+                Loc.accesses.push_back(&Inst);
+                Loc.hasStore = Loc.hasStore || Inst.isa<StoreInst>();
+            }
+            for (auto *Succ: BB->succs()) {
+                if (!loop.contains(Succ)) {
+                    exiting.push_back(BB);
+                    break;
+                }
+            }
+        }
+    }
+
+    ///< Only the accesses and the exiting blocks collected from the loop are scanned.
+    bool canPromote(Location &loc) {
+        // a location only read in the loop is left to LICM
+        if (!loc.hasStore || (hasCalls && aliasAnalysis.mayCallAccess(loc.ptr))) {
+            return false;
+        }
+        for (auto *Inst: loc.accesses) {
+            if (getAccessType(Inst) != loc.type) {
+                return false;
+            }
+        }
+        for (auto *Inst: accesses) {
+            if (!isAccessOf(Inst, loc) && aliasAnalysis.alias(getPtr(Inst), loc.ptr) != AliasResult::NoAlias) {
+                return false;
+            }
+        }
+        if (LICM::isDereferenceable(loc.ptr)) {
+            return true;
+        }
+        return std::any_of(loc.accesses.begin(), loc.accesses.end(), [&](Instruction *inst) {
+            return std::all_of(exiting.begin(), exiting.end(), [&](BasicBlock *exit) {
+                return inst->getParent()->dominates(exit);
+            });
+        });
+    }
+
+    void promote(Location &loc, Loop &loop) {
+        auto *Preheader = loop.getPreheader();
+        auto *Var = builder.createVariable("promoted", loc.type);
+        auto *Init = new LoadInst(loc.ptr);
+        Preheader->append(Init);
+        Init->setName("promoted");
+        builder.writeVariable(Var, Preheader, Init);
+        builder.sealBlock(Preheader);
+
+        // a block is sealed once all its preds are filled, the header waits for the latches
+        unfilledPreds.clear();
+        for (auto *BB: blocks) {
+            for (auto *Pred: BB->preds()) {
+                if (Pred != Preheader) {
+                    unfilledPreds[BB]++;
+                }
+            }
+        }
+        std::vector<Instruction *> Insts;
+        for (auto *BB: blocks) {
+            Insts.clear();
+            for (auto &Inst: *BB) {
+                if (isAccessOf(&Inst, loc)) {
+                    Insts.push_back(&Inst);
+                }
+            }
+            for (auto *Inst: Insts) {
+                if (auto *Store = Inst->as<StoreInst>()) {
+                    builder.writeVariable(Var, BB, Store->getVal());
+                } else {
+                    Inst->replaceAllUsesWith(builder.readVariable(Var, BB));
+                }
+                locationOf.erase(Inst);
+                Inst->eraseFromParent();
+            }
+            if (unfilledPreds[BB] == 0) {
+                builder.sealBlock(BB);
+            }
+            for (auto *Succ: BB->succs()) {
+                if (loop.contains(Succ) && --unfilledPreds[Succ] == 0) {
+                    builder.sealBlock(Succ);
+                }
+            }
+        }
+
+        for (auto *Exit: loop.getExits()) {
+            builder.sealBlock(Exit);
+            auto *Store = new StoreInst(loc.ptr, builder.readVariable(Var, Exit));
+            Exit->insertBefore(&*Exit->getInstrs().begin(), Store);
+        }
+        builder.finish();
+    }
+
+};
+
+
+#endif //DRAGON_SCALARPROMOTION_H
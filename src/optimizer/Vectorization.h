@@ -5,11 +5,700 @@
 #ifndef DRAGON_VECTORIZATION_H
 #define DRAGON_VECTORIZATION_H
 
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include "PassManager.h"
+#include "Function.h"
+#include "LoopAnalyse.h"
+#include "AliasAnalysis.h"
+
 /**
- * SLP Vecotrization
- * Loop Vectorization
+ * Loop Vectorization, strip mined for a vector length agnostic target like the RISC-V V extension.
+ * An inner loop `for (i = start; i < n; i = i + 1)` made of its header and one body is rewritten
+ * in place: the body sets the length of the strip from the elements left, works on a strip of
+ * elements per iteration and steps the induction by the length. The last strip is just shorter,
+ * so the loop needs no scalar epilogue.
+ * The body may load and store `base[i]` with loop invariant bases, compute element wise binaries
+ * of them and of loop invariants, and update reductions: a phi of the header combined with a value
+ * of the body by an add, an and, an or or a xor. An iteration only touches the element i of every
+ * array, so there is no dependence carried between the iterations through one base, and the stores
+ * must not alias the accesses through the other bases. The elements must be words.
  */
-class Vectorization {
+class LoopVectorize : public LoopPass {
+public:
+    FunctionPass *clone() const override { return new LoopVectorize(); }
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses().preserve<Dominance>().preserve<LoopAnalyse>();
+    }
+    ///< the vector values a body may define with its splats and accumulators, the registers left by the target
+    static constexpr unsigned MaxVectorValues = 24;
+
+    void runOnFunction(Function &function) override {
+        getAnalysis<LoopAnalyse>(function);
+        aliasAnalysis.clear();
+        for (auto &Loop: function.loops) {
+            runOnLoop(Loop);
+        }
+    }
+
+    void runOnLoop(Loop &loop) override {
+        if (canVectorize(loop)) {
+            vectorize();
+        }
+    }
+
+    ///< Can the binary work on the elements of a strip?
+    static bool isVectorizable(BinaryOp op) {
+        switch (op) {
+            case Add:
+            case Sub:
+            case Mul:
+            case Div:
+            case And:
+            case Or:
+            case Xor:
+            case Shl:
+            case Shr:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+private:
+    struct Reduction {
+        PhiInst *phi;
+        BinaryInst *update; ///< the value of the phi from the body
+        Value *val; ///< the value of the body combined with the phi
+    };
+    BasicBlock *body = nullptr;
+    PhiInst *induction = nullptr;
+    BinaryInst *step = nullptr; ///< the induction plus one
+    Value *bound = nullptr;
+    std::vector<Reduction> reductions;
+    std::vector<Instruction *> insts; ///< the loads, the binaries and the stores of the body in order
+    std::vector<Instruction *> accesses;
+    std::unordered_map<Value *, Value *> widened; ///< scalar in the body -> its vector, null before the rewrite
+    std::unordered_map<Value *, Value *> splats; ///< loop invariant -> its splat, null before the rewrite
+    Instruction *top = nullptr; ///< the splats go before it, right after the setvl
+    AliasAnalysis aliasAnalysis;
+
+    inline bool isVector(Value *val) const {
+        return widened.count(val) != 0;
+    }
+
+    static Value *getPtr(Instruction *inst) {
+        if (auto *Load = inst->as<LoadInst>()) {
+            return Load->getPtr();
+        }
+        return inst->cast<StoreInst>()->getPtr();
+    }
+
+    ///< Is the pointer `base[i]` with a loop invariant base and word elements?
+    bool isUnitStride(Value *ptr, Loop &loop) const {
+        auto *GetPtr = ptr->as<GetPtrInst>();
+        if (!GetPtr || GetPtr->getOffset() != induction || !loop.isLoopInvariant(GetPtr->getBase())) {
+            return false;
+        }
+        auto *Ty = GetPtr->getType();
+        return Ty && Ty->isPointerType() && Ty->getPointerElementType()->isIntegerType();
+    }
+
+    bool canVectorize(Loop &loop) {
+        auto *Header = loop.getHeader();
+        if (loop.getBlocks().size() != 2 || loop.getLatches().size() != 1 || loop.getLatches()[0] == Header) {
+            return false;
+        }
+        body = loop.getLatches()[0];
+        if (body->hasPhi() || body->hasMultiplePredecessor()) {
+            return false;
+        }
+        // the header only tests the induction against the bound
+        auto *Br = Header->getTerminator()->as<CondBrInst>();
+        if (!Br || Br->getTrueTarget() != body || loop.contains(Br->getFalseTarget())) {
+            return false;
+        }
+        auto *Cond = Br->getCond()->as<BinaryInst>();
+        if (!Cond || Cond->getOp() != Lt || !loop.isLoopInvariant(Cond->getRHS()) ||
+            &*Header->getInstrs().begin() != Cond || Cond->getNext() != Br) {
+            return false;
+        }
+        induction = Cond->getLHS()->as<PhiInst>();
+        bound = Cond->getRHS();
+        if (!induction || induction->getParent() != Header || !findInduction() || !findReductions(Header)) {
+            return false;
+        }
+
+        widened.clear();
+        insts.clear();
+        accesses.clear();
+        for (auto &Inst: body->getInstrs()) {
+            if (&Inst == step || Inst.isTerminator() || std::any_of(reductions.begin(), reductions.end(),
+                                                                    [&](Reduction &red) { return red.update == &Inst; })) {
+                continue;
+            }
+            switch (Inst.getOpcode()) {
+                case OpcodeGetPtr:
+                    // the address of a strip, only used by the accesses
+                    if (!isUnitStride(&Inst, loop)) {
+                        return false;
+                    }
+                    continue;
+                case OpcodeLoad:
+                    if (!isUnitStride(getPtr(&Inst), loop)) {
+                        return false;
+                    }
+                    widened[&Inst] = nullptr;
+                    accesses.push_back(&Inst);
+                    break;
+                case OpcodeStore: {
+                    auto *Val = Inst.cast<StoreInst>()->getVal();
+                    if (!isUnitStride(getPtr(&Inst), loop) || !(isVector(Val) || loop.isLoopInvariant(Val))) {
+                        return false;
+                    }
+                    accesses.push_back(&Inst);
+                    break;
+                }
+                case OpcodeBinary: {
+                    auto *Bin = Inst.cast<BinaryInst>();
+                    auto *LHS = Bin->getLHS(), *RHS = Bin->getRHS();
+                    if (!isVectorizable(Bin->getOp()) || !(isVector(LHS) || isVector(RHS)) ||
+                        !(isVector(LHS) || loop.isLoopInvariant(LHS)) || !(isVector(RHS) || loop.isLoopInvariant(RHS))) {
+                        return false;
+                    }
+                    widened[&Inst] = nullptr;
+                    break;
+                }
+                default:
+                    return false;
+            }
+            insts.push_back(&Inst);
+        }
+        // the GetPtrs only feed the accesses as their pointers
+        for (auto &Inst: body->getInstrs()) {
+            if (!Inst.isa<GetPtrInst>()) {
+                continue;
+            }
+            for (auto &Use: Inst.getUses()) {
+                auto *User = Use.getUser()->cast<Instruction>();
+                if (std::find(accesses.begin(), accesses.end(), User) == accesses.end() || User->getOperand(0) != &Inst) {
+                    return false;
+                }
+            }
+        }
+        for (auto &Red: reductions) {
+            if (!isVector(Red.val)) {
+                return false;
+            }
+        }
+        // an invariant is splat once when it is stored or is the lhs of a binary that can't swap
+        splats.clear();
+        for (auto *Inst: insts) {
+            if (auto *Store = Inst->as<StoreInst>()) {
+                if (!isVector(Store->getVal())) {
+                    splats[Store->getVal()] = nullptr;
+                }
+            } else if (auto *Bin = Inst->as<BinaryInst>()) {
+                if (!isVector(Bin->getLHS()) && !isCommutative(Bin->getOp())) {
+                    splats[Bin->getLHS()] = nullptr;
+                }
+            }
+        }
+        // every reduction takes a register for its accumulator
+        if (widened.size() + splats.size() + reductions.size() > MaxVectorValues) {
+            return false;
+        }
+        return !hasDependence();
+    }
+
+    ///< The induction starts anywhere and steps by one.
+    bool findInduction() {
+        if (induction->getOperandNum() != 2) {
+            return false;
+        }
+        step = induction->findIncomingValue(body)->as<BinaryInst>();
+        if (!step || step->getParent() != body || step->getOp() != Add || !step->isOnlyUsedOnce()) {
+            return false;
+        }
+        auto *One = step->getRHS()->as<IntConstant>();
+        return step->getLHS() == induction && One && One->getVal() == 1;
+    }
+
+    bool findReductions(BasicBlock *header) {
+        reductions.clear();
+        for (auto &Phi: header->phis()) {
+            if (&Phi == induction) {
+                continue;
+            }
+            if (Phi.getOperandNum() != 2) {
+                return false;
+            }
+            auto *Update = Phi.findIncomingValue(body)->as<BinaryInst>();
+            if (!Update || Update->getParent() != body || !Update->isOnlyUsedOnce()) {
+                return false;
+            }
+            auto Op = Update->getOp();
+            if (Op != Add && Op != And && Op != Or && Op != Xor) {
+                return false;
+            }
+            auto *Val = Update->getLHS() == &Phi ? Update->getRHS() : Update->getLHS();
+            if (Val == &Phi || (Update->getLHS() != &Phi && Update->getRHS() != &Phi)) {
+                return false;
+            }
+            // the partial values of the phi are only seen by the update, the exit sees the total
+            for (auto &Use: Phi.getUses()) {
+                auto *User = Use.getUser()->cast<Instruction>();
+                if (User->getParent() == body && User != Update) {
+                    return false;
+                }
+            }
+            reductions.push_back({&Phi, Update, Val});
+        }
+        return true;
+    }
+
+    ///< Does a store alias an access through another base?
+    bool hasDependence() {
+        for (auto *Store: accesses) {
+            if (!Store->isa<StoreInst>()) {
+                continue;
+            }
+            auto *StoreBase = getPtr(Store)->cast<GetPtrInst>()->getBase();
+            for (auto *Other: accesses) {
+                auto *OtherBase = getPtr(Other)->cast<GetPtrInst>()->getBase();
+                if (!AliasAnalysis::isSamePointer(StoreBase, OtherBase) &&
+                    aliasAnalysis.alias(getPtr(Store), getPtr(Other)) != AliasResult::NoAlias) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    ///< The vector of a value in the body, a loop invariant is splat once at the top when it must be a vector.
+    Value *getVector(Value *val, Value *vl, bool splat) {
+        if (isVector(val)) {
+            return widened[val];
+        }
+        if (!splat) {
+            return val;
+        }
+        auto &Splat = splats[val];
+        if (Splat == nullptr) {
+            auto *New = VectorInst::CreateSplat(val, vl);
+            body->insertBefore(top, New);
+            New->setName("splat");
+            Splat = New;
+        }
+        return Splat;
+    }
+
+    void vectorize() {
+        auto *First = &*body->getInstrs().begin();
+        top = First;
+        auto *AVL = BinaryInst::Create(Sub, bound, induction);
+        body->insertBefore(First, AVL);
+        AVL->setName("avl");
+        auto *VL = VectorInst::CreateSetVL(AVL);
+        body->insertBefore(First, VL);
+        VL->setName("vl");
+
+        for (auto *Inst: insts) {
+            VectorInst *New;
+            if (auto *Load = Inst->as<LoadInst>()) {
+                New = VectorInst::CreateLoad(Load->getPtr(), VL);
+            } else if (auto *Store = Inst->as<StoreInst>()) {
+                New = VectorInst::CreateStore(Store->getPtr(), getVector(Store->getVal(), VL, true), VL);
+            } else {
+                auto *Bin = Inst->cast<BinaryInst>();
+                auto *LHS = Bin->getLHS(), *RHS = Bin->getRHS();
+                // only the rhs may be a scalar
+                if (!isVector(LHS) && isCommutative(Bin->getOp())) {
+                    std::swap(LHS, RHS);
+                }
+                New = VectorInst::CreateBinary(Bin->getOp(), getVector(LHS, VL, true),
+                                               getVector(RHS, VL, false), VL);
+            }
+            body->insertBefore(Inst, New);
+            if (!Inst->isa<StoreInst>()) {
+                New->setName("vec");
+                widened[Inst] = New;
+            }
+        }
+        for (auto &Red: reductions) {
+            auto *New = VectorInst::CreateReduce(Red.update->getOp(), widened[Red.val], Red.phi, VL);
+            body->insertBefore(Red.update, New);
+            New->setName("red");
+            Red.update->replaceAllUsesWith(New);
+            Red.update->eraseFromParent();
+        }
+        step->setOperand(1, VL);
+        for (auto Iter = insts.rbegin(); Iter != insts.rend(); ++Iter) {
+            (*Iter)->eraseFromParent();
+        }
+    }
+
+};
+
+/**
+ * Superword Level Parallelism, "Exploiting Superword Level Parallelism with Multimedia Instruction
+ * Sets" Samuel Larsen, Saman Amarasinghe.
+ * The stores of a block to consecutive elements, `base[k]` to `base[k + 3]` with a constant k or
+ * an index plus constants, are the seeds. Their values are grown bottom up into a tree of
+ * isomorphic lanes: the loads of consecutive elements, the binaries with the same op, or the same
+ * scalar in every lane, which is splat. The tree is computed by vector instructions at the last
+ * store of the group when the cost model says it pays: an instruction saved for every scalar that
+ * dies against an instruction for every vector, the setvl and the store.
+ * The loads move down and the stores move together to the last store, so no access in between
+ * may alias them. A group has at most 4 lanes, the strip any RISC-V V target holds for words.
+ * The tree of a group dies at its store and the target frees a strip after its last use, so the
+ * vector registers of a block are those of its largest tree, which must fit the target's budget.
+ */
+class SLPVectorize : public FunctionPass {
+public:
+    FunctionPass *clone() const override { return new SLPVectorize(); }
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses().preserve<Dominance>().preserve<LoopAnalyse>();
+    }
+    static constexpr unsigned MaxLanes = 4;
+
+    void runOnFunction(Function &function) override {
+        aliasAnalysis.clear();
+        for (auto &BB: function) {
+            runOnBlock(&BB);
+        }
+    }
+
+    void runOnBlock(BasicBlock *bb) {
+        block = bb;
+        std::vector<std::vector<StoreInst *>> Groups;
+        collectGroups(Groups);
+        for (auto &Group: Groups) {
+            nodes.clear();
+            std::vector<Value *> Vals;
+            for (auto *Store: Group) {
+                Vals.push_back(Store->getVal());
+            }
+            if (build(Vals) >= 0 && getVectorNum() <= LoopVectorize::MaxVectorValues && isProfitable(Group) &&
+                isSafe(Group)) {
+                vectorize(Group);
+            }
+        }
+    }
+
+private:
+    ///< A pointer `base[index + offset]`, the index is null for a constant offset.
+    struct Address {
+        Value *base = nullptr;
+        Value *index = nullptr;
+        int64_t offset = 0;
+    };
+    struct Node {
+        enum Kind {
+            Load,
+            Binary,
+            Splat,
+        } kind;
+        std::vector<Value *> lanes;
+        BinaryOp op = BinNone;
+        int lhs = -1, rhs = -1;
+        Value *vector = nullptr;
+    };
+    BasicBlock *block = nullptr;
+    std::vector<Node> nodes; ///< the children come before their parents
+    std::unordered_map<Instruction *, unsigned> positions;
+    AliasAnalysis aliasAnalysis;
+
+    static bool getAddress(Value *ptr, Address &addr) {
+        auto *GetPtr = ptr->as<GetPtrInst>();
+        if (!GetPtr || !GetPtr->getType()->getPointerElementType()->isIntegerType()) {
+            return false;
+        }
+        addr.base = GetPtr->getBase();
+        auto *Offset = GetPtr->getOffset();
+        auto *Bin = Offset->as<BinaryInst>();
+        if (auto *Const = Offset->as<IntConstant>()) {
+            addr.index = nullptr;
+            addr.offset = Const->getVal();
+        } else if (Bin && Bin->getOp() == Add && Bin->getRHS()->isa<IntConstant>()) {
+            addr.index = Bin->getLHS();
+            addr.offset = Bin->getRHS()->cast<IntConstant>()->getVal();
+        } else {
+            addr.index = Offset;
+            addr.offset = 0;
+        }
+        return true;
+    }
+
+    ///< Does the second pointer point to the element after the first?
+    static bool isNextElement(Value *lhs, Value *rhs) {
+        Address L, R;
+        return getAddress(lhs, L) && getAddress(rhs, R) && AliasAnalysis::isSamePointer(L.base, R.base) &&
+               L.index == R.index && L.offset + 1 == R.offset;
+    }
+
+    ///< The runs of stores to consecutive elements, cut into groups of at most MaxLanes.
+    void collectGroups(std::vector<std::vector<StoreInst *>> &groups) {
+        std::vector<StoreInst *> Stores;
+        for (auto &Inst: *block) {
+            Address Addr;
+            if (auto *Store = Inst.as<StoreInst>(); Store && getAddress(Store->getPtr(), Addr)) {
+                Stores.push_back(Store);
+            }
+        }
+        auto FindNext = [&](StoreInst *store) {
+            auto Iter = std::find_if(Stores.begin(), Stores.end(), [&](StoreInst *next) {
+                return isNextElement(store->getPtr(), next->getPtr());
+            });
+            return Iter == Stores.end() ? nullptr : *Iter;
+        };
+        for (auto *Store: Stores) {
+            // a run starts at a store without a store to the element before
+            if (std::any_of(Stores.begin(), Stores.end(), [&](StoreInst *prev) {
+                return isNextElement(prev->getPtr(), Store->getPtr());
+            })) {
+                continue;
+            }
+            std::vector<StoreInst *> Run;
+            for (auto *Lane = Store; Lane && Run.size() < Stores.size(); Lane = FindNext(Lane)) {
+                Run.push_back(Lane);
+            }
+            for (size_t I = 0; I + 1 < Run.size(); I += MaxLanes) {
+                auto End = std::min(Run.size(), I + MaxLanes);
+                groups.emplace_back(Run.begin() + I, Run.begin() + End);
+            }
+        }
+    }
+
+    ///< Grow a node of the lanes, its index or -1 if they aren't isomorphic.
+    ///< The operands the lanes share, like `x[c] * x[c]`, are one node.
+    int build(const std::vector<Value *> &lanes) {
+        for (size_t I = 0; I < nodes.size(); ++I) {
+            if (nodes[I].lanes == lanes) {
+                return int(I);
+            }
+        }
+        Node New;
+        New.lanes = lanes;
+        auto *First = lanes[0]->as<Instruction>();
+        if (std::all_of(lanes.begin(), lanes.end(), [&](Value *lane) { return lane == lanes[0]; })) {
+            New.kind = Node::Splat;
+        } else if (First && First->getParent() == block && (First->isa<LoadInst>() || First->isa<BinaryInst>())) {
+            for (size_t I = 0; I < lanes.size(); ++I) {
+                auto *Lane = lanes[I]->as<Instruction>();
+                if (!Lane || Lane->getParent() != block || Lane->getOpcode() != First->getOpcode() ||
+                    std::count(lanes.begin(), lanes.end(), Lane) != 1) {
+                    return -1;
+                }
+                if (auto *Load = Lane->as<LoadInst>()) {
+                    if (I > 0 && !isNextElement(lanes[I - 1]->cast<LoadInst>()->getPtr(), Load->getPtr())) {
+                        return -1;
+                    }
+                } else if (Lane->cast<BinaryInst>()->getOp() != First->cast<BinaryInst>()->getOp()) {
+                    return -1;
+                }
+            }
+            if (auto *Bin = First->as<BinaryInst>()) {
+                if (!LoopVectorize::isVectorizable(Bin->getOp())) {
+                    return -1;
+                }
+                std::vector<Value *> LHS, RHS;
+                for (auto *Lane: lanes) {
+                    LHS.push_back(Lane->cast<BinaryInst>()->getLHS());
+                    RHS.push_back(Lane->cast<BinaryInst>()->getRHS());
+                }
+                New.kind = Node::Binary;
+                New.op = Bin->getOp();
+                New.lhs = build(LHS);
+                New.rhs = New.lhs < 0 ? -1 : build(RHS);
+                if (New.rhs < 0) {
+                    return -1;
+                }
+            } else {
+                Address Addr;
+                if (!getAddress(First->cast<LoadInst>()->getPtr(), Addr)) {
+                    return -1;
+                }
+                New.kind = Node::Load;
+            }
+        } else {
+            return -1;
+        }
+        nodes.push_back(New);
+        return int(nodes.size() - 1);
+    }
+
+    ///< Must the lhs of the binary be splat? A scalar rhs is used as it is.
+    bool needsSplat(Node &node) {
+        return nodes[node.lhs].kind == Node::Splat && (nodes[node.rhs].kind == Node::Splat || !isCommutative(node.op));
+    }
+
+    ///< The vector values the tree defines: its loads, its binaries and the splats they need.
+    unsigned getVectorNum() {
+        unsigned Num = nodes.back().kind == Node::Splat;
+        for (auto &Node: nodes) {
+            Num += Node.kind == Node::Load || Node.kind == Node::Binary;
+            Num += Node.kind == Node::Binary && needsSplat(Node);
+        }
+        return Num;
+    }
+
+    ///< Does the tree save instructions? A lane with a user out of the tree stays.
+    bool isProfitable(std::vector<StoreInst *> &group) {
+        std::unordered_set<Value *> Dead(group.begin(), group.end());
+        unsigned Scalar = group.size(), Vector = 2; // the setvl and the store
+        Vector += nodes.back().kind == Node::Splat;
+        for (auto Iter = nodes.rbegin(); Iter != nodes.rend(); ++Iter) {
+            if (Iter->kind == Node::Splat) {
+                continue;
+            }
+            Vector += 1 + (Iter->kind == Node::Binary && needsSplat(*Iter));
+            for (auto *Lane: Iter->lanes) {
+                if (std::all_of(Lane->getUses().begin(), Lane->getUses().end(), [&](Use &use) {
+                    return Dead.count(use.getUser()) != 0;
+                }) && Dead.insert(Lane).second) {
+                    Scalar++;
+                }
+            }
+        }
+        return Vector < Scalar;
+    }
+
+    ///< Can the loads of the tree and the stores of the group move down to the last store?
+    bool isSafe(std::vector<StoreInst *> &group) {
+        positions.clear();
+        unsigned Position = 0;
+        for (auto &Inst: *block) {
+            positions[&Inst] = Position++;
+        }
+        StoreInst *Last = group[0];
+        for (auto *Store: group) {
+            if (positions[Store] > positions[Last]) {
+                Last = Store;
+            }
+        }
+        auto Conflicts = [&](Instruction *inst, bool isStore) {
+            auto *Ptr = isStore ? inst->cast<StoreInst>()->getPtr() : inst->cast<LoadInst>()->getPtr();
+            for (auto *Inst = inst->getNext(); Inst != Last; Inst = Inst->getNext()) {
+                Value *Other = nullptr;
+                if (auto *Store = Inst->as<StoreInst>()) {
+                    Other = std::find(group.begin(), group.end(), Store) == group.end() ? Store->getPtr() : nullptr;
+                } else if (auto *Load = Inst->as<LoadInst>()) {
+                    Other = isStore ? Load->getPtr() : nullptr;
+                } else if (auto *Call = Inst->as<CallInst>()) {
+                    if (!(Call->getCallee() && Call->getCallee()->isPure()) && aliasAnalysis.mayCallAccess(Ptr)) {
+                        return true;
+                    }
+                } else if (auto *Vector = Inst->as<VectorInst>()) {
+                    if (Vector->isMemoryAccess() && aliasAnalysis.mayCallAccess(Ptr)) {
+                        return true;
+                    }
+                }
+                if (Other && aliasAnalysis.alias(Ptr, Other) != AliasResult::NoAlias) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        for (auto *Store: group) {
+            if (Store != Last && Conflicts(Store, true)) {
+                return false;
+            }
+        }
+        for (auto &Node: nodes) {
+            if (Node.kind != Node::Load) {
+                continue;
+            }
+            for (auto *Lane: Node.lanes) {
+                if (positions[Lane->cast<Instruction>()] > positions[Last] || Conflicts(Lane->cast<Instruction>(), false)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void vectorize(std::vector<StoreInst *> &group) {
+        auto *Last = group[0];
+        for (auto *Store: group) {
+            if (positions[Store] > positions[Last]) {
+                Last = Store;
+            }
+        }
+        auto Insert = [&](Instruction *inst, StrView name) {
+            block->insertBefore(Last, inst);
+            inst->setName(name);
+            return inst;
+        };
+        auto *VL = Insert(VectorInst::CreateSetVL(block->getContext()->getInt(group.size())), "slp.vl");
+        for (auto &Node: nodes) {
+            switch (Node.kind) {
+                case Node::Splat:
+                    Node.vector = Node.lanes[0];
+                    break;
+                case Node::Load:
+                    Node.vector = Insert(VectorInst::CreateLoad(Node.lanes[0]->cast<LoadInst>()->getPtr(), VL), "slp");
+                    break;
+                case Node::Binary: {
+                    auto *LHS = &nodes[Node.lhs], *RHS = &nodes[Node.rhs];
+                    // only the rhs may be a scalar
+                    if (LHS->kind == Node::Splat && isCommutative(Node.op)) {
+                        std::swap(LHS, RHS);
+                    }
+                    auto *L = LHS->vector;
+                    if (needsSplat(Node)) {
+                        L = Insert(VectorInst::CreateSplat(L, VL), "splat");
+                    }
+                    Node.vector = Insert(VectorInst::CreateBinary(Node.op, L, RHS->vector, VL), "slp");
+                    break;
+                }
+            }
+        }
+        auto *Root = nodes.back().vector;
+        if (nodes.back().kind == Node::Splat) {
+            Root = Insert(VectorInst::CreateSplat(Root, VL), "splat");
+        }
+        block->insertBefore(Last, VectorInst::CreateStore(group[0]->getPtr(), Root, VL));
+        // the users of a lane are in later nodes, the lanes of two load nodes may overlap
+        std::vector<Instruction *> Lanes;
+        std::unordered_set<Instruction *> Visited;
+        for (auto *Store: group) {
+            Lanes.push_back(Store);
+        }
+        for (auto Iter = nodes.rbegin(); Iter != nodes.rend(); ++Iter) {
+            if (Iter->kind == Node::Splat) {
+                continue;
+            }
+            for (auto *Lane: Iter->lanes) {
+                if (Visited.insert(Lane->cast<Instruction>()).second) {
+                    Lanes.push_back(Lane->cast<Instruction>());
+                }
+            }
+        }
+        std::vector<Instruction *> Ptrs;
+        for (auto *Lane: Lanes) {
+            if (!Lane->isNotUsed()) {
+                continue;
+            }
+            Value *Ptr = nullptr;
+            if (auto *Store = Lane->as<StoreInst>()) {
+                Ptr = Store->getPtr();
+            } else if (auto *Load = Lane->as<LoadInst>()) {
+                Ptr = Load->getPtr();
+            }
+            Lane->eraseFromParent();
+            if (Ptr && Ptr->isa<GetPtrInst>() && Visited.insert(Ptr->cast<Instruction>()).second) {
+                Ptrs.push_back(Ptr->cast<Instruction>());
+            }
+        }
+        for (auto *Ptr: Ptrs) {
+            if (Ptr->isNotUsed()) {
+                Ptr->eraseFromParent();
+            }
+        }
+    }
 
 };
 
@@ -7,6 +7,7 @@
 
 #include <unordered_map>
 #include <memory>
+#include <mutex>
 #include "Node.h"
 #include "Type.h"
 #include "Constant.h"
@@ -22,6 +23,8 @@ class Context {
     std::map<int64_t, std::unique_ptr<IntConstant>> intSlots;
     std::map<std::pair<std::vector<Type *>, bool>, std::unique_ptr<FunctionType>> functionTypes;
     std::map<Type *, std::unique_ptr<PointerType>> pointerTypes;
+    ///< Function passes may run in parallel, so the uniqued tables are locked.
+    std::recursive_mutex lock;
 
 public:
     Context() = default;
@@ -62,6 +65,7 @@ public:
     }
 
     PointerType *getPointerTy(Type *ty) {
+        std::lock_guard<std::recursive_mutex> Guard(lock);
         auto &PtrTy = pointerTypes[ty];
         if (!PtrTy)
             PtrTy = std::make_unique<PointerType>(ty);
@@ -69,6 +73,7 @@ public:
     }
 
     FunctionType *getFunctionTy(std::vector<Type *> &types, bool isVarArg = false) {
+        std::lock_guard<std::recursive_mutex> Guard(lock);
         auto &FT = functionTypes[std::make_pair(types, isVarArg)];
         if (FT)
             return FT.get();
@@ -92,6 +97,7 @@ public:
     }
 
     inline Constant *getInt(int64_t value) {
+        std::lock_guard<std::recursive_mutex> Guard(lock);
         auto It = intSlots.find(value);
         if (It != intSlots.end()) {
             return It->second.get();
@@ -10,6 +10,7 @@
 #include <cmath>
 
 #include "MachinePass.h"
+#include "Liveness.h"
 #include "PatternNode.h"
 
 using ColorTy = unsigned;
@@ -55,6 +56,7 @@ struct ColorHasher {
 
 class GraphColor : public MachinePass {
 public:
+    FunctionPass *clone() const override { return new GraphColor(); }
     int RegisterCount = 0;
     Function *func = nullptr;
     std::unordered_map<RegID, GraphNode> graph;
@@ -178,10 +180,14 @@ public:
             OpCount.clear();
             for (auto &Inst: MBB.instrs()) {
                 for (auto &Op: Inst.uses()) {
-                    OpCount[Op.getReg()]++;
+                    if (Op.isReg()) {
+                        OpCount[Op.getReg()]++;
+                    }
                 }
                 for (auto &Def: Inst.defs()) {
-                    OpCount[Def.getReg()]++;
+                    if (Def.isReg()) {
+                        OpCount[Def.getReg()]++;
+                    }
                 }
             }
             for (auto [node, b]: OpCount) {
@@ -294,6 +300,12 @@ public:
 
     void runOnFunction(Function &function) override {
         func = &function;
+        getAnalysis<Liveness>(function);
+        // the loop nesting depth scales the spill cost
+        auto &Loops = getAnalysis<LoopAnalyse>(function);
+        for (auto &MBB: func->blocks) {
+            MBB.level = MBB.getOrigin() ? Loops.getLoopDepth(MBB.getOrigin()) : 0;
+        }
         auto *TI = func->getTargetInfo();
         RegisterCount = TI->getSaveRegList().size() + TI->getTempRegList().size();
 
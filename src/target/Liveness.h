@@ -6,67 +6,82 @@
 #define DRAGON_LIVENESS_H
 
 #include "MachinePass.h"
+#include "DataFlow.h"
+
+template<>
+struct DataFlowTraits<MachineBlock> {
+    static auto &preds(MachineBlock *bb) { return bb->preds; }
+    static auto &succs(MachineBlock *bb) { return bb->succs; }
+};
+
+///< The registers live out of the machine blocks, a backward dataflow over the dense register numbers.
 class Liveness : public MachinePass {
 public:
-    using BlockSet = std::unordered_map<MachineBlock *, std::set<RegID>>;
-    BlockSet liveKills;
-    BlockSet liveGens;
+    FunctionPass *clone() const override { return new Liveness(); }
+    bool isAnalysis() const override { return true; }
+    std::vector<Register> registers; ///< dense number -> register
+    std::unordered_map<RegID, unsigned> regNumbers;
+    DataFlow<MachineBlock, false> dataFlow;
 
     void runOnFunction(Function &function) override {
+        registers.clear();
+        regNumbers.clear();
+        for (auto &MBB: function.blocks) {
+            MBB.liveOutSet.clear();
+            for (auto &Inst: MBB.instrs()) {
+                for (auto &Use: Inst.uses()) {
+                    if (Use.isReg()) {
+                        addRegister(Use.getReg());
+                    }
+                }
+                for (auto &Def: Inst.defs()) {
+                    if (Def.isReg()) {
+                        addRegister(Def.getReg());
+                    }
+                }
+            }
+        }
+        dataFlow.init(function.blocks, registers.size());
         computeLocalLiveness(&function);
-        computeGlobalLiveness(&function);
+        dataFlow.solve();
+        for (auto &MBB: function.blocks) {
+            for (auto Number: dataFlow[&MBB].input) {
+                MBB.liveOutSet.insert(registers[Number]);
+            }
+        }
 
         /*std::cout << "Liveness: " << std::endl;
         std::cout << function.dag.dump() << std::endl;
         std::cout << std::endl;*/
     }
 
+    void addRegister(Register reg) {
+        if (regNumbers.emplace(reg, registers.size()).second) {
+            registers.push_back(reg);
+        }
+    }
+
     void computeLocalLiveness(Function *func) {
         for (auto &MBB: func->blocks) {
-            auto &LiveGen = liveGens[&MBB];
-            auto &LiveKill = liveKills[&MBB];
+            auto &State = dataFlow[&MBB];
             for (auto &Inst: MBB.instrs()) {
                 for (auto &Use: Inst.uses()) {
                     if (Use.isReg()) {
-                        if (!LiveKill.count(Use.getReg())) {
-                            LiveGen.insert(Use.getReg());
+                        auto Number = regNumbers[Use.getReg()];
+                        if (!State.kill.get(Number)) {
+                            State.gen.set(Number);
                         }
                     }
                 }
                 for (auto &Def : Inst.defs()){
                     if (Def.isReg()) {
-                        LiveKill.insert(Def.getReg());
+                        State.kill.set(regNumbers[Def.getReg()]);
                     }
                 }
             }
         }
     }
 
-    void computeGlobalLiveness(Function *func) {
-        bool Changed;
-        do {
-            Changed = false;
-            for (auto &MBB: func->blocks) {
-                auto &LiveOut = MBB.liveOutSet;
-                for (auto *Succ: MBB.succs) {
-                    auto &SuccLiveKill = liveKills[Succ];
-                    for (auto &Use: liveGens[Succ]) {
-                        if (LiveOut.insert(Use).second) {
-                            Changed = true;
-                        }
-                    }
-                    for (auto &Def: Succ->liveOutSet) {
-                        if (!SuccLiveKill.count(Def)) {
-                            if (LiveOut.insert(Def).second) {
-                                Changed = true;
-                            }
-                        }
-                    }
-                }
-            }
-        } while (Changed);
-    }
-
     void dump(Function *function) {
         for (auto &MBB: function->blocks) {
             std::cout << MBB.name << ":" << std::endl;
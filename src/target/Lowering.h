@@ -10,6 +10,7 @@
 ///< Pattern DAG Builder
 class Lowering : public MachinePass, public InstVisitor<Lowering, PatternNode *> {
 public:
+    FunctionPass *clone() const override { return new Lowering(); }
     std::map<Value *, PatternNode *> mapValueToNode;
     MachineBlock *block = nullptr;
     Function *curFunc = nullptr;
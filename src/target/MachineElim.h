@@ -8,6 +8,7 @@
 #include "MachinePass.h"
 class MachineElim : public MachineBlockPass {
 public:
+    FunctionPass *clone() const override { return new MachineElim(); }
     void runOnMachineBlock(MachineBlock &block) override {
         auto *F = block.getFunction();
         auto *TI = F->getTargetInfo();
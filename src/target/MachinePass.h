@@ -7,10 +7,20 @@
 
 #include "Function.h"
 #include "PassManager.h"
+#include "AnalysisManager.h"
+#include "Dominance.h"
+#include "LoopAnalyse.h"
 #include "MachineBlock.h"
 class MachinePass : public FunctionPass {
 public:
     using FunctionPass::FunctionPass;
+    ///< The machine passes don't change the IR.
+    PreservedAnalyses preserved() const override {
+        if (isAnalysis()) {
+            return PreservedAnalyses::all();
+        }
+        return PreservedAnalyses().preserve<Dominance>().preserve<LoopAnalyse>();
+    }
 };
 
 class MachineBlockPass : public MachinePass {
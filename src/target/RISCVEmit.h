@@ -10,6 +10,10 @@
 
 class RISCVEmit : public MachinePass {
 public:
+    FunctionPass *clone() const override { return new RISCVEmit(); }
+    void merge(FunctionPass &other) override {
+        ss << static_cast<RISCVEmit &>(other).str();
+    }
     std::stringstream ss;
     TargetInfo *TI = nullptr;
     Function *F = nullptr;
@@ -37,24 +41,43 @@ public:
         indent(4);
         dumpOpcode(instr.getOpcode());
         ss << " ";
-        ss << dump_str(instr.ops(), [&](Operand &op) {
-            if (op.isReg()) {
-                return strlower(TI->getRegName(op.getReg()));
-            }
-            if (op.isImm()) {
-                return std::to_string(op.getImm());
-            }
-            if (op.isLabel()) {
-                return getBlockLable(*op.getLabel());
-            }
-            if (op.isSlot()) {
-                return "slot" + std::to_string(op.value.slot);
-            }
-            return std::string();
-        });
+        std::vector<std::string> Ops;
+        for (auto &Op: instr.ops()) {
+            Ops.push_back(dumpOperand(Op));
+        }
+        switch (instr.getOpcode()) {
+            case RISCV::VSETVLI:
+                // the element width, single register groups, the tail and the masked off elements are agnostic
+                Ops.back() = "e" + Ops.back();
+                Ops.insert(Ops.end(), {"m1", "ta", "ma"});
+                break;
+            case RISCV::VLE32_V:
+            case RISCV::VSE32_V:
+                Ops.back() = "(" + Ops.back() + ")";
+                break;
+            default:
+                break;
+        }
+        ss << dump_str(Ops, [](const std::string &op) { return op; });
         ss << std::endl;
     }
 
+    std::string dumpOperand(Operand &op) {
+        if (op.isReg()) {
+            return strlower(TI->getRegName(op.getReg()));
+        }
+        if (op.isImm()) {
+            return std::to_string(op.getImm());
+        }
+        if (op.isLabel()) {
+            return getBlockLable(*op.getLabel());
+        }
+        if (op.isSlot()) {
+            return "slot" + std::to_string(op.value.slot);
+        }
+        return std::string();
+    }
+
     void dumpOpcode(unsigned opcode) {
         switch (opcode) {
             case TargetAdd:
@@ -5,6 +5,8 @@
 #ifndef DRAGON_RISCVLOWERING_H
 #define DRAGON_RISCVLOWERING_H
 
+#include <set>
+#include <unordered_map>
 #include <MachinePass.h>
 #include <RISCVTarget.h>
 class RISCVLowering : public MachinePass, public InstVisitor<RISCVLowering, MachineInstr *, MachineBlock &> {
@@ -12,6 +14,10 @@ public:
     Function *curFunc = nullptr;
     std::map<Value *, RegID> mapValueToReg;
     int allocateVirReg = 0;
+    unsigned allocateVectorReg = 0;
+    std::set<unsigned> freeVectorRegs; ///< the vector registers of the dead strips, taken again first
+    std::unordered_map<Value *, unsigned> vectorUses; ///< strip -> its uses left in the block
+    std::unordered_map<Value *, unsigned> vectorIndex; ///< strip -> the number of its register from v1
     void runOnFunction(Function &function) override {
         curFunc = &function;
 
@@ -48,6 +54,20 @@ public:
 
     void buildOnBlock(MachineBlock &mbb) {
         auto *Block = mbb.getOrigin();
+        allocateVectorReg = 0;
+        freeVectorRegs.clear();
+        vectorUses.clear();
+        vectorIndex.clear();
+        for (auto &I: *Block) {
+            if (I.isa<VectorInst>()) {
+                for (auto &Use: I.operands()) {
+                    auto *Strip = Use.getValue()->as<VectorInst>();
+                    if (Strip && Strip->isStrip()) {
+                        vectorUses[Strip]++;
+                    }
+                }
+            }
+        }
         for (auto &I: *Block) {
             if(auto *MI = visit(&I, mbb)){
                 mbb.append(MI);
@@ -63,6 +83,38 @@ public:
         return mapValueToReg[V];
     }
 
+    ///< The strips only live in the block computing them, they take the lowest vector register free from v1.
+    ///< A register is free again after the last use of its strip.
+    Register getVectorReg(Value *V) {
+        if (mapValueToReg.count(V)) {
+            return mapValueToReg[V];
+        }
+        auto Index = newVectorIndex();
+        vectorIndex[V] = Index;
+        mapValueToReg[V] = Register::phy(RISCV::V1 + Index);
+        return mapValueToReg[V];
+    }
+
+    unsigned newVectorIndex() {
+        if (!freeVectorRegs.empty()) {
+            auto Index = *freeVectorRegs.begin();
+            freeVectorRegs.erase(freeVectorRegs.begin());
+            return Index;
+        }
+        ASSERT(RISCV::V1 + allocateVectorReg <= RISCV::V31);
+        return allocateVectorReg++;
+    }
+
+    ///< Free the registers of the strips the vector instruction uses last, after it took its own.
+    void releaseVectorOperands(VectorInst *value) {
+        for (auto &Use: value->operands()) {
+            auto Iter = vectorUses.find(Use.getValue());
+            if (Iter != vectorUses.end() && --Iter->second == 0) {
+                freeVectorRegs.insert(vectorIndex[Use.getValue()]);
+            }
+        }
+    }
+
     Operand getBlockLabel(BasicBlock *bb) {
         auto *F = bb->getParent();
         ASSERT(F && F->mapBlocks[bb]);
@@ -87,6 +139,17 @@ public:
         return Operand::undefined();
     }
 
+    ///< The operand in a register, a constant is loaded into one.
+    Operand getValueRegOp(Value *V, MachineBlock &mbb) {
+        auto Op = getValueOp(V);
+        if (!Op.isImm()) {
+            return Op;
+        }
+        auto Reg = Register::vir(allocateVirReg++);
+        mbb.append(MIBuilder().setOpcode(RISCV::LI).addDef(Reg).addOp(Op).build());
+        return Operand::reg(Reg);
+    }
+
     MachineInstr *visitCondBr(CondBrInst *value, MachineBlock &mbb) override {
         /*if (auto *Bin = value->getCond()->as<BinaryInst>()) {
             if (Bin->isOnlyUsedOnce()) {
@@ -174,6 +237,133 @@ public:
         return MIBuilder().setOpcode(TargetRet).build();
     }
 
+    ///< The elements are words.
+    MachineInstr *visitGetPtr(GetPtrInst *value, MachineBlock &mbb) override {
+        auto Base = getValueRegOp(value->getBase(), mbb);
+        if (auto *Offset = value->getOffset()->as<IntConstant>()) {
+            return MIBuilder().setOpcode(RISCV::ADDI)
+                    .addDef(getValueReg(value))
+                    .addOp(Base)
+                    .addOp(getImmOp(Offset->getVal() * 4))
+                    .build();
+        }
+        auto Scaled = Register::vir(allocateVirReg++);
+        mbb.append(MIBuilder().setOpcode(RISCV::SLLI)
+                           .addDef(Scaled)
+                           .addOp(getValueOp(value->getOffset()))
+                           .addOp(getImmOp(2))
+                           .build());
+        return MIBuilder().setOpcode(TargetAdd)
+                .addDef(getValueReg(value))
+                .addOp(Base)
+                .addOp(Operand::reg(Scaled))
+                .build();
+    }
+
+    static unsigned getVectorOpcode(BinaryOp op, bool scalar) {
+        switch (op) {
+            case Add:
+                return scalar ? RISCV::VADD_VX : RISCV::VADD_VV;
+            case Sub:
+                return scalar ? RISCV::VSUB_VX : RISCV::VSUB_VV;
+            case Mul:
+                return scalar ? RISCV::VMUL_VX : RISCV::VMUL_VV;
+            case Div:
+                return scalar ? RISCV::VDIV_VX : RISCV::VDIV_VV;
+            case And:
+                return scalar ? RISCV::VAND_VX : RISCV::VAND_VV;
+            case Or:
+                return scalar ? RISCV::VOR_VX : RISCV::VOR_VV;
+            case Xor:
+                return scalar ? RISCV::VXOR_VX : RISCV::VXOR_VV;
+            case Shl:
+                return scalar ? RISCV::VSLL_VX : RISCV::VSLL_VV;
+            case Shr:
+                return scalar ? RISCV::VSRA_VX : RISCV::VSRA_VV;
+            default:
+                UNREACHEABLE();
+                return TargetNone;
+        }
+    }
+
+    static unsigned getReduceOpcode(BinaryOp op) {
+        switch (op) {
+            case Add:
+                return RISCV::VREDSUM_VS;
+            case And:
+                return RISCV::VREDAND_VS;
+            case Or:
+                return RISCV::VREDOR_VS;
+            case Xor:
+                return RISCV::VREDXOR_VS;
+            default:
+                UNREACHEABLE();
+                return TargetNone;
+        }
+    }
+
+    ///< The vector instructions of a strip follow its setvl, so they run under the vl it sets.
+    MachineInstr *visitVector(VectorInst *value, MachineBlock &mbb) override {
+        auto *MI = buildVector(value, mbb);
+        releaseVectorOperands(value);
+        return MI;
+    }
+
+    MachineInstr *buildVector(VectorInst *value, MachineBlock &mbb) {
+        switch (value->getVectorOp()) {
+            case VectorOp::SetVL:
+                return MIBuilder().setOpcode(RISCV::VSETVLI)
+                        .addDef(getValueReg(value))
+                        .addOp(getValueRegOp(value->getOperand(0), mbb))
+                        .addOp(getImmOp(32))
+                        .build();
+            case VectorOp::Load:
+                return MIBuilder().setOpcode(RISCV::VLE32_V)
+                        .addDef(getVectorReg(value))
+                        .addOp(getValueRegOp(value->getPtr(), mbb))
+                        .build();
+            case VectorOp::Store:
+                return MIBuilder().setOpcode(RISCV::VSE32_V)
+                        .addOp(Operand::reg(getVectorReg(value->getOperand(1))))
+                        .addOp(getValueRegOp(value->getPtr(), mbb))
+                        .build();
+            case VectorOp::Splat:
+                return MIBuilder().setOpcode(RISCV::VMV_V_X)
+                        .addDef(getVectorReg(value))
+                        .addOp(getValueRegOp(value->getOperand(0), mbb))
+                        .build();
+            case VectorOp::Binary: {
+                auto *RHS = value->getOperand(1)->as<VectorInst>();
+                bool Scalar = !(RHS && RHS->isStrip());
+                return MIBuilder().setOpcode(getVectorOpcode(value->getOp(), Scalar))
+                        .addDef(getVectorReg(value))
+                        .addOp(Operand::reg(getVectorReg(value->getOperand(0))))
+                        .addOp(Scalar ? getValueRegOp(value->getOperand(1), mbb) : Operand::reg(getVectorReg(RHS)))
+                        .build();
+            }
+            case VectorOp::Reduce: {
+                // the scalar goes in and out through the element 0 of a register
+                auto AccIndex = newVectorIndex();
+                auto Acc = Register::phy(RISCV::V1 + AccIndex);
+                freeVectorRegs.insert(AccIndex);
+                mbb.append(MIBuilder().setOpcode(RISCV::VMV_S_X)
+                                   .addDef(Acc)
+                                   .addOp(getValueRegOp(value->getOperand(1), mbb))
+                                   .build());
+                mbb.append(MIBuilder().setOpcode(getReduceOpcode(value->getOp()))
+                                   .addDef(Acc)
+                                   .addOp(Operand::reg(getVectorReg(value->getOperand(0))))
+                                   .addOp(Operand::reg(Acc))
+                                   .build());
+                return MIBuilder().setOpcode(RISCV::VMV_X_S)
+                        .addDef(getValueReg(value))
+                        .addOp(Operand::reg(Acc))
+                        .build();
+            }
+        }
+        return nullptr;
+    }
+
     MachineInstr *visitLoad(LoadInst *value, MachineBlock &mbb) override {
         return InstVisitor::visitLoad(value, mbb);
     }
@@ -5,6 +5,7 @@
 #ifndef DRAGON_RISCVTARGET_H
 #define DRAGON_RISCVTARGET_H
 
+#include <algorithm>
 #include <Target.h>
 #include <Common.h>
 #define RV32I(S)  \
@@ -77,6 +78,37 @@ S(DIVW)          \
 S(REMW)          \
 S(REMUW)
 
+// RVV 1.0, the names dump with '.' for '_'
+#define RVV(S)      \
+S(VSETVLI)          \
+S(VLE32_V)          \
+S(VSE32_V)          \
+S(VMV_V_X)          \
+S(VMV_S_X)          \
+S(VMV_X_S)          \
+S(VADD_VV)          \
+S(VADD_VX)          \
+S(VSUB_VV)          \
+S(VSUB_VX)          \
+S(VMUL_VV)          \
+S(VMUL_VX)          \
+S(VDIV_VV)          \
+S(VDIV_VX)          \
+S(VAND_VV)          \
+S(VAND_VX)          \
+S(VOR_VV)           \
+S(VOR_VX)           \
+S(VXOR_VV)          \
+S(VXOR_VX)          \
+S(VSLL_VV)          \
+S(VSLL_VX)          \
+S(VSRA_VV)          \
+S(VSRA_VX)          \
+S(VREDSUM_VS)       \
+S(VREDAND_VS)       \
+S(VREDOR_VS)        \
+S(VREDXOR_VS)
+
 #define RVPseudo(S) \
 S(ARG)              \
 S(MV)               \
@@ -123,6 +155,12 @@ S(T4, X29)             \
 S(T5, X30)             \
 S(T6, X31)
 
+#define RVVRegNames(S) \
+S(V0) S(V1) S(V2) S(V3) S(V4) S(V5) S(V6) S(V7) \
+S(V8) S(V9) S(V10) S(V11) S(V12) S(V13) S(V14) S(V15) \
+S(V16) S(V17) S(V18) S(V19) S(V20) S(V21) S(V22) S(V23) \
+S(V24) S(V25) S(V26) S(V27) S(V28) S(V29) S(V30) S(V31)
+
 namespace RISCV {
     enum RegList {
         X0, X1, X2, X3, X4, X5,
@@ -131,6 +169,9 @@ namespace RISCV {
         X17, X18, X19, X20, X21,
         X22, X23, X24, X25, X26,
         X27, X28, X29, X30, X31,
+        // Vector registers, v0 holds the masks
+#define VectorRegDef(Reg) Reg,
+        RVVRegNames(VectorRegDef)
         // ABI Name
 #define ABIDef(Alias, Reg) Alias = Reg,
         RegABINames(ABIDef)
@@ -144,19 +185,23 @@ namespace RISCV {
         RV32M(RISCVOpcode)
         RV64I(RISCVOpcode)
         RV64M(RISCVOpcode)
+        RVV(RISCVOpcode)
 
         // Pseudo Opcode
         RVPseudo(RISCVOpcode)
     };
 
     inline std::ostream &dump_opcode(std::ostream &os, unsigned Opcode) {
-#define DumpRISCV(OPCODE) if (OPCODE == Opcode) os << strlower(#OPCODE);
+#define DumpRISCV(OPCODE) if (OPCODE == Opcode) Name = strlower(#OPCODE);
+        std::string Name;
         RV32I(DumpRISCV)
         RV32M(DumpRISCV)
         RV64I(DumpRISCV)
         RV64M(DumpRISCV)
+        RVV(DumpRISCV)
         RVPseudo(DumpRISCV)
-        return os;
+        std::replace(Name.begin(), Name.end(), '_', '.');
+        return os << Name;
     }
 
 } // namespace RISCV
@@ -167,6 +212,8 @@ public:
         switch (regNo) {
 #define RegABIName(Alias, Reg) case RISCV::Reg: return #Alias;
             RegABINames(RegABIName)
+#define VectorRegName(Reg) case RISCV::Reg: return #Reg;
+            RVVRegNames(VectorRegName)
             default:
                 break;
         }
@@ -194,7 +241,9 @@ public:
             return true;
         }
         if (Opcode == RISCV::ADDI) {
-            return instr.getOp(1).getReg() == RISCV::Zero;
+            // the addi of a getptr at a constant offset has an immediate
+            auto &Op = instr.getOp(1);
+            return Op.isReg() && Op.getReg() == RISCV::Zero;
         }
         return false;
     }
@@ -5,25 +5,30 @@
 #ifndef DRAGONCOMPILER_BITVECTOR_H
 #define DRAGONCOMPILER_BITVECTOR_H
 
+#include <bit>
 #include <memory>
 #include <cstring>
 #include <cstdlib>
+#include <cstdint>
+#include <ostream>
 #include <Common.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * The bulk operations work on whole 64-bit words, with AVX2 kernels when the target has it.
+ * The bits past the size in the last word are always zero, so the words can be
+ * compared and counted directly. A vector of up to 64 bits is stored inline.
+ */
 class BitVector {
     using unit_t = uint64_t;
-    using small_t = uint32_t;
-    unit_t *Bits = reinterpret_cast<unit_t *>(&SmallBits);
-    union {
-        size_t Size;
-        struct {
-            small_t SmallBits = 0;
-            uint8_t SmallSize = 0;
-        };
-    };
-    bool Small = true; // is Small Bits?
+    unit_t *Bits = &Inline;
+    unit_t Inline = 0;
+    size_t Size = 0;
 
     class BitIterator {
-        BitVector *Vec;
+        const BitVector *Vec;
         size_t Index;
     public:
         using iterator_category = std::forward_iterator_tag;
@@ -32,13 +37,13 @@ class BitVector {
         using pointer = value_type *;
         using reference = value_type &;
 
-        BitIterator(BitVector *vec, size_t index) : Vec(vec), Index(index) {}
+        BitIterator(const BitVector *vec, size_t index) : Vec(vec), Index(index) {}
 
-        bool operator==(const BitIterator &RHS) {
+        bool operator==(const BitIterator &RHS) const {
             return Vec == RHS.Vec && Index == RHS.Index;
         }
 
-        bool operator!=(const BitIterator &RHS) {
+        bool operator!=(const BitIterator &RHS) const {
             return !operator==(RHS);
         }
 
@@ -46,7 +51,7 @@ class BitVector {
         reference operator*() { return *operator->(); }
 
         BitIterator &operator++() {
-            Index = Vec->next(Index + 1);
+            Index = Vec->find_next(Index);
             return *this;
         }
 
@@ -58,9 +63,7 @@ class BitVector {
     };
 
 public:
-    BitVector() {
-        resize(0);
-    }
+    BitVector() = default;
 
     BitVector(size_t size) {
         resize(size);
@@ -69,7 +72,7 @@ public:
     BitVector(const char *str) {
         auto len = strlen(str);
         resize(len);
-        for (int i = 0; i < len; ++i) {
+        for (size_t i = 0; i < len; ++i) {
             if (str[i] == '1') {
                 set(i);
             }
@@ -77,158 +80,180 @@ public:
     }
 
     ~BitVector() {
-        resize(0);
+        if (Bits != &Inline) {
+            free(Bits);
+        }
     }
 
-    BitVector(BitVector &&RHS) {
-        Bits = RHS.Bits;
-        Size = RHS.Size;
-        Small = RHS.Small;
-        RHS.Small = true;
-        RHS.resize(0);
+    BitVector(BitVector &&RHS) noexcept {
+        *this = std::move(RHS);
     }
 
-    BitVector(const BitVector& RHS) {
-        if (RHS.size()) {
-            resize(RHS.size());
-            std::memcpy(Bits, RHS.Bits, BitCountToByte(size()));
-        } else {
-            resize(0);
-        }
+    BitVector(const BitVector &RHS) {
+        *this = RHS;
     }
 
-    BitIterator begin() {
-        return BitIterator(this, next(0));
+    BitIterator begin() const {
+        return BitIterator(this, find_first());
     }
 
-    BitIterator end() {
+    BitIterator end() const {
         return BitIterator(this, size());
     }
 
-    size_t next(size_t Index) {
-        while (!get(Index) && Index < size()) {
-            Index++;
-        }
-        return Index;
+    ///< The first set bit, or size() if there is none.
+    size_t find_first() const {
+        return find_from(0);
+    }
+
+    ///< The first set bit after the index, or size() if there is none.
+    size_t find_next(size_t index) const {
+        return find_from(index + 1);
+    }
+
+    size_t next(size_t index) const {
+        return find_from(index);
     }
 
     void resize(size_t newSize) {
         if (size() == newSize) {
             return;
         }
-        if (newSize <= BitCount<small_t>()) {
-            if (!Small) {
-                auto fitSize = std::min(size(), newSize);
-                SmallBits = 0;
-                move_bits(&SmallBits, Bits, fitSize);
-                free(Bits);
-            }
-            SmallSize = newSize;
-            Bits = (unit_t *) &SmallBits;
-            Small = true;
-        } else {
-            auto *newBits = (unit_t *) calloc(BitCountToUnitLength(newSize), sizeof(unit_t));
-            auto fitSize = std::min(size(), newSize);
-            move_bits(newBits, Bits, fitSize);
-            if (!Small) {
-                free(Bits);
+        auto OldWords = words(), NewWords = UnitLength(newSize);
+        if (OldWords != NewWords) {
+            auto *NewBits = NewWords <= 1 ? &Inline : (unit_t *) calloc(NewWords, sizeof(unit_t));
+            if (NewBits != Bits) {
+                if (NewBits == &Inline) {
+                    Inline = OldWords ? Bits[0] : 0;
+                } else {
+                    std::memcpy(NewBits, Bits, std::min(OldWords, NewWords) * sizeof(unit_t));
+                }
+                if (Bits != &Inline) {
+                    free(Bits);
+                }
+                Bits = NewBits;
             }
-            Size = newSize;
-            Bits = newBits;
-            Small = false;
         }
+        if (newSize == 0) {
+            Inline = 0;
+        }
+        Size = newSize;
+        clearTail();
     }
 
     bool get(size_t i) const {
-        return Bits[i / BitCount<unit_t>()] & (unit_t(1) << (i % BitCount<unit_t>()));
+        return Bits[i / BitCount] & (unit_t(1) << (i % BitCount));
     }
 
     void set(size_t i) {
-        Bits[i / BitCount<unit_t>()] |= (unit_t(1) << (i % BitCount<unit_t>()));
+        Bits[i / BitCount] |= (unit_t(1) << (i % BitCount));
     }
 
     void clear(size_t i) {
-        Bits[i / BitCount<unit_t>()] &= ~(unit_t(1) << (i % BitCount<unit_t>()));
+        Bits[i / BitCount] &= ~(unit_t(1) << (i % BitCount));
     }
 
     inline size_t size() const {
-        return Small ? SmallSize : Size;
+        return Size;
+    }
+
+    inline size_t words() const {
+        return UnitLength(Size);
     }
 
     inline void fill(bool bit) {
-        std::memset(Bits, bit ? uint8_t(-1) : uint8_t(0), BitCountToByte(size()));
+        std::memset(Bits, bit ? uint8_t(-1) : uint8_t(0), words() * sizeof(unit_t));
+        clearTail();
     }
 
     inline void flip() {
-        if (Small) {
-            auto margin = BitCount<small_t>() - SmallSize;
-            SmallBits = ~SmallBits & (small_t(-1) >> margin);
-        } else {
-            auto i = 0;
-            while (i < BitCountToUnitLength(Size) - 1)
-                Bits[i] = ~Bits[i++];
-            auto margin = BitCount<unit_t>() - (Size % BitCount<unit_t>());
-            Bits[i] = ~Bits[i] & (unit_t(-1) >> margin);
+        for (size_t i = 0; i < words(); ++i) {
+            Bits[i] = ~Bits[i];
+        }
+        clearTail();
+    }
+
+    ///< Is any bit set?
+    bool any() const {
+        size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 4 <= words(); i += 4) {
+            auto V = _mm256_loadu_si256((const __m256i *) (Bits + i));
+            if (!_mm256_testz_si256(V, V)) {
+                return true;
+            }
+        }
+#endif
+        for (; i < words(); ++i) {
+            if (Bits[i]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool none() const {
+        return !any();
+    }
+
+    ///< The number of set bits.
+    size_t count() const {
+        size_t Count = 0;
+        for (size_t i = 0; i < words(); ++i) {
+            Count += std::popcount(Bits[i]);
         }
+        return Count;
     }
 
-    inline BitVector operator-(BitVector RHS) {
-        RHS.flip();
-        RHS &= *this;
-        return RHS;
+    inline BitVector operator-(const BitVector &RHS) const {
+        BitVector Ret = *this;
+        Ret -= RHS;
+        return Ret;
     }
 
-    inline BitVector operator&(const BitVector &RHS) {
+    inline BitVector operator&(const BitVector &RHS) const {
         BitVector Ret = *this;
         Ret &= RHS;
         return Ret;
     }
 
-    inline BitVector operator|(const BitVector &RHS) {
+    inline BitVector operator|(const BitVector &RHS) const {
         BitVector Ret = *this;
         Ret |= RHS;
         return Ret;
     }
 
     inline BitVector &operator&=(const BitVector &RHS) {
-        if (size() == RHS.size()) {
-            if (Small) {
-                SmallBits &= RHS.SmallBits;
-            } else {
-                for (auto i = 0; i < BitCountToUnitLength(Size); i++) {
-                    Bits[i] &= RHS.Bits[i];
-                }
-            }
-        } else {
-            unreachable();
-        }
+        ASSERT(size() == RHS.size());
+        apply<Kernel::And>(RHS);
         return *this;
     }
 
     inline BitVector &operator|=(const BitVector &RHS) {
-        if (size() == RHS.size()) {
-            if (Small) {
-                SmallBits |= RHS.SmallBits;
-            } else {
-                for (auto i = 0; i < BitCountToUnitLength(Size); i++) {
-                    Bits[i] |= RHS.Bits[i];
-                }
-            }
-        } else {
-            unreachable();
-        }
+        ASSERT(size() == RHS.size());
+        apply<Kernel::Or>(RHS);
+        return *this;
+    }
+
+    ///< Clear the bits set in RHS.
+    inline BitVector &operator-=(const BitVector &RHS) {
+        ASSERT(size() == RHS.size());
+        apply<Kernel::AndNot>(RHS);
         return *this;
     }
 
     inline BitVector &operator&=(const unit_t &Val) {
-        auto margin = BitCount<unit_t>() > size() ? (BitCount<unit_t>() - size()) : 0;
-        Bits[0] = Bits[0] & (Val & (unit_t(-1) >> margin));
+        if (size()) {
+            Bits[0] &= Val;
+        }
         return *this;
     }
 
     inline BitVector &operator|=(const unit_t &Val) {
-        auto margin = BitCount<unit_t>() > size() ? (BitCount<unit_t>() - size()) : 0;
-        Bits[0] = Bits[0] | (Val & (unit_t(-1) >> margin));
+        if (size()) {
+            Bits[0] |= Val;
+            clearTail();
+        }
         return *this;
     }
 
@@ -239,33 +264,49 @@ public:
     }
 
     inline BitVector &operator=(const BitVector &RHS) {
-        if (!RHS.size()) {
-            resize(0);
-            return *this;
+        if (this != &RHS) {
+            resize(RHS.size());
+            std::memcpy(Bits, RHS.Bits, words() * sizeof(unit_t));
         }
-        resize(RHS.size());
-        std::memcpy(Bits, RHS.Bits, BitCountToByte(size()));
         return *this;
     }
 
-    inline BitVector &operator=(BitVector &&RHS) {
-        if (!RHS.Small) {
-            Bits = RHS.Bits;
+    inline BitVector &operator=(BitVector &&RHS) noexcept {
+        if (this == &RHS) {
+            return *this;
         }
+        if (Bits != &Inline) {
+            free(Bits);
+        }
+        Bits = RHS.Bits == &RHS.Inline ? &Inline : RHS.Bits;
+        Inline = RHS.Inline;
         Size = RHS.Size;
-        Small = RHS.Small;
-        RHS.Small = true;
-        RHS.resize(0);
+        RHS.Bits = &RHS.Inline;
+        RHS.Inline = 0;
+        RHS.Size = 0;
         return *this;
     }
 
     inline bool operator==(const BitVector &RHS) const {
-        if (size() == RHS.size()) {
-            return std::memcmp(Bits, RHS.Bits, BitCountToByte(size())) == 0;
-        } else {
-            unreachable();
+        if (size() != RHS.size()) {
+            return false;
         }
-        return false;
+        size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 4 <= words(); i += 4) {
+            auto X = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (Bits + i)),
+                                      _mm256_loadu_si256((const __m256i *) (RHS.Bits + i)));
+            if (!_mm256_testz_si256(X, X)) {
+                return false;
+            }
+        }
+#endif
+        for (; i < words(); ++i) {
+            if (Bits[i] != RHS.Bits[i]) {
+                return false;
+            }
+        }
+        return true;
     }
 
     inline bool operator!=(const BitVector &RHS) const {
@@ -277,27 +318,73 @@ public:
     }
 
 private:
-    inline void move_bits(void *dest, void *src, size_t n_bits) {
-        auto byte = n_bits / 8;
-        auto reminder = n_bits % 8;
-        std::memcpy(dest, src, byte);
-        if (reminder) {
-            *((uint8_t *) dest + byte) = *((uint8_t *) src + byte) & (uint8_t(-1) >> reminder);
-        }
+    static constexpr size_t BitCount = sizeof(unit_t) * 8;
 
+    static inline size_t UnitLength(size_t size) {
+        return (size + BitCount - 1) / BitCount;
     }
 
-    template<typename Ty>
-    static constexpr size_t BitCount() {
-        return sizeof(Ty) * 8;
+    inline void clearTail() {
+        if (auto Used = Size % BitCount) {
+            Bits[words() - 1] &= unit_t(-1) >> (BitCount - Used);
+        }
+    }
+
+    size_t find_from(size_t index) const {
+        if (index >= size()) {
+            return size();
+        }
+        size_t Word = index / BitCount;
+        unit_t Current = Bits[Word] & (unit_t(-1) << (index % BitCount));
+        while (!Current) {
+            if (++Word >= words()) {
+                return size();
+            }
+            Current = Bits[Word];
+        }
+        return Word * BitCount + std::countr_zero(Current);
     }
 
-    static inline size_t BitCountToUnitLength(size_t size) {
-        return (size - 1) / BitCount<unit_t>() + 1;
+    enum class Kernel { And, Or, AndNot };
+
+    template<Kernel kernel>
+    static inline unit_t op(unit_t l, unit_t r) {
+        if constexpr (kernel == Kernel::And) {
+            return l & r;
+        } else if constexpr (kernel == Kernel::Or) {
+            return l | r;
+        } else {
+            return l & ~r;
+        }
     }
 
-    static inline size_t BitCountToByte(size_t size) {
-        return (size - 1) / 8 + 1;
+#if defined(__AVX2__)
+    template<Kernel kernel>
+    static inline __m256i op(__m256i l, __m256i r) {
+        if constexpr (kernel == Kernel::And) {
+            return _mm256_and_si256(l, r);
+        } else if constexpr (kernel == Kernel::Or) {
+            return _mm256_or_si256(l, r);
+        } else {
+            return _mm256_andnot_si256(r, l);
+        }
+    }
+#endif
+
+    ///< Bits[i] = op(Bits[i], RHS.Bits[i]) for all the words.
+    template<Kernel kernel>
+    inline void apply(const BitVector &RHS) {
+        size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 4 <= words(); i += 4) {
+            auto L = _mm256_loadu_si256((const __m256i *) (Bits + i));
+            auto R = _mm256_loadu_si256((const __m256i *) (RHS.Bits + i));
+            _mm256_storeu_si256((__m256i *) (Bits + i), op<kernel>(L, R));
+        }
+#endif
+        for (; i < words(); ++i) {
+            Bits[i] = op<kernel>(Bits[i], RHS.Bits[i]);
+        }
     }
 
 };
@@ -305,7 +392,7 @@ private:
 inline std::ostream &operator<<(std::ostream &os, const BitVector &vec) {
     os << vec.size();
     os << '(';
-    for (auto i = 0; i < vec.size(); ++i)
+    for (size_t i = 0; i < vec.size(); ++i)
         os << vec.get(i) ;
     os << ')';
     return os;
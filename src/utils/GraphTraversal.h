@@ -0,0 +1,217 @@
+//
+// Created by Alex on 2022/6/11.
+//
+
+#ifndef DRAGON_GRAPHTRAVERSAL_H
+#define DRAGON_GRAPHTRAVERSAL_H
+
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <unordered_map>
+#include "Common.h"
+
+/**
+ * Depth first walk with an explicit stack, so a deep graph can't overflow the call stack.
+ * A frame keeps the node and the cursor into its children, which visits the nodes in the
+ * same order as the recursion would. The stack is kept between the walks.
+ * children(node) gives the range of the children, the range must not own its elements.
+ * enter(child) returns the node to descend into, or null to skip the child.
+ * exit(node) runs once all the children are done, the frame is popped before, so top()
+ * is the parent of the node.
+ * The root is always entered, mark it before the walk if enter tracks the visited nodes.
+ */
+template<typename NodeT, typename Range>
+class DFSWalker {
+    using Iter = decltype(std::begin(std::declval<Range &>()));
+    struct Frame {
+        NodeT node;
+        Iter cur;
+        Iter end;
+    };
+    std::vector<Frame> stack;
+public:
+    template<typename ChildrenFn, typename EnterFn, typename ExitFn>
+    void walk(NodeT root, ChildrenFn children, EnterFn enter, ExitFn exit) {
+        stack.clear();
+        push(root, children);
+        while (!stack.empty()) {
+            auto &Top = stack.back();
+            if (Top.cur != Top.end) {
+                auto &&Child = *Top.cur;
+                ++Top.cur;
+                if (NodeT Node = enter(Child)) {
+                    push(Node, children);
+                }
+                continue;
+            }
+            NodeT Node = Top.node;
+            stack.pop_back();
+            exit(Node);
+        }
+    }
+
+    inline bool empty() const {
+        return stack.empty();
+    }
+
+    ///< The node being walked.
+    inline NodeT top() const {
+        ASSERT(!stack.empty());
+        return stack.back().node;
+    }
+
+    inline size_t depth() const {
+        return stack.size();
+    }
+
+private:
+    template<typename ChildrenFn>
+    inline void push(NodeT node, ChildrenFn &children) {
+        auto &&Children = children(node);
+        stack.push_back({node, std::begin(Children), std::end(Children)});
+    }
+};
+
+/**
+ * Walk a tree, like the dominator tree, enter(node) runs before the children and exit(node)
+ * after them. Both callbacks see the root.
+ */
+template<typename NodeT, typename Range>
+class TreeWalker {
+    DFSWalker<NodeT, Range> walker;
+public:
+    template<typename ChildrenFn, typename EnterFn, typename ExitFn>
+    void walk(NodeT root, ChildrenFn children, EnterFn enter, ExitFn exit) {
+        enter(root);
+        walker.walk(root, children, [&](NodeT node) {
+            enter(node);
+            return node;
+        }, exit);
+    }
+
+    template<typename ChildrenFn, typename EnterFn>
+    void preorder(NodeT root, ChildrenFn children, EnterFn enter) {
+        walk(root, children, enter, [](NodeT) {});
+    }
+
+    template<typename ChildrenFn, typename ExitFn>
+    void postorder(NodeT root, ChildrenFn children, ExitFn exit) {
+        walk(root, children, [](NodeT) {}, exit);
+    }
+};
+
+/**
+ * The post order and the reverse post order of the nodes reachable from a root.
+ * mark(node) returns true the first time it sees a node.
+ */
+template<typename NodeT, typename Range>
+class PostOrderTraversal {
+    DFSWalker<NodeT, Range> walker;
+    std::vector<NodeT> order;
+public:
+    template<typename ChildrenFn, typename MarkFn>
+    const std::vector<NodeT> &postOrder(NodeT root, ChildrenFn children, MarkFn mark) {
+        order.clear();
+        if (mark(root)) {
+            walker.walk(root, children, [&](NodeT node) -> NodeT {
+                return mark(node) ? node : NodeT();
+            }, [&](NodeT node) {
+                order.push_back(node);
+            });
+        }
+        return order;
+    }
+
+    template<typename ChildrenFn, typename MarkFn>
+    const std::vector<NodeT> &reversePostOrder(NodeT root, ChildrenFn children, MarkFn mark) {
+        postOrder(root, children, mark);
+        std::reverse(order.begin(), order.end());
+        return order;
+    }
+};
+
+/**
+ * Tarjan's strongly connected components, iteratively.
+ * The children may be of another type than the nodes, like the operands of an instruction,
+ * asNode(child) gives the node or null if the child is not in the graph.
+ * onSCC(group, root) gets the members of a component in the order they are popped, the
+ * root is the first member visited. A component is reported after all the components
+ * reachable from it. The nodes stay visited until clear(), so the walks can be started
+ * from every node of a graph.
+ */
+template<typename NodeT, typename Range>
+class TarjanSCC {
+    struct Info {
+        unsigned num = 0;
+        unsigned low = 0;
+        bool inStack = false;
+    };
+    DFSWalker<NodeT, Range> walker;
+    std::unordered_map<NodeT, Info> infos;
+    std::vector<NodeT> stack;
+    std::vector<NodeT> group;
+    unsigned nextNum = 0;
+public:
+    void clear() {
+        infos.clear();
+        stack.clear();
+        nextNum = 0;
+    }
+
+    inline bool isVisited(NodeT node) const {
+        return infos.count(node);
+    }
+
+    template<typename ChildrenFn, typename AsNodeFn, typename SCCFn>
+    void run(NodeT root, ChildrenFn children, AsNodeFn asNode, SCCFn onSCC) {
+        if (isVisited(root)) {
+            return;
+        }
+        visit(root);
+        walker.walk(root, children, [&](auto &&child) -> NodeT {
+            NodeT Node = asNode(child);
+            if (!Node) {
+                return NodeT();
+            }
+            auto Iter = infos.find(Node);
+            if (Iter == infos.end()) {
+                visit(Node);
+                return Node;
+            }
+            if (Iter->second.inStack) {
+                auto &Parent = infos[walker.top()];
+                Parent.low = std::min(Parent.low, Iter->second.num);
+            }
+            return NodeT();
+        }, [&](NodeT node) {
+            auto &Cur = infos[node];
+            if (!walker.empty()) {
+                auto &Parent = infos[walker.top()];
+                Parent.low = std::min(Parent.low, Cur.low);
+            }
+            if (Cur.low != Cur.num) {
+                return;
+            }
+            group.clear();
+            NodeT Member;
+            do {
+                Member = stack.back();
+                stack.pop_back();
+                infos[Member].inStack = false;
+                group.push_back(Member);
+            } while (Member != node);
+            onSCC(group, node);
+        });
+    }
+
+private:
+    inline void visit(NodeT node) {
+        auto &Cur = infos[node];
+        Cur.num = Cur.low = nextNum++;
+        Cur.inStack = true;
+        stack.push_back(node);
+    }
+};
+
+#endif //DRAGON_GRAPHTRAVERSAL_H
@@ -5,7 +5,9 @@
 #ifndef DRAGONCOMPILER_LOOPINFO_H
 #define DRAGONCOMPILER_LOOPINFO_H
 #include <algorithm>
+#include <vector>
 #include "Instruction.h"
+#include "BitVector.h"
 class BasicBlock;
 
 class Loop {
@@ -14,18 +16,23 @@ class Loop {
     Loop *parent = nullptr;
     ///< 循环所指向的头
     BasicBlock *header = nullptr;
-    ///< 后向边, 可能有多个后向边指向同一个循环头暂时不用
+    ///< 后向边, 第一条后向边的来源
     BasicBlock *backege = nullptr;
-    ///< 循环层级
+    ///< the sources of all the back edges
+    std::vector<BasicBlock *> latches;
+    ///< 循环层级, the nesting depth, 1 for the outermost loops
     unsigned level = 0;
     ///< 循环预头, block中不包含循环预头
     BasicBlock *preheader = nullptr;
-    std::set<BasicBlock *> blocks;
-    std::set<BasicBlock *> exits;
+    std::vector<Loop *> subLoops;
+    std::vector<BasicBlock *> blocks; ///< the header first, the blocks of the sub loops included
+    BitVector members; ///< block number -> contained
+    std::vector<BasicBlock *> exits; ///< the blocks outside with an edge from the loop
 public:
     Loop(BasicBlock *header, BasicBlock *backege) : header(header), backege(backege) {
         ASSERT(header && backege);
-        blocks.insert(header);
+        latches.push_back(backege);
+        addBlock(header);
     }
     // iterator
     inline auto begin() { return blocks.begin(); }
@@ -37,28 +44,34 @@ public:
     inline BasicBlock *getHeader() const { return header; }
     ///< get the back edge of the loop
     inline BasicBlock *getBackedge() const { return backege; }
+    inline const std::vector<BasicBlock *> &getLatches() const { return latches; }
     ///< get the preheader of the loop
     inline BasicBlock *getPreheader() const { return preheader; }
     ///< set the preheader of the loop
     void setPreheader(BasicBlock *ph) {
         this->preheader = ph;
     }
-    inline bool contains(BasicBlock *bb) { return blocks.count(bb) > 0; }
-    inline bool isLoopInvariant(Value *val) {
-        if (auto *Inst = val->as<Instruction>()) {
-            if (!contains(Inst->getParent())) {
+    ///< the nesting depth, 1 for the outermost loops
+    inline unsigned getLevel() const { return level; }
+    inline const std::vector<Loop *> &getSubLoops() const { return subLoops; }
+    inline const std::vector<BasicBlock *> &getBlocks() const { return blocks; }
+    inline const std::vector<BasicBlock *> &getExits() const { return exits; }
+    inline bool contains(BasicBlock *bb) const {
+        auto Number = bb->getNumber();
+        return Number < members.size() && members.get(Number);
+    }
+    inline bool contains(const Loop *loop) const {
+        for (; loop; loop = loop->parent) {
+            if (loop == this) {
                 return true;
             }
-            if (hasLoopInvariantOperands(Inst)) {
-                switch (Inst->getOpcode()) {
-                    case OpcodeBinary:
-                    case OpcodeLoad:
-                        return true;
-                    default:
-                        break;
-                }
-            }
-            return false;
+        }
+        return false;
+    }
+    ///< Is the value defined out of the loop? LICM moves the invariant instructions out before their users.
+    inline bool isLoopInvariant(Value *val) {
+        if (auto *Inst = val->as<Instruction>()) {
+            return !contains(Inst->getParent());
         }
         return true;
     }
@@ -68,8 +81,23 @@ public:
         });
     }
 
-    inline bool addBlock(BasicBlock *bb) { return blocks.insert(bb).second; }
-    inline void removeBlock(BasicBlock *bb) { blocks.erase(bb); }
+    inline bool addBlock(BasicBlock *bb) {
+        if (contains(bb)) {
+            return false;
+        }
+        if (members.size() <= bb->getNumber()) {
+            members.resize(bb->getNumber() + 1);
+        }
+        members.set(bb->getNumber());
+        blocks.push_back(bb);
+        return true;
+    }
+    inline void removeBlock(BasicBlock *bb) {
+        if (contains(bb)) {
+            members.clear(bb->getNumber());
+            blocks.erase(std::find(blocks.begin(), blocks.end(), bb));
+        }
+    }
 };
 
 #endif //DRAGONCOMPILER_LOOPINFO_H
@@ -112,8 +112,10 @@ public:
 
 template<typename T, typename ParentT>
 class NodeWithParent : public Node<T> {
+    template<typename, typename, typename> friend class NodeParent;
 private:
     ParentT *parent = nullptr;
+    unsigned order = 0; ///< the position in the parent, see NodeParent::comesBefore
 public:
     NodeWithParent() = default;
     NodeWithParent(ParentT *parent) {
@@ -163,6 +165,12 @@ public:
         parent->insertBefore(node, static_cast<T *>(this));
     }
 
+    ///< Is this before the node in the same parent?
+    bool comesBefore(const T *node) const {
+        ASSERT(node && parent);
+        return parent->comesBefore(static_cast<const T *>(this), node);
+    }
+
     bool isSentinel() const {
         return parent->list->get_sentinel() == this;
     }
@@ -601,6 +609,7 @@ public:
             node->setParent(static_cast<ParentTy *>(this));
             list.push_back(node);
         }
+        noteInserted(node);
     }
 
     void insertAfter(NodeTy *node, NodeTy *after) {
@@ -613,6 +622,7 @@ public:
             after->setParent(static_cast<ParentTy *>(this));
             list.insert_after(node, after);
         }
+        noteInserted(after);
     }
 
     void insertBefore(NodeTy *node, NodeTy *before) {
@@ -625,6 +635,7 @@ public:
             before->setParent(static_cast<ParentTy *>(this));
             list.insert_before(node, before);
         }
+        noteInserted(before);
     }
 
     void replace(NodeTy *node, NodeTy *newNode) {
@@ -637,6 +648,25 @@ public:
             newNode->setParent(static_cast<ParentTy *>(this));
             list.replace(node, newNode);
         }
+        noteInserted(newNode);
+    }
+
+    /**
+     * Is lhs before rhs in this list?
+     * The nodes are numbered lazily with gaps between them, a node inserted later takes
+     * the middle of its neighbours, and the list is numbered again only when there is no
+     * room left. Removing a node keeps the order.
+     */
+    bool comesBefore(const NodeTy *lhs, const NodeTy *rhs) {
+        ASSERT(lhs->getParent() == this && rhs->getParent() == this);
+        if (!orderValid) {
+            unsigned Order = 0;
+            for (auto &Item: list) {
+                Item.order = Order += OrderGap;
+            }
+            orderValid = true;
+        }
+        return lhs->order < rhs->order;
     }
 
     NodeListTy &getSubList() {
@@ -649,6 +679,35 @@ public:
 
 protected:
     NodeListTy list;
+    bool orderValid = false; ///< the nodes are numbered, only after the first query
+
+    ///< Number the node inserted into the list.
+    void noteInserted(NodeTy *node) {
+        if (!orderValid) {
+            return;
+        }
+        auto Where = iterator(node);
+        auto Prev = Where.prev(), Next = Where.next();
+        unsigned Low = Prev == list.end() ? 0 : Prev->order;
+        if (Next == list.end()) {
+            if (Low > ~0u - OrderGap) {
+                orderValid = false;
+                return;
+            }
+            node->order = Low + OrderGap;
+            return;
+        }
+        unsigned High = Next->order;
+        if (High - Low < 2) {
+            // no room between the neighbours
+            orderValid = false;
+            return;
+        }
+        node->order = Low + (High - Low) / 2;
+    }
+
+private:
+    static constexpr unsigned OrderGap = 1u << 10;
 };
 
 #endif //DRAGONCOMPILER_INODE_H
@@ -0,0 +1,143 @@
+//
+// Created by Alex on 2022/6/5.
+//
+
+#include "PassTimer.h"
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+bool AllocStats::enabled = false;
+
+AllocStats &getThreadAllocStats() {
+    static thread_local AllocStats Stats;
+    return Stats;
+}
+
+double getThreadCPUTime() {
+#if defined(__unix__) || defined(__APPLE__)
+    timespec TS;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &TS);
+    return TS.tv_sec + TS.tv_nsec / 1e9;
+#else
+    return (double) std::clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+void PassTimer::addRecord(const std::string &name, const std::string &category, const std::string &detail,
+                          double start, const TimeRecord &record) {
+    std::lock_guard<std::mutex> Guard(lock);
+    auto Iter = records.find(name);
+    if (Iter == records.end()) {
+        order.push_back(name);
+        Iter = records.emplace(name, std::map<std::string, TimeRecord>()).first;
+    }
+    Iter->second[detail] += record;
+
+    auto TID = threadIDs.emplace(std::this_thread::get_id(), threadIDs.size()).first->second;
+    events.push_back({name, category, detail, start, record.wall * 1e6, TID, record});
+}
+
+TimeRecord PassTimer::getTotal(const std::string &name) {
+    std::lock_guard<std::mutex> Guard(lock);
+    TimeRecord Total;
+    auto Iter = records.find(name);
+    if (Iter != records.end()) {
+        for (auto &[Function, Record]: Iter->second) {
+            Total += Record;
+        }
+    }
+    return Total;
+}
+
+void PassTimer::print(std::ostream &os) {
+    std::vector<std::pair<std::string, TimeRecord>> Totals;
+    for (auto &Name: order) {
+        Totals.emplace_back(Name, getTotal(Name));
+    }
+    std::stable_sort(Totals.begin(), Totals.end(), [](auto &l, auto &r) {
+        return l.second.wall > r.second.wall;
+    });
+
+    std::lock_guard<std::mutex> Guard(lock);
+    char Line[256];
+    auto PrintRecord = [&](const TimeRecord &record, const std::string &name) {
+        snprintf(Line, sizeof(Line), "%10.3f %10.3f %10zu %12zu %6u  %s\n",
+                 record.wall * 1e3, record.cpu * 1e3, record.allocs, record.bytes, record.runs, name.c_str());
+        os << Line;
+    };
+    os << "===-------------------------------------------------------------------------===\n";
+    os << "                          Pass execution timing report\n";
+    os << "===-------------------------------------------------------------------------===\n";
+    snprintf(Line, sizeof(Line), "%10s %10s %10s %12s %6s  %s\n",
+             "Wall(ms)", "CPU(ms)", "Allocs", "Bytes", "Runs", "Name");
+    os << Line;
+    for (auto &[Name, Record]: Totals) {
+        PrintRecord(Record, Name);
+        auto &Functions = records[Name];
+        if (Functions.size() <= 1) {
+            continue;
+        }
+        for (auto &[Function, FuncRecord]: Functions) {
+            PrintRecord(FuncRecord, "  " + Function);
+        }
+    }
+}
+
+static void writeString(std::ostream &os, const std::string &str) {
+    os << '"';
+    for (auto Ch: str) {
+        switch (Ch) {
+            case '"':
+                os << "\\\"";
+                break;
+            case '\\':
+                os << "\\\\";
+                break;
+            case '\n':
+                os << "\\n";
+                break;
+            default:
+                os << Ch;
+                break;
+        }
+    }
+    os << '"';
+}
+
+void PassTimer::writeTrace(std::ostream &os) {
+    std::lock_guard<std::mutex> Guard(lock);
+    os << "{\"traceEvents\":[";
+    bool First = true;
+    for (auto &Event: events) {
+        if (!First) {
+            os << ",";
+        }
+        First = false;
+        os << "\n{\"name\":";
+        writeString(os, Event.name);
+        os << ",\"cat\":";
+        writeString(os, Event.category);
+        os << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << Event.tid;
+        os << ",\"ts\":" << Event.start << ",\"dur\":" << Event.duration;
+        os << ",\"args\":{";
+        if (!Event.detail.empty()) {
+            os << "\"function\":";
+            writeString(os, Event.detail);
+            os << ",";
+        }
+        os << "\"cpu_ms\":" << Event.record.cpu * 1e3;
+        os << ",\"allocs\":" << Event.record.allocs;
+        os << ",\"bytes\":" << Event.record.bytes << "}}";
+    }
+    os << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+void PassTimer::clear() {
+    std::lock_guard<std::mutex> Guard(lock);
+    order.clear();
+    records.clear();
+    events.clear();
+    threadIDs.clear();
+}
@@ -0,0 +1,124 @@
+//
+// Created by Alex on 2022/6/5.
+//
+
+#ifndef DRAGON_PASSTIMER_H
+#define DRAGON_PASSTIMER_H
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <thread>
+#include <ostream>
+
+///< Allocations made by the current thread, counted by the operator new of AllocHook.cpp.
+struct AllocStats {
+    size_t count = 0;
+    size_t bytes = 0;
+    static bool enabled; ///< set by the program when it times its passes
+};
+AllocStats &getThreadAllocStats();
+
+///< CPU time of the current thread in seconds.
+double getThreadCPUTime();
+
+struct TimeRecord {
+    double wall = 0; ///< wall time in seconds
+    double cpu = 0; ///< cpu time in seconds
+    size_t allocs = 0; ///< count of allocations
+    size_t bytes = 0; ///< allocated bytes
+    unsigned runs = 0;
+
+    TimeRecord &operator+=(const TimeRecord &rhs) {
+        wall += rhs.wall;
+        cpu += rhs.cpu;
+        allocs += rhs.allocs;
+        bytes += rhs.bytes;
+        runs += rhs.runs;
+        return *this;
+    }
+};
+
+/**
+ * Record the time and the allocations of every pass on every function.
+ * Print a -time-passes style report, or a Chrome trace_event timeline which
+ * can be opened by chrome://tracing or https://ui.perfetto.dev.
+ * The times are inclusive, a pass includes the analyses it requests, so they are not summed up.
+ */
+class PassTimer {
+    struct TraceEvent {
+        std::string name;
+        std::string category;
+        std::string detail; ///< the function name
+        double start; ///< in microseconds
+        double duration;
+        unsigned tid;
+        TimeRecord record;
+    };
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point origin = Clock::now();
+    std::mutex lock;
+    std::vector<std::string> order; ///< names in the order of the first record
+    std::map<std::string, std::map<std::string, TimeRecord>> records; ///< name -> function -> record
+    std::vector<TraceEvent> events;
+    std::map<std::thread::id, unsigned> threadIDs;
+public:
+    ///< Microseconds since the timer was created.
+    double now() const {
+        return std::chrono::duration<double, std::micro>(Clock::now() - origin).count();
+    }
+
+    void addRecord(const std::string &name, const std::string &category, const std::string &detail,
+                   double start, const TimeRecord &record);
+
+    TimeRecord getTotal(const std::string &name);
+
+    ///< Print the report, sorted by wall time.
+    void print(std::ostream &os);
+    ///< Write the events as a Chrome trace_event JSON.
+    void writeTrace(std::ostream &os);
+
+    void clear();
+};
+
+///< Time the region until the end of the scope, nothing is recorded if the timer is null.
+class TimeRegion {
+    PassTimer *timer;
+    std::string name;
+    std::string category;
+    std::string detail;
+    double start = 0;
+    double cpu = 0;
+    AllocStats allocs;
+public:
+    TimeRegion(PassTimer *timer, const std::string &name, const std::string &category,
+               const std::string &detail = "") : timer(timer) {
+        if (timer) {
+            this->name = name;
+            this->category = category;
+            this->detail = detail;
+            allocs = getThreadAllocStats();
+            cpu = getThreadCPUTime();
+            start = timer->now();
+        }
+    }
+    ~TimeRegion() {
+        if (!timer) {
+            return;
+        }
+        TimeRecord Record;
+        Record.wall = (timer->now() - start) / 1e6;
+        Record.cpu = getThreadCPUTime() - cpu;
+        auto &Stats = getThreadAllocStats();
+        Record.allocs = Stats.count - allocs.count;
+        Record.bytes = Stats.bytes - allocs.bytes;
+        Record.runs = 1;
+        timer->addRecord(name, category, detail, start, Record);
+    }
+    TimeRegion(const TimeRegion &) = delete;
+    TimeRegion &operator=(const TimeRegion &) = delete;
+};
+
+#endif //DRAGON_PASSTIMER_H
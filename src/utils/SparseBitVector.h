@@ -0,0 +1,257 @@
+//
+// Created by Alex on 2022/6/8.
+//
+
+#ifndef DRAGONCOMPILER_SPARSEBITVECTOR_H
+#define DRAGONCOMPILER_SPARSEBITVECTOR_H
+
+#include <bit>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <ostream>
+
+/**
+ * A bit set for huge and mostly empty universes.
+ * Only the non-zero 64-bit words are kept, sorted by the word index, so the set
+ * operations merge the two lists of words and the memory follows the set bits.
+ */
+class SparseBitVector {
+    using unit_t = uint64_t;
+    struct Element {
+        size_t index; ///< the word index
+        unit_t bits; ///< never zero
+
+        bool operator==(const Element &RHS) const {
+            return index == RHS.index && bits == RHS.bits;
+        }
+    };
+    std::vector<Element> elements;
+
+    class BitIterator {
+        const SparseBitVector *Vec;
+        size_t Index;
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = size_t;
+        using difference_type = std::ptrdiff_t;
+        using pointer = value_type *;
+        using reference = value_type &;
+
+        BitIterator(const SparseBitVector *vec, size_t index) : Vec(vec), Index(index) {}
+
+        bool operator==(const BitIterator &RHS) const {
+            return Vec == RHS.Vec && Index == RHS.Index;
+        }
+
+        bool operator!=(const BitIterator &RHS) const {
+            return !operator==(RHS);
+        }
+
+        pointer operator->() { return &Index; }
+        reference operator*() { return *operator->(); }
+
+        BitIterator &operator++() {
+            Index = Vec->find_next(Index);
+            return *this;
+        }
+
+        BitIterator operator++(int) {
+            auto back = *this;
+            ++*this;
+            return back;
+        }
+    };
+
+public:
+    static constexpr size_t npos = size_t(-1);
+
+    BitIterator begin() const {
+        return BitIterator(this, find_first());
+    }
+
+    BitIterator end() const {
+        return BitIterator(this, npos);
+    }
+
+    bool get(size_t i) const {
+        auto Iter = lookup(i / BitCount);
+        return Iter != elements.end() && Iter->index == i / BitCount && (Iter->bits & mask(i));
+    }
+
+    void set(size_t i) {
+        auto Iter = lookup(i / BitCount);
+        if (Iter == elements.end() || Iter->index != i / BitCount) {
+            elements.insert(Iter, {i / BitCount, mask(i)});
+        } else {
+            Iter->bits |= mask(i);
+        }
+    }
+
+    void clear(size_t i) {
+        auto Iter = lookup(i / BitCount);
+        if (Iter != elements.end() && Iter->index == i / BitCount) {
+            Iter->bits &= ~mask(i);
+            if (!Iter->bits) {
+                elements.erase(Iter);
+            }
+        }
+    }
+
+    ///< Clear all the bits.
+    void reset() {
+        elements.clear();
+    }
+
+    bool any() const {
+        return !elements.empty();
+    }
+
+    bool none() const {
+        return elements.empty();
+    }
+
+    size_t count() const {
+        size_t Count = 0;
+        for (auto &Elem: elements) {
+            Count += std::popcount(Elem.bits);
+        }
+        return Count;
+    }
+
+    ///< The first set bit, or npos if there is none.
+    size_t find_first() const {
+        return elements.empty() ? npos : elements[0].index * BitCount + std::countr_zero(elements[0].bits);
+    }
+
+    ///< The first set bit after the index, or npos if there is none.
+    size_t find_next(size_t index) const {
+        if (index == npos || ++index == npos) {
+            return npos;
+        }
+        auto Iter = lookup(index / BitCount);
+        if (Iter == elements.end()) {
+            return npos;
+        }
+        if (Iter->index == index / BitCount) {
+            if (auto Bits = Iter->bits & (unit_t(-1) << (index % BitCount))) {
+                return Iter->index * BitCount + std::countr_zero(Bits);
+            }
+            if (++Iter == elements.end()) {
+                return npos;
+            }
+        }
+        return Iter->index * BitCount + std::countr_zero(Iter->bits);
+    }
+
+    SparseBitVector &operator|=(const SparseBitVector &RHS) {
+        std::vector<Element> Merged;
+        Merged.reserve(elements.size() + RHS.elements.size());
+        auto L = elements.cbegin();
+        auto R = RHS.elements.cbegin();
+        while (L != elements.end() || R != RHS.elements.end()) {
+            if (R == RHS.elements.end() || (L != elements.end() && L->index < R->index)) {
+                Merged.push_back(*L++);
+            } else if (L == elements.end() || R->index < L->index) {
+                Merged.push_back(*R++);
+            } else {
+                Merged.push_back({L->index, L->bits | R->bits});
+                ++L, ++R;
+            }
+        }
+        elements.swap(Merged);
+        return *this;
+    }
+
+    SparseBitVector &operator&=(const SparseBitVector &RHS) {
+        return filter(RHS, [](unit_t l, unit_t r) { return l & r; }, false);
+    }
+
+    ///< Clear the bits set in RHS.
+    SparseBitVector &operator-=(const SparseBitVector &RHS) {
+        return filter(RHS, [](unit_t l, unit_t r) { return l & ~r; }, true);
+    }
+
+    SparseBitVector operator|(const SparseBitVector &RHS) const {
+        SparseBitVector Ret = *this;
+        Ret |= RHS;
+        return Ret;
+    }
+
+    SparseBitVector operator&(const SparseBitVector &RHS) const {
+        SparseBitVector Ret = *this;
+        Ret &= RHS;
+        return Ret;
+    }
+
+    SparseBitVector operator-(const SparseBitVector &RHS) const {
+        SparseBitVector Ret = *this;
+        Ret -= RHS;
+        return Ret;
+    }
+
+    bool operator==(const SparseBitVector &RHS) const {
+        return elements == RHS.elements;
+    }
+
+    bool operator!=(const SparseBitVector &RHS) const {
+        return !(*this == RHS);
+    }
+
+private:
+    static constexpr size_t BitCount = sizeof(unit_t) * 8;
+
+    static inline unit_t mask(size_t i) {
+        return unit_t(1) << (i % BitCount);
+    }
+
+    std::vector<Element>::const_iterator lookup(size_t word) const {
+        return std::lower_bound(elements.begin(), elements.end(), word, [](const Element &elem, size_t word) {
+            return elem.index < word;
+        });
+    }
+
+    std::vector<Element>::iterator lookup(size_t word) {
+        return std::lower_bound(elements.begin(), elements.end(), word, [](const Element &elem, size_t word) {
+            return elem.index < word;
+        });
+    }
+
+    ///< Combine the words in place, keep the words missing in RHS if keepMissing.
+    template<typename Op>
+    SparseBitVector &filter(const SparseBitVector &RHS, Op op, bool keepMissing) {
+        auto Out = elements.begin();
+        auto R = RHS.elements.begin();
+        for (auto L = elements.begin(); L != elements.end(); ++L) {
+            while (R != RHS.elements.end() && R->index < L->index) {
+                ++R;
+            }
+            unit_t Bits;
+            if (R != RHS.elements.end() && R->index == L->index) {
+                Bits = op(L->bits, R->bits);
+            } else {
+                Bits = keepMissing ? L->bits : 0;
+            }
+            if (Bits) {
+                *Out++ = {L->index, Bits};
+            }
+        }
+        elements.erase(Out, elements.end());
+        return *this;
+    }
+
+};
+
+inline std::ostream &operator<<(std::ostream &os, const SparseBitVector &vec) {
+    os << '{';
+    bool First = true;
+    for (auto Index: vec) {
+        os << (First ? "" : ", ") << Index;
+        First = false;
+    }
+    os << '}';
+    return os;
+}
+
+
+#endif //DRAGONCOMPILER_SPARSEBITVECTOR_H
@@ -0,0 +1,148 @@
+//
+// Created by Alex on 2022/6/2.
+//
+
+#ifndef DRAGON_THREADPOOL_H
+#define DRAGON_THREADPOOL_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+/**
+ * A small work-stealing thread pool.
+ * Every worker owns a deque: it pops tasks from the back of its own deque and
+ * steals from the front of the others when it runs dry.
+ * The pool runs batches of tasks, `run` returns after the whole batch is done.
+ */
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+private:
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::condition_variable finished;
+    size_t pending = 0; ///< tasks of the current batch that are not finished
+    unsigned generation = 0; ///< bumped for every batch to wake up the workers
+    bool stopping = false;
+public:
+    static unsigned getDefaultThreads() {
+        auto Count = std::thread::hardware_concurrency();
+        return Count ? Count : 1;
+    }
+
+    explicit ThreadPool(unsigned threads = getDefaultThreads()) {
+        for (unsigned I = 0; I < threads; ++I) {
+            queues.emplace_back(std::make_unique<WorkQueue>());
+        }
+        for (unsigned I = 0; I < threads; ++I) {
+            workers.emplace_back([this, I] { work(I); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> Guard(lock);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (auto &Worker: workers) {
+            Worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    inline size_t size() const {
+        return workers.size();
+    }
+
+    ///< Run all the tasks and wait until they are finished.
+    void run(std::vector<Task> &tasks) {
+        if (tasks.empty()) {
+            return;
+        }
+        if (workers.empty()) {
+            for (auto &T: tasks) {
+                T();
+            }
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> Guard(lock);
+            pending = tasks.size();
+            // Round-robin the initial distribution, stealing balances the rest.
+            for (size_t I = 0; I < tasks.size(); ++I) {
+                auto &Queue = *queues[I % queues.size()];
+                std::lock_guard<std::mutex> QueueGuard(Queue.lock);
+                Queue.tasks.push_back(std::move(tasks[I]));
+            }
+            ++generation;
+        }
+        wakeup.notify_all();
+        std::unique_lock<std::mutex> Guard(lock);
+        finished.wait(Guard, [this] { return pending == 0; });
+    }
+
+private:
+    void work(unsigned index) {
+        unsigned Seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> Guard(lock);
+                wakeup.wait(Guard, [&] { return stopping || generation != Seen; });
+                if (stopping) {
+                    return;
+                }
+                Seen = generation;
+            }
+            Task Cur;
+            while (pop(index, Cur) || steal(index, Cur)) {
+                Cur();
+                Cur = nullptr;
+                std::lock_guard<std::mutex> Guard(lock);
+                if (--pending == 0) {
+                    finished.notify_all();
+                }
+            }
+        }
+    }
+
+    bool pop(unsigned index, Task &task) {
+        auto &Queue = *queues[index];
+        std::lock_guard<std::mutex> Guard(Queue.lock);
+        if (Queue.tasks.empty()) {
+            return false;
+        }
+        task = std::move(Queue.tasks.back());
+        Queue.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(unsigned index, Task &task) {
+        for (size_t I = 1; I < queues.size(); ++I) {
+            auto &Queue = *queues[(index + I) % queues.size()];
+            std::lock_guard<std::mutex> Guard(Queue.lock);
+            if (!Queue.tasks.empty()) {
+                task = std::move(Queue.tasks.front());
+                Queue.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+};
+
+#endif //DRAGON_THREADPOOL_H
@@ -409,3 +409,101 @@ ret i32 %not.0
 
 }
 
+TEST(SysExpr, BuildSSA) {
+    const char *Code = R"(
+        int main(int n){
+            int a = 0;
+            int b = 1;
+            int i = 0;
+            while (i < n) {
+              int t = a + b;
+              a = b;
+              b = t;
+              if (t > 100) b = b - 100;
+              i = i + 1;
+            }
+            do {
+              a = a - 1;
+            } while (a > 10);
+            if (a == n) a = 0; else n = 1;
+            return a + b + n;
+        }
+    )";
+    auto Module = compileModule(Code, true);
+    auto *Fun = Module->getFunction("main");
+    CHECK_OR_DUMP(Fun, R"(
+def main(i32 %n) -> i32 {
+entry.0:    preds=() succs=(%while.header.0)
+br %while.header.0
+
+while.header.0:    preds=(%if.leave.0, %entry.0) succs=(%while.body.0, %while.leave.0)
+%i.0 = phi [%if.leave.0: i32 %add.0], [%entry.0: i32 0]
+%a.0 = phi [%if.leave.0: i32 %b.0], [%entry.0: i32 0]
+%b.0 = phi [%if.leave.0: i32 %b.1], [%entry.0: i32 1]
+%lt.0 = lt i32 %i.0, i32 %n
+condbr i32 %lt.0, %while.body.0, %while.leave.0
+
+while.body.0:    preds=(%while.header.0) succs=(%if.then.0, %if.leave.0)
+%add.1 = add i32 %a.0, i32 %b.0
+%gt.0 = gt i32 %add.1, i32 100
+condbr i32 %gt.0, %if.then.0, %if.leave.0
+
+while.leave.0:    preds=(%while.header.0) succs=(%do.body.0)
+br %do.body.0
+
+if.then.0:    preds=(%while.body.0) succs=(%if.leave.0)
+%sub.0 = sub i32 %add.1, i32 100
+br %if.leave.0
+
+if.leave.0:    preds=(%if.then.0, %while.body.0) succs=(%while.header.0)
+%b.1 = phi [%if.then.0: i32 %sub.0], [%while.body.0: i32 %add.1]
+%add.0 = add i32 %i.0, i32 1
+br %while.header.0
+
+do.body.0:    preds=(%do.cond.0, %while.leave.0) succs=(%do.cond.0)
+%a.1 = phi [%do.cond.0: i32 %sub.1], [%while.leave.0: i32 %a.0]
+%sub.1 = sub i32 %a.1, i32 1
+br %do.cond.0
+
+do.cond.0:    preds=(%do.body.0) succs=(%do.body.0, %do.leave.0)
+%gt.1 = gt i32 %sub.1, i32 10
+condbr i32 %gt.1, %do.body.0, %do.leave.0
+
+do.leave.0:    preds=(%do.cond.0) succs=(%if.cond.0)
+br %if.cond.0
+
+if.cond.0:    preds=(%do.leave.0) succs=(%if.body.0, %if.else.0)
+%eq.0 = eq i32 %sub.1, i32 %n
+condbr i32 %eq.0, %if.body.0, %if.else.0
+
+if.body.0:    preds=(%if.cond.0) succs=(%if.leave.1)
+br %if.leave.1
+
+if.else.0:    preds=(%if.cond.0) succs=(%if.leave.1)
+br %if.leave.1
+
+if.leave.1:    preds=(%if.else.0, %if.body.0) succs=()
+%a.2 = phi [%if.else.0: i32 %sub.1], [%if.body.0: i32 0]
+%n.0 = phi [%if.else.0: i32 1], [%if.body.0: i32 %n]
+%add.2 = add i32 %a.2, i32 %b.0
+%add.3 = add i32 %add.2, i32 %n.0
+ret i32 %add.3
+}
+)");
+
+    // the same phis as the allocas promoted by SSAConstructor
+    auto Promoted = compileModule(Code);
+    PassManager PM;
+    PM.addPass(new SSAConstructor);
+    PM.run(Promoted.get());
+    auto CountPhis = [](Function *F) {
+        size_t Count = 0;
+        for (auto &BB: *F) {
+            for (auto &Phi: BB.phis()) {
+                Count++;
+            }
+        }
+        return Count;
+    };
+    EXPECT_EQ(CountPhis(Fun), CountPhis(Promoted->getFunction("main")));
+}
@@ -1,4 +1,5 @@
 #include "test_common.h"
+#include "Vectorization.h"
 
 #define EXPECT_EQ_ASM(V, EXPECTED) \
     EXPECT_EQ(SplitAndTrim(compileAsm(V)), SplitAndTrim(EXPECTED))
@@ -302,3 +303,222 @@ main_entry_0:
 )");
 }
 
+
+///< The asm of the module vectorized by the pass.
+inline std::string compileVectorAsm(Module *M, FunctionPass *vectorizer) {
+    PassManager PM;
+    PM.addPass(new Dominance);
+    PM.addPass(vectorizer);
+    PM.addPass(new SSADestructor);
+    PM.addPass(new Lowering);
+    PM.addPass(new RISCVLowering);
+    PM.addPass(new Liveness);
+    PM.addPass(new GraphColor);
+    PM.addPass(new MachineElim);
+    PM.run(M);
+    RISCVEmit E;
+    E.run(M);
+    return E.str();
+}
+
+///< Check the scalar control of the strip-mined loop of the function: the strip is set to `n - i`,
+///< a strip is accessed at `base + (i << 2)`, i is bumped by the strip and the loop exits when i >= n.
+inline void checkStripLoop(const std::string &code, const std::string &name) {
+    using Line = std::vector<std::string>;
+    std::map<std::string, std::vector<Line>> Blocks;
+    std::vector<Line> *Block = nullptr;
+    std::stringstream SS(code);
+    std::string Text;
+    while (std::getline(SS, Text)) {
+        Line Operands;
+        std::string Item;
+        for (char C: Text + " ") {
+            if (C == ' ' || C == ',' || C == '(' || C == ')') {
+                if (!Item.empty()) {
+                    Operands.push_back(std::exchange(Item, ""));
+                }
+            } else {
+                Item += C;
+            }
+        }
+        if (Operands.empty() || Operands[0][0] == '#') {
+            continue;
+        }
+        if (Operands[0].back() == ':') {
+            Block = &Blocks[Operands[0].substr(0, Operands[0].size() - 1)];
+        } else if (Block) {
+            Block->push_back(Operands);
+        }
+    }
+    auto &Loop = Blocks[name + "_loop_0"], &Body = Blocks[name + "_body_0"];
+    ASSERT_EQ(Loop.size(), 3);
+    ASSERT_EQ(Loop[0].size(), 4);
+    EXPECT_EQ(Loop[0][0], "lt");
+    auto I = Loop[0][2], N = Loop[0][3];
+    EXPECT_EQ(Loop[1], (Line{"bne", Loop[0][1], "zero", name + "_body_0"}));
+    EXPECT_EQ(Loop[2], (Line{"br", name + "_exit_0"}));
+    ASSERT_GE(Body.size(), 3);
+    ASSERT_EQ(Body[0].size(), 4);
+    EXPECT_EQ(Body[0], (Line{"sub", Body[0][1], N, I}));
+    auto VL = Body[1][1];
+    EXPECT_EQ(Body[1], (Line{"vsetvli", VL, Body[0][1], "e32", "m1", "ta", "ma"}));
+    EXPECT_EQ(Body.back(), (Line{"br", name + "_loop_0"}));
+    unsigned Accesses = 0;
+    bool Bumped = false;
+    for (size_t K = 2; K < Body.size() && !Bumped; ++K) {
+        auto &Cur = Body[K];
+        if (Cur[0] == "vle32.v" || Cur[0] == "vse32.v") {
+            ASSERT_GE(K, 4);
+            auto &Shift = Body[K - 2], &Add = Body[K - 1];
+            EXPECT_EQ(Shift, (Line{"slli", Shift[1], I, "2"}));
+            ASSERT_EQ(Add.size(), 4);
+            EXPECT_EQ(Add, (Line{"add", Cur[2], Add[2], Shift[1]}));
+            Accesses++;
+        } else if (Cur == Line{"add", Cur[1], I, VL}) {
+            Bumped = true;
+        } else {
+            // the strip and i live until the bump
+            EXPECT_TRUE(Cur.size() < 2 || (Cur[1] != VL && Cur[1] != I)) << Cur[0] << " " << Cur[1];
+        }
+    }
+    EXPECT_GT(Accesses, 0);
+    EXPECT_TRUE(Bumped);
+}
+
+///< The opcodes of the vector instructions in order.
+inline std::vector<std::string> getVectorOpcodes(const std::string &code) {
+    std::vector<std::string> Vector;
+    std::stringstream SS(code);
+    std::string Line;
+    while (std::getline(SS, Line)) {
+        Line.erase(0, Line.find_first_not_of(' '));
+        if (!Line.empty() && Line[0] == 'v') {
+            Vector.push_back(Line.substr(0, Line.find(' ')));
+        }
+    }
+    return Vector;
+}
+
+TEST(ASM, Vector) {
+    auto M = std::make_unique<Module>("test", Context);
+    auto *IntPtr = Context.getInt32Ty()->getPointerType();
+    // int dot(int *a, int *b, int n) { int s = 0; for (int i = 0; i < n; i = i + 1) s = s + a[i] * b[i]; return s; }
+    createCountedLoop(M.get(), "dot", {{"a", IntPtr}, {"b", IntPtr}},
+                      [&](IRBuilder &B, std::vector<Value *> &P, Value *I) -> Value * {
+        auto *X = B.createLoad(createElement(B, P[0], I));
+        return B.createMul(X, B.createLoad(createElement(B, P[1], I)));
+    });
+    auto Code = compileVectorAsm(M.get(), new LoopVectorize);
+    checkStripLoop(Code, "dot");
+    // the scalar registers are up to the allocator, the strips take the lowest vector register free,
+    // the accumulator reuses the one of a load dead after the multiply
+    std::stringstream SS(Code);
+    std::string Line;
+    while (std::getline(SS, Line)) {
+        Line.erase(0, Line.find_first_not_of(' '));
+        if (Line.rfind("vle32.v", 0) == 0) {
+            EXPECT_EQ(Line.find(", ("), 10);
+        } else if (Line.rfind("vmul.vv", 0) == 0) {
+            EXPECT_EQ(Line, "vmul.vv v3, v1, v2");
+        } else if (Line.rfind("vredsum.vs", 0) == 0) {
+            EXPECT_EQ(Line, "vredsum.vs v1, v3, v1");
+        }
+    }
+    std::vector<std::string> Expected{"vsetvli", "vle32.v", "vle32.v", "vmul.vv", "vmv.s.x", "vredsum.vs", "vmv.x.s"};
+    EXPECT_EQ(getVectorOpcodes(Code), Expected);
+}
+
+TEST(ASM, VectorOffset) {
+    auto M = std::make_unique<Module>("test", Context);
+    auto *IntPtr = Context.getInt32Ty()->getPointerType();
+    // int tail(int *a, int n) { int s = 0; for (int i = 0; i < n; i = i + 1) s = s + a[i + 1]; return s; }
+    // the loads go through the base a + 1 computed by an addi
+    createCountedLoop(M.get(), "tail", {{"a", IntPtr}},
+                      [&](IRBuilder &B, std::vector<Value *> &P, Value *I) -> Value * {
+        auto *Entry = B.getInsertBlock()->getParent()->getEntryBlock();
+        auto *Tail = new GetPtrInst(P[0], B.getInt(1));
+        Entry->insertBefore(Entry->getTerminator(), Tail);
+        return B.createLoad(createElement(B, Tail, I));
+    });
+    auto Code = compileVectorAsm(M.get(), new LoopVectorize);
+    checkStripLoop(Code, "tail");
+    EXPECT_NE(Code.find("addi"), std::string::npos);
+    std::vector<std::string> Expected{"vsetvli", "vle32.v", "vmv.s.x", "vredsum.vs", "vmv.x.s"};
+    EXPECT_EQ(getVectorOpcodes(Code), Expected);
+}
+
+TEST(ASM, VectorChain) {
+    auto M = std::make_unique<Module>("test", Context);
+    auto *Int = Context.getInt32Ty();
+    // int chain(int *a, int c, int n) { for (int i = 0; i < n; i = i + 1) { x = a[i]; x = c - x; ... a[i] = x; } return 0; }
+    createCountedLoop(M.get(), "chain", {{"a", Int->getPointerType()}, {"c", Int}},
+                      [&](IRBuilder &B, std::vector<Value *> &P, Value *I) -> Value * {
+        Value *X = B.createLoad(createElement(B, P[0], I));
+        for (int K = 0; K < 20; ++K) {
+            X = B.createSub(P[1], X);
+        }
+        B.createStore(createElement(B, P[0], I), X);
+        return nullptr;
+    });
+    auto Code = compileVectorAsm(M.get(), new LoopVectorize);
+    checkStripLoop(Code, "chain");
+    // c is splat once, the registers of the dead strips are taken again
+    unsigned Splats = 0, Subs = 0;
+    std::set<std::string> Registers;
+    std::stringstream SS(Code);
+    std::string Line;
+    while (std::getline(SS, Line)) {
+        Line.erase(0, Line.find_first_not_of(' '));
+        Splats += Line.rfind("vmv.v.x", 0) == 0;
+        Subs += Line.rfind("vsub.vv", 0) == 0;
+        for (size_t Pos = Line.find(" v"); Pos != std::string::npos; Pos = Line.find(" v", Pos + 1)) {
+            Registers.insert(Line.substr(Pos + 1, Line.find_first_of(",)", Pos) - Pos - 1));
+        }
+    }
+    EXPECT_EQ(Splats, 1);
+    EXPECT_EQ(Subs, 20);
+    EXPECT_EQ(Registers, (std::set<std::string>{"v1", "v2", "v3"}));
+}
+
+TEST(ASM, SLPVector) {
+    auto M = std::make_unique<Module>("test", Context);
+    auto *Int = Context.getInt32Ty();
+    auto *IntPtr = Int->getPointerType();
+    // int inc(int *a) { a[0] = a[0] + 1; ... a[n - 1] = a[n - 1] + 1; return 0; }
+    // the tree of deep is a load and 24 adds, more vector values than the target has registers for
+    auto Compile = [&](const char *name, int n, int adds) {
+        std::vector<Type *> Types{Int, IntPtr};
+        auto *F = M->createFunction(name, Context.getFunctionTy(Types));
+        auto *A = F->addParam("a", IntPtr);
+        IRBuilder Builder(BasicBlock::Create(F, "entry"));
+        for (int K = 0; K < n; ++K) {
+            Value *Add = Builder.createLoad(createElement(Builder, A, Builder.getInt(K)));
+            for (int I = 0; I < adds; ++I) {
+                Add = Builder.createAdd(Add, Builder.getInt(1));
+            }
+            Builder.createStore(createElement(Builder, A, Builder.getInt(K)), Add);
+        }
+        Builder.createRet(Builder.getInt(0));
+    };
+    Compile("inc4", 4, 1);
+    Compile("inc64", 64, 1);
+    Compile("deep", 4, 24);
+
+    // a group of 4 lanes at a constant offset is a vle32.v, a vadd.vx and a vse32.v
+    std::map<std::string, unsigned> Counts;
+    std::set<std::string> Registers;
+    std::stringstream SS(compileVectorAsm(M.get(), new SLPVectorize));
+    std::string Line;
+    while (std::getline(SS, Line)) {
+        Line.erase(0, Line.find_first_not_of(' '));
+        if (!Line.empty() && Line[0] == 'v') {
+            Counts[Line.substr(0, Line.find(' '))]++;
+        }
+        for (size_t Pos = Line.find(" v"); Pos != std::string::npos; Pos = Line.find(" v", Pos + 1)) {
+            Registers.insert(Line.substr(Pos + 1, Line.find_first_of(",)", Pos) - Pos - 1));
+        }
+    }
+    std::map<std::string, unsigned> Expected{{"vsetvli", 17}, {"vle32.v", 17}, {"vadd.vx", 17}, {"vse32.v", 17}};
+    EXPECT_EQ(Counts, Expected);
+    EXPECT_EQ(Registers, (std::set<std::string>{"v1", "v2"}));
+}
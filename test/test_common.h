@@ -28,6 +28,8 @@
 #include "MachineElim.h"
 #include "RISCVLowering.h"
 #include "RISCVEmit.h"
+#include "IRBuilder.h"
+#include <functional>
 
 inline auto SplitAndTrim(const std::string &str) -> std::string {
     std::vector<std::string> Res;
@@ -66,13 +68,72 @@ inline value_t ParseCode(const char *str) {
 
 Context Context;
 
-inline std::unique_ptr<Module> compileModule(const char *str) {
+inline std::unique_ptr<Module> compileModule(const char *str, bool buildSSA = false) {
     auto Val = ParseCode(str);
-    Codegen CG(Context);
+    Codegen CG(Context, buildSSA);
     CG.visit(Val);
     return std::move(CG.getModule());
 }
 
+using Params = std::vector<std::pair<const char *, Type *>>;
+
+///< `int name(params)`, the values of the params are appended to the vector.
+inline Function *createFunction(Module *M, const char *name, const Params &params, std::vector<Value *> &values) {
+    std::vector<Type *> Types{Context.getInt32Ty()};
+    for (auto &[Name, Ty]: params) {
+        Types.push_back(Ty);
+    }
+    auto *F = M->createFunction(name, Context.getFunctionTy(Types));
+    for (auto &[Name, Ty]: params) {
+        values.push_back(F->addParam(Name, Ty));
+    }
+    return F;
+}
+
+///< The pointer `base[index]` appended to the block of the builder.
+inline GetPtrInst *createElement(IRBuilder &builder, Value *base, Value *index) {
+    auto *GetPtr = new GetPtrInst(base, index);
+    builder.getInsertBlock()->append(GetPtr);
+    GetPtr->setName("ptr");
+    return GetPtr;
+}
+
+using LoopBodyFn = std::function<Value *(IRBuilder &, std::vector<Value *> &, Value *)>;
+
+///< `int name(params, int n) { int s = 0; for (int i = 0; i < n; i = i + 1) s = s + body; return s; }`,
+///< the body gets the values of the params and n, and i. It returns null for a loop without the sum.
+inline Function *createCountedLoop(Module *M, const char *name, Params params, const LoopBodyFn &body) {
+    auto *Int = Context.getInt32Ty();
+    std::vector<Value *> Values;
+    params.emplace_back("n", Int);
+    auto *F = createFunction(M, name, params, Values);
+    auto *N = Values.back();
+    auto *Entry = BasicBlock::Create(F, "entry");
+    auto *Header = BasicBlock::Create(F, "loop");
+    auto *Body = BasicBlock::Create(F, "body");
+    auto *Exit = BasicBlock::Create(F, "exit");
+    IRBuilder Builder(Entry);
+    Builder.createBr(Header);
+    auto *I = PhiInst::Create(Int, Header, "i");
+    Builder.setInsertPoint(Header);
+    Builder.createCondBr(Builder.createLt(I, N), Body, Exit);
+    Builder.setInsertPoint(Body);
+    Value *Zero = Builder.getInt(0), *Result = Zero;
+    std::vector<std::pair<BasicBlock *, Value *>> Incomings;
+    if (auto *Val = body(Builder, Values, I)) {
+        auto *S = PhiInst::Create(Int, Header, "s");
+        Incomings = {{Entry, Zero}, {Body, Builder.createAdd(S, Val)}};
+        S->fill(Incomings);
+        Result = S;
+    }
+    Incomings = {{Entry, Zero}, {Body, Builder.createAdd(I, Builder.getInt(1))}};
+    I->fill(Incomings);
+    Builder.createBr(Header);
+    Builder.setInsertPoint(Exit);
+    Builder.createRet(Result);
+    return F;
+}
+
 
 #define EXPECT_EQ_VALUE(V, EXPECTED) \
     EXPECT_EQ(SplitAndTrim(V->dumpToString()), SplitAndTrim(EXPECTED))
@@ -6,6 +6,8 @@
 #include "Function.h"
 #include "IRBuilder.h"
 #include "Dominance.h"
+#include "DomTreeUpdater.h"
+#include "DataFlow.h"
 #include "SSAConstructor.h"
 #include "Inliner.h"
 #include "LoopAnalyse.h"
@@ -49,6 +51,18 @@ ret i32 22
 
 }
 
+TEST(IR, BlockOrder) {
+    Function F("test", Context.getVoidFunTy());
+    auto *Entry = BasicBlock::Create(&F, "entry");
+    auto *Exit = BasicBlock::Create(&F, "exit");
+    EXPECT_TRUE(Entry->comesBefore(Exit));
+    // the blocks are numbered now, a new block takes the order after the last one
+    auto *BB = F.createBasicBlock("BB");
+    EXPECT_EQ(BB->getParent(), &F);
+    EXPECT_TRUE(Exit->comesBefore(BB));
+    EXPECT_FALSE(BB->comesBefore(Entry));
+}
+
 TEST(IR, BBSplit) {
     Function F("test", Context.getVoidFunTy());
     auto *Entry = BasicBlock::Create(&F, "entry");
@@ -56,7 +70,8 @@ TEST(IR, BBSplit) {
     auto *Alloca = Builder.createAlloca(Context.getInt32Ty(), "V");
     auto *Add = Builder.createAdd(Context.getInt(1), Context.getInt(2));
     Builder.createStore(Alloca, Add);
-    Builder.createRet(Builder.createLoad(Alloca));
+    auto *Load = Builder.createLoad(Alloca);
+    Builder.createRet(Load);
 
     Entry->split(Add, "NewBB");
 
@@ -68,6 +83,15 @@ store i32* %V.0, i32 %add.0
 ret i32 %load.0
 )");
 
+    Dominance Dom;
+    Dom.runOnFunction(F);
+    EXPECT_TRUE(Dom.dominates(Alloca, Add));
+    EXPECT_FALSE(Dom.dominates(Add, Alloca));
+    EXPECT_TRUE(Dom.dominates(Add, Load));
+    EXPECT_FALSE(Dom.dominates(Load, Load));
+    Load->moveBefore(Add);
+    EXPECT_TRUE(Dom.dominates(Load, Add));
+    EXPECT_FALSE(Dom.dominates(Add, Load));
 }
 
 TEST(IR, DeadBlock) {
@@ -221,10 +245,25 @@ TEST(IR, IDF) {
 
     CHECK_OR_DUMP(F, R"()");
 
-    //F->getEntryBlock()->calculateLevel();
-    //IDFCalculator Calc;
-    //EXPECT_EQ(dump_str(Calc.calc({BB[1], BB[3], BB[4], BB[7]})), "%2, %5, %6");
-    //EXPECT_EQ(dump_str(Calc.calc({BB[6]})), "%2, %5, %6");
+    IDFCalculator Calc;
+    Calc.reserve(DomPass->blocks.size());
+    auto CalcIDF = [&](const std::vector<BasicBlock *> &blocks) {
+        std::vector<BasicBlock *> IDF;
+        Calc.calculate(blocks, IDF);
+        std::sort(IDF.begin(), IDF.end(), [](BasicBlock *lhs, BasicBlock *rhs) {
+            return lhs->getNumber() < rhs->getNumber();
+        });
+        std::string Str;
+        for (auto *BB: IDF) {
+            Str += Str.empty() ? "%" : ", %";
+            Str += BB->getName();
+        }
+        return Str;
+    };
+    EXPECT_EQ(CalcIDF({BB[1], BB[3], BB[4], BB[7]}), "%2, %5, %6");
+    EXPECT_EQ(CalcIDF({BB[6]}), "%2, %5, %6");
+    EXPECT_EQ(CalcIDF({BB[10]}), "%2, %5, %6, %8");
+    EXPECT_EQ(CalcIDF({BB[0], BB[11]}), "");
 
     F->getSubList().clear();
     BasicBlock *BBNews[] = {
@@ -366,6 +405,359 @@ TEST(IR, Loop) {
         std::cout << "Loop: " << Loop.getHeader()->getName() << std::endl;
     }
 
+    ASSERT_EQ(F->loops.size(), 3);
+    auto *Inner = LoopPass->getLoopFor(BB[4]);
+    ASSERT_TRUE(Inner);
+    ASSERT_EQ(Inner->getHeader(), BB[3]);
+    ASSERT_EQ(Inner->getLevel(), 2);
+    ASSERT_TRUE(Inner->getParent());
+    ASSERT_EQ(Inner->getParent()->getHeader(), BB[1]);
+    ASSERT_EQ(Inner->getParent()->getSubLoops().size(), 1);
+    ASSERT_TRUE(Inner->getParent()->contains(BB[4]));
+    ASSERT_FALSE(Inner->contains(BB[2]));
+    ASSERT_EQ(LoopPass->getLoopDepth(BB[2]), 1);
+    ASSERT_EQ(LoopPass->getLoopDepth(BB[6]), 1);
+    ASSERT_EQ(LoopPass->getLoopDepth(BB[0]), 0);
+    ASSERT_EQ(LoopPass->getLoopDepth(BB[7]), 0);
+    ASSERT_EQ(Inner->getParent()->getExits(), std::vector<BasicBlock *>{BB[5]});
+    ASSERT_EQ(Inner->getParent()->getPreheader(), BB[0]);
+    ASSERT_EQ(LoopPass->topLevel.size(), 2);
+
+    delete F;
+}
+
+TEST(IR, Dominance) {
+    // A random cfg with irreducible loops and unreachable blocks.
+    Function *F = new Function("test", Context.getVoidFunTy());
+    const unsigned Size = 200;
+    std::vector<BasicBlock *> BB;
+    for (unsigned I = 0; I < Size; ++I) {
+        BB.push_back(BasicBlock::Create(F, "bb"));
+    }
+    unsigned Seed = 12345;
+    auto Random = [&](unsigned n) {
+        Seed = Seed * 1103515245 + 12345;
+        return (Seed >> 16) % n;
+    };
+    IRBuilder Builder;
+    for (unsigned I = 0; I < Size; ++I) {
+        Builder.setInsertPoint(BB[I]);
+        auto Kind = Random(8);
+        if (I == Size - 1 || Kind == 0) {
+            Builder.createRet();
+        } else if (Kind < 4) {
+            Builder.createBr(BB[1 + Random(Size - 1)]);
+        } else {
+            auto T = 1 + Random(Size - 1), E = 1 + Random(Size - 1);
+            if (T == E) {
+                Builder.createBr(BB[T]);
+            } else {
+                Builder.createCondBr(Builder.getInt(1), BB[T], BB[E]);
+            }
+        }
+    }
+    Dominance Dom;
+    Dom.runOnFunction(*F);
+
+    // Brute force: Dom(n) = {n} + the intersection of Dom(pred)
+    std::vector<std::vector<bool>> Doms(Size, std::vector<bool>(Size, true));
+    std::vector<bool> Reachable(Size, false);
+    std::vector<BasicBlock *> Worklist = {BB[0]};
+    Reachable[0] = true;
+    while (!Worklist.empty()) {
+        auto *Cur = Worklist.back();
+        Worklist.pop_back();
+        for (auto *Succ: Cur->succs()) {
+            if (!Reachable[Succ->getNumber()]) {
+                Reachable[Succ->getNumber()] = true;
+                Worklist.push_back(Succ);
+            }
+        }
+    }
+    Doms[0].assign(Size, false);
+    Doms[0][0] = true;
+    bool Changed;
+    do {
+        Changed = false;
+        for (unsigned I = 1; I < Size; ++I) {
+            if (!Reachable[I]) {
+                continue;
+            }
+            std::vector<bool> New(Size, true);
+            for (auto *Pred: BB[I]->preds()) {
+                if (!Reachable[Pred->getNumber()]) {
+                    continue;
+                }
+                for (unsigned K = 0; K < Size; ++K) {
+                    New[K] = New[K] && Doms[Pred->getNumber()][K];
+                }
+            }
+            New[I] = true;
+            if (New != Doms[I]) {
+                Doms[I] = New;
+                Changed = true;
+            }
+        }
+    } while (Changed);
+
+    auto Count = [&](unsigned n) {
+        return std::count(Doms[n].begin(), Doms[n].end(), true);
+    };
+    for (unsigned I = 0; I < Size; ++I) {
+        EXPECT_EQ(BB[I]->getNumber(), I);
+        if (!Reachable[I] || I == 0) {
+            EXPECT_EQ(BB[I]->getDominator(), nullptr);
+            continue;
+        }
+        // the immediate dominator is the strict dominator with the most dominators
+        BasicBlock *IDom = nullptr;
+        for (unsigned K = 0; K < Size; ++K) {
+            if (K != I && Doms[I][K] && (!IDom || Count(K) > Count(IDom->getNumber()))) {
+                IDom = BB[K];
+            }
+        }
+        EXPECT_EQ(BB[I]->getDominator(), IDom);
+        EXPECT_EQ(BB[I]->getLevel(), Count(I) - 1);
+    }
+    // the dominance queries answered by the DFS intervals
+    for (unsigned I = 0; I < Size; ++I) {
+        if (!Reachable[I]) {
+            continue;
+        }
+        for (unsigned K = 0; K < Size; ++K) {
+            if (Reachable[K]) {
+                EXPECT_EQ(BB[K]->dominates(BB[I]), bool(Doms[I][K]));
+            }
+        }
+    }
+
+    // DF(x) = { y | x dominates a pred of y, and x doesn't strictly dominate y }
+    for (unsigned X = 0; X < Size; ++X) {
+        if (!Reachable[X]) {
+            continue;
+        }
+        std::vector<BasicBlock *> Expected;
+        for (unsigned Y = 0; Y < Size; ++Y) {
+            if (!Reachable[Y] || (X != Y && Doms[Y][X])) {
+                continue;
+            }
+            for (auto *Pred: BB[Y]->preds()) {
+                if (Reachable[Pred->getNumber()] && Doms[Pred->getNumber()][X]) {
+                    Expected.push_back(BB[Y]);
+                    break;
+                }
+            }
+        }
+        EXPECT_EQ(BB[X]->getDomFrontier(), Expected);
+    }
+    delete F;
+
+    // A deep chain doesn't overflow the stack
+    F = new Function("chain", Context.getVoidFunTy());
+    BasicBlock *Prev = BasicBlock::Create(F, "entry");
+    BasicBlock *Header = nullptr;
+    for (unsigned I = 0; I < 50000; ++I) {
+        auto *Next = BasicBlock::Create(F, "chain");
+        Builder.setInsertPoint(Prev);
+        Builder.createBr(Next);
+        Prev = Next;
+        Header = Header ? Header : Next;
+    }
+    Builder.setInsertPoint(Prev);
+    Builder.createBr(Header);
+    Dom.runOnFunction(*F);
+    EXPECT_EQ(Prev->getLevel(), 50000);
+    ASSERT_EQ(Prev->getDomFrontier().size(), 1);
+    EXPECT_EQ(Prev->getDomFrontier()[0], Header);
+    delete F;
+}
+
+TEST(IR, DomTreeUpdater) {
+    Function *F = new Function("test", Context.getVoidFunTy());
+    const unsigned Size = 120;
+    std::vector<BasicBlock *> BB;
+    for (unsigned I = 0; I < Size; ++I) {
+        BB.push_back(BasicBlock::Create(F, "bb"));
+    }
+    unsigned Seed = 4321;
+    auto Random = [&](unsigned n) {
+        Seed = Seed * 1103515245 + 12345;
+        return (Seed >> 16) % n;
+    };
+    IRBuilder Builder;
+    for (unsigned I = 0; I < Size; ++I) {
+        Builder.setInsertPoint(BB[I]);
+        auto Kind = Random(8);
+        if (I == Size - 1 || Kind == 0) {
+            Builder.createRet();
+        } else if (Kind < 4) {
+            Builder.createBr(BB[1 + Random(Size - 1)]);
+        } else {
+            Builder.createCondBr(Builder.getInt(1), BB[1 + Random(Size - 1)], BB[1 + Random(Size - 1)]);
+        }
+    }
+
+    struct Info {
+        BasicBlock *dom;
+        unsigned level;
+        std::set<BasicBlock *> children;
+        std::set<BasicBlock *> frontier;
+    };
+    auto Sorted = [](std::vector<BasicBlock *> &blocks) {
+        return std::is_sorted(blocks.begin(), blocks.end(), [](BasicBlock *lhs, BasicBlock *rhs) {
+            return lhs->getNumber() < rhs->getNumber();
+        });
+    };
+    Dominance Dom;
+    Dom.runOnFunction(*F);
+    for (unsigned Round = 0; Round < 30; ++Round) {
+        DomTreeUpdater Updater(*F, Dom);
+        for (unsigned Batch = 0; Batch < 3; ++Batch) {
+            for (unsigned Edit = 0; Edit < 1 + Random(4); ++Edit) {
+                auto *From = BB[Random(BB.size())];
+                auto *Term = From->getTerminator();
+                if (Term->getNumSuccessors() == 0) {
+                    continue;
+                }
+                auto Index = Random(Term->getNumSuccessors());
+                auto *OldSucc = Term->getSuccessor(Index);
+                if (Random(4) == 0) {
+                    // split the block before the terminator
+                    BB.push_back(From->split(Term, "", &Updater));
+                } else {
+                    auto *NewSucc = BB[1 + Random(BB.size() - 1)];
+                    if (NewSucc == F->getEntryBlock()) {
+                        continue;
+                    }
+                    Term->setSuccessor(Index, NewSucc);
+                    Updater.deleteEdge(From, OldSucc);
+                    Updater.insertEdge(From, NewSucc);
+                }
+            }
+            Updater.applyUpdates();
+        }
+
+        std::map<BasicBlock *, Info> Incremental;
+        for (auto &Block: *F) {
+            EXPECT_TRUE(Sorted(Block.getDomChildren()));
+            EXPECT_TRUE(Sorted(Block.getDomFrontier()));
+            if (auto *IDom = Block.getDominator()) {
+                EXPECT_TRUE(IDom->getDFSIn() < Block.getDFSIn() && Block.getDFSOut() <= IDom->getDFSOut());
+            }
+            auto &Children = Block.getDomChildren();
+            auto &Frontier = Block.getDomFrontier();
+            Incremental[&Block] = {Block.getDominator(), Block.getLevel(),
+                                   {Children.begin(), Children.end()}, {Frontier.begin(), Frontier.end()}};
+        }
+        Dom.runOnFunction(*F);
+        for (auto &Block: *F) {
+            auto &Expected = Incremental[&Block];
+            auto &Children = Block.getDomChildren();
+            auto &Frontier = Block.getDomFrontier();
+            EXPECT_EQ(Expected.dom, Block.getDominator());
+            if (Block.getDominator()) {
+                EXPECT_EQ(Expected.level, Block.getLevel());
+            }
+            EXPECT_EQ(Expected.children, std::set<BasicBlock *>(Children.begin(), Children.end()));
+            EXPECT_EQ(Expected.frontier, std::set<BasicBlock *>(Frontier.begin(), Frontier.end()));
+        }
+    }
+    delete F;
+
+    // BranchElim erases the unreachable loop in one call, its blocks still branch to each other
+    auto Mod = compileModule(R"(
+        int f(int n) {
+            if (0) {
+                while (n < 3) {
+                    n = n + 1;
+                }
+            }
+            return n;
+        }
+    )");
+    PassManager PM;
+    PM.addPass(new Dominance);
+    PM.addPass(new SSAConstructor);
+    PM.addPass(new GVN);
+    PM.addPass(new BranchElim);
+    PM.run(Mod.get());
+    auto &G = *Mod->begin();
+    std::map<BasicBlock *, std::pair<BasicBlock *, std::vector<BasicBlock *>>> Updated;
+    for (auto &Block: G) {
+        EXPECT_TRUE(Block.getDominator() || &Block == G.getEntryBlock());
+        Updated[&Block] = {Block.getDominator(), Block.getDomFrontier()};
+    }
+    Dom.runOnFunction(G);
+    for (auto &Block: G) {
+        EXPECT_EQ(Updated[&Block], std::make_pair(Block.getDominator(), Block.getDomFrontier()));
+    }
+}
+
+TEST(IR, DataFlow) {
+    Function *F = new Function("test", Context.getVoidFunTy());
+    const unsigned Size = 60;
+    std::vector<BasicBlock *> BB;
+    for (unsigned I = 0; I < Size; ++I) {
+        BB.push_back(BasicBlock::Create(F, "bb"));
+    }
+    unsigned Seed = 1234;
+    auto Random = [&](unsigned n) {
+        Seed = Seed * 1103515245 + 12345;
+        return (Seed >> 16) % n;
+    };
+    // every block is reachable through the next one
+    IRBuilder Builder;
+    for (unsigned I = 0; I < Size; ++I) {
+        Builder.setInsertPoint(BB[I]);
+        if (I == Size - 1) {
+            Builder.createRet();
+        } else {
+            Builder.createCondBr(Builder.getInt(1), BB[I + 1], BB[1 + Random(Size - 1)]);
+        }
+    }
+    Dominance Dom;
+    Dom.runOnFunction(*F);
+    auto Reaches = [&](BasicBlock *from, BasicBlock *to) {
+        std::set<BasicBlock *> Visited = {from};
+        std::vector<BasicBlock *> Stack = {from};
+        while (!Stack.empty()) {
+            auto *Cur = Stack.back();
+            Stack.pop_back();
+            for (auto *Succ: Cur->succs()) {
+                if (Visited.insert(Succ).second) {
+                    Stack.push_back(Succ);
+                }
+            }
+        }
+        return Visited.count(to) != 0;
+    };
+
+    // the blocks dominating a block, and the blocks reaching it or reached from it
+    DataFlow<BasicBlock, true, true> Dominators;
+    DataFlow<BasicBlock, true> Reaching;
+    DataFlow<BasicBlock, false> Reachable;
+    Dominators.init(*F, Size);
+    Reaching.init(*F, Size);
+    Reachable.init(*F, Size);
+    EXPECT_EQ(Dominators.getBlock(0), BB[0]);
+    for (unsigned I = 0; I < Size; ++I) {
+        Dominators[BB[I]].gen.set(I);
+        Reaching[BB[I]].gen.set(I);
+        Reachable[BB[I]].gen.set(I);
+    }
+    Dominators.solve();
+    Reaching.solve();
+    Reachable.solve();
+    EXPECT_GE(Dominators.stats.visits, Size);
+    EXPECT_GE(Dominators.stats.changes, Size);
+    EXPECT_LE(Reaching.stats.sweeps, Reaching.stats.visits);
+    for (unsigned I = 0; I < Size; ++I) {
+        for (unsigned J = 0; J < Size; ++J) {
+            EXPECT_EQ(Dominators[BB[J]].output.get(I), BB[I]->dominates(BB[J]));
+            EXPECT_EQ(Reaching[BB[J]].output.get(I), I == J || Reaches(BB[I], BB[J]));
+            EXPECT_EQ(Reachable[BB[I]].output.get(J), I == J || Reaches(BB[I], BB[J]));
+        }
+    }
     delete F;
 }
 
@@ -3,6 +3,11 @@
 //
 #include "gtest/gtest.h"
 #include "Node.h"
+#include "BitVector.h"
+#include "SparseBitVector.h"
+#include "GraphTraversal.h"
+#include <set>
+#include <random>
 
 class Element : public Node<Element> {
 public:
@@ -97,3 +102,215 @@ TEST(NodeList, Test) {
     EXPECT_EQ(Join(List), "");
 
 }
+
+class Holder;
+class Item : public NodeWithParent<Item, Holder> {
+public:
+    int value = 0;
+    Item(int value) : value(value) {}
+};
+class Holder : public NodeParent<Holder, Item> {};
+
+TEST(NodeList, Order) {
+    Holder H;
+    std::vector<Item *> Items;
+    for (int I = 0; I < 4; ++I) {
+        Items.push_back(new Item(I));
+        H.append(Items.back());
+    }
+    auto Check = [&]() {
+        std::vector<Item *> Order;
+        for (auto &Cur: H.getSubList()) {
+            Order.push_back(&Cur);
+        }
+        for (size_t I = 0; I < Order.size(); ++I) {
+            for (size_t J = 0; J < Order.size(); ++J) {
+                ASSERT_EQ(Order[I]->comesBefore(Order[J]), I < J);
+            }
+        }
+    };
+    Check();
+    // insert at the same place until the gaps run out
+    for (int I = 0; I < 40; ++I) {
+        auto *New = new Item(100 + I);
+        H.insertAfter(Items[0], New);
+        ASSERT_TRUE(Items[0]->comesBefore(New));
+        ASSERT_TRUE(New->comesBefore(Items[1]));
+    }
+    Check();
+    Items[3]->moveBefore(Items[0]);
+    H.erase(Items[1]);
+    Check();
+    ASSERT_TRUE(Items[3]->comesBefore(Items[0]));
+}
+
+struct GraphNode {
+    int id = 0;
+    bool visited = false;
+    std::vector<GraphNode *> succs;
+};
+
+TEST(Graph, Traversal) {
+    using Range = std::vector<GraphNode *>;
+    auto Children = [](GraphNode *node) -> Range & { return node->succs; };
+    auto Mark = [](GraphNode *node) {
+        return !std::exchange(node->visited, true);
+    };
+    // 0 -> 1 -> 3, 0 -> 2 -> 3, 3 -> 0
+    std::vector<GraphNode> G(4);
+    for (int I = 0; I < 4; ++I) {
+        G[I].id = I;
+    }
+    G[0].succs = {&G[1], &G[2]};
+    G[1].succs = {&G[3]};
+    G[2].succs = {&G[3]};
+    G[3].succs = {&G[0]};
+    PostOrderTraversal<GraphNode *, Range> PO;
+    std::vector<int> Ids;
+    for (auto *Node: PO.reversePostOrder(&G[0], Children, Mark)) {
+        Ids.push_back(Node->id);
+    }
+    EXPECT_EQ(Ids, (std::vector<int>{0, 2, 1, 3}));
+
+    // enter and exit of a tree
+    TreeWalker<GraphNode *, Range> Tree;
+    std::string Trace;
+    G[3].succs.clear();
+    G[2].succs.clear();
+    Tree.walk(&G[0], Children, [&](GraphNode *node) {
+        Trace += "+" + std::to_string(node->id);
+    }, [&](GraphNode *node) {
+        Trace += "-" + std::to_string(node->id);
+    });
+    EXPECT_EQ(Trace, "+0+1+3-3-1+2-2-0");
+
+    // a chain much deeper than the call stack could take
+    const int Depth = 1000000;
+    std::vector<GraphNode> Chain(Depth);
+    for (int I = 0; I + 1 < Depth; ++I) {
+        Chain[I].succs = {&Chain[I + 1]};
+    }
+    EXPECT_EQ(PO.postOrder(&Chain[0], Children, Mark).size(), Depth);
+}
+
+TEST(Graph, SCC) {
+    using Range = std::vector<GraphNode *>;
+    auto Children = [](GraphNode *node) -> Range & { return node->succs; };
+    auto AsNode = [](GraphNode *node) { return node; };
+    // {0, 1, 2} -> {3, 4} -> {5}
+    std::vector<GraphNode> G(6);
+    for (int I = 0; I < 6; ++I) {
+        G[I].id = I;
+    }
+    G[0].succs = {&G[1]};
+    G[1].succs = {&G[2], &G[3]};
+    G[2].succs = {&G[0]};
+    G[3].succs = {&G[4], &G[5]};
+    G[4].succs = {&G[3]};
+    TarjanSCC<GraphNode *, Range> SCC;
+    std::vector<std::set<int>> Groups;
+    std::vector<int> Roots;
+    for (auto &Node: G) {
+        SCC.run(&Node, Children, AsNode, [&](const std::vector<GraphNode *> &group, GraphNode *root) {
+            std::set<int> Ids;
+            for (auto *Member: group) {
+                Ids.insert(Member->id);
+            }
+            Groups.push_back(Ids);
+            Roots.push_back(root->id);
+        });
+    }
+    EXPECT_EQ(Groups, (std::vector<std::set<int>>{{5}, {3, 4}, {0, 1, 2}}));
+    EXPECT_EQ(Roots, (std::vector<int>{5, 3, 0}));
+}
+
+TEST(BitVector, Ops) {
+    BitVector Vec("0110000001");
+    EXPECT_EQ(Vec.count(), 3);
+    EXPECT_EQ(Vec.find_first(), 1);
+    EXPECT_EQ(Vec.find_next(2), 9);
+    EXPECT_EQ(Vec.find_next(9), Vec.size());
+    EXPECT_EQ(~Vec, BitVector("1001111110"));
+    EXPECT_EQ(Vec - BitVector("0100000001"), BitVector("0010000000"));
+
+    std::mt19937 Random(42);
+    for (size_t Size: {1, 63, 64, 65, 255, 256, 1000}) {
+        BitVector L(Size), R(Size);
+        std::set<size_t> LSet, RSet;
+        for (size_t I = 0; I < Size / 3 + 1; ++I) {
+            auto A = Random() % Size, B = Random() % Size;
+            L.set(A), LSet.insert(A);
+            R.set(B), RSet.insert(B);
+        }
+        auto Check = [](const BitVector &vec, const std::set<size_t> &set) {
+            EXPECT_EQ(vec.count(), set.size());
+            EXPECT_EQ(vec.any(), !set.empty());
+            EXPECT_EQ(std::set<size_t>(vec.begin(), vec.end()), set);
+        };
+        Check(L, LSet);
+        std::set<size_t> Union = LSet, Inter, Diff;
+        Union.insert(RSet.begin(), RSet.end());
+        std::set_intersection(LSet.begin(), LSet.end(), RSet.begin(), RSet.end(), std::inserter(Inter, Inter.end()));
+        std::set_difference(LSet.begin(), LSet.end(), RSet.begin(), RSet.end(), std::inserter(Diff, Diff.end()));
+        Check(L | R, Union);
+        Check(L & R, Inter);
+        Check(L - R, Diff);
+        EXPECT_EQ((~L).count(), Size - LSet.size());
+        EXPECT_EQ(L | R, R | L);
+
+        BitVector Copy = L;
+        Copy.resize(Size + 70);
+        Check(Copy, LSet);
+        Copy.resize(Size);
+        EXPECT_EQ(Copy, L);
+        BitVector Moved = std::move(Copy);
+        EXPECT_EQ(Moved, L);
+    }
+    // a single bit in every word, inside and after the blocks of 4 words the bulk kernels take
+    // with DRAGON_AVX2
+    for (size_t Bit = 0; Bit < 1000; Bit += 61) {
+        BitVector One(1000), Other(1000);
+        One.set(Bit);
+        EXPECT_TRUE(One.any());
+        EXPECT_NE(One, Other);
+        Other |= One;
+        EXPECT_EQ(One, Other);
+        EXPECT_TRUE((One - Other).none());
+        EXPECT_EQ((One & Other).find_first(), Bit);
+    }
+}
+
+TEST(BitVector, Sparse) {
+    std::mt19937 Random(7);
+    SparseBitVector L, R;
+    std::set<size_t> LSet, RSet;
+    for (int I = 0; I < 500; ++I) {
+        auto A = Random() % 100000, B = Random() % 100000;
+        L.set(A), LSet.insert(A);
+        R.set(B), RSet.insert(B);
+        if (I % 3 == 0) {
+            L.set(B), LSet.insert(B);
+        }
+    }
+    for (int I = 0; I < 100; ++I) {
+        auto A = *std::next(LSet.begin(), Random() % LSet.size());
+        L.clear(A), LSet.erase(A);
+    }
+    auto Check = [](const SparseBitVector &vec, const std::set<size_t> &set) {
+        EXPECT_EQ(vec.count(), set.size());
+        EXPECT_EQ(std::set<size_t>(vec.begin(), vec.end()), set);
+        for (auto Index: set) {
+            EXPECT_TRUE(vec.get(Index));
+        }
+    };
+    Check(L, LSet);
+    std::set<size_t> Union = LSet, Inter, Diff;
+    Union.insert(RSet.begin(), RSet.end());
+    std::set_intersection(LSet.begin(), LSet.end(), RSet.begin(), RSet.end(), std::inserter(Inter, Inter.end()));
+    std::set_difference(LSet.begin(), LSet.end(), RSet.begin(), RSet.end(), std::inserter(Diff, Diff.end()));
+    Check(L | R, Union);
+    Check(L & R, Inter);
+    Check(L - R, Diff);
+    EXPECT_EQ((L - R) | (L & R), L);
+    EXPECT_EQ(SparseBitVector().find_first(), SparseBitVector::npos);
+}
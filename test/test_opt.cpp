@@ -18,6 +18,15 @@
 #include "DCE.h"
 #include "LICM.h"
 #include "SCCP.h"
+#include "PassTimer.h"
+#include "SSALiveness.h"
+#include "CallGraph.h"
+#include "MemorySSA.h"
+#include "PRE.h"
+#include "ScalarPromotion.h"
+#include "Vectorization.h"
+#include "OSR.h"
+#include "ScalarEvolution.h"
 
 template<typename ...Passes>
 inline std::unique_ptr<Module> compileWithPasses(const char *Code) {
@@ -189,6 +198,73 @@ ret i32 %add.0
 )");
 }
 
+TEST(Pass, InlineCost) {
+    auto Mod = compileWithPasses<Inliner>(
+            "int add(int a, int b) {"
+            "  return a + b;"
+            "}"
+            "int twice(int a) {"
+            "  return add(a, a);"
+            "}"
+            "int big(int a, int b) {"
+            "  a = a * b + 1;"
+            "  a = a * b + 2;"
+            "  a = a * b + 3;"
+            "  a = a * b + 4;"
+            "  a = a * b + 5;"
+            "  a = a * b + 6;"
+            "  a = a * b + 7;"
+            "  a = a * b + 8;"
+            "  a = a * b + 9;"
+            "  a = a * b + 10;"
+            "  a = a * b + 11;"
+            "  a = a * b + 12;"
+            "  return a;"
+            "}"
+            "int pick(int k, int x) {"
+            "  if (k == 0) {"
+            "    x = x * 3 + 1;"
+            "    x = x * 3 + 2;"
+            "    x = x * 3 + 3;"
+            "    x = x * 3 + 4;"
+            "    x = x * 3 + 5;"
+            "    x = x * 3 + 6;"
+            "    x = x * 3 + 7;"
+            "    x = x * 3 + 8;"
+            "    x = x * 3 + 9;"
+            "    x = x * 3 + 10;"
+            "    x = x * 3 + 11;"
+            "    x = x * 3 + 12;"
+            "  }"
+            "  return x;"
+            "}"
+            "int abs(int x) {"
+            "  if (x < 0) {"
+            "    return 0 - x;"
+            "  }"
+            "  return x;"
+            "}"
+            "int main(int n) {"
+            "  int a = twice(n) + big(n, n);"
+            "  int b = pick(1, n) + pick(0, n);"
+            "  return a + b + abs(n);"
+            "}");
+    auto Calls = [&](const char *name) {
+        std::vector<std::string> Callees;
+        Mod->getFunction(name)->forEach<CallInst>([&](CallInst *call) {
+            Callees.push_back(call->getCallee()->getName());
+        });
+        return Callees;
+    };
+    // add is inlined into twice first, then twice into main
+    EXPECT_TRUE(Calls("twice").empty());
+    // big is too large, pick only folds away its body with k != 0
+    EXPECT_EQ(Calls("main"), (std::vector<std::string>{"big", "pick"}));
+    unsigned Phis = 0;
+    Mod->getFunction("main")->forEach<PhiInst>([&](PhiInst *) { Phis++; });
+    EXPECT_EQ(Phis, 2); // the x of pick, and the two returns of abs
+}
+
 TEST(Pass, SCCP) {
     auto Mod = compileWithPasses<SCCP, Dominance, BranchElim, Dominance>(
             "int test_add(int a, int b) {"
@@ -235,3 +311,1408 @@ ret i32 360
 }
 )");
 }
+
+TEST(Pass, IPSCCP) {
+    auto Mod = compileWithPasses<IPSCCP, Dominance, BranchElim, Dominance>(
+            "int scale(int x, int mode) {"
+            "  if (mode == 1) {"
+            "    return x * 2;"
+            "  }"
+            "  return x * 3;"
+            "}"
+            "int depth(int n) {"
+            "  if (n > 0) {"
+            "    return depth(n - 1);"
+            "  }"
+            "  return 0;"
+            "}"
+            "int fib(int t) {"
+            "  if (t < 2) {"
+            "    return t;"
+            "  }"
+            "  return fib(t - 1) + fib(t - 2);"
+            "}"
+            "int main(int n) {"
+            "  int a = scale(n, 1) + scale(4, 1);"
+            "  return a + depth(n) + fib(10);"
+            "}");
+    // mode is always 1, depth always returns 0, the recursion of fib settles on unknown values
+    CHECK_OR_DUMP(Mod, R"(
+Module: Module
+def scale(i32 %x, i32 %mode) -> i32 {
+entry.0:    preds=() succs=()
+%mul.0 = mul i32 %x, i32 2
+ret i32 %mul.0
+}
+
+def depth(i32 %n) -> i32 {
+entry.0:    preds=() succs=(%if.then.0, %if.leave.0) doms=(%if.then.0, %if.leave.0)
+%gt.0 = gt i32 %n, i32 0
+condbr i32 %gt.0, %if.then.0, %if.leave.0
+
+if.then.0:    preds=(%entry.0) succs=() idom=%entry.0
+%sub.0 = sub i32 %n, i32 1
+%call.0 = call i32 @depth(i32 %sub.0)
+ret i32 0
+
+if.leave.0:    preds=(%entry.0) succs=() idom=%entry.0
+ret i32 0
+}
+
+def fib(i32 %t) -> i32 {
+entry.0:    preds=() succs=(%if.then.0, %if.leave.0) doms=(%if.then.0, %if.leave.0)
+%lt.0 = lt i32 %t, i32 2
+condbr i32 %lt.0, %if.then.0, %if.leave.0
+
+if.then.0:    preds=(%entry.0) succs=() idom=%entry.0
+ret i32 %t
+
+if.leave.0:    preds=(%entry.0) succs=() idom=%entry.0
+%sub.0 = sub i32 %t, i32 1
+%call.0 = call i32 @fib(i32 %sub.0)
+%sub.1 = sub i32 %t, i32 2
+%call.1 = call i32 @fib(i32 %sub.1)
+%add.0 = add i32 %call.0, i32 %call.1
+ret i32 %add.0
+}
+
+def main(i32 %n) -> i32 {
+entry.0:    preds=() succs=()
+%call.0 = call i32 @scale(i32 %n, i32 1)
+%call.1 = call i32 @scale(i32 4, i32 1)
+%add.0 = add i32 %call.0, i32 %call.1
+%call.2 = call i32 @depth(i32 %n)
+%add.1 = add i32 %add.0, i32 0
+%call.3 = call i32 @fib(i32 10)
+%add.2 = add i32 %add.1, i32 %call.3
+ret i32 %add.2
+}
+)");
+}
+
+TEST(Pass, Parallel) {
+    const char *Code = "int add(int a, int b) {"
+                       "  int c = a + b;"
+                       "  if (c > 10) {"
+                       "    c = c - 10;"
+                       "  }"
+                       "  return c;"
+                       "}"
+                       "int mul(int a, int b) {"
+                       "  int c = 0;"
+                       "  while (b > 0) {"
+                       "    c = c + a;"
+                       "    b = b - 1;"
+                       "  }"
+                       "  return c;"
+                       "}"
+                       "int main() {"
+                       "  int a = 1 + 2;"
+                       "  return add(a, mul(a, 4));"
+                       "}";
+    auto Seq = compileModule(Code);
+    auto Par = compileModule(Code);
+    auto AddPasses = [](PassManager &PM) {
+        PM.addPass(new Dominance);
+        PM.addPass(new SSAConstructor);
+        PM.addPass(new GVN);
+        PM.addPass(new Inliner); // barrier
+        PM.addPass(new DCE);
+    };
+    PassManager SeqPM, ParPM;
+    AddPasses(SeqPM);
+    AddPasses(ParPM);
+    ParPM.setThreads(4);
+    SeqPM.run(Seq.get());
+    ParPM.run(Par.get());
+    EXPECT_EQ(Seq->dumpToString(), Par->dumpToString());
+}
+
+TEST(Pass, AnalysisManager) {
+    auto Mod = compileModule("int mul(int a, int b) {"
+                             "  int c = 0;"
+                             "  while (b > 0) {"
+                             "    c = c + a;"
+                             "    b = b - 1;"
+                             "  }"
+                             "  return c;"
+                             "}");
+    auto &F = *Mod->begin();
+    PassManager PM;
+    PM.addPass(new SSAConstructor);
+    PM.addPass(new LoopAnalyse);
+    PM.addPass(new GVN);
+    PM.run(Mod.get());
+    auto &AM = PM.getAnalysisManager();
+    // computed on demand and preserved by GVN
+    auto *Dom = AM.getCachedResult<Dominance>(F);
+    ASSERT_NE(Dom, nullptr);
+    EXPECT_EQ(&AM.getResult<Dominance>(F), Dom);
+    EXPECT_NE(AM.getCachedResult<LoopAnalyse>(F), nullptr);
+    EXPECT_EQ(F.loops.size(), 1);
+
+    // recomputing the loops doesn't duplicate them
+    AM.invalidate(F);
+    EXPECT_EQ(AM.getCachedResult<Dominance>(F), nullptr);
+    AM.getResult<LoopAnalyse>(F);
+    EXPECT_EQ(F.loops.size(), 1);
+
+    // a pass that changes the cfg invalidates them
+    PassManager PM2;
+    PM2.addPass(new LoopAnalyse);
+    PM2.addPass(new BranchElim);
+    PM2.run(Mod.get());
+    EXPECT_EQ(PM2.getAnalysisManager().getCachedResult<LoopAnalyse>(F), nullptr);
+}
+
+TEST(Pass, Timer) {
+    auto Mod = compileModule("int add(int a, int b) {"
+                             "  int c = a + b;"
+                             "  if (c > 10) {"
+                             "    c = c - 10;"
+                             "  }"
+                             "  return c;"
+                             "}"
+                             "int main() {"
+                             "  return add(1, 2);"
+                             "}");
+    PassTimer Timer;
+    AllocStats::enabled = true;
+    PassManager PM;
+    PM.setTimer(&Timer);
+    PM.addPass(new SSAConstructor);
+    PM.addPass(new GVN);
+    PM.addPass(new Dominance);
+    PM.run(Mod.get());
+    AllocStats::enabled = false;
+
+    auto SSA = Timer.getTotal("SSAConstructor");
+    EXPECT_EQ(SSA.runs, 2);
+    EXPECT_GT(SSA.allocs, 0);
+    EXPECT_GT(SSA.bytes, 0);
+    EXPECT_EQ(Timer.getTotal("GVN").runs, 2);
+    // computed once per function and preserved by the transforms
+    EXPECT_EQ(Timer.getTotal("Dominance").runs, 2);
+
+    std::stringstream Trace;
+    Timer.writeTrace(Trace);
+    EXPECT_NE(Trace.str().find("\"traceEvents\""), std::string::npos);
+    EXPECT_NE(Trace.str().find("\"name\":\"GVN\""), std::string::npos);
+    EXPECT_NE(Trace.str().find("\"function\":\"add\""), std::string::npos);
+}
+
+TEST(Pass, SSALiveness) {
+    auto Mod = compileModule(R"(
+        int main(int n){
+            int a = 0;
+            int b = 1;
+            int i = 0;
+            while (i < n) {
+              int t = a + b;
+              a = b;
+              b = t;
+              if (t > 100) b = b - 100;
+              int j = 0;
+              while (j < i) j = j + a;
+              i = i + 1;
+            }
+            do {
+              a = a - 1;
+            } while (a > n);
+            if (a == n) a = 0; else n = 1;
+            return a + b + n;
+        }
+    )", true);
+    auto &F = *Mod->begin();
+    PassManager PM;
+    auto &Live = PM.getAnalysisManager().getResult<SSALiveness>(F);
+
+    // the reference sets walk back from every use to the def
+    std::map<BasicBlock *, std::set<Value *>> LiveIn, LiveOut;
+    std::vector<Value *> Values;
+    for (auto &Param: F.getParams()) {
+        Values.push_back(Param.get());
+    }
+    for (auto &BB: F) {
+        for (auto &I: BB) {
+            Values.push_back(&I);
+        }
+    }
+    for (auto *V: Values) {
+        auto *Def = Live.getDefBlock(V);
+        for (auto &Use: V->getUses()) {
+            std::vector<BasicBlock *> Worklist;
+            auto *UseBlock = SSALiveness::getUseBlock(Use);
+            if (SSALiveness::isPhiUse(Use)) {
+                LiveOut[UseBlock].insert(V);
+                if (UseBlock != Def) {
+                    Worklist.push_back(UseBlock);
+                }
+            } else if (UseBlock != Def) {
+                Worklist.push_back(UseBlock);
+            }
+            while (!Worklist.empty()) {
+                auto *BB = Worklist.back();
+                Worklist.pop_back();
+                if (!LiveIn[BB].insert(V).second) {
+                    continue;
+                }
+                for (auto *Pred: BB->preds()) {
+                    LiveOut[Pred].insert(V);
+                    if (Pred != Def) {
+                        Worklist.push_back(Pred);
+                    }
+                }
+            }
+        }
+    }
+    size_t LiveCount = 0;
+    for (auto *V: Values) {
+        for (auto &BB: F) {
+            EXPECT_EQ(Live.isLiveIn(V, &BB), LiveIn[&BB].count(V) != 0);
+            EXPECT_EQ(Live.isLiveOut(V, &BB), LiveOut[&BB].count(V) != 0);
+            LiveCount += Live.isLiveIn(V, &BB);
+        }
+    }
+    EXPECT_GT(LiveCount, 0);
+}
+
+TEST(Pass, CallGraph) {
+    const char *Code = "int sq(int x) { return x * x; }"
+                       "int odd(int n) { if (n == 0) return 0; return even(n - 1); }"
+                       "int even(int n) { if (n == 0) return 1; return odd(n - 1); }"
+                       "int fact(int n) { if (n < 2) return 1; return n * fact(n - 1); }"
+                       "int show(int x) { putint(x); return x; }"
+                       "int main() { return show(sq(even(4)) + fact(3)); }";
+    auto Mod = compileModule(Code, true);
+    CallGraph CG;
+    CG.run(Mod.get());
+    std::vector<std::vector<std::string>> Names;
+    for (auto &S: CG.getSCCs()) {
+        auto &Group = Names.emplace_back();
+        for (auto *F: S.functions) {
+            Group.push_back(F->getName());
+        }
+    }
+    // bottom-up, the callees come first
+    EXPECT_EQ(Names, (std::vector<std::vector<std::string>>{
+        {"sq"}, {"odd", "even"}, {"fact"}, {"show"}, {"main"}}));
+    EXPECT_TRUE(CG.getSCC(Mod->getFunction("even")).recursive);
+    EXPECT_TRUE(CG.getSCC(Mod->getFunction("fact")).recursive);
+    EXPECT_FALSE(CG.getSCC(Mod->getFunction("sq")).recursive);
+    EXPECT_EQ(CG.getSCC(Mod->getFunction("main")).height, 1);
+    EXPECT_EQ(CG.getSCC(Mod->getFunction("main")).callees.size(), 4);
+    EXPECT_EQ(CG.getHeights(), 2);
+    EXPECT_EQ(CG.getNode(Mod->getFunction("show"))->calls.size(), 1);
+
+    // the same attributes with the components of a height in parallel
+    for (unsigned Threads: {1, 4}) {
+        auto M = compileModule(Code, true);
+        PassManager PM;
+        PM.setThreads(Threads);
+        PM.addPass(new FunctionAttrs);
+        PM.run(M.get());
+        std::vector<std::string> Pure;
+        for (auto &F: *M) {
+            if (F.isPure()) {
+                Pure.push_back(F.getName());
+            }
+        }
+        EXPECT_EQ(Pure, (std::vector<std::string>{"sq", "odd", "even", "fact"}));
+    }
+}
+
+TEST(Pass, MemorySSA) {
+    auto Mod = compileModule(R"(
+        int f(int n) {
+            int a = 1;
+            int b = 2;
+            int s = 0;
+            while (n > 0) {
+                s = s + a;
+                n = n - 1;
+            }
+            b = 3;
+            return s + a + b;
+        }
+    )");
+    auto &F = *Mod->begin();
+    PassManager PM;
+    auto &MSSA = PM.getAnalysisManager().getResult<MemorySSA>(F);
+    std::vector<Value *> Allocas; // n, a, b, s
+    std::map<Value *, std::vector<Instruction *>> Loads, Stores;
+    for (auto &BB: F) {
+        for (auto &I: BB) {
+            if (I.getOpcode() == OpcodeAlloca) {
+                Allocas.push_back(&I);
+            } else if (auto *Load = I.as<LoadInst>()) {
+                Loads[Load->getPtr()].push_back(Load);
+            } else if (auto *Store = I.as<StoreInst>()) {
+                Stores[Store->getPtr()].push_back(Store);
+            }
+        }
+    }
+    ASSERT_EQ(Allocas.size(), 4);
+    auto *A = Allocas[1], *B = Allocas[2], *S = Allocas[3];
+    auto ClobberOf = [&](Value *load) {
+        return MSSA.getClobberingAccess(load->cast<Instruction>());
+    };
+    // the stores in the loop don't write a, so the loads of a reach the store before the loop
+    ASSERT_EQ(Loads[A].size(), 2);
+    EXPECT_TRUE(MSSA.getMemoryAccess(Loads[A][0])->getDefiningAccess()->isPhi());
+    for (auto *Load: Loads[A]) {
+        ASSERT_NE(ClobberOf(Load), nullptr);
+        EXPECT_EQ(ClobberOf(Load)->getInst(), Stores[A][0]);
+    }
+    EXPECT_EQ(ClobberOf(Loads[B][0])->getInst(), Stores[B][1]);
+    // s is written on both paths to the header
+    auto *Phi = ClobberOf(Loads[S].back());
+    ASSERT_TRUE(Phi->isPhi());
+    EXPECT_EQ(Phi, MSSA.getMemoryPhi(Loads[S].front()->getParent()->getDominator()));
+    EXPECT_EQ(Phi->getIncomings().size(), 2);
+    EXPECT_TRUE(MSSA.getClobberingAccess(Stores[A][0])->isLiveOnEntry());
+
+    // the elements of an array by their offsets
+    auto M = std::make_unique<Module>("test", Context);
+    auto *G = M->createFunction("g", Context.getFunctionTy(Context.getInt32Ty(), {Context.getInt32Ty()}));
+    auto *Index = G->addParam("i", Context.getInt32Ty());
+    BasicBlock::Create(G, "entry");
+    IRBuilder Builder(G);
+    auto *Arr = Builder.createAlloca(Context.getInt32Ty(), "arr");
+    auto *Float = Builder.createAlloca(Context.getFloatTy(), "float");
+    auto *E0 = createElement(Builder, Arr, Builder.getInt(0)), *E1 = createElement(Builder, Arr, Builder.getInt(1));
+    auto *Store0 = Builder.createStore(E0, Builder.getInt(10));
+    Builder.createStore(E1, Builder.getInt(20));
+    Builder.createStore(Float, Builder.getInt(30));
+    auto *Load0 = Builder.createLoad(E0);
+    auto *StoreI = Builder.createStore(createElement(Builder, Arr, Index), Builder.getInt(40));
+    auto *Load1 = Builder.createLoad(E1);
+    Builder.createRet(Builder.createAdd(Load0, Load1));
+    PassManager PM2;
+    auto &MSSA2 = PM2.getAnalysisManager().getResult<MemorySSA>(*G);
+    auto &AA = MSSA2.getAliasAnalysis();
+    EXPECT_EQ(AA.alias(E0, E1), AliasResult::NoAlias);
+    EXPECT_EQ(AA.alias(E0, createElement(Builder, Arr, Builder.getInt(0))), AliasResult::MustAlias);
+    EXPECT_EQ(AA.alias(E0, createElement(Builder, Arr, Index)), AliasResult::MayAlias);
+    EXPECT_EQ(AA.alias(E0, Float), AliasResult::NoAlias);
+    EXPECT_TRUE(AA.isLocal(Arr));
+    EXPECT_EQ(MSSA2.getClobberingAccess(Load0)->getInst(), Store0);
+    EXPECT_EQ(MSSA2.getClobberingAccess(Load1)->getInst(), StoreI);
+}
+
+TEST(Pass, PRE) {
+    const char *Code = R"(
+        int diamond(int a, int b, int c) {
+            int x = 0;
+            if (c > 0) {
+                x = a + b;
+            } else {
+                x = c;
+            }
+            int y = a + b;
+            return x + y;
+        }
+        int loop(int a, int b, int n) {
+            int s = 0;
+            while (n > a * b) {
+                s = s + n;
+                n = n - 1;
+            }
+            return s;
+        }
+    )";
+    auto Mod = compileWithPasses<PRE>(Code);
+    CHECK_OR_DUMP(Mod, R"(
+Module: Module
+def diamond(i32 %a, i32 %b, i32 %c) -> i32 {
+entry.0:    preds=() succs=(%if.cond.0) doms=(%if.cond.0)
+br %if.cond.0
+
+if.cond.0:    preds=(%entry.0) succs=(%if.body.0, %if.else.0) doms=(%if.body.0, %if.else.0, %if.leave.0) idom=%entry.0
+%gt.0 = gt i32 %c, i32 0
+condbr i32 %gt.0, %if.body.0, %if.else.0
+
+if.body.0:    preds=(%if.cond.0) succs=(%if.leave.0) df=(%if.leave.0) idom=%if.cond.0
+%add.0 = add i32 %a, i32 %b
+br %if.leave.0
+
+if.else.0:    preds=(%if.cond.0) succs=(%if.leave.0) df=(%if.leave.0) idom=%if.cond.0
+%pre.0 = add i32 %a, i32 %b
+br %if.leave.0
+
+if.leave.0:    preds=(%if.else.0, %if.body.0) succs=() idom=%if.cond.0
+%x.0 = phi [%if.body.0: i32 %add.0], [%if.else.0: i32 %c]
+%pre.1 = phi [%if.else.0: i32 %pre.0], [%if.body.0: i32 %add.0]
+%add.1 = add i32 %x.0, i32 %pre.1
+ret i32 %add.1
+}
+
+def loop(i32 %a, i32 %b, i32 %n) -> i32 {
+entry.0:    preds=() succs=(%while.header.0) doms=(%while.header.0)
+%pre.0 = mul i32 %a, i32 %b
+br %while.header.0
+
+while.header.0:    preds=(%while.body.0, %entry.0) succs=(%while.body.0, %while.leave.0) doms=(%while.body.0, %while.leave.0) df=(%while.header.0) idom=%entry.0
+%n.0 = phi [%entry.0: i32 %n], [%while.body.0: i32 %sub.0]
+%s.0 = phi [%entry.0: i32 0], [%while.body.0: i32 %add.0]
+%gt.0 = gt i32 %n.0, i32 %pre.0
+condbr i32 %gt.0, %while.body.0, %while.leave.0
+
+while.body.0:    preds=(%while.header.0) succs=(%while.header.0) df=(%while.header.0) idom=%while.header.0
+%add.0 = add i32 %s.0, i32 %n.0
+%sub.0 = sub i32 %n.0, i32 1
+br %while.header.0
+
+while.leave.0:    preds=(%while.header.0) succs=() idom=%while.header.0
+ret i32 %s.0
+}
+)");
+
+    // on the memory form the loads of the joins are merged from the stores and the loads before
+    auto Mem = compileModule(Code);
+    PassManager PM;
+    PM.addPass(new PRE);
+    PM.run(Mem.get());
+    size_t Muls = 0, JoinLoads = 0;
+    for (auto &F: *Mem) {
+        for (auto &BB: F) {
+            for (auto &I: BB) {
+                if (I.getOpcode() == OpcodeLoad) {
+                    EXPECT_NE(BB.getName(), "while.header");
+                    JoinLoads += BB.getName() == "if.leave";
+                }
+                if (auto *Bin = I.as<BinaryInst>(); Bin && Bin->getOp() == BinaryOp::Mul) {
+                    EXPECT_EQ(&BB, F.getEntryBlock());
+                    Muls++;
+                }
+            }
+        }
+    }
+    EXPECT_EQ(Muls, 1);
+    EXPECT_EQ(JoinLoads, 1); // y is stored in the join itself
+}
+
+TEST(Pass, LICM) {
+    const char *Code = R"(
+        int f(int a, int b, int n) {
+            int s = 0;
+            int i = 0;
+            while (i < n) {
+                int j = 0;
+                while (j < n) {
+                    s = s + a * b + i * a;
+                    if (s > 100) {
+                        s = s / b;
+                    }
+                    j = j + 1;
+                }
+                i = i + 1;
+            }
+            return s;
+        }
+    )";
+    // a * b leaves both loops, i * a only the inner one, the division may trap and stays
+    auto Mod = compileWithPasses<LICM>(Code);
+    std::map<std::string, std::string> Placed; // the muls and the div -> their block
+    for (auto &BB: *Mod->begin()) {
+        for (auto &I: BB) {
+            auto *Bin = I.as<BinaryInst>();
+            if (Bin && Bin->getOp() == BinaryOp::Mul) {
+                Placed[Bin->getRHS() == Bin->getParent()->getParent()->getParam(1) ? "a * b" : "i * a"] = BB.getName();
+            } else if (Bin && Bin->getOp() == BinaryOp::Div) {
+                Placed["s / b"] = BB.getName();
+            }
+        }
+    }
+    EXPECT_EQ(Placed, (std::map<std::string, std::string>{
+            {"a * b", "entry"}, {"i * a", "while.body"}, {"s / b", "if.then"}}));
+
+    // the loads of a and b are hoisted, s, i and j are stored in the loops
+    auto Mem = compileModule(Code);
+    PassManager PM;
+    PM.addPass(new LICM);
+    PM.run(Mem.get());
+    CHECK_OR_DUMP(Mem, R"(
+Module: Module
+def f(i32 %a, i32 %b, i32 %n) -> i32 {
+entry.0:    preds=() succs=(%while.header.0) doms=(%while.header.0)
+%a.0 = alloca i32
+store i32* %a.0, i32 %a
+%b.0 = alloca i32
+store i32* %b.0, i32 %b
+%n.0 = alloca i32
+store i32* %n.0, i32 %n
+%s.0 = alloca i32
+store i32* %s.0, i32 0
+%i.0 = alloca i32
+store i32* %i.0, i32 0
+%load.0 = load i32* %n.0
+%load.1 = load i32* %n.0
+%load.2 = load i32* %a.0
+%load.3 = load i32* %b.0
+%mul.0 = mul i32 %load.2, i32 %load.3
+%load.4 = load i32* %a.0
+%load.5 = load i32* %b.0
+br %while.header.0
+
+while.header.0:    preds=(%while.leave.1, %entry.0) succs=(%while.body.0, %while.leave.0) doms=(%while.body.0, %while.leave.0) df=(%while.header.0) idom=%entry.0
+%load.6 = load i32* %i.0
+%lt.0 = lt i32 %load.6, i32 %load.0
+condbr i32 %lt.0, %while.body.0, %while.leave.0
+
+while.body.0:    preds=(%while.header.0) succs=(%while.header.1) doms=(%while.header.1) df=(%while.header.0) idom=%while.header.0
+%j.0 = alloca i32
+store i32* %j.0, i32 0
+%load.7 = load i32* %i.0
+%mul.1 = mul i32 %load.7, i32 %load.4
+br %while.header.1
+
+while.leave.0:    preds=(%while.header.0) succs=() idom=%while.header.0
+%load.8 = load i32* %s.0
+ret i32 %load.8
+
+while.header.1:    preds=(%if.leave.0, %while.body.0) succs=(%while.body.1, %while.leave.1) doms=(%while.body.1, %while.leave.1) df=(%while.header.0, %while.header.1) idom=%while.body.0
+%load.9 = load i32* %j.0
+%lt.1 = lt i32 %load.9, i32 %load.1
+condbr i32 %lt.1, %while.body.1, %while.leave.1
+
+while.body.1:    preds=(%while.header.1) succs=(%if.then.0, %if.leave.0) doms=(%if.then.0, %if.leave.0) df=(%while.header.1) idom=%while.header.1
+%load.10 = load i32* %s.0
+%add.0 = add i32 %load.10, i32 %mul.0
+%add.1 = add i32 %add.0, i32 %mul.1
+store i32* %s.0, i32 %add.1
+%load.11 = load i32* %s.0
+%gt.0 = gt i32 %load.11, i32 100
+condbr i32 %gt.0, %if.then.0, %if.leave.0
+
+while.leave.1:    preds=(%while.header.1) succs=(%while.header.0) df=(%while.header.0) idom=%while.header.1
+%load.12 = load i32* %i.0
+%add.2 = add i32 %load.12, i32 1
+store i32* %i.0, i32 %add.2
+br %while.header.0
+
+if.then.0:    preds=(%while.body.1) succs=(%if.leave.0) df=(%if.leave.0) idom=%while.body.1
+%load.13 = load i32* %s.0
+%div.0 = div i32 %load.13, i32 %load.5
+store i32* %s.0, i32 %div.0
+br %if.leave.0
+
+if.leave.0:    preds=(%if.then.0, %while.body.1) succs=(%while.header.1) df=(%while.header.1) idom=%while.body.1
+%load.14 = load i32* %j.0
+%add.3 = add i32 %load.14, i32 1
+store i32* %j.0, i32 %add.3
+br %while.header.1
+}
+)");
+
+    // a loop entered from two blocks gets a preheader, the values entering the phi are merged there
+    auto *G = Mod->createFunction("g", Context.getFunctionTy(Context.getInt32Ty(), {Context.getInt32Ty()}));
+    auto *X = G->addParam("x", Context.getInt32Ty());
+    auto *Entry = BasicBlock::Create(G, "entry");
+    auto *Left = BasicBlock::Create(G, "left");
+    auto *Right = BasicBlock::Create(G, "right");
+    auto *Header = BasicBlock::Create(G, "loop");
+    auto *Exit = BasicBlock::Create(G, "exit");
+    IRBuilder Builder(Entry);
+    Builder.createCondBr(X, Left, Right);
+    Builder.setInsertPoint(Left);
+    Builder.createBr(Header);
+    Builder.setInsertPoint(Right);
+    Builder.createBr(Header);
+    Builder.setInsertPoint(Header);
+    auto *Phi = PhiInst::Create(Context.getInt32Ty(), Header, "v");
+    auto *Add = Builder.createAdd(Phi, Builder.createMul(X, X));
+    Builder.createCondBr(Builder.createLt(Add, X), Header, Exit);
+    std::vector<std::pair<BasicBlock *, Value *>> Incomings{
+        {Left, Builder.getInt(1)}, {Right, Builder.getInt(2)}, {Header, Add}};
+    Phi->fill(Incomings);
+    Builder.setInsertPoint(Exit);
+    Builder.createRet(Add);
+    PassManager PM2;
+    PM2.addPass(new LICM);
+    PM2.run(Mod.get());
+    CHECK_OR_DUMP(G, R"(
+def g(i32 %x) -> i32 {
+entry.0:    preds=() succs=(%left.0, %right.0) doms=(%left.0, %right.0, %loop.preheader.0)
+condbr i32 %x, %left.0, %right.0
+
+left.0:    preds=(%entry.0) succs=(%loop.preheader.0) df=(%loop.preheader.0) idom=%entry.0
+br %loop.preheader.0
+
+right.0:    preds=(%entry.0) succs=(%loop.preheader.0) df=(%loop.preheader.0) idom=%entry.0
+br %loop.preheader.0
+
+loop.preheader.0:    preds=(%left.0, %right.0) succs=(%loop.0) doms=(%loop.0) idom=%entry.0
+%v.0 = phi [%left.0: i32 1], [%right.0: i32 2]
+%mul.0 = mul i32 %x, i32 %x
+br %loop.0
+
+loop.0:    preds=(%loop.preheader.0, %loop.0) succs=(%loop.0, %exit.0) doms=(%exit.0) df=(%loop.0) idom=%loop.preheader.0
+%v.1 = phi [%loop.0: i32 %add.0], [%loop.preheader.0: i32 %v.0]
+%add.0 = add i32 %v.1, i32 %mul.0
+%lt.0 = lt i32 %add.0, i32 %x
+condbr i32 %lt.0, %loop.0, %exit.0
+
+exit.0:    preds=(%loop.0) succs=() idom=%loop.0
+ret i32 %add.0
+}
+)");
+}
+
+TEST(Pass, ScalarPromotion) {
+    const char *Code = R"(
+        int f(int n) {
+            int s = 0;
+            int i = 0;
+            while (i < n) {
+                int j = 0;
+                while (j < i) {
+                    s = s + j;
+                    j = j + 1;
+                }
+                if (s > 100) {
+                    s = s - 100;
+                }
+                i = i + 1;
+            }
+            return s;
+        }
+    )";
+    auto Mod = compileModule(Code);
+    PassManager PM;
+    PM.addPass(new ScalarPromotion);
+    PM.run(Mod.get());
+    // s and j are promoted in the inner loop, then s again and i in the outer one
+    CHECK_OR_DUMP(Mod, R"(
+Module: Module
+def f(i32 %n) -> i32 {
+entry.0:    preds=() succs=(%while.header.0) doms=(%while.header.0)
+%n.0 = alloca i32
+store i32* %n.0, i32 %n
+%s.0 = alloca i32
+store i32* %s.0, i32 0
+%i.0 = alloca i32
+store i32* %i.0, i32 0
+%promoted.0 = load i32* %i.0
+%promoted.1 = load i32* %s.0
+br %while.header.0
+
+while.header.0:    preds=(%if.leave.0, %entry.0) succs=(%while.body.0, %while.leave.0) doms=(%while.body.0, %while.leave.0) df=(%while.header.0) idom=%entry.0
+%promoted.2 = phi [%if.leave.0: i32 %add.0], [%entry.0: i32 %promoted.0]
+%promoted.3 = phi [%if.leave.0: i32 %promoted.4], [%entry.0: i32 %promoted.1]
+%load.0 = load i32* %n.0
+%lt.0 = lt i32 %promoted.2, i32 %load.0
+condbr i32 %lt.0, %while.body.0, %while.leave.0
+
+while.body.0:    preds=(%while.header.0) succs=(%while.header.1) doms=(%while.header.1) df=(%while.header.0) idom=%while.header.0
+%j.0 = alloca i32
+store i32* %j.0, i32 0
+%promoted.5 = load i32* %j.0
+br %while.header.1
+
+while.leave.0:    preds=(%while.header.0) succs=() idom=%while.header.0
+store i32* %s.0, i32 %promoted.3
+store i32* %i.0, i32 %promoted.2
+%load.1 = load i32* %s.0
+ret i32 %load.1
+
+while.header.1:    preds=(%while.body.1, %while.body.0) succs=(%while.body.1, %while.leave.1) doms=(%while.body.1, %while.leave.1) df=(%while.header.0, %while.header.1) idom=%while.body.0
+%promoted.6 = phi [%while.body.1: i32 %add.1], [%while.body.0: i32 %promoted.5]
+%promoted.7 = phi [%while.body.1: i32 %add.2], [%while.body.0: i32 %promoted.3]
+%lt.1 = lt i32 %promoted.6, i32 %promoted.2
+condbr i32 %lt.1, %while.body.1, %while.leave.1
+
+while.body.1:    preds=(%while.header.1) succs=(%while.header.1) df=(%while.header.1) idom=%while.header.1
+%add.2 = add i32 %promoted.7, i32 %promoted.6
+%add.1 = add i32 %promoted.6, i32 1
+br %while.header.1
+
+while.leave.1:    preds=(%while.header.1) succs=(%if.then.0, %if.leave.0) doms=(%if.then.0, %if.leave.0) df=(%while.header.0) idom=%while.header.1
+store i32* %j.0, i32 %promoted.6
+%gt.0 = gt i32 %promoted.7, i32 100
+condbr i32 %gt.0, %if.then.0, %if.leave.0
+
+if.then.0:    preds=(%while.leave.1) succs=(%if.leave.0) df=(%if.leave.0) idom=%while.leave.1
+%sub.0 = sub i32 %promoted.7, i32 100
+br %if.leave.0
+
+if.leave.0:    preds=(%if.then.0, %while.leave.1) succs=(%while.header.0) df=(%while.header.0) idom=%while.leave.1
+%promoted.4 = phi [%if.then.0: i32 %sub.0], [%while.leave.1: i32 %promoted.7]
+%add.0 = add i32 %promoted.2, i32 1
+br %while.header.0
+}
+)");
+
+    // an element at an invariant index, the store to another element may overwrite it
+    auto Element = [&](bool clobber) {
+        auto *G = Mod->createFunction(clobber ? "h" : "g",
+                                      Context.getFunctionTy(Context.getInt32Ty(), {Context.getInt32Ty()}));
+        auto *K = G->addParam("k", Context.getInt32Ty());
+        auto *Entry = BasicBlock::Create(G, "entry");
+        auto *Header = BasicBlock::Create(G, "loop");
+        auto *Exit = BasicBlock::Create(G, "exit");
+        IRBuilder Builder(Entry);
+        auto *Arr = Builder.createAlloca(Context.getInt32Ty(), "arr");
+        auto *P1 = createElement(Builder, Arr, K), *P2 = createElement(Builder, Arr, K);
+        Builder.createBr(Header);
+        Builder.setInsertPoint(Header);
+        auto *Add = Builder.createAdd(Builder.createLoad(P1), Builder.getInt(1));
+        Builder.createStore(P2, Add);
+        if (clobber) {
+            Builder.createStore(createElement(Builder, Arr, Builder.getInt(0)), Builder.getInt(0));
+        }
+        Builder.createCondBr(Builder.createLt(Add, K), Header, Exit);
+        Builder.setInsertPoint(Exit);
+        Builder.createRet(Builder.createLoad(P1));
+        PassManager PM2;
+        PM2.addPass(new ScalarPromotion);
+        PM2.run(Mod.get());
+        size_t Accesses = 0;
+        for (auto &I: *Header) {
+            Accesses += I.getOpcode() == OpcodeLoad || I.getOpcode() == OpcodeStore;
+        }
+        return Accesses;
+    };
+    EXPECT_EQ(Element(false), 0);
+    EXPECT_EQ(Element(true), 3);
+}
+
+TEST(Pass, LoopVectorize) {
+    auto M = std::make_unique<Module>("test", Context);
+    auto *Int = Context.getInt32Ty();
+    auto *IntPtr = Int->getPointerType();
+    // for (i = 0; i < n; i = i + 1) runs the body, the value it returns is summed up
+    createCountedLoop(M.get(), "dot", {{"a", IntPtr}, {"b", IntPtr}},
+                      [&](IRBuilder &B, std::vector<Value *> &A, Value *I) -> Value * {
+        auto *X = B.createLoad(createElement(B, A[0], I));
+        return B.createMul(X, B.createLoad(createElement(B, A[1], I)));
+    });
+    createCountedLoop(M.get(), "scale", {{"a", IntPtr}},
+                      [&](IRBuilder &B, std::vector<Value *> &A, Value *I) -> Value * {
+        auto *Ptr = createElement(B, A[0], I);
+        B.createStore(Ptr, B.createSub(B.getInt(2), B.createMul(B.createLoad(Ptr), A[1])));
+        return nullptr;
+    });
+    // the arrays of the params may overlap
+    createCountedLoop(M.get(), "copy", {{"a", IntPtr}, {"b", IntPtr}},
+                      [&](IRBuilder &B, std::vector<Value *> &A, Value *I) -> Value * {
+        B.createStore(createElement(B, A[0], I), B.createLoad(createElement(B, A[1], I)));
+        return nullptr;
+    });
+    createCountedLoop(M.get(), "local", {}, [&](IRBuilder &B, std::vector<Value *> &A, Value *I) -> Value * {
+        auto *X = new AllocaInst(Int, 100), *Y = new AllocaInst(Int, 100);
+        auto *Entry = M->getFunction("local")->getEntryBlock();
+        Entry->insertBefore(Entry->getTerminator(), X);
+        Entry->insertBefore(Entry->getTerminator(), Y);
+        X->setName("x");
+        Y->setName("y");
+        auto *Add = B.createAdd(B.createLoad(createElement(B, Y, I)), B.getInt(1));
+        B.createStore(createElement(B, X, I), Add);
+        return nullptr;
+    });
+    // x[i + 1] = x[i] carries the value to the next iteration
+    createCountedLoop(M.get(), "shift", {}, [&](IRBuilder &B, std::vector<Value *> &A, Value *I) -> Value * {
+        auto *X = new AllocaInst(Int, 100);
+        auto *Entry = M->getFunction("shift")->getEntryBlock();
+        Entry->insertBefore(Entry->getTerminator(), X);
+        X->setName("x");
+        auto *Next = new GetPtrInst(X, B.getInt(1));
+        Entry->insertBefore(Entry->getTerminator(), Next);
+        auto *Load = B.createLoad(createElement(B, X, I));
+        B.createStore(createElement(B, Next, I), Load);
+        return nullptr;
+    });
+    PassManager PM;
+    PM.addPass(new LoopVectorize);
+    PM.run(M.get());
+    // copy and shift keep their scalar loops
+    CHECK_OR_DUMP(M, R"(
+Module: test
+def dot(i32* %a, i32* %b, i32 %n) -> i32 {
+entry.0:    preds=() succs=(%loop.0) doms=(%loop.0)
+br %loop.0
+
+loop.0:    preds=(%body.0, %entry.0) succs=(%body.0, %exit.0) doms=(%body.0, %exit.0) df=(%loop.0) idom=%entry.0
+%i.0 = phi [%entry.0: i32 0], [%body.0: i32 %add.0]
+%s.0 = phi [%entry.0: i32 0], [%body.0: i32 %red.0]
+%lt.0 = lt i32 %i.0, i32 %n
+condbr i32 %lt.0, %body.0, %exit.0
+
+body.0:    preds=(%loop.0) succs=(%loop.0) df=(%loop.0) idom=%loop.0
+%avl.0 = sub i32 %n, i32 %i.0
+%vl.0 = vector.setvl i32 %avl.0
+%ptr.0 = getptr i32* %a, i32 %i.0
+%vec.0 = vector.load i32* %ptr.0, i32 %vl.0
+%ptr.1 = getptr i32* %b, i32 %i.0
+%vec.1 = vector.load i32* %ptr.1, i32 %vl.0
+%vec.2 = vector.mul i32 %vec.0, i32 %vec.1, i32 %vl.0
+%red.0 = vector.reduce.add i32 %vec.2, i32 %s.0, i32 %vl.0
+%add.0 = add i32 %i.0, i32 %vl.0
+br %loop.0
+
+exit.0:    preds=(%loop.0) succs=() idom=%loop.0
+ret i32 %s.0
+}
+
+
+def scale(i32* %a, i32 %n) -> i32 {
+entry.0:    preds=() succs=(%loop.0) doms=(%loop.0)
+br %loop.0
+
+loop.0:    preds=(%body.0, %entry.0) succs=(%body.0, %exit.0) doms=(%body.0, %exit.0) df=(%loop.0) idom=%entry.0
+%i.0 = phi [%entry.0: i32 0], [%body.0: i32 %add.0]
+%lt.0 = lt i32 %i.0, i32 %n
+condbr i32 %lt.0, %body.0, %exit.0
+
+body.0:    preds=(%loop.0) succs=(%loop.0) df=(%loop.0) idom=%loop.0
+%avl.0 = sub i32 %n, i32 %i.0
+%vl.0 = vector.setvl i32 %avl.0
+%splat.0 = vector.splat i32 2, i32 %vl.0
+%ptr.0 = getptr i32* %a, i32 %i.0
+%vec.0 = vector.load i32* %ptr.0, i32 %vl.0
+%vec.1 = vector.mul i32 %vec.0, i32 %n, i32 %vl.0
+%vec.2 = vector.sub i32 %splat.0, i32 %vec.1, i32 %vl.0
+vector.store i32* %ptr.0, i32 %vec.2, i32 %vl.0
+%add.0 = add i32 %i.0, i32 %vl.0
+br %loop.0
+
+exit.0:    preds=(%loop.0) succs=() idom=%loop.0
+ret i32 0
+}
+
+
+def copy(i32* %a, i32* %b, i32 %n) -> i32 {
+entry.0:    preds=() succs=(%loop.0) doms=(%loop.0)
+br %loop.0
+
+loop.0:    preds=(%body.0, %entry.0) succs=(%body.0, %exit.0) doms=(%body.0, %exit.0) df=(%loop.0) idom=%entry.0
+%i.0 = phi [%entry.0: i32 0], [%body.0: i32 %add.0]
+%lt.0 = lt i32 %i.0, i32 %n
+condbr i32 %lt.0, %body.0, %exit.0
+
+body.0:    preds=(%loop.0) succs=(%loop.0) df=(%loop.0) idom=%loop.0
+%ptr.0 = getptr i32* %b, i32 %i.0
+%load.0 = load i32* %ptr.0
+%ptr.1 = getptr i32* %a, i32 %i.0
+store i32* %ptr.1, i32 %load.0
+%add.0 = add i32 %i.0, i32 1
+br %loop.0
+
+exit.0:    preds=(%loop.0) succs=() idom=%loop.0
+ret i32 0
+}
+
+
+def local(i32 %n) -> i32 {
+entry.0:    preds=() succs=(%loop.0) doms=(%loop.0)
+%x.0 = alloca i32
+%y.0 = alloca i32
+br %loop.0
+
+loop.0:    preds=(%body.0, %entry.0) succs=(%body.0, %exit.0) doms=(%body.0, %exit.0) df=(%loop.0) idom=%entry.0
+%i.0 = phi [%entry.0: i32 0], [%body.0: i32 %add.0]
+%lt.0 = lt i32 %i.0, i32 %n
+condbr i32 %lt.0, %body.0, %exit.0
+
+body.0:    preds=(%loop.0) succs=(%loop.0) df=(%loop.0) idom=%loop.0
+%avl.0 = sub i32 %n, i32 %i.0
+%vl.0 = vector.setvl i32 %avl.0
+%ptr.0 = getptr i32* %y.0, i32 %i.0
+%vec.0 = vector.load i32* %ptr.0, i32 %vl.0
+%vec.1 = vector.add i32 %vec.0, i32 1, i32 %vl.0
+%ptr.1 = getptr i32* %x.0, i32 %i.0
+vector.store i32* %ptr.1, i32 %vec.1, i32 %vl.0
+%add.0 = add i32 %i.0, i32 %vl.0
+br %loop.0
+
+exit.0:    preds=(%loop.0) succs=() idom=%loop.0
+ret i32 0
+}
+
+
+def shift(i32 %n) -> i32 {
+entry.0:    preds=() succs=(%loop.0) doms=(%loop.0)
+%x.0 = alloca i32
+%0 = getptr i32* %x.0, i32 1
+br %loop.0
+
+loop.0:    preds=(%body.0, %entry.0) succs=(%body.0, %exit.0) doms=(%body.0, %exit.0) df=(%loop.0) idom=%entry.0
+%i.0 = phi [%entry.0: i32 0], [%body.0: i32 %add.0]
+%lt.0 = lt i32 %i.0, i32 %n
+condbr i32 %lt.0, %body.0, %exit.0
+
+body.0:    preds=(%loop.0) succs=(%loop.0) df=(%loop.0) idom=%loop.0
+%ptr.0 = getptr i32* %x.0, i32 %i.0
+%load.0 = load i32* %ptr.0
+%ptr.1 = getptr i32* %0, i32 %i.0
+store i32* %ptr.1, i32 %load.0
+%add.0 = add i32 %i.0, i32 1
+br %loop.0
+
+exit.0:    preds=(%loop.0) succs=() idom=%loop.0
+ret i32 0
+}
+)");
+}
+
+TEST(Pass, SLPVectorize) {
+    auto M = std::make_unique<Module>("test", Context);
+    auto *Int = Context.getInt32Ty();
+    auto *IntPtr = Int->getPointerType();
+    // a function of one block, the params are arrays and k, the allocas hold 4 elements
+    auto CreateBlock = [&](const char *name, Params params, unsigned allocas,
+                           const std::function<void(IRBuilder &, std::vector<Value *> &)> &body) {
+        std::vector<Value *> Arrays;
+        params.emplace_back("k", Int);
+        IRBuilder Builder(BasicBlock::Create(createFunction(M.get(), name, params, Arrays), "entry"));
+        const char *Names[] = {"x", "y", "z"};
+        for (unsigned I = 0; I < allocas; ++I) {
+            auto *Alloca = new AllocaInst(Int, 4);
+            Builder.getInsertBlock()->append(Alloca);
+            Alloca->setName(Names[I]);
+            Arrays.push_back(Alloca);
+        }
+        body(Builder, Arrays);
+        Builder.createRet(Builder.getInt(0));
+    };
+    // x[c] = y[c] + z[c]
+    CreateBlock("add", {}, 3, [&](IRBuilder &B, std::vector<Value *> &A) {
+        for (int C = 0; C < 4; ++C) {
+            auto *Y = B.createLoad(createElement(B, A[2], B.getInt(C)));
+            auto *Add = B.createAdd(Y, B.createLoad(createElement(B, A[3], B.getInt(C))));
+            B.createStore(createElement(B, A[1], B.getInt(C)), Add);
+        }
+    });
+    // a[k + c] = x[k + c] * 3 with the loads first
+    CreateBlock("scale", {{"a", IntPtr}}, 1, [&](IRBuilder &B, std::vector<Value *> &A) {
+        std::vector<Value *> Vals;
+        for (int C = 0; C < 4; ++C) {
+            auto *Index = B.createAdd(A[1], B.getInt(C));
+            Vals.push_back(B.createMul(B.createLoad(createElement(B, A[2], Index)), B.getInt(3)));
+        }
+        for (int C = 0; C < 4; ++C) {
+            B.createStore(createElement(B, A[0], B.createAdd(A[1], B.getInt(C))), Vals[C]);
+        }
+    });
+    // the store to a[0] may write b[1]
+    CreateBlock("copy", {{"a", IntPtr}, {"b", IntPtr}}, 0, [&](IRBuilder &B, std::vector<Value *> &A) {
+        for (int C = 0; C < 2; ++C) {
+            B.createStore(createElement(B, A[0], B.getInt(C)), B.createLoad(createElement(B, A[1], B.getInt(C))));
+        }
+    });
+    // the splat costs more than the second store
+    CreateBlock("fill", {}, 1, [&](IRBuilder &B, std::vector<Value *> &A) {
+        for (int C = 0; C < 2; ++C) {
+            B.createStore(createElement(B, A[1], B.getInt(C)), A[0]);
+        }
+    });
+    // a[c] = x[c] * x[c], both operands are the same loads
+    CreateBlock("square", {{"a", IntPtr}}, 1, [&](IRBuilder &B, std::vector<Value *> &A) {
+        for (int C = 0; C < 4; ++C) {
+            auto *X = B.createLoad(createElement(B, A[2], B.getInt(C)));
+            B.createStore(createElement(B, A[0], B.getInt(C)), B.createMul(X, X));
+        }
+    });
+    PassManager PM;
+    PM.addPass(new SLPVectorize);
+    PM.run(M.get());
+    // the dead indices are left to DCE
+    CHECK_OR_DUMP(M, R"(
+Module: test
+def add(i32 %k) -> i32 {
+entry.0:    preds=() succs=() 
+%x.0 = alloca i32
+%y.0 = alloca i32
+%z.0 = alloca i32
+%ptr.0 = getptr i32* %y.0, i32 0
+%ptr.1 = getptr i32* %z.0, i32 0
+%ptr.2 = getptr i32* %x.0, i32 0
+%slp.vl.0 = vector.setvl i32 4
+%slp.0 = vector.load i32* %ptr.0, i32 %slp.vl.0
+%slp.1 = vector.load i32* %ptr.1, i32 %slp.vl.0
+%slp.2 = vector.add i32 %slp.0, i32 %slp.1, i32 %slp.vl.0
+vector.store i32* %ptr.2, i32 %slp.2, i32 %slp.vl.0
+ret i32 0
+}
+
+
+def scale(i32* %a, i32 %k) -> i32 {
+entry.0:    preds=() succs=() 
+%x.0 = alloca i32
+%add.0 = add i32 %k, i32 0
+%ptr.0 = getptr i32* %x.0, i32 %add.0
+%add.1 = add i32 %k, i32 1
+%add.2 = add i32 %k, i32 2
+%add.3 = add i32 %k, i32 3
+%add.4 = add i32 %k, i32 0
+%ptr.1 = getptr i32* %a, i32 %add.4
+%add.5 = add i32 %k, i32 1
+%add.6 = add i32 %k, i32 2
+%add.7 = add i32 %k, i32 3
+%slp.vl.0 = vector.setvl i32 4
+%slp.0 = vector.load i32* %ptr.0, i32 %slp.vl.0
+%slp.1 = vector.mul i32 %slp.0, i32 3, i32 %slp.vl.0
+vector.store i32* %ptr.1, i32 %slp.1, i32 %slp.vl.0
+ret i32 0
+}
+
+
+def copy(i32* %a, i32* %b, i32 %k) -> i32 {
+entry.0:    preds=() succs=() 
+%ptr.0 = getptr i32* %b, i32 0
+%load.0 = load i32* %ptr.0
+%ptr.1 = getptr i32* %a, i32 0
+store i32* %ptr.1, i32 %load.0
+%ptr.2 = getptr i32* %b, i32 1
+%load.1 = load i32* %ptr.2
+%ptr.3 = getptr i32* %a, i32 1
+store i32* %ptr.3, i32 %load.1
+ret i32 0
+}
+
+
+def fill(i32 %k) -> i32 {
+entry.0:    preds=() succs=() 
+%x.0 = alloca i32
+%ptr.0 = getptr i32* %x.0, i32 0
+store i32* %ptr.0, i32 %k
+%ptr.1 = getptr i32* %x.0, i32 1
+store i32* %ptr.1, i32 %k
+ret i32 0
+}
+
+
+def square(i32* %a, i32 %k) -> i32 {
+entry.0:    preds=() succs=() 
+%x.0 = alloca i32
+%ptr.0 = getptr i32* %x.0, i32 0
+%ptr.1 = getptr i32* %a, i32 0
+%slp.vl.0 = vector.setvl i32 4
+%slp.0 = vector.load i32* %ptr.0, i32 %slp.vl.0
+%slp.1 = vector.mul i32 %slp.0, i32 %slp.0, i32 %slp.vl.0
+vector.store i32* %ptr.1, i32 %slp.1, i32 %slp.vl.0
+ret i32 0
+}
+
+)");
+}
+
+TEST(Pass, OSR) {
+    auto M = std::make_unique<Module>("test", Context);
+    auto *Int = Context.getInt32Ty();
+    auto *IntPtr = Int->getPointerType();
+    std::vector<Type *> Types{Int, IntPtr, Int};
+    std::vector<std::pair<BasicBlock *, Value *>> Incomings;
+    // for (i = 0; i < n; i = i + 1) for (j = 0; j < n; j = j + 1) s = s + a[i * n + j]
+    {
+        auto *F = M->createFunction("matrix", Context.getFunctionTy(Types));
+        auto *A = F->addParam("a", IntPtr);
+        auto *N = F->addParam("n", Int);
+        auto *Entry = BasicBlock::Create(F, "entry");
+        auto *Outer = BasicBlock::Create(F, "outer");
+        auto *Inner = BasicBlock::Create(F, "inner");
+        auto *Body = BasicBlock::Create(F, "body");
+        auto *Latch = BasicBlock::Create(F, "latch");
+        auto *Exit = BasicBlock::Create(F, "exit");
+        IRBuilder Builder(Entry);
+        Builder.createBr(Outer);
+        auto *I = PhiInst::Create(Int, Outer, "i");
+        auto *S = PhiInst::Create(Int, Outer, "s");
+        Builder.setInsertPoint(Outer);
+        Builder.createCondBr(Builder.createLt(I, N), Inner, Exit);
+        auto *J = PhiInst::Create(Int, Inner, "j");
+        auto *T = PhiInst::Create(Int, Inner, "t");
+        Builder.setInsertPoint(Inner);
+        Builder.createCondBr(Builder.createLt(J, N), Body, Latch);
+        Builder.setInsertPoint(Body);
+        auto *Index = Builder.createAdd(Builder.createMul(I, N), J);
+        auto *Ptr = createElement(Builder, A, Index);
+        auto *Sum = Builder.createAdd(T, Builder.createLoad(Ptr));
+        Incomings = {{Outer, Builder.getInt(0)}, {Body, Builder.createAdd(J, Builder.getInt(1))}};
+        J->fill(Incomings);
+        Incomings = {{Outer, S}, {Body, Sum}};
+        T->fill(Incomings);
+        Builder.createBr(Inner);
+        Builder.setInsertPoint(Latch);
+        Incomings = {{Entry, Builder.getInt(0)}, {Latch, Builder.createAdd(I, Builder.getInt(1))}};
+        I->fill(Incomings);
+        Incomings = {{Entry, Builder.getInt(0)}, {Latch, T}};
+        S->fill(Incomings);
+        Builder.createBr(Outer);
+        Builder.setInsertPoint(Exit);
+        Builder.createRet(S);
+    }
+    // for (i = 0; i < bound; i = i + 1) s = s + a[i * 4 + 1]
+    auto CreateStride = [&](const char *name, int64_t bound) {
+        auto *F = M->createFunction(name, Context.getFunctionTy(Types));
+        auto *A = F->addParam("a", IntPtr);
+        F->addParam("n", Int);
+        auto *Entry = BasicBlock::Create(F, "entry");
+        auto *Loop = BasicBlock::Create(F, "loop");
+        auto *Body = BasicBlock::Create(F, "body");
+        auto *Exit = BasicBlock::Create(F, "exit");
+        IRBuilder Builder(Entry);
+        Builder.createBr(Loop);
+        auto *I = PhiInst::Create(Int, Loop, "i");
+        auto *S = PhiInst::Create(Int, Loop, "s");
+        Builder.setInsertPoint(Loop);
+        Builder.createCondBr(Builder.createLt(I, Builder.getInt(bound)), Body, Exit);
+        Builder.setInsertPoint(Body);
+        auto *Index = Builder.createAdd(Builder.createMul(I, Builder.getInt(4)), Builder.getInt(1));
+        auto *Ptr = createElement(Builder, A, Index);
+        Incomings = {{Entry, Builder.getInt(0)}, {Body, Builder.createAdd(S, Builder.createLoad(Ptr))}};
+        S->fill(Incomings);
+        Incomings = {{Entry, Builder.getInt(0)}, {Body, Builder.createAdd(I, Builder.getInt(1))}};
+        I->fill(Incomings);
+        Builder.createBr(Loop);
+        Builder.setInsertPoint(Exit);
+        Builder.createRet(S);
+    };
+    CreateStride("stride", 100);
+    // 600000000 * 4 wraps around i32
+    CreateStride("wrap", 600000000);
+    PassManager PM;
+    PM.addPass(new OSR);
+    PM.run(M.get());
+    // i * n and j are reduced to adds, the tests stay for the bound n * n may wrap around. In stride i is replaced
+    // by i * 4 + 1 and is gone, in wrap the bound 600000000 * 4 + 1 would wrap around and the test stays.
+    CHECK_OR_DUMP(M, R"(
+Module: test
+def matrix(i32* %a, i32 %n) -> i32 {
+entry.0:    preds=() succs=(%outer.0) doms=(%outer.0)
+br %outer.0
+outer.0:    preds=(%latch.0, %entry.0) succs=(%inner.0, %exit.0) doms=(%inner.0, %exit.0) df=(%outer.0) idom=%entry.0
+%i.0 = phi [%entry.0: i32 0], [%latch.0: i32 %add.0]
+%s.0 = phi [%entry.0: i32 0], [%latch.0: i32 %t.0]
+%osr.0 = phi [%entry.0: i32 0], [%latch.0: i32 %osr.1]
+%lt.0 = lt i32 %i.0, i32 %n
+condbr i32 %lt.0, %inner.0, %exit.0
+inner.0:    preds=(%body.0, %outer.0) succs=(%body.0, %latch.0) doms=(%body.0, %latch.0) df=(%outer.0, %inner.0) idom=%outer.0
+%j.0 = phi [%outer.0: i32 0], [%body.0: i32 %add.1]
+%t.0 = phi [%outer.0: i32 %s.0], [%body.0: i32 %add.2]
+%osr.2 = phi [%outer.0: i32 %osr.0], [%body.0: i32 %osr.3]
+%lt.1 = lt i32 %j.0, i32 %n
+condbr i32 %lt.1, %body.0, %latch.0
+body.0:    preds=(%inner.0) succs=(%inner.0) df=(%inner.0) idom=%inner.0
+%ptr.0 = getptr i32* %a, i32 %osr.2
+%load.0 = load i32* %ptr.0
+%add.2 = add i32 %t.0, i32 %load.0
+%add.1 = add i32 %j.0, i32 1
+%osr.3 = add i32 %osr.2, i32 1
+br %inner.0
+latch.0:    preds=(%inner.0) succs=(%outer.0) df=(%outer.0) idom=%inner.0
+%add.0 = add i32 %i.0, i32 1
+%osr.1 = add i32 %osr.0, i32 %n
+br %outer.0
+exit.0:    preds=(%outer.0) succs=() idom=%outer.0
+ret i32 %s.0
+}
+
+
+def stride(i32* %a, i32 %n) -> i32 {
+entry.0:    preds=() succs=(%loop.0) doms=(%loop.0)
+br %loop.0
+loop.0:    preds=(%body.0, %entry.0) succs=(%body.0, %exit.0) doms=(%body.0, %exit.0) df=(%loop.0) idom=%entry.0
+%s.0 = phi [%entry.0: i32 0], [%body.0: i32 %add.0]
+%osr.0 = phi [%entry.0: i32 1], [%body.0: i32 %osr.1]
+%lt.0 = lt i32 %osr.0, i32 401
+condbr i32 %lt.0, %body.0, %exit.0
+body.0:    preds=(%loop.0) succs=(%loop.0) df=(%loop.0) idom=%loop.0
+%ptr.0 = getptr i32* %a, i32 %osr.0
+%load.0 = load i32* %ptr.0
+%add.0 = add i32 %s.0, i32 %load.0
+%osr.1 = add i32 %osr.0, i32 4
+br %loop.0
+exit.0:    preds=(%loop.0) succs=() idom=%loop.0
+ret i32 %s.0
+}
+
+
+def wrap(i32* %a, i32 %n) -> i32 {
+entry.0:    preds=() succs=(%loop.0) doms=(%loop.0)
+br %loop.0
+loop.0:    preds=(%body.0, %entry.0) succs=(%body.0, %exit.0) doms=(%body.0, %exit.0) df=(%loop.0) idom=%entry.0
+%i.0 = phi [%entry.0: i32 0], [%body.0: i32 %add.0]
+%s.0 = phi [%entry.0: i32 0], [%body.0: i32 %add.1]
+%osr.0 = phi [%entry.0: i32 1], [%body.0: i32 %osr.1]
+%lt.0 = lt i32 %i.0, i32 600000000
+condbr i32 %lt.0, %body.0, %exit.0
+body.0:    preds=(%loop.0) succs=(%loop.0) df=(%loop.0) idom=%loop.0
+%ptr.0 = getptr i32* %a, i32 %osr.0
+%load.0 = load i32* %ptr.0
+%add.1 = add i32 %s.0, i32 %load.0
+%add.0 = add i32 %i.0, i32 1
+%osr.1 = add i32 %osr.0, i32 4
+br %loop.0
+exit.0:    preds=(%loop.0) succs=() idom=%loop.0
+ret i32 %s.0
+}
+
+)");
+    // the guard i < 10 is tested while i goes on to the bound, i * 4 of 600000000 iterations wraps around
+    // and only the guard in the loop of 100 iterations is replaced
+    auto Guard = compileWithPasses<OSR>(R"(
+        int f() {
+            int s = 0;
+            int i = 0;
+            while (i < 600000000) {
+                if (i < 10) {
+                    s = s + i * 4 + 1;
+                }
+                i = i + 1;
+            }
+            return s;
+        }
+        int g() {
+            int s = 0;
+            int i = 0;
+            while (i < 100) {
+                if (i < 10) {
+                    s = s + i * 4 + 1;
+                }
+                i = i + 1;
+            }
+            return s;
+        }
+    )");
+    CHECK_OR_DUMP(Guard, R"(
+Module: Module
+def f() -> i32 {
+entry.0:    preds=() succs=(%while.header.0) doms=(%while.header.0)
+br %while.header.0
+while.header.0:    preds=(%if.leave.0, %entry.0) succs=(%while.body.0, %while.leave.0) doms=(%while.body.0, %while.leave.0) df=(%while.header.0) idom=%entry.0
+%s.0 = phi [%entry.0: i32 0], [%if.leave.0: i32 %s.1]
+%i.0 = phi [%entry.0: i32 0], [%if.leave.0: i32 %add.0]
+%osr.0 = phi [%entry.0: i32 0], [%if.leave.0: i32 %osr.1]
+%lt.0 = lt i32 %i.0, i32 600000000
+condbr i32 %lt.0, %while.body.0, %while.leave.0
+while.body.0:    preds=(%while.header.0) succs=(%if.then.0, %if.leave.0) doms=(%if.then.0, %if.leave.0) df=(%while.header.0) idom=%while.header.0
+%lt.1 = lt i32 %i.0, i32 10
+condbr i32 %lt.1, %if.then.0, %if.leave.0
+while.leave.0:    preds=(%while.header.0) succs=() idom=%while.header.0
+ret i32 %s.0
+if.then.0:    preds=(%while.body.0) succs=(%if.leave.0) df=(%if.leave.0) idom=%while.body.0
+%add.1 = add i32 %s.0, i32 %osr.0
+%add.2 = add i32 %add.1, i32 1
+br %if.leave.0
+if.leave.0:    preds=(%if.then.0, %while.body.0) succs=(%while.header.0) df=(%while.header.0) idom=%while.body.0
+%s.1 = phi [%while.body.0: i32 %s.0], [%if.then.0: i32 %add.2]
+%add.0 = add i32 %i.0, i32 1
+%osr.1 = add i32 %osr.0, i32 4
+br %while.header.0
+}
+
+
+def g() -> i32 {
+entry.0:    preds=() succs=(%while.header.0) doms=(%while.header.0)
+br %while.header.0
+while.header.0:    preds=(%if.leave.0, %entry.0) succs=(%while.body.0, %while.leave.0) doms=(%while.body.0, %while.leave.0) df=(%while.header.0) idom=%entry.0
+%s.0 = phi [%entry.0: i32 0], [%if.leave.0: i32 %s.1]
+%osr.0 = phi [%entry.0: i32 0], [%if.leave.0: i32 %osr.1]
+%lt.0 = lt i32 %osr.0, i32 400
+condbr i32 %lt.0, %while.body.0, %while.leave.0
+while.body.0:    preds=(%while.header.0) succs=(%if.then.0, %if.leave.0) doms=(%if.then.0, %if.leave.0) df=(%while.header.0) idom=%while.header.0
+%lt.1 = lt i32 %osr.0, i32 40
+condbr i32 %lt.1, %if.then.0, %if.leave.0
+while.leave.0:    preds=(%while.header.0) succs=() idom=%while.header.0
+ret i32 %s.0
+if.then.0:    preds=(%while.body.0) succs=(%if.leave.0) df=(%if.leave.0) idom=%while.body.0
+%add.0 = add i32 %s.0, i32 %osr.0
+%add.1 = add i32 %add.0, i32 1
+br %if.leave.0
+if.leave.0:    preds=(%if.then.0, %while.body.0) succs=(%while.header.0) df=(%while.header.0) idom=%while.body.0
+%s.1 = phi [%while.body.0: i32 %s.0], [%if.then.0: i32 %add.1]
+%osr.1 = add i32 %osr.0, i32 4
+br %while.header.0
+}
+
+)");
+}
+
+TEST(Pass, ScalarEvolution) {
+    auto Mod = compileWithPasses<DCE>(R"(
+        int f(int n, int m) {
+            int s = 0;
+            int i = 0;
+            while (i < 10) {
+                int u = i * 3 + 1;
+                s = s + u;
+                i = i + 2;
+            }
+            int j = n;
+            while (j > m) {
+                j = j - 1;
+            }
+            int k = 0;
+            while (k != m) {
+                k = k + 1;
+            }
+            int x = 1;
+            while (x < n) {
+                x = x * 2;
+            }
+            return s + j + k + x;
+        }
+        int g(int n) {
+            int t = 0;
+            int i = 0;
+            while (i < n) {
+                int j = i;
+                while (j < n) {
+                    t = t + j;
+                    j = j + 1;
+                }
+                i = i + 1;
+            }
+            return t;
+        }
+    )");
+    PassManager PM;
+    // the phi of the variable -> its expression and the trip count of its loop
+    auto Evolve = [&](Function &F) {
+        auto &SE = PM.getAnalysisManager().getResult<ScalarEvolution>(F);
+        auto &LA = PM.getAnalysisManager().getResult<LoopAnalyse>(F);
+        std::map<std::string, std::string> Result;
+        for (auto &BB: F) {
+            for (auto &I: BB) {
+                auto *Phi = I.as<PhiInst>();
+                auto *Loop = LA.getLoopFor(&BB);
+                if (!Phi || Phi->getName() == "s" || Phi->getName() == "t") {
+                    continue;
+                }
+                auto *Count = SE.getTripCount(Loop);
+                Result[Phi->getName()] = SE.getSCEV(Phi)->dumpToString() + " " +
+                                         (Count ? Count->dumpToString() : "unknown");
+            }
+        }
+        return Result;
+    };
+    auto &F = *Mod->begin();
+    std::map<std::string, std::string> Expected{
+            {"i", "{0,+,2}<%while.header.0> 5"},
+            {"j", "{i32 %n,+,-1}<%while.header.1> smax((i32 %n + (-1 * i32 %m)), 0)"},
+            {"k", "{0,+,1}<%while.header.2> i32 %m"},
+            {"x", "i32 %x.0 unknown"}};
+    EXPECT_EQ(Evolve(F), Expected);
+    // the inner loop starts from the outer induction variable
+    EXPECT_EQ(Evolve(*++Mod->begin()), (std::map<std::string, std::string>{
+            {"i", "{0,+,1}<%while.header.0> smax(i32 %n, 0)"},
+            {"j", "{{0,+,1}<%while.header.0>,+,1}<%while.header.1> smax({i32 %n,+,-1}<%while.header.0>, 0)"}}));
+
+    // i * 3 + 1 and the value i leaves the loop with
+    auto &SE = PM.getAnalysisManager().getResult<ScalarEvolution>(F);
+    for (auto &BB: F) {
+        for (auto &I: BB) {
+            auto *Bin = I.as<BinaryInst>();
+            if (Bin && Bin->getOp() == BinaryOp::Mul && Bin->getRHS() == Context.getInt(3)) {
+                auto *Add = Bin->getUses().begin()->getUser();
+                EXPECT_EQ(SE.getSCEV(Add)->dumpToString(), "{1,+,6}<%while.header.0>");
+            }
+            auto *Phi = I.as<PhiInst>();
+            if (Phi && Phi->getName() == "i") {
+                auto *Loop = PM.getAnalysisManager().getResult<LoopAnalyse>(F).getLoopFor(&BB);
+                EXPECT_EQ(SE.evaluateAtIteration(SE.getSCEV(Phi), SE.getTripCount(Loop))->dumpToString(), "10");
+            }
+        }
+    }
+}